@@ -13,25 +13,76 @@
 #include "buffer/buffer_pool_manager.h"
 
 #include <list>
+#include <new>
 #include <unordered_map>
+#include <utility>
 
 namespace bustub {
 
-BufferPoolManager::BufferPoolManager(size_t pool_size, DiskManager *disk_manager, LogManager *log_manager)
-    : pool_size_(pool_size), disk_manager_(disk_manager), log_manager_(log_manager) {
-  // We allocate a consecutive memory space for the buffer pool.
-  pages_ = new Page[pool_size_];
-  replacer_ = new LRUReplacer(pool_size);
+BufferPoolManager::BufferPoolManager(size_t pool_size, DiskManager *disk_manager, LogManager *log_manager,
+                                     ReplacerType replacer_type)
+    : BufferPoolManager(std::array<size_t, NUM_PAGE_SIZE_CLASSES>{pool_size}, disk_manager, log_manager,
+                        replacer_type) {}
 
-  // Initially, every page is in the free list.
-  for (size_t i = 0; i < pool_size_; ++i) {
-    free_list_.emplace_back(static_cast<int>(i));
+BufferPoolManager::BufferPoolManager(const std::array<size_t, NUM_PAGE_SIZE_CLASSES> &pool_sizes,
+                                     DiskManager *disk_manager, LogManager *log_manager, ReplacerType replacer_type)
+    : disk_manager_(disk_manager), log_manager_(log_manager) {
+  for (size_t i = 0; i < NUM_PAGE_SIZE_CLASSES; ++i) {
+    FramePool &pool = frame_pools_[i];
+    pool.pool_size_ = pool_sizes[i];
+    // We allocate a consecutive memory space for the frames of each size class.
+    pool.pages_ = static_cast<Page *>(::operator new(sizeof(Page) * pool.pool_size_));
+    for (size_t j = 0; j < pool.pool_size_; ++j) {
+      new (pool.pages_ + j) Page(PageSizeOf(static_cast<PageSizeClass>(i)));
+    }
+    if (replacer_type == ReplacerType::CLOCK) {
+      pool.replacer_ = new ClockReplacer(pool.pool_size_);
+    } else {
+      pool.replacer_ = new LRUReplacer(pool.pool_size_);
+    }
+
+    // Initially, every page is in the free list.
+    for (size_t j = 0; j < pool.pool_size_; ++j) {
+      pool.free_list_.emplace_back(static_cast<int>(j));
+    }
   }
 }
 
 BufferPoolManager::~BufferPoolManager() {
-  delete[] pages_;
-  delete replacer_;
+  for (auto &pool : frame_pools_) {
+    for (size_t j = 0; j < pool.pool_size_; ++j) {
+      pool.pages_[j].~Page();
+    }
+    ::operator delete(pool.pages_);
+    delete pool.replacer_;
+  }
+}
+
+void BufferPoolManager::WritePageToDisk(Page *page) {
+  // Write-ahead logging: the log records describing the page must reach the disk before the page does.
+  if (enable_logging && log_manager_ != nullptr && page->GetLSN() > log_manager_->GetPersistentLSN()) {
+    log_manager_->Flush(page->GetLSN());
+  }
+  // Changes logged from now on dirty the page again.
+  page->rec_lsn_ = INVALID_LSN;
+  disk_manager_->WritePage(page->GetPageId(), page->GetData());
+}
+
+bool BufferPoolManager::FindFrame(FramePool *pool, frame_id_t *frame_id) {
+  if (!pool->free_list_.empty()) {
+    *frame_id = pool->free_list_.front();
+    pool->free_list_.pop_front();
+    return true;
+  }
+  if (!pool->replacer_->Victim(frame_id)) {
+    return false;
+  }
+  Page *victim = pool->pages_ + *frame_id;
+  if (victim->IsDirty()) {
+    WritePageToDisk(victim);
+  }
+  page_table_.erase(victim->GetPageId());
+  return true;
 }
 
 Page *BufferPoolManager::FetchPageImpl(page_id_t page_id) {
@@ -42,110 +93,106 @@ Page *BufferPoolManager::FetchPageImpl(page_id_t page_id) {
   // 2.     If R is dirty, write it back to the disk.
   // 3.     Delete R from the page table and insert P.
   // 4.     Update P's metadata, read in the page content from disk, and then return a pointer to P.
-  // 1.
-  // 1.1 
-  std::lock_guard latch(latch_);
-  if(page_table_.find(page_id) != page_table_.end()) {
-      atuo entry = page_table_[page_id];
-      replacer_->Pin(entry->second);
-      Page* page = GetPages() + entry->second;
-      ++page->pin_count_;
-      return page;
-  }
-  // 1.2
-  frame_id_t frame_id = -1;
-  if(free_list_.size() <= 0) {
-      replacer_->Victim(&frame_id)
-  } else {
-      frame_id = free_list_.front();
-      free_list_.pop_front(); 
-  }
-  if(frame_id <= -1) {
-      return nullptr;
-  }
-  Page* page = GetPages() + frame_id;
-  //2.
-  if(page->IsDirty()) {
-      disk_manager_->WritePage(page->GetPageId(), page->GetData());
-  }
-  //3.
-  page_table_.erase(page->GetPageId());
-  page_table[page_id] = page;
-  //4.
-  disk_manager_.ReadPage(page_id, page->GetData());
-  page->ResetMemory();
+  std::unique_lock<std::mutex> lock(latch_);
+  FramePool &pool = GetFramePool(page_id);
+  auto entry = page_table_.find(page_id);
+  if (entry != page_table_.end()) {
+    Page *page = pool.pages_ + entry->second;
+    ++page->pin_count_;
+    pool.replacer_->Pin(entry->second);
+    return page;
+  }
+
+  frame_id_t frame_id;
+  if (!FindFrame(&pool, &frame_id)) {
+    return nullptr;
+  }
+  Page *page = pool.pages_ + frame_id;
+  page_table_[page_id] = frame_id;
   page->page_id_ = page_id;
   page->pin_count_ = 1;
   page->is_dirty_ = false;
+  page->rec_lsn_ = INVALID_LSN;
+  disk_manager_->ReadPage(page_id, page->GetData());
+  pool.replacer_->Pin(frame_id);
+  if (!page_recovery_handler_) {
+    return page;
+  }
+
+  // Nobody else holds a pin on the page yet, so nobody else can have it latched. Threads that fetch the page from now
+  // on wait on the latch until it is up to date.
+  auto handler = page_recovery_handler_;
+  page->WLatch();
+  lock.unlock();
+  if (handler(page)) {
+    lock.lock();
+    page->is_dirty_ = true;
+    lock.unlock();
+  }
+  page->WUnlatch();
   return page;
 }
 
+void BufferPoolManager::SetPageRecoveryHandler(std::function<bool(Page *)> handler) {
+  std::lock_guard<std::mutex> guard(latch_);
+  page_recovery_handler_ = std::move(handler);
+}
+
 bool BufferPoolManager::UnpinPageImpl(page_id_t page_id, bool is_dirty) {
-    std::lock_guard mutex(latch_);
-    auto ite = page_table_.find(page_id);
-    if(ite == page_table.end()) {
-        return false;
-    }
-    frame_id_t frame_id = ite->second;
-    Page* page = GetPages() + frame_id;
-    --page->pin_count_;
-    if(page->pin_count_ <= 0) {
-        replacer_->UnPin(frame_id);
-    }
-    page->is_dirty_ |= is_dirty;
-    return true;
+  std::lock_guard<std::mutex> guard(latch_);
+  auto entry = page_table_.find(page_id);
+  if (entry == page_table_.end()) {
+    return false;
+  }
+  FramePool &pool = GetFramePool(page_id);
+  Page *page = pool.pages_ + entry->second;
+  if (page->pin_count_ <= 0) {
+    return false;
+  }
+  page->is_dirty_ |= is_dirty;
+  if (--page->pin_count_ == 0) {
+    pool.replacer_->Unpin(entry->second);
+  }
+  return true;
 }
 
 bool BufferPoolManager::FlushPageImpl(page_id_t page_id) {
   // Make sure you call DiskManager::WritePage!
   if (page_id == INVALID_PAGE_ID) {
-      return false;
+    return false;
   }
-  std::locl_guard mutex(latch_);
+  std::lock_guard<std::mutex> guard(latch_);
   auto entry = page_table_.find(page_id);
-  if(entry == page_table_.end()) {
-      return false;
+  if (entry == page_table_.end()) {
+    return false;
   }
-  Page* page = GetPages() + entry->second;
-  disk_manager_.WritePage(page_id, page->GetData());
+  Page *page = GetFramePool(page_id).pages_ + entry->second;
+  WritePageToDisk(page);
   page->is_dirty_ = false;
   return true;
 }
 
-Page *BufferPoolManager::NewPageImpl(page_id_t *page_id) {
+Page *BufferPoolManager::NewPageImpl(page_id_t *page_id, PageSizeClass size_class) {
   // 0.   Make sure you call DiskManager::AllocatePage!
   // 1.   If all the pages in the buffer pool are pinned, return nullptr.
   // 2.   Pick a victim page P from either the free list or the replacer. Always pick from the free list first.
   // 3.   Update P's metadata, zero out memory and add P to the page table.
   // 4.   Set the page ID output parameter. Return a pointer to P.
-  //1.
-  std::lock_guard mutex(latch_);
-  bool is_all_pinned = true;
-  for(int i = 0; i < pool_size_; ++i) {
-      Page* page = GetPages() + i;
-      if(page->pin_count_ <= 0) {
-          is_all_pinned = false;
-          break;
-      }
-  }
-  if(is_all_pinned) {
-      return nullptr; 
-  }
-  frame_id_t frame_id = -1;
-  if(free_list_.size() >= 0) {
-      frame_id = free_list_.front();
-      free_list_.pop_front();
-  } else {
-      if(!replacer_->Vimtim(&frame_id)) {
-          return nullptr;
-      }
-  }
-  Page* page = GetPages() + frame_id;
+  std::lock_guard<std::mutex> guard(latch_);
+  FramePool &pool = frame_pools_[static_cast<size_t>(size_class)];
+  frame_id_t frame_id;
+  if (!FindFrame(&pool, &frame_id)) {
+    return nullptr;
+  }
+  Page *page = pool.pages_ + frame_id;
+  *page_id = disk_manager_->AllocatePage(size_class);
+  page_table_[*page_id] = frame_id;
   page->ResetMemory();
-  page->page_id_ = disk_manager_->AllocatePage();
-  page->pin_count_ = 0;
+  page->page_id_ = *page_id;
+  page->pin_count_ = 1;
   page->is_dirty_ = false;
-  page_table_[page->page_id_] = frame_id;
+  page->rec_lsn_ = INVALID_LSN;
+  pool.replacer_->Pin(frame_id);
   return page;
 }
 
@@ -155,35 +202,101 @@ bool BufferPoolManager::DeletePageImpl(page_id_t page_id) {
   // 1.   If P does not exist, return true.
   // 2.   If P exists, but has a non-zero pin-count, return false. Someone is using the page.
   // 3.   Otherwise, P can be deleted. Remove P from the page table, reset its metadata and return it to the free list.
-  //1.
-  std::locl_guard mutex(latch_);
+  std::lock_guard<std::mutex> guard(latch_);
   auto entry = page_table_.find(page_id);
-  if(entry == page_table_.end()) {
-      return true;
+  if (entry == page_table_.end()) {
+    disk_manager_->DeallocatePage(page_id);
+    return true;
   }
-  //2.
-  Page* page = GetPages() + entry->second; 
-  if(page->pin_count_ > 0) {
-      return false;
+  FramePool &pool = GetFramePool(page_id);
+  frame_id_t frame_id = entry->second;
+  Page *page = pool.pages_ + frame_id;
+  if (page->pin_count_ > 0) {
+    return false;
   }
+  page_table_.erase(entry);
+  // Take the frame out of the replacer so that it is only handed out through the free list.
+  pool.replacer_->Pin(frame_id);
   page->ResetMemory();
   page->page_id_ = INVALID_PAGE_ID;
   page->pin_count_ = 0;
   page->is_dirty_ = false;
-  replacer_->Unpin(entry->second);
-  free_list_.push_back(entry->second);
-  page_table.erase(page_id);
+  page->rec_lsn_ = INVALID_LSN;
+  pool.free_list_.push_back(frame_id);
+  disk_manager_->DeallocatePage(page_id);
   return true;
 }
 
 void BufferPoolManager::FlushAllPagesImpl() {
-  // You can do it!
-  std::lock_guard mutex(latch_);
-  for(int i = 0; i < pool_size_; ++i) {
-      Page* page = GetPages() + i;
-      disk_manager_.WritePage(page->GetPageId(), page->GetData());
-      page->is_dirty_ = false;
+  std::lock_guard<std::mutex> guard(latch_);
+  for (const auto &entry : page_table_) {
+    Page *page = GetFramePool(entry.first).pages_ + entry.second;
+    WritePageToDisk(page);
+    page->is_dirty_ = false;
+  }
+}
+
+void BufferPoolManager::GetDirtyPageTable(std::unordered_map<page_id_t, lsn_t> *dirty_pages) {
+  std::lock_guard<std::mutex> guard(latch_);
+  for (const auto &entry : page_table_) {
+    Page *page = GetFramePool(entry.first).pages_ + entry.second;
+    lsn_t rec_lsn = page->GetRecLSN();
+    if (page->is_dirty_ || rec_lsn != INVALID_LSN) {
+      dirty_pages->emplace(entry.first, rec_lsn);
+    }
+  }
+}
+
+bool BufferPoolManager::CheckpointPage(page_id_t page_id) {
+  Page *page;
+  {
+    std::lock_guard<std::mutex> guard(latch_);
+    auto entry = page_table_.find(page_id);
+    if (entry == page_table_.end()) {
+      return false;
+    }
+    FramePool &pool = GetFramePool(page_id);
+    page = pool.pages_ + entry->second;
+    if (!page->is_dirty_ && page->GetRecLSN() == INVALID_LSN) {
+      return false;
+    }
+    // Pin the page so that it stays in its frame while we wait for the latch.
+    ++page->pin_count_;
+    pool.replacer_->Pin(entry->second);
+  }
+
+  // Page latches are taken before the buffer pool latch, so we cannot wait for the page latch while holding it.
+  page->RLatch();
+  {
+    std::lock_guard<std::mutex> guard(latch_);
+    WritePageToDisk(page);
+    page->is_dirty_ = false;
+  }
+  page->RUnlatch();
+  UnpinPageImpl(page_id, false);
+  return true;
+}
+
+BasicPageGuard BufferPoolManager::FetchPageBasic(page_id_t page_id) { return {this, FetchPage(page_id)}; }
+
+ReadPageGuard BufferPoolManager::FetchPageRead(page_id_t page_id) {
+  Page *page = FetchPage(page_id);
+  if (page != nullptr) {
+    page->RLatch();
+  }
+  return {this, page};
+}
+
+WritePageGuard BufferPoolManager::FetchPageWrite(page_id_t page_id) {
+  Page *page = FetchPage(page_id);
+  if (page != nullptr) {
+    page->WLatch();
   }
+  return {this, page};
+}
+
+BasicPageGuard BufferPoolManager::NewPageGuarded(page_id_t *page_id, PageSizeClass size_class) {
+  return {this, NewPageImpl(page_id, size_class)};
 }
 
 }  // namespace bustub
@@ -14,16 +14,55 @@
 
 namespace bustub {
 
-ClockReplacer::ClockReplacer(size_t num_pages) {}
+ClockReplacer::ClockReplacer(size_t num_pages) : in_replacer_(num_pages, false), referenced_(num_pages, false) {}
 
 ClockReplacer::~ClockReplacer() = default;
 
-bool ClockReplacer::Victim(frame_id_t *frame_id) { return false; }
+bool ClockReplacer::Victim(frame_id_t *frame_id) {
+  std::lock_guard<std::mutex> guard(latch_);
+  if (size_ == 0) {
+    return false;
+  }
+  // Terminates within two sweeps: the first one clears every reference bit it passes.
+  while (true) {
+    size_t frame = hand_;
+    hand_ = (hand_ + 1) % in_replacer_.size();
+    if (!in_replacer_[frame]) {
+      continue;
+    }
+    if (referenced_[frame]) {
+      referenced_[frame] = false;
+      continue;
+    }
+    in_replacer_[frame] = false;
+    size_--;
+    *frame_id = static_cast<frame_id_t>(frame);
+    return true;
+  }
+}
 
-void ClockReplacer::Pin(frame_id_t frame_id) {}
+void ClockReplacer::Pin(frame_id_t frame_id) {
+  std::lock_guard<std::mutex> guard(latch_);
+  auto frame = static_cast<size_t>(frame_id);
+  if (in_replacer_[frame]) {
+    in_replacer_[frame] = false;
+    size_--;
+  }
+}
 
-void ClockReplacer::Unpin(frame_id_t frame_id) {}
+void ClockReplacer::Unpin(frame_id_t frame_id) {
+  std::lock_guard<std::mutex> guard(latch_);
+  auto frame = static_cast<size_t>(frame_id);
+  if (!in_replacer_[frame]) {
+    in_replacer_[frame] = true;
+    size_++;
+  }
+  referenced_[frame] = true;
+}
 
-size_t ClockReplacer::Size() { return 0; }
+size_t ClockReplacer::Size() {
+  std::lock_guard<std::mutex> guard(latch_);
+  return size_;
+}
 
 }  // namespace bustub
@@ -12,50 +12,728 @@
 
 #include "concurrency/lock_manager.h"
 
+#include <chrono>  // NOLINT
+#include <functional>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
 namespace bustub {
 
 bool LockManager::LockShared(Transaction *txn, const RID &rid) {
+  if (!CheckCanLock(txn)) {
+    return false;
+  }
+  if (txn->GetIsolationLevel() == IsolationLevel::READ_UNCOMMITTED) {
+    AbortTransaction(txn, AbortReason::LOCKSHARED_ON_READ_UNCOMMITTED);
+  }
+  if (txn->IsSharedLocked(rid) || txn->IsExclusiveLocked(rid)) {
+    return true;
+  }
+  // The increments of other transactions would change what the transaction reads, so reading a tuple it increments
+  // takes an exclusive lock.
+  if (txn->IsIncrementLocked(rid)) {
+    return LockUpgrade(txn, rid);
+  }
+  LockTableShard *shard = GetShard(rid);
+  std::unique_lock<std::mutex> lock(shard->latch_);
+  auto queue = GetQueue(shard, rid);
+  auto request = AddRequest(shard, &queue->second, txn, LockMode::SHARED);
+  if (!WaitForGrant(&lock, shard, &queue->second, request)) {
+    RemoveRowRequest(shard, queue, request);
+    throw TransactionAbortException(txn->GetTransactionId(), AbortReason::DEADLOCK);
+  }
   txn->GetSharedLockSet()->emplace(rid);
   return true;
 }
 
 bool LockManager::LockExclusive(Transaction *txn, const RID &rid) {
+  if (!CheckCanLock(txn)) {
+    return false;
+  }
+  if (txn->IsExclusiveLocked(rid)) {
+    return true;
+  }
+  if (txn->IsSharedLocked(rid) || txn->IsIncrementLocked(rid)) {
+    return LockUpgrade(txn, rid);
+  }
+  LockTableShard *shard = GetShard(rid);
+  std::unique_lock<std::mutex> lock(shard->latch_);
+  auto queue = GetQueue(shard, rid);
+  auto request = AddRequest(shard, &queue->second, txn, LockMode::EXCLUSIVE);
+  if (!WaitForGrant(&lock, shard, &queue->second, request)) {
+    RemoveRowRequest(shard, queue, request);
+    throw TransactionAbortException(txn->GetTransactionId(), AbortReason::DEADLOCK);
+  }
   txn->GetExclusiveLockSet()->emplace(rid);
   return true;
 }
 
+bool LockManager::TryLockExclusive(Transaction *txn, const RID &rid) {
+  if (!CheckCanLock(txn)) {
+    return false;
+  }
+  LockTableShard *shard = GetShard(rid);
+  std::lock_guard<std::mutex> guard(shard->latch_);
+  auto queue = GetQueue(shard, rid);
+  auto request = AddRequest(shard, &queue->second, txn, LockMode::EXCLUSIVE);
+  if (!IsGrantable(queue->second, request)) {
+    RemoveRowRequest(shard, queue, request);
+    return false;
+  }
+  GrantRequest(shard, request);
+  txn->GetExclusiveLockSet()->emplace(rid);
+  return true;
+}
+
+bool LockManager::LockIncrement(Transaction *txn, const RID &rid) {
+  if (!CheckCanLock(txn)) {
+    return false;
+  }
+  if (txn->IsIncrementLocked(rid) || txn->IsExclusiveLocked(rid)) {
+    return true;
+  }
+  // The increments of other transactions would change what the transaction read.
+  if (txn->IsSharedLocked(rid)) {
+    return LockUpgrade(txn, rid);
+  }
+  LockTableShard *shard = GetShard(rid);
+  std::unique_lock<std::mutex> lock(shard->latch_);
+  auto queue = GetQueue(shard, rid);
+  auto request = AddRequest(shard, &queue->second, txn, LockMode::INCREMENT);
+  if (!WaitForGrant(&lock, shard, &queue->second, request)) {
+    RemoveRowRequest(shard, queue, request);
+    throw TransactionAbortException(txn->GetTransactionId(), AbortReason::DEADLOCK);
+  }
+  txn->GetIncrementLockSet()->emplace(rid);
+  return true;
+}
+
 bool LockManager::LockUpgrade(Transaction *txn, const RID &rid) {
+  if (!CheckCanLock(txn)) {
+    return false;
+  }
+  if (txn->IsExclusiveLocked(rid)) {
+    return true;
+  }
+  LockTableShard *shard = GetShard(rid);
+  std::unique_lock<std::mutex> lock(shard->latch_);
+  auto queue = shard->lock_table_.find(rid);
+  BUSTUB_ASSERT(queue != shard->lock_table_.end() && (txn->IsSharedLocked(rid) || txn->IsIncrementLocked(rid)),
+                "Upgrading a lock that is not held.");
+  auto request = FindRequest(&queue->second, txn);
+  bool granted = UpgradeRequest(&lock, shard, &queue->second, request, LockMode::EXCLUSIVE);
   txn->GetSharedLockSet()->erase(rid);
+  txn->GetIncrementLockSet()->erase(rid);
+  if (!granted) {
+    RemoveRowRequest(shard, queue, request);
+    throw TransactionAbortException(txn->GetTransactionId(), AbortReason::DEADLOCK);
+  }
   txn->GetExclusiveLockSet()->emplace(rid);
   return true;
 }
 
 bool LockManager::Unlock(Transaction *txn, const RID &rid) {
+  bool shared = txn->IsSharedLocked(rid);
+  if (!shared && !txn->IsExclusiveLocked(rid) && !txn->IsIncrementLocked(rid)) {
+    return false;
+  }
+  // READ_COMMITTED gives shared locks back right after the read, which does not end the growing phase.
+  if (txn->GetState() == TransactionState::GROWING &&
+      !(shared && txn->GetIsolationLevel() == IsolationLevel::READ_COMMITTED)) {
+    txn->SetState(TransactionState::SHRINKING);
+  }
+  ReleaseRowLock(txn, rid);
+  return true;
+}
+
+bool LockManager::LockShared(Transaction *txn, table_oid_t table_oid, const RID &rid) {
+  if (!LockTable(txn, table_oid, LockMode::INTENTION_SHARED)) {
+    return false;
+  }
+  LockMode held;
+  if (txn->IsTableLocked(table_oid, &held) && Covers(held, LockMode::SHARED)) {
+    return true;
+  }
+  if (!LockShared(txn, rid)) {
+    return false;
+  }
+  TrackRowLock(txn, table_oid, rid);
+  return true;
+}
+
+bool LockManager::LockExclusive(Transaction *txn, table_oid_t table_oid, const RID &rid) {
+  if (!LockTable(txn, table_oid, LockMode::INTENTION_EXCLUSIVE)) {
+    return false;
+  }
+  LockMode held;
+  if (txn->IsTableLocked(table_oid, &held) && Covers(held, LockMode::EXCLUSIVE)) {
+    return true;
+  }
+  if (!LockExclusive(txn, rid)) {
+    return false;
+  }
+  TrackRowLock(txn, table_oid, rid);
+  return true;
+}
+
+bool LockManager::LockIncrement(Transaction *txn, table_oid_t table_oid, const RID &rid) {
+  if (!LockTable(txn, table_oid, LockMode::INTENTION_EXCLUSIVE)) {
+    return false;
+  }
+  LockMode held;
+  if (txn->IsTableLocked(table_oid, &held) && Covers(held, LockMode::INCREMENT)) {
+    return true;
+  }
+  if (!LockIncrement(txn, rid)) {
+    return false;
+  }
+  TrackRowLock(txn, table_oid, rid);
+  return true;
+}
+
+bool LockManager::Unlock(Transaction *txn, table_oid_t table_oid, const RID &rid) {
+  auto rids = txn->GetTableRowLockSet()->find(table_oid);
+  if (rids != txn->GetTableRowLockSet()->end()) {
+    rids->second.erase(rid);
+  }
+  return Unlock(txn, rid);
+}
+
+void LockManager::TrackRowLock(Transaction *txn, table_oid_t table_oid, const RID &rid) {
+  auto &rids = (*txn->GetTableRowLockSet())[table_oid];
+  if (!rids.insert(rid).second || escalation_threshold_ == 0 || rids.size() % escalation_threshold_ != 0) {
+    return;
+  }
+  // Increments change the tuples, the only table lock that covers them is EXCLUSIVE.
+  bool exclusive = std::any_of(rids.begin(), rids.end(), [txn](const RID &locked) {
+    return txn->IsExclusiveLocked(locked) || txn->IsIncrementLocked(locked);
+  });
+  if (!TryLockTable(txn, table_oid, exclusive ? LockMode::EXCLUSIVE : LockMode::SHARED)) {
+    return;
+  }
+  for (const auto &locked : rids) {
+    ReleaseRowLock(txn, locked);
+  }
+  rids.clear();
+}
+
+bool LockManager::TryLockTable(Transaction *txn, table_oid_t table_oid, LockMode lock_mode) {
+  {
+    std::lock_guard<std::mutex> guard(table_locks_latch_);
+    if (table_locks_blocked_) {
+      return false;
+    }
+  }
+  LockMode held;
+  bool is_held = txn->IsTableLocked(table_oid, &held);
+  if (is_held) {
+    if (Covers(held, lock_mode)) {
+      return true;
+    }
+    if (!Covers(lock_mode, held)) {
+      lock_mode = LockMode::SHARED_INTENTION_EXCLUSIVE;
+    }
+  }
+  LockTableShard *shard = GetShard(table_oid);
+  std::lock_guard<std::mutex> guard(shard->latch_);
+  auto *queue = &shard->table_lock_table_[table_oid];
+  if (is_held) {
+    auto request = FindRequest(queue, txn);
+    request->lock_mode_ = lock_mode;
+    if (queue->upgrading_ || !IsGrantable(*queue, request)) {
+      request->lock_mode_ = held;
+      return false;
+    }
+  } else {
+    auto request = AddRequest(shard, queue, txn, lock_mode);
+    if (!IsGrantable(*queue, request)) {
+      RemoveRequest(shard, queue, request);
+      return false;
+    }
+    GrantRequest(shard, request);
+  }
+  (*txn->GetTableLockSet())[table_oid] = lock_mode;
+  return true;
+}
+
+void LockManager::ReleaseRowLock(Transaction *txn, const RID &rid) {
   txn->GetSharedLockSet()->erase(rid);
   txn->GetExclusiveLockSet()->erase(rid);
+  txn->GetIncrementLockSet()->erase(rid);
+  LockTableShard *shard = GetShard(rid);
+  std::lock_guard<std::mutex> guard(shard->latch_);
+  auto queue = shard->lock_table_.find(rid);
+  BUSTUB_ASSERT(queue != shard->lock_table_.end(), "Releasing a lock that is not held.");
+  RemoveRowRequest(shard, queue, FindRequest(&queue->second, txn));
+}
+
+bool LockManager::LockTable(Transaction *txn, table_oid_t table_oid, LockMode lock_mode) {
+  BUSTUB_ASSERT(lock_mode != LockMode::INCREMENT, "Tables are not locked in INCREMENT mode.");
+  if (!CheckCanLock(txn)) {
+    return false;
+  }
+  if (txn->GetIsolationLevel() == IsolationLevel::READ_UNCOMMITTED && lock_mode != LockMode::EXCLUSIVE &&
+      lock_mode != LockMode::INTENTION_EXCLUSIVE) {
+    AbortTransaction(txn, AbortReason::LOCKSHARED_ON_READ_UNCOMMITTED);
+  }
+  LockMode held;
+  bool is_held = txn->IsTableLocked(table_oid, &held);
+  if (is_held) {
+    if (Covers(held, lock_mode)) {
+      return true;
+    }
+    // SHARED and INTENTION_EXCLUSIVE are the only modes that neither covers the other.
+    if (!Covers(lock_mode, held)) {
+      lock_mode = LockMode::SHARED_INTENTION_EXCLUSIVE;
+    }
+  }
+  WaitForTableLocks(lock_mode);
+  LockTableShard *shard = GetShard(table_oid);
+  std::unique_lock<std::mutex> lock(shard->latch_);
+  auto *queue = &shard->table_lock_table_[table_oid];
+  std::list<LockRequest>::iterator request;
+  bool granted;
+  if (is_held) {
+    request = FindRequest(queue, txn);
+    granted = UpgradeRequest(&lock, shard, queue, request, lock_mode);
+  } else {
+    request = AddRequest(shard, queue, txn, lock_mode);
+    granted = WaitForGrant(&lock, shard, queue, request);
+  }
+  if (!granted) {
+    // An upgrade that is not granted gives up the lock it upgrades too.
+    txn->GetTableLockSet()->erase(table_oid);
+    RemoveRequest(shard, queue, request);
+    throw TransactionAbortException(txn->GetTransactionId(), AbortReason::DEADLOCK);
+  }
+  (*txn->GetTableLockSet())[table_oid] = lock_mode;
+  return true;
+}
+
+bool LockManager::UnlockTable(Transaction *txn, table_oid_t table_oid) {
+  LockMode held;
+  if (!txn->IsTableLocked(table_oid, &held)) {
+    return false;
+  }
+  txn->GetTableLockSet()->erase(table_oid);
+  if (txn->GetState() == TransactionState::GROWING &&
+      !(Covers(LockMode::SHARED, held) && txn->GetIsolationLevel() == IsolationLevel::READ_COMMITTED)) {
+    txn->SetState(TransactionState::SHRINKING);
+  }
+  LockTableShard *shard = GetShard(table_oid);
+  std::lock_guard<std::mutex> guard(shard->latch_);
+  auto *queue = &shard->table_lock_table_[table_oid];
+  RemoveRequest(shard, queue, FindRequest(queue, txn));
+  return true;
+}
+
+void LockManager::BlockTableLocks() {
+  std::lock_guard<std::mutex> guard(table_locks_latch_);
+  table_locks_blocked_ = true;
+}
+
+void LockManager::ResumeTableLocks() {
+  {
+    std::lock_guard<std::mutex> guard(table_locks_latch_);
+    table_locks_blocked_ = false;
+  }
+  table_locks_cv_.notify_all();
+}
+
+void LockManager::WaitForTableLocks(LockMode lock_mode) {
+  // The intention locks leave the tuples to tuple locks, which see the locks of the stand-ins.
+  if (!Covers(lock_mode, LockMode::SHARED)) {
+    return;
+  }
+  std::unique_lock<std::mutex> lock(table_locks_latch_);
+  table_locks_cv_.wait(lock, [this] { return !table_locks_blocked_; });
+}
+
+bool LockManager::Covers(LockMode held, LockMode lock_mode) {
+  if (held == lock_mode || held == LockMode::EXCLUSIVE) {
+    return true;
+  }
+  switch (held) {
+    case LockMode::SHARED_INTENTION_EXCLUSIVE:
+      return lock_mode != LockMode::EXCLUSIVE && lock_mode != LockMode::INCREMENT;
+    case LockMode::SHARED:
+    case LockMode::INTENTION_EXCLUSIVE:
+      return lock_mode == LockMode::INTENTION_SHARED;
+    default:
+      return false;
+  }
+}
+
+bool LockManager::AreCompatible(LockMode mode1, LockMode mode2) {
+  if (mode1 == LockMode::EXCLUSIVE || mode2 == LockMode::EXCLUSIVE) {
+    return false;
+  }
+  // Increments commute with each other, but not with reads of the tuple.
+  if (mode1 == LockMode::INCREMENT || mode2 == LockMode::INCREMENT) {
+    return mode1 == mode2;
+  }
+  if (mode1 == LockMode::INTENTION_SHARED || mode2 == LockMode::INTENTION_SHARED) {
+    return true;
+  }
+  // What is left are SHARED, INTENTION_EXCLUSIVE and SHARED_INTENTION_EXCLUSIVE, of which only two locks of the same
+  // mode other than SHARED_INTENTION_EXCLUSIVE go together.
+  return mode1 == mode2 && mode1 != LockMode::SHARED_INTENTION_EXCLUSIVE;
+}
+
+bool LockManager::CheckCanLock(Transaction *txn) {
+  if (txn->GetState() == TransactionState::ABORTED) {
+    return false;
+  }
+  if (txn->GetState() == TransactionState::SHRINKING) {
+    AbortTransaction(txn, AbortReason::LOCK_ON_SHRINKING);
+  }
   return true;
 }
 
-void LockManager::AddEdge(txn_id_t t1, txn_id_t t2) {}
+void LockManager::AbortTransaction(Transaction *txn, AbortReason reason) {
+  txn->SetState(TransactionState::ABORTED);
+  throw TransactionAbortException(txn->GetTransactionId(), reason);
+}
+
+LockManager::RowLockTable::iterator LockManager::GetQueue(LockTableShard *shard, const RID &rid) {
+  auto queue = shard->lock_table_.find(rid);
+  if (queue != shard->lock_table_.end()) {
+    return queue;
+  }
+  if (shard->free_queues_.empty()) {
+    return shard->lock_table_.try_emplace(rid).first;
+  }
+  auto node = std::move(shard->free_queues_.back());
+  shard->free_queues_.pop_back();
+  node.key() = rid;
+  return shard->lock_table_.insert(std::move(node)).position;
+}
+
+std::list<LockManager::LockRequest>::iterator LockManager::AddRequest(LockTableShard *shard, LockRequestQueue *queue,
+                                                                      Transaction *txn, LockMode lock_mode) {
+  auto &requests = queue->request_queue_;
+  if (shard->free_requests_.empty()) {
+    return requests.emplace(requests.end(), txn, lock_mode);
+  }
+  requests.splice(requests.end(), shard->free_requests_, shard->free_requests_.begin());
+  auto request = std::prev(requests.end());
+  *request = LockRequest(txn, lock_mode);
+  return request;
+}
+
+bool LockManager::UpgradeRequest(std::unique_lock<std::mutex> *lock, LockTableShard *shard, LockRequestQueue *queue,
+                                 std::list<LockRequest>::iterator request, LockMode lock_mode) {
+  if (queue->upgrading_) {
+    AbortTransaction(request->txn_, AbortReason::UPGRADE_CONFLICT);
+  }
+  auto &requests = queue->request_queue_;
+  // The upgrade goes ahead of the transactions that are waiting, and waits for the other granted locks to go.
+  requests.splice(std::find_if(requests.begin(), requests.end(), [](const LockRequest &r) { return !r.granted_; }),
+                  requests, request);
+  request->lock_mode_ = lock_mode;
+  request->granted_ = false;
+  queue->upgrading_ = true;
+  bool granted = WaitForGrant(lock, shard, queue, request);
+  queue->upgrading_ = false;
+  return granted;
+}
+
+bool LockManager::WaitForGrant(std::unique_lock<std::mutex> *lock, LockTableShard *shard, LockRequestQueue *queue,
+                               std::list<LockRequest>::iterator request) {
+  Transaction *txn = request->txn_;
+  // Under DETECTION, the request searches for a cycle once it waited for cycle_detection_interval, however often it
+  // was woken up in between, and again after each further interval.
+  auto detect_at = std::chrono::steady_clock::now() + cycle_detection_interval;
+  // The edges and the policy are updated on each wake up, as the requests ahead come and go, and an upgrade may have
+  // put another transaction ahead of the request.
+  while (txn->GetState() != TransactionState::ABORTED && !IsGrantable(*queue, request)) {
+    std::vector<txn_id_t> victims;
+    if (deadlock_mode_ == DeadlockMode::DETECTION) {
+      SetWaitsFor(shard, queue, request);
+      txn_id_t victim;
+      auto now = std::chrono::steady_clock::now();
+      if (now >= detect_at) {
+        detect_at = now + cycle_detection_interval;
+        if (DetectDeadlock(request->txn_id_, &victim) && victim != request->txn_id_) {
+          victims.push_back(victim);
+        }
+      }
+    } else if (!PreventDeadlock(queue, request, &victims)) {
+      break;
+    }
+    if (!victims.empty()) {
+      // Latching the shard of another queue while this one is latched could deadlock.
+      lock->unlock();
+      for (txn_id_t victim : victims) {
+        WakeUp(victim);
+      }
+      lock->lock();
+      continue;
+    }
+    if (deadlock_mode_ == DeadlockMode::WOUND_WAIT) {
+      std::lock_guard<std::mutex> guard(waits_for_latch_);
+      waiting_[request->txn_id_] = {txn, shard, queue};
+    }
+    // A transaction that aborts this one after the check finds it in waiting_ and wakes it up.
+    if (txn->GetState() == TransactionState::ABORTED) {
+      break;
+    }
+    if (deadlock_mode_ == DeadlockMode::DETECTION) {
+      queue->cv_.wait_until(*lock, detect_at);
+    } else {
+      queue->cv_.wait(*lock);
+    }
+  }
+  if (deadlock_mode_ != DeadlockMode::WAIT_DIE) {
+    std::lock_guard<std::mutex> guard(waits_for_latch_);
+    waiting_.erase(request->txn_id_);
+    waits_for_.erase(request->txn_id_);
+  }
+  if (txn->GetState() == TransactionState::ABORTED) {
+    return false;
+  }
+  GrantRequest(shard, request);
+  return true;
+}
 
-void LockManager::RemoveEdge(txn_id_t t1, txn_id_t t2) {}
+void LockManager::GrantRequest(LockTableShard *shard, std::list<LockRequest>::iterator request) {
+  request->granted_ = true;
+  if (shard->release_lsn_ != INVALID_LSN) {
+    request->txn_->AddDependencyLSN(shard->release_lsn_);
+  }
+}
 
-bool LockManager::HasCycle(txn_id_t *txn_id) { return false; }
+void LockManager::SetWaitsFor(LockTableShard *shard, LockRequestQueue *queue,
+                              std::list<LockRequest>::const_iterator request) {
+  std::vector<txn_id_t> edges;
+  bool before = true;
+  for (auto other = queue->request_queue_.cbegin(); other != queue->request_queue_.cend(); ++other) {
+    if (other == request) {
+      before = false;
+    } else if ((before || other->granted_) && !AreCompatible(other->lock_mode_, request->lock_mode_) &&
+               other->txn_->GetState() != TransactionState::ABORTED) {
+      edges.push_back(other->txn_id_);
+    }
+  }
+  std::lock_guard<std::mutex> guard(waits_for_latch_);
+  waiting_[request->txn_id_] = {request->txn_, shard, queue};
+  waits_for_[request->txn_id_] = std::move(edges);
+}
 
-std::vector<std::pair<txn_id_t, txn_id_t>> LockManager::GetEdgeList() { return {}; }
+bool LockManager::DetectDeadlock(txn_id_t txn_id, txn_id_t *victim) {
+  std::lock_guard<std::mutex> guard(waits_for_latch_);
+  if (!FindCycleThrough(waits_for_, txn_id, victim)) {
+    return false;
+  }
+  // Every transaction in the cycle waits, so the victim is still in waiting_. Dropping its edges keeps the others in
+  // the cycle from picking another victim.
+  waiting_.at(*victim).txn_->TransitionState(TransactionState::ABORTED);
+  waits_for_.erase(*victim);
+  return true;
+}
 
-void LockManager::RunCycleDetection() {
-  while (enable_cycle_detection_) {
-    std::this_thread::sleep_for(cycle_detection_interval);
-    {
-      std::unique_lock<std::mutex> l(latch_);
-      // TODO(student): remove the continue and add your cycle detection and abort code here
+bool LockManager::PreventDeadlock(LockRequestQueue *queue, std::list<LockRequest>::iterator request,
+                                  std::vector<txn_id_t> *wounded) {
+  bool wounded_here = false;
+  bool before = true;
+  for (auto other = queue->request_queue_.begin(); other != queue->request_queue_.end(); ++other) {
+    if (other == request) {
+      before = false;
+      continue;
+    }
+    // An aborted or committed transaction does not wait for locks anymore, so waiting for it cannot deadlock.
+    TransactionState other_state = other->txn_->GetState();
+    if (!(before || other->granted_) || AreCompatible(other->lock_mode_, request->lock_mode_) ||
+        other_state == TransactionState::ABORTED || other_state == TransactionState::COMMITTED) {
       continue;
     }
+    bool older = other->txn_id_ < request->txn_id_;
+    if (deadlock_mode_ == DeadlockMode::WAIT_DIE && older) {
+      request->txn_->TransitionState(TransactionState::ABORTED);
+      return false;
+    }
+    if (deadlock_mode_ == DeadlockMode::WOUND_WAIT && !older) {
+      // A wounded transaction that holds the lock keeps it until it is rolled back, and learns it was aborted when it
+      // asks for its next lock or commits. One that began to commit in the meantime is not wounded.
+      if (!other->txn_->TransitionState(TransactionState::ABORTED)) {
+        continue;
+      }
+      if (other->granted_) {
+        wounded->push_back(other->txn_id_);
+      } else {
+        wounded_here = true;
+      }
+    }
   }
+  if (wounded_here) {
+    queue->cv_.notify_all();
+  }
+  return true;
+}
+
+void LockManager::WakeUp(txn_id_t txn_id) {
+  std::unique_lock<std::mutex> waiting_lock(waits_for_latch_);
+  auto waiting = waiting_.find(txn_id);
+  if (waiting == waiting_.end()) {
+    return;
+  }
+  Waiter waiter = waiting->second;
+  waiting_lock.unlock();
+  std::lock_guard<std::mutex> guard(waiter.shard_->latch_);
+  waiting_lock.lock();
+  // The queue may only be used if the transaction still waits in it, or else it may have been recycled.
+  waiting = waiting_.find(txn_id);
+  if (waiting != waiting_.end() && waiting->second.shard_ == waiter.shard_ &&
+      waiting->second.queue_ == waiter.queue_) {
+    waiter.queue_->cv_.notify_all();
+  }
+}
+
+bool LockManager::IsGrantable(const LockRequestQueue &queue, std::list<LockRequest>::const_iterator request) {
+  bool before = true;
+  for (auto other = queue.request_queue_.begin(); other != queue.request_queue_.end(); ++other) {
+    if (other == request) {
+      before = false;
+    } else if ((before || other->granted_) && !AreCompatible(other->lock_mode_, request->lock_mode_)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void LockManager::RemoveRequest(LockTableShard *shard, LockRequestQueue *queue,
+                                std::list<LockRequest>::iterator request) {
+  if (request->granted_ && request->txn_->GetState() == TransactionState::COMMITTED) {
+    shard->release_lsn_ = std::max(shard->release_lsn_, request->txn_->GetPrevLSN());
+  }
+  shard->free_requests_.splice(shard->free_requests_.begin(), queue->request_queue_, request);
+  if (!queue->request_queue_.empty()) {
+    queue->cv_.notify_all();
+  }
+}
+
+void LockManager::RemoveRowRequest(LockTableShard *shard, RowLockTable::iterator queue,
+                                   std::list<LockRequest>::iterator request) {
+  RemoveRequest(shard, &queue->second, request);
+  if (!queue->second.request_queue_.empty()) {
+    return;
+  }
+  // Every waiting transaction has a request in the queue, so nobody waits on an empty queue.
+  if (shard->free_queues_.size() < MAX_FREE_QUEUES) {
+    shard->free_queues_.push_back(shard->lock_table_.extract(queue));
+  } else {
+    shard->lock_table_.erase(queue);
+  }
+}
+
+std::list<LockManager::LockRequest>::iterator LockManager::FindRequest(LockRequestQueue *queue, Transaction *txn) {
+  auto request = std::find_if(queue->request_queue_.begin(), queue->request_queue_.end(),
+                              [txn](const LockRequest &request) { return request.txn_id_ == txn->GetTransactionId(); });
+  BUSTUB_ASSERT(request != queue->request_queue_.end(), "The transaction has no lock request in the queue.");
+  return request;
+}
+
+void LockManager::AddEdge(txn_id_t t1, txn_id_t t2) {
+  std::lock_guard<std::mutex> guard(waits_for_latch_);
+  auto &edges = waits_for_[t1];
+  if (std::find(edges.begin(), edges.end(), t2) == edges.end()) {
+    edges.push_back(t2);
+  }
+}
+
+void LockManager::RemoveEdge(txn_id_t t1, txn_id_t t2) {
+  std::lock_guard<std::mutex> guard(waits_for_latch_);
+  auto edges = waits_for_.find(t1);
+  if (edges == waits_for_.end()) {
+    return;
+  }
+  edges->second.erase(std::remove(edges->second.begin(), edges->second.end(), t2), edges->second.end());
+  if (edges->second.empty()) {
+    waits_for_.erase(edges);
+  }
+}
+
+bool LockManager::HasCycle(txn_id_t *txn_id) {
+  std::lock_guard<std::mutex> guard(waits_for_latch_);
+  return FindCycle(waits_for_, txn_id);
+}
+
+std::vector<std::pair<txn_id_t, txn_id_t>> LockManager::GetEdgeList() {
+  std::lock_guard<std::mutex> guard(waits_for_latch_);
+  std::vector<std::pair<txn_id_t, txn_id_t>> edge_list;
+  for (const auto &edges : waits_for_) {
+    for (txn_id_t t2 : edges.second) {
+      edge_list.emplace_back(edges.first, t2);
+    }
+  }
+  return edge_list;
+}
+
+bool LockManager::FindCycle(const std::unordered_map<txn_id_t, std::vector<txn_id_t>> &waits_for, txn_id_t *txn_id) {
+  std::vector<txn_id_t> txns;
+  for (const auto &edges : waits_for) {
+    txns.push_back(edges.first);
+  }
+  std::sort(txns.begin(), txns.end());
+  std::unordered_set<txn_id_t> visited;
+  std::vector<txn_id_t> path;
+  std::function<bool(txn_id_t)> visit = [&](txn_id_t txn) {
+    auto on_path = std::find(path.begin(), path.end(), txn);
+    if (on_path != path.end()) {
+      *txn_id = *std::max_element(on_path, path.end());
+      return true;
+    }
+    if (!visited.insert(txn).second) {
+      return false;
+    }
+    path.push_back(txn);
+    auto edges = waits_for.find(txn);
+    if (edges != waits_for.end()) {
+      std::vector<txn_id_t> next(edges->second);
+      std::sort(next.begin(), next.end());
+      for (txn_id_t t2 : next) {
+        if (visit(t2)) {
+          return true;
+        }
+      }
+    }
+    path.pop_back();
+    return false;
+  };
+  for (txn_id_t txn : txns) {
+    if (visit(txn)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool LockManager::FindCycleThrough(const std::unordered_map<txn_id_t, std::vector<txn_id_t>> &waits_for,
+                                   txn_id_t txn_id, txn_id_t *victim) {
+  std::unordered_set<txn_id_t> visited;
+  std::vector<txn_id_t> path;
+  std::function<bool(txn_id_t)> visit = [&](txn_id_t txn) {
+    if (!visited.insert(txn).second) {
+      return false;
+    }
+    path.push_back(txn);
+    auto edges = waits_for.find(txn);
+    if (edges != waits_for.end()) {
+      for (txn_id_t t2 : edges->second) {
+        if (t2 == txn_id) {
+          *victim = *std::max_element(path.begin(), path.end());
+          return true;
+        }
+        if (visit(t2)) {
+          return true;
+        }
+      }
+    }
+    path.pop_back();
+    return false;
+  };
+  return visit(txn_id);
 }
 
 }  // namespace bustub
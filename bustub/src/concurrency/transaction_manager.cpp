@@ -12,16 +12,18 @@
 
 #include "concurrency/transaction_manager.h"
 
+#include <algorithm>
+#include <map>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
+#include <vector>
 
 #include "catalog/catalog.h"
 #include "storage/table/table_heap.h"
 
 namespace bustub {
 
-std::unordered_map<txn_id_t, Transaction *> TransactionManager::txn_map = {};
-
 Transaction *TransactionManager::Begin(Transaction *txn, IsolationLevel isolation_level) {
   // Acquire the global transaction latch in shared mode.
   global_txn_latch_.RLock();
@@ -29,37 +31,132 @@ Transaction *TransactionManager::Begin(Transaction *txn, IsolationLevel isolatio
   if (txn == nullptr) {
     txn = new Transaction(next_txn_id_++, isolation_level);
   }
+  txn->SetConcurrencyMode(concurrency_mode_);
+
+  if (txn->ReadsSnapshot()) {
+    std::lock_guard<std::mutex> guard(timestamp_latch_);
+    txn->SetReadTs(last_commit_ts_);
+    snapshots_.insert(last_commit_ts_);
+  }
+
+  // The BEGIN record is appended under the shard latch, so a checkpoint sees every transaction that began before it.
+  RegistryShard *shard = GetRegistryShard(txn->GetTransactionId());
+  std::lock_guard<std::mutex> guard(shard->latch_);
+  if (enable_logging) {
+    LogRecord log_record(txn->GetTransactionId(), txn->GetPrevLSN(), LogRecordType::BEGIN);
+    txn->SetPrevLSN(log_manager_->AppendLogRecord(&log_record));
+    txn->SetFirstLSN(txn->GetPrevLSN());
+  }
+  [[maybe_unused]] bool registered = shard->txns_.try_emplace(txn->GetTransactionId(), txn).second;
+  BUSTUB_ASSERT(registered, "Another running transaction has the same id.");
+  return txn;
+}
 
-  txn_map[txn->GetTransactionId()] = txn;
+Transaction *TransactionManager::BeginReadOnly(Transaction *txn, IsolationLevel isolation_level) {
+  if (txn == nullptr) {
+    txn = new Transaction(next_txn_id_++, isolation_level);
+  }
+  txn->SetReadOnly(true);
+  if (txn->ReadsSnapshot()) {
+    std::lock_guard<std::mutex> guard(timestamp_latch_);
+    txn->SetReadTs(last_commit_ts_);
+    snapshots_.insert(last_commit_ts_);
+  }
   return txn;
 }
 
 void TransactionManager::Commit(Transaction *txn) {
-  txn->SetState(TransactionState::COMMITTED);
+  // A transaction wounded or picked as a deadlock victim while it held its locks learns it was aborted here, if it
+  // asked for no lock since. Once it moved to COMMITTED, it cannot be aborted anymore.
+  auto abort_wounded = [this, txn] {
+    Abort(txn);
+    throw TransactionAbortException(txn->GetTransactionId(), AbortReason::DEADLOCK);
+  };
+  if (txn->IsReadOnly()) {
+    if (!txn->TransitionState(TransactionState::COMMITTED)) {
+      abort_wounded();
+    }
+    FinishReadOnly(txn, TransactionState::COMMITTED);
+    return;
+  }
+  // Committing the versions comes first, an insert may reuse the slot of a delete as soon as it is applied.
+  timestamp_t commit_ts;
+  if (txn->GetConcurrencyMode() == ConcurrencyMode::OPTIMISTIC) {
+    try {
+      commit_ts = ValidateAndInstall(txn);
+    } catch (TransactionAbortException &e) {
+      Abort(txn);
+      throw;
+    }
+  } else {
+    if (!txn->TransitionState(TransactionState::COMMITTED)) {
+      abort_wounded();
+    }
+    commit_ts = CommitVersions(txn);
+  }
 
-  // Perform all deletes before we commit.
-  auto write_set = txn->GetWriteSet();
-  while (!write_set->empty()) {
-    auto &item = write_set->back();
-    auto table = item.table_;
-    if (item.wtype_ == WType::DELETE) {
-      // Note that this also releases the lock when holding the page latch.
-      table->ApplyDelete(item.rid_, txn);
+  // Perform all deletes before we commit, one page at a time.
+  if (txn->HasTableWrites()) {
+    auto write_set = txn->GetWriteSet();
+    std::map<std::pair<TableHeap *, page_id_t>, std::vector<RID>> deletes;
+    for (const auto &item : *write_set) {
+      if (item.wtype_ == WType::DELETE) {
+        deletes[{item.table_, item.rid_.GetPageId()}].push_back(item.rid_);
+      } else if (item.wtype_ == WType::INCREMENT) {
+        item.table_->CommitIncrement(item.rid_, item.offset_, item.delta_);
+      }
+    }
+    for (const auto &[page, rids] : deletes) {
+      page.first->ApplyDeletes(rids, txn);
     }
-    write_set->pop_back();
+    write_set->clear();
   }
-  write_set->clear();
 
-  // Release all the locks.
+  lsn_t commit_lsn = INVALID_LSN;
+  if (enable_logging) {
+    LogRecord log_record(txn->GetTransactionId(), txn->GetPrevLSN(), LogRecordType::COMMIT);
+    commit_lsn = log_manager_->AppendLogRecord(&log_record);
+    txn->SetPrevLSN(commit_lsn);
+    CommitLogged(commit_ts, commit_lsn);
+  }
+  Unregister(txn);
+
+  // Release all the locks, deletes included, without waiting for the COMMIT record to be on disk. The transactions
+  // that take them write their own COMMIT records after this one, or as read-only transactions wait for this one.
   ReleaseLocks(txn);
+
+  // The transaction is committed once its COMMIT record is on disk. The wait is shared with concurrent commits.
+  // An asynchronous commit only asks for the flush and leaves the wait to WaitForDurableCommit().
+  if (enable_logging) {
+    if (txn->IsAsyncCommit()) {
+      log_manager_->ScheduleFlush(commit_lsn);
+    } else {
+      log_manager_->WaitForCommit(commit_lsn);
+    }
+  }
   // Release the global transaction latch.
   global_txn_latch_.RUnlock();
 }
 
+void TransactionManager::WaitForDurableCommit(lsn_t commit_lsn) {
+  if (enable_logging) {
+    log_manager_->WaitForCommit(commit_lsn);
+  }
+}
+
 void TransactionManager::Abort(Transaction *txn) {
+  if (txn->IsReadOnly()) {
+    FinishReadOnly(txn, TransactionState::ABORTED);
+    return;
+  }
   txn->SetState(TransactionState::ABORTED);
   // Rollback before releasing the lock.
   auto table_write_set = txn->GetWriteSet();
+  // The versions of a tuple are rolled back once all the changes to it are, snapshots must not see the ones between.
+  std::vector<std::pair<TableHeap *, RID>> changed_tuples;
+  for (const auto &item : *table_write_set) {
+    changed_tuples.emplace_back(item.table_, item.rid_);
+  }
   while (!table_write_set->empty()) {
     auto &item = table_write_set->back();
     auto table = item.table_;
@@ -69,7 +166,9 @@ void TransactionManager::Abort(Transaction *txn) {
       // Note that this also releases the lock when holding the page latch.
       table->ApplyDelete(item.rid_, txn);
     } else if (item.wtype_ == WType::UPDATE) {
-      table->UpdateTuple(item.tuple_, item.rid_, txn);
+      table->RollbackUpdate(item.tuple_, item.rid_, txn);
+    } else if (item.wtype_ == WType::INCREMENT) {
+      table->RollbackIncrement(item.rid_, item.offset_, item.delta_, txn);
     }
     table_write_set->pop_back();
   }
@@ -99,6 +198,21 @@ void TransactionManager::Abort(Transaction *txn) {
   }
   table_write_set->clear();
   index_write_set->clear();
+  txn->GetTableReadSet()->clear();
+  txn->GetBufferedWriteSet()->clear();
+  for (const auto &[table, rid] : changed_tuples) {
+    table->RollbackVersion(rid, txn);
+  }
+  {
+    std::lock_guard<std::mutex> guard(timestamp_latch_);
+    EndSnapshot(txn);
+  }
+
+  if (enable_logging) {
+    LogRecord log_record(txn->GetTransactionId(), txn->GetPrevLSN(), LogRecordType::ABORT);
+    txn->SetPrevLSN(log_manager_->AppendLogRecord(&log_record));
+  }
+  Unregister(txn);
 
   // Release all the locks.
   ReleaseLocks(txn);
@@ -106,6 +220,150 @@ void TransactionManager::Abort(Transaction *txn) {
   global_txn_latch_.RUnlock();
 }
 
+void TransactionManager::GetActiveTransactionTable(std::unordered_map<txn_id_t, lsn_t> *active_txns,
+                                                   lsn_t *oldest_first_lsn) {
+  *oldest_first_lsn = INVALID_LSN;
+  for (auto &shard : registry_) {
+    std::lock_guard<std::mutex> guard(shard.latch_);
+    for (const auto &entry : shard.txns_) {
+      Transaction *txn = entry.second;
+      if (txn->GetFirstLSN() == INVALID_LSN) {
+        // Began while logging was off, nothing to undo.
+        continue;
+      }
+      active_txns->emplace(entry.first, txn->GetPrevLSN());
+      if (*oldest_first_lsn == INVALID_LSN || txn->GetFirstLSN() < *oldest_first_lsn) {
+        *oldest_first_lsn = txn->GetFirstLSN();
+      }
+    }
+  }
+}
+
+void TransactionManager::FinishReadOnly(Transaction *txn, TransactionState state) {
+  txn->SetState(state);
+  if (txn->ReadsSnapshot()) {
+    std::unique_lock<std::mutex> guard(timestamp_latch_);
+    EndSnapshot(txn);
+    // A snapshot takes no locks, but sees the commits up to its read timestamp, which commit their versions before
+    // they append their COMMIT records. Once those are appended, the newest COMMIT record covers them all.
+    if (enable_logging && state == TransactionState::COMMITTED) {
+      commit_logged_cv_.wait(guard, [this, txn] {
+        return unlogged_commits_.empty() || *unlogged_commits_.begin() > txn->GetReadTs();
+      });
+      txn->AddDependencyLSN(last_commit_lsn_);
+    }
+  }
+  ReleaseLocks(txn);
+  // Without a COMMIT record of its own, a transaction that read the changes of a commit that released its locks early
+  // waits for that commit to be durable.
+  lsn_t dependency_lsn = txn->GetDependencyLSN();
+  if (enable_logging && state == TransactionState::COMMITTED && dependency_lsn != INVALID_LSN) {
+    if (txn->IsAsyncCommit()) {
+      log_manager_->ScheduleFlush(dependency_lsn);
+    } else {
+      log_manager_->WaitForCommit(dependency_lsn);
+    }
+  }
+}
+
+void TransactionManager::Unregister(Transaction *txn) {
+  RegistryShard *shard = GetRegistryShard(txn->GetTransactionId());
+  std::lock_guard<std::mutex> guard(shard->latch_);
+  auto entry = shard->txns_.find(txn->GetTransactionId());
+  if (entry != shard->txns_.end() && entry->second == txn) {
+    shard->txns_.erase(entry);
+  }
+}
+
+timestamp_t TransactionManager::GetWatermark() {
+  std::lock_guard<std::mutex> guard(timestamp_latch_);
+  return snapshots_.empty() ? last_commit_ts_ : *snapshots_.begin();
+}
+
+timestamp_t TransactionManager::CommitVersions(Transaction *txn) {
+  std::lock_guard<std::mutex> guard(timestamp_latch_);
+  EndSnapshot(txn);
+  if (!txn->HasTableWrites()) {
+    return 0;
+  }
+  auto write_set = txn->GetWriteSet();
+  // Snapshots that begin after this one see the new versions, so only the running ones hold back the watermark.
+  timestamp_t commit_ts = last_commit_ts_ + 1;
+  timestamp_t watermark = snapshots_.empty() ? commit_ts : *snapshots_.begin();
+  for (const auto &item : *write_set) {
+    item.table_->CommitVersion(item.rid_, txn, commit_ts, watermark);
+  }
+  last_commit_ts_ = commit_ts;
+  if (enable_logging) {
+    unlogged_commits_.insert(commit_ts);
+  }
+  return commit_ts;
+}
+
+void TransactionManager::CommitLogged(timestamp_t commit_ts, lsn_t commit_lsn) {
+  if (commit_ts == 0) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> guard(timestamp_latch_);
+    unlogged_commits_.erase(commit_ts);
+    last_commit_lsn_ = std::max(last_commit_lsn_, commit_lsn);
+  }
+  commit_logged_cv_.notify_all();
+}
+
+timestamp_t TransactionManager::ValidateAndInstall(Transaction *txn) {
+  auto fail = [txn](AbortReason reason) {
+    txn->SetState(TransactionState::ABORTED);
+    throw TransactionAbortException(txn->GetTransactionId(), reason);
+  };
+  // Lock the tuples to change first, so that no locking transaction changes them between validation and installation.
+  // Taking the locks in RID order keeps committing transactions from waiting for each other in a cycle.
+  auto buffered_write_set = txn->GetBufferedWriteSet();
+  std::vector<const TableWriteRecord *> writes;
+  for (const auto &entry : *buffered_write_set) {
+    writes.push_back(&entry.second);
+  }
+  std::sort(writes.begin(), writes.end(),
+            [](const TableWriteRecord *a, const TableWriteRecord *b) { return a->rid_.Get() < b->rid_.Get(); });
+  for (const auto *write : writes) {
+    if (!write->table_->LockForInstall(write->rid_, txn)) {
+      fail(AbortReason::DEADLOCK);
+    }
+  }
+
+  std::lock_guard<std::mutex> guard(validation_latch_);
+  // Each buffered change read its tuple first, so the read set covers the changed tuples too.
+  for (const auto &[rid, table] : *txn->GetTableReadSet()) {
+    if (table->IsChangedSince(rid, txn)) {
+      fail(AbortReason::VALIDATION_FAILED);
+    }
+  }
+  for (const auto *write : writes) {
+    if (!write->table_->InstallWrite(*write, txn) || txn->GetState() == TransactionState::ABORTED) {
+      fail(AbortReason::VALIDATION_FAILED);
+    }
+  }
+  txn->GetTableReadSet()->clear();
+  buffered_write_set->clear();
+  // The installed changes hold their locks, so a transaction may still be wounded up to here.
+  if (!txn->TransitionState(TransactionState::COMMITTED)) {
+    fail(AbortReason::DEADLOCK);
+  }
+  // Later transactions validate against the commit timestamp, so it is taken before the next one validates.
+  return CommitVersions(txn);
+}
+
+void TransactionManager::EndSnapshot(Transaction *txn) {
+  if (!txn->ReadsSnapshot()) {
+    return;
+  }
+  auto snapshot = snapshots_.find(txn->GetReadTs());
+  if (snapshot != snapshots_.end()) {
+    snapshots_.erase(snapshot);
+  }
+}
+
 void TransactionManager::BlockAllTransactions() { global_txn_latch_.WLock(); }
 
 void TransactionManager::ResumeTransactions() { global_txn_latch_.WUnlock(); }
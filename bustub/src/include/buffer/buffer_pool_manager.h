@@ -12,23 +12,33 @@
 
 #pragma once
 
+#include <array>
+#include <functional>
 #include <list>
 #include <mutex>  // NOLINT
 #include <unordered_map>
 
+#include "buffer/clock_replacer.h"
 #include "buffer/lru_replacer.h"
 #include "recovery/log_manager.h"
 #include "storage/disk/disk_manager.h"
 #include "storage/page/page.h"
+#include "storage/page/page_guard.h"
+#include "storage/page/page_size_class.h"
 
 namespace bustub {
 
 /**
  * BufferPoolManager reads disk pages to and from its internal buffer pool.
+ *
+ * The buffer pool keeps a separate set of frames, free list and replacer for every page size class, so large pages
+ * never compete with small pages for frames. The size class of a page is encoded in its page id.
  */
 class BufferPoolManager {
  public:
   enum class CallbackType { BEFORE, AFTER };
+  /** Replacement policy used to pick the frames to evict. */
+  enum class ReplacerType { LRU, CLOCK };
   using bufferpool_callback_fn = void (*)(enum CallbackType, const page_id_t page_id);
 
   /**
@@ -36,8 +46,20 @@ class BufferPoolManager {
    * @param pool_size the size of the buffer pool
    * @param disk_manager the disk manager
    * @param log_manager the log manager (for testing only: nullptr = disable logging)
+   * @param replacer_type the replacement policy of the buffer pool
    */
-  BufferPoolManager(size_t pool_size, DiskManager *disk_manager, LogManager *log_manager = nullptr);
+  BufferPoolManager(size_t pool_size, DiskManager *disk_manager, LogManager *log_manager = nullptr,
+                    ReplacerType replacer_type = ReplacerType::LRU);
+
+  /**
+   * Creates a new BufferPoolManager with frames for several page size classes.
+   * @param pool_sizes the number of frames of each page size class, indexed by PageSizeClass
+   * @param disk_manager the disk manager
+   * @param log_manager the log manager (for testing only: nullptr = disable logging)
+   * @param replacer_type the replacement policy of every page size class
+   */
+  BufferPoolManager(const std::array<size_t, NUM_PAGE_SIZE_CLASSES> &pool_sizes, DiskManager *disk_manager,
+                    LogManager *log_manager = nullptr, ReplacerType replacer_type = ReplacerType::LRU);
 
   /**
    * Destroys an existing BufferPoolManager.
@@ -91,11 +113,77 @@ class BufferPoolManager {
     GradingCallback(callback, CallbackType::AFTER, INVALID_PAGE_ID);
   }
 
-  /** @return pointer to all the pages in the buffer pool */
-  Page *GetPages() { return pages_; }
+  /**
+   * Creates a new page of the given size class in the buffer pool.
+   * @param[out] page_id id of created page, with the size class encoded in it
+   * @param size_class the size class of the new page
+   * @return nullptr if no new page of that size class could be created, otherwise pointer to new page
+   */
+  Page *NewPage(page_id_t *page_id, PageSizeClass size_class) { return NewPageImpl(page_id, size_class); }
 
-  /** @return size of the buffer pool */
-  size_t GetPoolSize() { return pool_size_; }
+  /**
+   * Fetches the requested page and wraps it in a guard that unpins it when it goes out of scope.
+   * @param page_id id of page to be fetched
+   * @return a guard over the pinned page, not valid if the page could not be fetched
+   */
+  BasicPageGuard FetchPageBasic(page_id_t page_id);
+
+  /**
+   * Fetches the requested page and read-latches it. The guard unlatches and unpins the page when it goes out of scope.
+   * @param page_id id of page to be fetched
+   * @return a guard over the pinned and read-latched page, not valid if the page could not be fetched
+   */
+  ReadPageGuard FetchPageRead(page_id_t page_id);
+
+  /**
+   * Fetches the requested page and write-latches it. The guard unlatches and unpins the page when it goes out of scope.
+   * @param page_id id of page to be fetched
+   * @return a guard over the pinned and write-latched page, not valid if the page could not be fetched
+   */
+  WritePageGuard FetchPageWrite(page_id_t page_id);
+
+  /**
+   * Creates a new page in the buffer pool and wraps it in a guard that unpins it when it goes out of scope.
+   * @param[out] page_id id of created page
+   * @param size_class the size class of the new page
+   * @return a guard over the new page, not valid if no new page could be created
+   */
+  BasicPageGuard NewPageGuarded(page_id_t *page_id, PageSizeClass size_class = PageSizeClass::SMALL);
+
+  /**
+   * Takes a snapshot of the dirty page table for a checkpoint. Pages are dirty from the first logged change after
+   * they were last written to disk.
+   * @param[out] dirty_pages the recovery LSN of each dirty page, INVALID_LSN for pages that are only dirty because of
+   * changes that were not logged
+   */
+  void GetDirtyPageTable(std::unordered_map<page_id_t, lsn_t> *dirty_pages);
+
+  /**
+   * Writes a page to disk if it is dirty, in the background of a fuzzy checkpoint. Unlike FlushPage, the page is read
+   * latched, so the image on disk never has a half applied change, and the page is not written if it was evicted or
+   * written out since the dirty page table was taken.
+   * @param page_id id of the page to write
+   * @return true if the page was written
+   */
+  bool CheckpointPage(page_id_t page_id);
+
+  /**
+   * Installs a function that brings a page up to date when it is read from disk, for instant restart. It runs on the
+   * thread that fetches the page, with the page pinned and write latched, so no other thread sees the page before it
+   * is done. It must not fetch pages itself.
+   * @param handler returns true if it changed the page, nullptr to remove it
+   */
+  void SetPageRecoveryHandler(std::function<bool(Page *)> handler);
+
+  /** @return pointer to all the pages of the given size class in the buffer pool */
+  Page *GetPages(PageSizeClass size_class = PageSizeClass::SMALL) {
+    return frame_pools_[static_cast<size_t>(size_class)].pages_;
+  }
+
+  /** @return number of frames of the given size class in the buffer pool */
+  size_t GetPoolSize(PageSizeClass size_class = PageSizeClass::SMALL) {
+    return frame_pools_[static_cast<size_t>(size_class)].pool_size_;
+  }
 
  protected:
   /**
@@ -136,9 +224,10 @@ class BufferPoolManager {
   /**
    * Creates a new page in the buffer pool.
    * @param[out] page_id id of created page
+   * @param size_class the size class of the new page
    * @return nullptr if no new pages could be created, otherwise pointer to new page
    */
-  Page *NewPageImpl(page_id_t *page_id);
+  Page *NewPageImpl(page_id_t *page_id, PageSizeClass size_class = PageSizeClass::SMALL);
 
   /**
    * Deletes a page from the buffer pool.
@@ -152,21 +241,44 @@ class BufferPoolManager {
    */
   void FlushAllPagesImpl();
 
-  /** Number of pages in the buffer pool. */
-  size_t pool_size_;
-  /** Array of buffer pool pages. */
-  Page *pages_;
+  /** The frames of one page size class. */
+  struct FramePool {
+    /** Number of frames. */
+    size_t pool_size_{0};
+    /** Array of frames, each holding PageSizeOf() bytes of page data. */
+    Page *pages_{nullptr};
+    /** Replacer to find unpinned frames for replacement. */
+    Replacer *replacer_{nullptr};
+    /** List of free frames. */
+    std::list<frame_id_t> free_list_;
+  };
+
+  /** @return the frame pool holding pages of the size class encoded in page_id */
+  FramePool &GetFramePool(page_id_t page_id) { return frame_pools_[static_cast<size_t>(GetPageSizeClass(page_id))]; }
+
+  /** Writes a page to disk, after flushing the log up to the page LSN if logging is enabled. */
+  void WritePageToDisk(Page *page);
+
+  /**
+   * Finds a frame for a new page, from the free list first and the replacer otherwise. A dirty victim is written back
+   * and removed from the page table.
+   * @param pool the frame pool of the size class of the new page
+   * @param[out] frame_id the frame that can be reused
+   * @return false if all the frames of the pool are pinned
+   */
+  bool FindFrame(FramePool *pool, frame_id_t *frame_id);
+
+  /** Frames of each page size class, indexed by PageSizeClass. */
+  FramePool frame_pools_[NUM_PAGE_SIZE_CLASSES];
   /** Pointer to the disk manager. */
   DiskManager *disk_manager_ __attribute__((__unused__));
   /** Pointer to the log manager. */
-  LogManager *log_manager_ __attribute__((__unused__));
-  /** Page table for keeping track of buffer pool pages. */
+  LogManager *log_manager_;
+  /** Page table for keeping track of buffer pool pages. Frame ids index the frame pool of the page's size class. */
   std::unordered_map<page_id_t, frame_id_t> page_table_;
-  /** Replacer to find unpinned pages for replacement. */
-  Replacer *replacer_;
-  /** List of free pages. */
-  std::list<frame_id_t> free_list_;
-  /** This latch protects shared data structures. We recommend updating this comment to describe what it protects. */
+  /** Brings pages read from disk up to date while an instant restart is in progress, see SetPageRecoveryHandler(). */
+  std::function<bool(Page *)> page_recovery_handler_;
+  /** This latch protects the page table, the free lists and the page metadata (page id, pin count, dirty flag). */
   std::mutex latch_;
 };
 }  // namespace bustub
@@ -12,7 +12,6 @@
 
 #pragma once
 
-#include <list>
 #include <mutex>  // NOLINT
 #include <vector>
 
@@ -23,6 +22,9 @@ namespace bustub {
 
 /**
  * ClockReplacer implements the clock replacement policy, which approximates the Least Recently Used policy.
+ *
+ * Frames are arranged in a circle swept by the clock hand. Unpinning a frame sets its reference bit; the hand clears
+ * the reference bits it passes and victimizes the first frame in the replacer whose bit is already clear.
  */
 class ClockReplacer : public Replacer {
  public:
@@ -46,7 +48,15 @@ class ClockReplacer : public Replacer {
   size_t Size() override;
 
  private:
-  // TODO(student): implement me!
+  std::mutex latch_;
+  /** Whether each frame is in the replacer, indexed by frame id. */
+  std::vector<bool> in_replacer_;
+  /** Reference bit of each frame, indexed by frame id. */
+  std::vector<bool> referenced_;
+  /** Frame the clock hand points at. */
+  size_t hand_{0};
+  /** Number of frames in the replacer. */
+  size_t size_{0};
 };
 
 }  // namespace bustub
@@ -29,15 +29,35 @@ namespace bustub {
 class TransactionManager;
 
 /**
- * LockManager handles transactions asking for locks on records.
+ * LockManager handles transactions asking for locks on records and tables.
+ *
+ * Tables are locked in any LockMode but INCREMENT, records in SHARED, EXCLUSIVE or INCREMENT mode. A transaction that
+ * reads or writes many records of a table can lock the table instead of each record. Otherwise it announces its record
+ * locks with an intention lock on the table, see TableHeap.
+ *
+ * Any number of transactions may hold INCREMENT locks on a record at once, so counters that many transactions add to
+ * do not serialize them. What they add is undone by subtracting it again, see TableHeap::IncrementTuple(). Reading or
+ * writing a record a transaction increments upgrades its lock to EXCLUSIVE.
+ *
+ * The lock table is split into shards by the hash of the RID or table, each with its own latch, so that transactions
+ * locking different records rarely contend on a latch. The requests and queues of a shard are recycled, not freed.
+ *
+ * Under the DETECTION policy, a waiting request keeps its edges in the waits-for graph up to date each time it wakes
+ * up. A request that has waited for cycle_detection_interval searches the graph for a cycle through its transaction,
+ * so the cost of detection grows with the number of waiting transactions, not with the size of the lock table.
+ *
+ * A committing transaction releases its locks as soon as its COMMIT record is in the log buffer, see
+ * TransactionManager::Commit(). Each shard remembers the newest COMMIT record of a transaction that released a lock in
+ * it, and a transaction granted a lock in the shard depends on that record. A transaction that writes its own COMMIT
+ * record later is durable only after the records before it are; a read-only one waits for the record it depends on.
  */
 class LockManager {
-  enum class LockMode { SHARED, EXCLUSIVE };
-
   class LockRequest {
    public:
-    LockRequest(txn_id_t txn_id, LockMode lock_mode) : txn_id_(txn_id), lock_mode_(lock_mode), granted_(false) {}
+    LockRequest(Transaction *txn, LockMode lock_mode)
+        : txn_(txn), txn_id_(txn->GetTransactionId()), lock_mode_(lock_mode), granted_(false) {}
 
+    Transaction *txn_;
     txn_id_t txn_id_;
     LockMode lock_mode_;
     bool granted_;
@@ -50,22 +70,59 @@ class LockManager {
     bool upgrading_ = false;
   };
 
+  using RowLockTable = std::unordered_map<RID, LockRequestQueue>;
+
+  /** The lock table has 2^SHARD_BITS shards. */
+  static constexpr size_t SHARD_BITS = 6;
+  static constexpr size_t NUM_SHARDS = 1 << SHARD_BITS;
+  /** Number of empty queues a shard keeps for reuse. */
+  static constexpr size_t MAX_FREE_QUEUES = 1024;
+
+  /** A part of the lock table, on its own cache line so that the latches of different shards do not share one. */
+  struct alignas(64) LockTableShard {
+    std::mutex latch_;
+    /** Lock table for lock requests. */
+    RowLockTable lock_table_;
+    /** Lock requests on tables. There are few tables, so their queues are kept when they become empty. */
+    std::unordered_map<table_oid_t, LockRequestQueue> table_lock_table_;
+    /** Requests that were removed from their queues, ready to be reused. */
+    std::list<LockRequest> free_requests_;
+    /** Queues that became empty, ready to be reused for another RID. */
+    std::vector<RowLockTable::node_type> free_queues_;
+    /** The newest COMMIT record of a transaction that released a lock in this shard. */
+    lsn_t release_lsn_{INVALID_LSN};
+  };
+
  public:
+  /** Number of tuple locks on one table a transaction holds before they are escalated to a lock on the table. */
+  static constexpr size_t DEFAULT_ESCALATION_THRESHOLD = 1000;
+
   /**
-   * Creates a new lock manager configured for the deadlock detection policy.
+   * How deadlocks are dealt with. Under the prevention policies, a transaction is older than another if its id is
+   * smaller, and a request only waits for the transactions it conflicts with if they are all younger (WAIT_DIE) or all
+   * older (WOUND_WAIT) than it is, so no cycle of waiting transactions can form.
    */
-  LockManager() {
-    enable_cycle_detection_ = true;
-    cycle_detection_thread_ = new std::thread(&LockManager::RunCycleDetection, this);
-    LOG_INFO("Cycle detection thread launched");
-  }
+  enum class DeadlockMode {
+    /** Requests wait, one that waited for cycle_detection_interval looks for a cycle and aborts the newest waiter. */
+    DETECTION,
+    /** An older requester aborts the younger transactions it conflicts with, a younger requester waits. */
+    WOUND_WAIT,
+    /** An older requester waits, a younger requester that conflicts with an older transaction is aborted. */
+    WAIT_DIE
+  };
 
-  ~LockManager() {
-    enable_cycle_detection_ = false;
-    cycle_detection_thread_->join();
-    delete cycle_detection_thread_;
-    LOG_INFO("Cycle detection thread stopped");
-  }
+  /**
+   * Creates a new lock manager.
+   * @param deadlock_mode how deadlocks are dealt with
+   * @param escalation_threshold number of tuple locks on one table a transaction holds before they are escalated to a
+   * lock on the table, 0 to never escalate
+   */
+  explicit LockManager(DeadlockMode deadlock_mode = DeadlockMode::DETECTION,
+                       size_t escalation_threshold = DEFAULT_ESCALATION_THRESHOLD)
+      : deadlock_mode_(deadlock_mode), escalation_threshold_(escalation_threshold) {}
+
+  /** @return how deadlocks are dealt with */
+  inline DeadlockMode GetDeadlockMode() const { return deadlock_mode_; }
 
   /*
    * [LOCK_NOTE]: For all locking functions, we:
@@ -92,9 +149,27 @@ class LockManager {
   bool LockExclusive(Transaction *txn, const RID &rid);
 
   /**
-   * Upgrade a lock from a shared lock to an exclusive lock.
+   * Acquire a lock on RID in exclusive mode if it is granted at once, without waiting. The transaction must not hold a
+   * lock on RID yet.
+   * @param txn the transaction requesting the exclusive lock
+   * @param rid the RID to be locked in exclusive mode
+   * @return true if the lock is granted, false if it would have had to wait or the transaction is aborted
+   */
+  bool TryLockExclusive(Transaction *txn, const RID &rid);
+
+  /**
+   * Acquire a lock on RID in increment mode, which only conflicts with shared and exclusive locks. A transaction that
+   * holds a shared lock on RID upgrades it to an exclusive lock. See [LOCK_NOTE] in header file.
+   * @param txn the transaction requesting the increment lock
+   * @param rid the RID to be locked in increment mode
+   * @return true if the lock is granted, false otherwise
+   */
+  bool LockIncrement(Transaction *txn, const RID &rid);
+
+  /**
+   * Upgrade a lock from a shared or increment lock to an exclusive lock.
    * @param txn the transaction requesting the lock upgrade
-   * @param rid the RID that should already be locked in shared mode by the requesting transaction
+   * @param rid the RID that should already be locked in shared or increment mode by the requesting transaction
    * @return true if the upgrade is successful, false otherwise
    */
   bool LockUpgrade(Transaction *txn, const RID &rid);
@@ -107,6 +182,86 @@ class LockManager {
    */
   bool Unlock(Transaction *txn, const RID &rid);
 
+  /**
+   * Acquire a lock on a tuple of a table in shared mode, after an INTENTION_SHARED lock on the table. The tuple is not
+   * locked if the lock of the transaction on the table covers it. See [LOCK_NOTE] and [ESCALATION_NOTE].
+   * @param txn the transaction requesting the shared lock
+   * @param table_oid the table of the tuple
+   * @param rid the RID to be locked in shared mode
+   * @return true if the lock is granted, false otherwise
+   */
+  bool LockShared(Transaction *txn, table_oid_t table_oid, const RID &rid);
+
+  /**
+   * Acquire a lock on a tuple of a table in exclusive mode, after an INTENTION_EXCLUSIVE lock on the table. The tuple
+   * is not locked if the lock of the transaction on the table covers it. See [LOCK_NOTE] and [ESCALATION_NOTE].
+   * @param txn the transaction requesting the exclusive lock
+   * @param table_oid the table of the tuple
+   * @param rid the RID to be locked in exclusive mode
+   * @return true if the lock is granted, false otherwise
+   */
+  bool LockExclusive(Transaction *txn, table_oid_t table_oid, const RID &rid);
+
+  /**
+   * Acquire a lock on a tuple of a table in increment mode, after an INTENTION_EXCLUSIVE lock on the table. The tuple
+   * is not locked if the lock of the transaction on the table covers it. See [LOCK_NOTE] and [ESCALATION_NOTE].
+   * @param txn the transaction requesting the increment lock
+   * @param table_oid the table of the tuple
+   * @param rid the RID to be locked in increment mode
+   * @return true if the lock is granted, false otherwise
+   */
+  bool LockIncrement(Transaction *txn, table_oid_t table_oid, const RID &rid);
+
+  /**
+   * Release the lock held by the transaction on a tuple of a table.
+   * @param txn the transaction releasing the lock
+   * @param table_oid the table of the tuple
+   * @param rid the RID that is locked by the transaction
+   * @return true if the unlock is successful, false otherwise
+   */
+  bool Unlock(Transaction *txn, table_oid_t table_oid, const RID &rid);
+
+  /*
+   * [ESCALATION_NOTE]: Each time the number of tuples a transaction locked through these functions on one table
+   * reaches a multiple of the escalation threshold, we try to trade them for one lock on the table: SHARED if the
+   * transaction only reads them, EXCLUSIVE if it changes or increments any. The escalation only happens if the table
+   * lock is granted without waiting, so it never causes a deadlock.
+   */
+
+  /**
+   * Acquire a lock on a table. A transaction that holds a lock on the table already upgrades it to the weakest mode
+   * that covers both modes. See [LOCK_NOTE] in header file.
+   * @param txn the transaction requesting the lock
+   * @param table_oid the table to be locked
+   * @param lock_mode the mode of the lock, READ_UNCOMMITTED transactions only take INTENTION_EXCLUSIVE and EXCLUSIVE
+   * @return true if the lock is granted, false otherwise
+   */
+  bool LockTable(Transaction *txn, table_oid_t table_oid, LockMode lock_mode);
+
+  /**
+   * Release the lock held by the transaction on a table.
+   * @param txn the transaction releasing the lock, it should actually hold the lock
+   * @param table_oid the table that is locked by the transaction
+   * @return true if the unlock is successful, false otherwise
+   */
+  bool UnlockTable(Transaction *txn, table_oid_t table_oid);
+
+  /**
+   * Makes SHARED, SHARED_INTENTION_EXCLUSIVE and EXCLUSIVE table locks wait until ResumeTableLocks(), and keeps
+   * escalation from taking them. Recovery does this while stand-ins of the losers hold tuple locks without holding
+   * intention locks on the tables, which those table locks would pass.
+   */
+  void BlockTableLocks();
+
+  /** Lets the table locks blocked by BlockTableLocks() go ahead. */
+  void ResumeTableLocks();
+
+  /** @return true if a lock in mode held gives all the access a lock in mode lock_mode gives */
+  static bool Covers(LockMode held, LockMode lock_mode);
+
+  /** @return true if two transactions may hold locks in these modes on the same table or record at once */
+  static bool AreCompatible(LockMode mode1, LockMode mode2);
+
   /*** Graph API ***/
   /**
    * Adds edge t1->t2
@@ -128,18 +283,157 @@ class LockManager {
   /** @return the set of all edges in the graph, used for testing only! */
   std::vector<std::pair<txn_id_t, txn_id_t>> GetEdgeList();
 
-  /** Runs cycle detection in the background. */
-  void RunCycleDetection();
-
  private:
-  std::mutex latch_;
-  std::atomic<bool> enable_cycle_detection_;
-  std::thread *cycle_detection_thread_;
+  /** @return the shard of the lock table that holds the queue of rid */
+  LockTableShard *GetShard(const RID &rid) { return GetShard(std::hash<RID>()(rid)); }
+
+  /** @return the shard of the lock table that holds the queue of a table */
+  LockTableShard *GetShard(table_oid_t table_oid) { return GetShard(std::hash<table_oid_t>()(table_oid)); }
+
+  LockTableShard *GetShard(size_t hash) {
+    // Fibonacci hashing, the top bits of the product depend on all the bits of the hash.
+    return &shards_[(hash * 0x9E3779B97F4A7C15ULL) >> (64 - SHARD_BITS)];
+  }
+
+  /**
+   * Checks the state of a transaction that asks for a lock.
+   * @return false if the transaction is aborted already, throws if it may not take locks
+   */
+  static bool CheckCanLock(Transaction *txn);
+
+  /** Records a lock on a tuple of a table, and escalates the locks of the transaction on the table if need be. */
+  void TrackRowLock(Transaction *txn, table_oid_t table_oid, const RID &rid);
+
+  /** @return true if a lock on a table was granted at once, false if it would have had to wait */
+  bool TryLockTable(Transaction *txn, table_oid_t table_oid, LockMode lock_mode);
+
+  /** Waits until a table lock in mode lock_mode is not blocked by BlockTableLocks(). */
+  void WaitForTableLocks(LockMode lock_mode);
+
+  /** Releases a tuple lock without ending the growing phase of its transaction. */
+  void ReleaseRowLock(Transaction *txn, const RID &rid);
+
+  /** Aborts a transaction that may not have a lock it asked for. */
+  [[noreturn]] static void AbortTransaction(Transaction *txn, AbortReason reason);
 
-  /** Lock table for lock requests. */
-  std::unordered_map<RID, LockRequestQueue> lock_table_;
-  /** Waits-for graph representation. */
+  /** @return the queue of rid, taken from the recycled queues of the shard if rid has none yet */
+  static RowLockTable::iterator GetQueue(LockTableShard *shard, const RID &rid);
+
+  /**
+   * Adds a request to the end of a queue, reusing a removed request of the shard if there is one.
+   * @param shard the shard of the queue, latched
+   * @return the new request, not granted yet
+   */
+  static std::list<LockRequest>::iterator AddRequest(LockTableShard *shard, LockRequestQueue *queue, Transaction *txn,
+                                                     LockMode lock_mode);
+
+  /**
+   * Upgrades a granted request to a stronger mode, ahead of the requests that wait, and waits until it is granted.
+   * @param lock the latch of the shard of the request, held
+   * @return true if the upgrade was granted, false if the transaction was aborted and the request is still queued
+   */
+  bool UpgradeRequest(std::unique_lock<std::mutex> *lock, LockTableShard *shard, LockRequestQueue *queue,
+                      std::list<LockRequest>::iterator request, LockMode lock_mode);
+
+  /**
+   * Waits until a request is granted, or its transaction is aborted on deadlock.
+   * @param lock the latch of the shard of the request, held
+   * @return true if the request was granted, false if the transaction was aborted and the request is still queued
+   */
+  bool WaitForGrant(std::unique_lock<std::mutex> *lock, LockTableShard *shard, LockRequestQueue *queue,
+                    std::list<LockRequest>::iterator request);
+
+  /**
+   * Applies the WOUND_WAIT or WAIT_DIE policy to a request that cannot be granted yet. Aborts the transaction of the
+   * request if it has to die, or else the younger transactions it conflicts with if it wounds them.
+   * @param[out] wounded the wounded transactions that wait in other queues than this one, and must be woken up
+   * @return false if the transaction of the request was aborted
+   */
+  bool PreventDeadlock(LockRequestQueue *queue, std::list<LockRequest>::iterator request,
+                       std::vector<txn_id_t> *wounded);
+
+  /**
+   * Under DETECTION, sets the edges of a waiting request in the waits-for graph to the requests it waits for.
+   * @param shard the shard of the queue, latched
+   */
+  void SetWaitsFor(LockTableShard *shard, LockRequestQueue *queue, std::list<LockRequest>::const_iterator request);
+
+  /**
+   * Looks for a cycle of waiting transactions through a transaction, and aborts the newest one in the cycle.
+   * @param[out] victim the aborted transaction
+   * @return true if there was a cycle
+   */
+  bool DetectDeadlock(txn_id_t txn_id, txn_id_t *victim);
+
+  /** Wakes up an aborted transaction if it waits for a lock, so that it sees it was aborted. */
+  void WakeUp(txn_id_t txn_id);
+
+  /**
+   * @return true if a request is compatible with the granted requests and with the requests before it in its queue,
+   * requests are granted in order unless they are compatible with the ones they pass
+   */
+  static bool IsGrantable(const LockRequestQueue &queue, std::list<LockRequest>::const_iterator request);
+
+  /**
+   * Grants a request, which makes its transaction depend on the commits that released locks in the shard before.
+   * @param shard the shard of the request, latched
+   */
+  static void GrantRequest(LockTableShard *shard, std::list<LockRequest>::iterator request);
+
+  /**
+   * Removes a request from its queue, and wakes up the requests that may be granted now. A request of a committed
+   * transaction leaves its COMMIT record for the transactions granted a lock in the shard afterwards.
+   */
+  static void RemoveRequest(LockTableShard *shard, LockRequestQueue *queue, std::list<LockRequest>::iterator request);
+
+  /** Removes a request from the queue of a RID, and recycles the queue if it became empty. */
+  static void RemoveRowRequest(LockTableShard *shard, RowLockTable::iterator queue,
+                               std::list<LockRequest>::iterator request);
+
+  /** @return the request of a transaction in a queue */
+  static std::list<LockRequest>::iterator FindRequest(LockRequestQueue *queue, Transaction *txn);
+
+  /**
+   * Looks for a cycle in a waits-for graph, visiting transactions in the order of their ids.
+   * @param[out] txn_id the newest transaction in the cycle
+   * @return true if the graph has a cycle
+   */
+  static bool FindCycle(const std::unordered_map<txn_id_t, std::vector<txn_id_t>> &waits_for, txn_id_t *txn_id);
+
+  /**
+   * Looks for a cycle in a waits-for graph that goes through one transaction, following only the edges reachable from
+   * it.
+   * @param[out] victim the newest transaction in the cycle
+   * @return true if the graph has such a cycle
+   */
+  static bool FindCycleThrough(const std::unordered_map<txn_id_t, std::vector<txn_id_t>> &waits_for, txn_id_t txn_id,
+                               txn_id_t *victim);
+
+  const DeadlockMode deadlock_mode_;
+  /** See [ESCALATION_NOTE]. */
+  const size_t escalation_threshold_;
+
+  LockTableShard shards_[NUM_SHARDS];
+
+  /** A transaction that waits for a lock, and where it waits. */
+  struct Waiter {
+    Transaction *txn_;
+    LockTableShard *shard_;
+    LockRequestQueue *queue_;
+  };
+
+  /** Protects waits_for_ and waiting_. Taken after the latch of a shard, never before one. */
+  std::mutex waits_for_latch_;
+  /** Waits-for graph, kept up to date by the waiting requests under DETECTION. */
   std::unordered_map<txn_id_t, std::vector<txn_id_t>> waits_for_;
+  /** Under DETECTION and WOUND_WAIT, the transactions that wait for a lock, for aborting and waking them up. */
+  std::unordered_map<txn_id_t, Waiter> waiting_;
+
+  /** Protects table_locks_blocked_. */
+  std::mutex table_locks_latch_;
+  std::condition_variable table_locks_cv_;
+  /** True between BlockTableLocks() and ResumeTableLocks(). */
+  bool table_locks_blocked_{false};
 };
 
 }  // namespace bustub
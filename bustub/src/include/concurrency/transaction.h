@@ -12,11 +12,13 @@
 
 #pragma once
 
+#include <algorithm>
 #include <atomic>
 #include <deque>
 #include <memory>
 #include <string>
 #include <thread>  // NOLINT
+#include <unordered_map>
 #include <unordered_set>
 
 #include "common/config.h"
@@ -44,19 +46,37 @@ namespace bustub {
 enum class TransactionState { GROWING, SHRINKING, COMMITTED, ABORTED };
 
 /**
- * Transaction isolation level.
+ * Transaction isolation level. SNAPSHOT_ISOLATION reads the tuples as they were when the transaction began, without
+ * locks, and aborts a write to a tuple that changed since then. Its writes are locked like the other levels.
  */
-enum class IsolationLevel { READ_UNCOMMITTED, REPEATABLE_READ, READ_COMMITTED };
+enum class IsolationLevel { READ_UNCOMMITTED, REPEATABLE_READ, READ_COMMITTED, SNAPSHOT_ISOLATION };
+
+/**
+ * How a transaction keeps out of the way of the others. LOCKING transactions lock the tuples they access, in their
+ * isolation level. OPTIMISTIC transactions read a snapshot without locks, buffer their updates and deletes, and at
+ * commit validate that no tuple they read changed since they began, see TransactionManager.
+ */
+enum class ConcurrencyMode { LOCKING, OPTIMISTIC };
+
+/**
+ * Lock modes. Tables are locked in any mode other than INCREMENT, records in SHARED, EXCLUSIVE or INCREMENT mode. The
+ * intention modes announce locks on records of the table, SHARED_INTENTION_EXCLUSIVE is a SHARED lock together with an
+ * INTENTION_EXCLUSIVE lock. INCREMENT lets a transaction add to the numeric fields of a record, which commutes with the
+ * increments of other transactions, so INCREMENT locks only go with each other.
+ */
+enum class LockMode { SHARED, EXCLUSIVE, INTENTION_SHARED, INTENTION_EXCLUSIVE, SHARED_INTENTION_EXCLUSIVE, INCREMENT };
 
 /**
  * Type of write operation.
  */
-enum class WType { INSERT = 0, DELETE, UPDATE };
+enum class WType { INSERT = 0, DELETE, UPDATE, INCREMENT };
 
 class TableHeap;
 class Catalog;
 using table_oid_t = uint32_t;
 using index_oid_t = uint32_t;
+/** Commit timestamps order the committed versions of tuples, see TransactionManager. */
+using timestamp_t = uint64_t;
 
 /**
  * WriteRecord tracks information related to a write.
@@ -66,12 +86,20 @@ class TableWriteRecord {
   TableWriteRecord(RID rid, WType wtype, const Tuple &tuple, TableHeap *table)
       : rid_(rid), wtype_(wtype), tuple_(tuple), table_(table) {}
 
+  /** Constructor for the increment operation, which is undone by subtracting the delta. */
+  TableWriteRecord(RID rid, uint32_t offset, const Value &delta, TableHeap *table)
+      : rid_(rid), wtype_(WType::INCREMENT), table_(table), offset_(offset), delta_(delta) {}
+
   RID rid_;
   WType wtype_;
   /** The tuple is only used for the update operation. */
   Tuple tuple_;
   /** The table heap specifies which table this write record is for. */
   TableHeap *table_;
+  /** The offset of the incremented field in the tuple, only used for the increment operation. */
+  uint32_t offset_{0};
+  /** The value added to the field, only used for the increment operation. */
+  Value delta_;
 };
 
 /**
@@ -107,7 +135,8 @@ enum class AbortReason {
   UNLOCK_ON_SHRINKING,
   UPGRADE_CONFLICT,
   DEADLOCK,
-  LOCKSHARED_ON_READ_UNCOMMITTED
+  LOCKSHARED_ON_READ_UNCOMMITTED,
+  VALIDATION_FAILED
 };
 
 /**
@@ -137,6 +166,9 @@ class TransactionAbortException : public std::exception {
         return "Transaction " + std::to_string(txn_id_) + " aborted on deadlock\n";
       case AbortReason::LOCKSHARED_ON_READ_UNCOMMITTED:
         return "Transaction " + std::to_string(txn_id_) + " aborted on lockshared on READ_UNCOMMITTED\n";
+      case AbortReason::VALIDATION_FAILED:
+        return "Transaction " + std::to_string(txn_id_) +
+               " aborted because a tuple it read changed after it began, or one of its writes did not apply\n";
     }
     // Todo: Should fail with unreachable.
     return "";
@@ -153,15 +185,7 @@ class Transaction {
         isolation_level_(isolation_level),
         thread_id_(std::this_thread::get_id()),
         txn_id_(txn_id),
-        prev_lsn_(INVALID_LSN),
-        shared_lock_set_{new std::unordered_set<RID>},
-        exclusive_lock_set_{new std::unordered_set<RID>} {
-    // Initialize the sets that will be tracked.
-    table_write_set_ = std::make_shared<std::deque<TableWriteRecord>>();
-    index_write_set_ = std::make_shared<std::deque<IndexWriteRecord>>();
-    page_set_ = std::make_shared<std::deque<bustub::Page *>>();
-    deleted_page_set_ = std::make_shared<std::unordered_set<page_id_t>>();
-  }
+        prev_lsn_(INVALID_LSN) {}
 
   ~Transaction() = default;
 
@@ -177,20 +201,28 @@ class Transaction {
   inline IsolationLevel GetIsolationLevel() const { return isolation_level_; }
 
   /** @return the list of table write records of this transaction */
-  inline std::shared_ptr<std::deque<TableWriteRecord>> GetWriteSet() { return table_write_set_; }
+  inline std::shared_ptr<std::deque<TableWriteRecord>> GetWriteSet() { return Allocated(&table_write_set_); }
+
+  /** @return the tuples an OPTIMISTIC transaction read, with their tables, to be validated at commit */
+  inline std::shared_ptr<std::unordered_map<RID, TableHeap *>> GetTableReadSet() { return Allocated(&table_read_set_); }
+
+  /** @return the last update or delete of each tuple that an OPTIMISTIC transaction holds back until it commits */
+  inline std::shared_ptr<std::unordered_map<RID, TableWriteRecord>> GetBufferedWriteSet() {
+    return Allocated(&buffered_write_set_);
+  }
 
   /** @return the list of index write records of this transaction */
-  inline std::shared_ptr<std::deque<IndexWriteRecord>> GetIndexWriteSet() { return index_write_set_; }
+  inline std::shared_ptr<std::deque<IndexWriteRecord>> GetIndexWriteSet() { return Allocated(&index_write_set_); }
 
   /** @return the page set */
-  inline std::shared_ptr<std::deque<Page *>> GetPageSet() { return page_set_; }
+  inline std::shared_ptr<std::deque<Page *>> GetPageSet() { return Allocated(&page_set_); }
 
   /**
    * Adds a tuple write record into the table write set.
    * @param write_record write record to be added
    */
   inline void AppendTableWriteRecord(const TableWriteRecord &write_record) {
-    table_write_set_->push_back(write_record);
+    Allocated(&table_write_set_)->push_back(write_record);
   }
 
   /**
@@ -198,35 +230,81 @@ class Transaction {
    * @param write_record write record to be added
    */
   inline void AppendTableWriteRecord(const IndexWriteRecord &write_record) {
-    index_write_set_->push_back(write_record);
+    Allocated(&index_write_set_)->push_back(write_record);
   }
 
   /**
    * Adds a page into the page set.
    * @param page page to be added
    */
-  inline void AddIntoPageSet(Page *page) { page_set_->push_back(page); }
+  inline void AddIntoPageSet(Page *page) { Allocated(&page_set_)->push_back(page); }
 
   /** @return the deleted page set */
-  inline std::shared_ptr<std::unordered_set<page_id_t>> GetDeletedPageSet() { return deleted_page_set_; }
+  inline std::shared_ptr<std::unordered_set<page_id_t>> GetDeletedPageSet() { return Allocated(&deleted_page_set_); }
 
   /**
    * Adds a page to the deleted page set.
    * @param page_id id of the page to be marked as deleted
    */
-  inline void AddIntoDeletedPageSet(page_id_t page_id) { deleted_page_set_->insert(page_id); }
+  inline void AddIntoDeletedPageSet(page_id_t page_id) { Allocated(&deleted_page_set_)->insert(page_id); }
 
   /** @return the set of resources under a shared lock */
-  inline std::shared_ptr<std::unordered_set<RID>> GetSharedLockSet() { return shared_lock_set_; }
+  inline std::shared_ptr<std::unordered_set<RID>> GetSharedLockSet() { return Allocated(&shared_lock_set_); }
 
   /** @return the set of resources under an exclusive lock */
-  inline std::shared_ptr<std::unordered_set<RID>> GetExclusiveLockSet() { return exclusive_lock_set_; }
+  inline std::shared_ptr<std::unordered_set<RID>> GetExclusiveLockSet() { return Allocated(&exclusive_lock_set_); }
 
   /** @return true if rid is shared locked by this transaction */
-  bool IsSharedLocked(const RID &rid) { return shared_lock_set_->find(rid) != shared_lock_set_->end(); }
+  bool IsSharedLocked(const RID &rid) { return shared_lock_set_ != nullptr && shared_lock_set_->count(rid) != 0; }
+
+  /** @return the set of resources under an increment lock */
+  inline std::shared_ptr<std::unordered_set<RID>> GetIncrementLockSet() { return Allocated(&increment_lock_set_); }
 
   /** @return true if rid is exclusively locked by this transaction */
-  bool IsExclusiveLocked(const RID &rid) { return exclusive_lock_set_->find(rid) != exclusive_lock_set_->end(); }
+  bool IsExclusiveLocked(const RID &rid) {
+    return exclusive_lock_set_ != nullptr && exclusive_lock_set_->count(rid) != 0;
+  }
+
+  /** @return true if rid is increment locked by this transaction */
+  bool IsIncrementLocked(const RID &rid) {
+    return increment_lock_set_ != nullptr && increment_lock_set_->count(rid) != 0;
+  }
+
+  /** @return true if this transaction holds a lock on a tuple or a table */
+  bool HoldsLocks() const {
+    return !IsEmpty(shared_lock_set_) || !IsEmpty(exclusive_lock_set_) || !IsEmpty(increment_lock_set_) ||
+           !IsEmpty(table_lock_set_);
+  }
+
+  /** @return true if this transaction changed a tuple */
+  bool HasTableWrites() const { return !IsEmpty(table_write_set_); }
+
+  /** @return the tables locked by this transaction, with the mode of each lock */
+  inline std::shared_ptr<std::unordered_map<table_oid_t, LockMode>> GetTableLockSet() {
+    return Allocated(&table_lock_set_);
+  }
+
+  /** @return the tuples of each table that this transaction locked through the table, see LockManager */
+  inline std::shared_ptr<std::unordered_map<table_oid_t, std::unordered_set<RID>>> GetTableRowLockSet() {
+    return Allocated(&table_row_lock_set_);
+  }
+
+  /**
+   * @param table_oid a table
+   * @param[out] lock_mode the mode this transaction locked the table in
+   * @return true if the table is locked by this transaction
+   */
+  bool IsTableLocked(table_oid_t table_oid, LockMode *lock_mode) {
+    if (table_lock_set_ == nullptr) {
+      return false;
+    }
+    auto lock = table_lock_set_->find(table_oid);
+    if (lock == table_lock_set_->end()) {
+      return false;
+    }
+    *lock_mode = lock->second;
+    return true;
+  }
 
   /** @return the current state of the transaction */
   inline TransactionState GetState() { return state_; }
@@ -237,6 +315,22 @@ class Transaction {
    */
   inline void SetState(TransactionState state) { state_ = state; }
 
+  /**
+   * Set the state of the transaction, unless it already committed or aborted. Other transactions abort it this way,
+   * so that it does not both commit and get aborted.
+   * @param state new state
+   * @return false if the transaction already committed or aborted
+   */
+  inline bool TransitionState(TransactionState state) {
+    TransactionState current = state_;
+    while (current == TransactionState::GROWING || current == TransactionState::SHRINKING) {
+      if (state_.compare_exchange_weak(current, state)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
   /** @return the previous LSN */
   inline lsn_t GetPrevLSN() { return prev_lsn_; }
 
@@ -246,9 +340,91 @@ class Transaction {
    */
   inline void SetPrevLSN(lsn_t prev_lsn) { prev_lsn_ = prev_lsn; }
 
+  /** @return the LSN of the BEGIN record of the transaction */
+  inline lsn_t GetFirstLSN() const { return first_lsn_; }
+
+  /**
+   * Set the LSN of the BEGIN record.
+   * @param first_lsn the LSN of the BEGIN record
+   */
+  inline void SetFirstLSN(lsn_t first_lsn) { first_lsn_ = first_lsn; }
+
+  /** @return the newest COMMIT record this transaction depends on, see LockManager */
+  inline lsn_t GetDependencyLSN() const { return dependency_lsn_; }
+
+  /**
+   * Make the transaction depend on a COMMIT record that may not be on disk yet.
+   * @param lsn the LSN of the COMMIT record, ignored if the transaction depends on a newer one already
+   */
+  inline void AddDependencyLSN(lsn_t lsn) { dependency_lsn_ = std::max(dependency_lsn_, lsn); }
+
+  /** @return the commit timestamp of the newest versions that a transaction reading a snapshot reads */
+  inline timestamp_t GetReadTs() const { return read_ts_; }
+
+  /**
+   * Set the snapshot the transaction reads.
+   * @param read_ts the commit timestamp of the last transaction that committed before this one began
+   */
+  inline void SetReadTs(timestamp_t read_ts) { read_ts_ = read_ts; }
+
+  /** @return how the transaction keeps out of the way of the others */
+  inline ConcurrencyMode GetConcurrencyMode() const { return concurrency_mode_; }
+
+  /**
+   * Set how the transaction keeps out of the way of the others, before it accesses any tuple.
+   * @param concurrency_mode the new mode
+   */
+  inline void SetConcurrencyMode(ConcurrencyMode concurrency_mode) { concurrency_mode_ = concurrency_mode; }
+
+  /** @return true if the transaction was begun with TransactionManager::BeginReadOnly() */
+  inline bool IsReadOnly() const { return read_only_; }
+
+  /**
+   * Declare that the transaction changes nothing, before it begins.
+   * @param read_only true if the transaction only reads
+   */
+  inline void SetReadOnly(bool read_only) { read_only_ = read_only; }
+
+  /**
+   * @return true if the transaction reads the tuples as of its read timestamp, without locking them. A read-only
+   * READ_COMMITTED transaction reads a snapshot too, as it sees only committed changes.
+   */
+  inline bool ReadsSnapshot() const {
+    return isolation_level_ == IsolationLevel::SNAPSHOT_ISOLATION || concurrency_mode_ == ConcurrencyMode::OPTIMISTIC ||
+           (read_only_ && isolation_level_ == IsolationLevel::READ_COMMITTED);
+  }
+
+  /** @return true if committing this transaction does not wait for its COMMIT record to be on disk */
+  inline bool IsAsyncCommit() const { return async_commit_; }
+
+  /**
+   * Set whether committing this transaction waits for its COMMIT record to be on disk. An asynchronous commit can be
+   * lost by a crash, but recovery never sees part of it.
+   * @param async_commit true to return from commit as soon as the COMMIT record is in the log buffer
+   */
+  inline void SetAsyncCommit(bool async_commit) { async_commit_ = async_commit; }
+
  private:
-  /** The current transaction state. */
-  TransactionState state_;
+  /**
+   * Allocates a set of the transaction the first time it is used. Most transactions use few of the sets, and one that
+   * only reads a snapshot may use none. The sets are only used by the thread running the transaction.
+   */
+  template <typename Set>
+  static const std::shared_ptr<Set> &Allocated(std::shared_ptr<Set> *set) {
+    if (*set == nullptr) {
+      *set = std::make_shared<Set>();
+    }
+    return *set;
+  }
+
+  /** @return true if the set was never allocated or is empty */
+  template <typename Set>
+  static bool IsEmpty(const std::shared_ptr<Set> &set) {
+    return set == nullptr || set->empty();
+  }
+
+  /** The current transaction state. Another transaction may set it to ABORTED, see LockManager::DeadlockMode. */
+  std::atomic<TransactionState> state_;
   /** The isolation level of the transaction. */
   IsolationLevel isolation_level_;
   /** The thread ID, used in single-threaded transactions. */
@@ -258,10 +434,26 @@ class Transaction {
 
   /** The undo set of table tuples. */
   std::shared_ptr<std::deque<TableWriteRecord>> table_write_set_;
+  /** OCC: the tuples read, validated at commit. */
+  std::shared_ptr<std::unordered_map<RID, TableHeap *>> table_read_set_;
+  /** OCC: the updates and deletes applied at commit. */
+  std::shared_ptr<std::unordered_map<RID, TableWriteRecord>> buffered_write_set_;
   /** The undo set of indexes. */
   std::shared_ptr<std::deque<IndexWriteRecord>> index_write_set_;
-  /** The LSN of the last record written by the transaction. */
-  lsn_t prev_lsn_;
+  /** The LSN of the last record written by the transaction, read by checkpoints while the transaction runs. */
+  std::atomic<lsn_t> prev_lsn_;
+  /** The LSN of the first record written by the transaction. */
+  lsn_t first_lsn_{INVALID_LSN};
+  /** The newest COMMIT record of a transaction that gave a lock to this one before the record was on disk. */
+  lsn_t dependency_lsn_{INVALID_LSN};
+  /** True if commit does not wait for the log flush. */
+  bool async_commit_{false};
+  /** The snapshot of a transaction that reads one. */
+  timestamp_t read_ts_{0};
+  /** How the transaction keeps out of the way of the others. */
+  ConcurrencyMode concurrency_mode_{ConcurrencyMode::LOCKING};
+  /** True if the transaction may not change anything. */
+  bool read_only_{false};
 
   /** Concurrent index: the pages that were latched during index operation. */
   std::shared_ptr<std::deque<Page *>> page_set_;
@@ -272,6 +464,12 @@ class Transaction {
   std::shared_ptr<std::unordered_set<RID>> shared_lock_set_;
   /** LockManager: the set of exclusive-locked tuples held by this transaction. */
   std::shared_ptr<std::unordered_set<RID>> exclusive_lock_set_;
+  /** LockManager: the set of increment-locked tuples held by this transaction. */
+  std::shared_ptr<std::unordered_set<RID>> increment_lock_set_;
+  /** LockManager: the tables locked by this transaction. */
+  std::shared_ptr<std::unordered_map<table_oid_t, LockMode>> table_lock_set_;
+  /** LockManager: the locked tuples of each table, counted towards lock escalation. */
+  std::shared_ptr<std::unordered_map<table_oid_t, std::unordered_set<RID>>> table_row_lock_set_;
 };
 
 }  // namespace bustub
@@ -13,8 +13,12 @@
 #pragma once
 
 #include <atomic>
+#include <condition_variable>  // NOLINT
+#include <mutex>  // NOLINT
+#include <set>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 #include "common/config.h"
 #include "concurrency/lock_manager.h"
@@ -26,11 +30,21 @@ class LockManager;
 
 /**
  * TransactionManager keeps track of all the transactions running in the system.
+ *
+ * Each transaction that changed tuples gets a commit timestamp when it commits, and its changes become visible to the
+ * SNAPSHOT_ISOLATION transactions that begin afterwards, all at once. A snapshot reads the tuples as of the last commit
+ * timestamp handed out before it began.
+ *
+ * In OPTIMISTIC mode, the transactions read a snapshot without locks and buffer their updates and deletes. To commit, a
+ * transaction locks the tuples it changes, then checks that none of the tuples it read got a version committed after
+ * its snapshot, and installs its changes and takes its commit timestamp. Validation and installation run one
+ * transaction at a time, so each transaction sees the commits validated before it.
  */
 class TransactionManager {
  public:
-  explicit TransactionManager(LockManager *lock_manager, LogManager *log_manager = nullptr)
-      : lock_manager_(lock_manager), log_manager_(log_manager) {}
+  explicit TransactionManager(LockManager *lock_manager, LogManager *log_manager = nullptr,
+                              ConcurrencyMode concurrency_mode = ConcurrencyMode::LOCKING)
+      : lock_manager_(lock_manager), log_manager_(log_manager), concurrency_mode_(concurrency_mode) {}
 
   ~TransactionManager() = default;
 
@@ -43,36 +57,90 @@ class TransactionManager {
   Transaction *Begin(Transaction *txn = nullptr, IsolationLevel isolation_level = IsolationLevel::REPEATABLE_READ);
 
   /**
-   * Commits a transaction.
+   * Begins a transaction that only reads. It writes no log records, is not registered, and does not hold back
+   * checkpoints. Under SNAPSHOT_ISOLATION or READ_COMMITTED it reads a snapshot and takes no locks, otherwise it locks
+   * like other transactions of its isolation level. Changing a table aborts it.
+   * @param txn an optional transaction object to be initialized, otherwise a new transaction is created.
+   * @param isolation_level an optional isolation level of the transaction.
+   * @return an initialized transaction
+   */
+  Transaction *BeginReadOnly(Transaction *txn = nullptr,
+                             IsolationLevel isolation_level = IsolationLevel::SNAPSHOT_ISOLATION);
+
+  /**
+   * Commits a transaction. Unless the transaction is set to commit asynchronously, this returns once the COMMIT record
+   * is on disk, or for a read-only transaction the COMMIT records it depends on. The locks are released as soon as the
+   * COMMIT record is in the log buffer. Afterwards txn->GetPrevLSN() is the LSN of the COMMIT record.
    * @param txn the transaction to commit
+   * @throw TransactionAbortException if an OPTIMISTIC transaction fails validation, or the transaction was already
+   * aborted by deadlock prevention, it is aborted by then
    */
   void Commit(Transaction *txn);
 
   /**
-   * Aborts a transaction
-   * @param txn the transaction to abort
+   * Blocks until a transaction that committed asynchronously is durable.
+   * @param commit_lsn the LSN of the COMMIT record of the transaction
    */
-  void Abort(Transaction *txn);
+  void WaitForDurableCommit(lsn_t commit_lsn);
 
   /**
-   * Global list of running transactions
+   * Aborts a transaction
+   * @param txn the transaction to abort
    */
-
-  /** The transaction map is a global list of all the running transactions in the system. */
-  static std::unordered_map<txn_id_t, Transaction *> txn_map;
+  void Abort(Transaction *txn);
 
   /**
    * Locates and returns the transaction with the given transaction ID.
    * @param txn_id the id of the transaction to be found, it must exist!
    * @return the transaction with the given transaction id
    */
-  static Transaction *GetTransaction(txn_id_t txn_id) {
-    assert(TransactionManager::txn_map.find(txn_id) != TransactionManager::txn_map.end());
-    auto *res = TransactionManager::txn_map[txn_id];
-    assert(res != nullptr);
-    return res;
+  Transaction *GetTransaction(txn_id_t txn_id) {
+    Transaction *txn = nullptr;
+    VisitTransaction(txn_id, [&txn](Transaction *found) { txn = found; });
+    assert(txn != nullptr);
+    return txn;
   }
 
+  /**
+   * Calls visit with a running transaction, while the transaction cannot finish. A transaction is unregistered before
+   * Commit() or Abort() returns and may be freed right after, so a thread that did not begin it must not keep the
+   * pointer past visit.
+   * @param txn_id the id of the transaction
+   * @param visit called with the transaction, it must not begin or finish a transaction
+   * @return false if no transaction with this id is running
+   */
+  template <typename Visit>
+  bool VisitTransaction(txn_id_t txn_id, Visit &&visit) {
+    RegistryShard *shard = GetRegistryShard(txn_id);
+    std::lock_guard<std::mutex> guard(shard->latch_);
+    auto entry = shard->txns_.find(txn_id);
+    if (entry == shard->txns_.end()) {
+      return false;
+    }
+    visit(entry->second);
+    return true;
+  }
+
+  /**
+   * Takes a snapshot of the active transaction table for a fuzzy checkpoint, without blocking any transaction.
+   * @param[out] active_txns the last LSN of each running transaction
+   * @param[out] oldest_first_lsn the first LSN of the oldest running transaction, INVALID_LSN if there is none
+   */
+  void GetActiveTransactionTable(std::unordered_map<txn_id_t, lsn_t> *active_txns, lsn_t *oldest_first_lsn);
+
+  /**
+   * @return the read timestamp of the oldest running transaction that reads a snapshot, or the last commit timestamp if
+   * none runs. No snapshot needs the versions that were replaced at or before it.
+   */
+  timestamp_t GetWatermark();
+
+  /**
+   * Makes Begin() hand out transaction ids from the given one on. Used after a restart, so that new transactions do
+   * not take the ids of the transactions in the log.
+   * @param txn_id the next transaction id
+   */
+  void SetNextTxnId(txn_id_t txn_id) { next_txn_id_ = txn_id; }
+
   /** Prevents all transactions from performing operations, used for checkpointing. */
   void BlockAllTransactions();
 
@@ -85,21 +153,97 @@ class TransactionManager {
    * @param txn the transaction whose locks should be released
    */
   void ReleaseLocks(Transaction *txn) {
-    std::unordered_set<RID> lock_set;
-    for (auto item : *txn->GetExclusiveLockSet()) {
-      lock_set.emplace(item);
-    }
-    for (auto item : *txn->GetSharedLockSet()) {
-      lock_set.emplace(item);
+    // Transactions that read snapshots may never have allocated their lock sets.
+    if (!txn->HoldsLocks()) {
+      return;
     }
+    // A tuple is in one of the lock sets, an upgrade moves it from the shared or increment set to the exclusive one.
+    std::vector<RID> lock_set(txn->GetExclusiveLockSet()->begin(), txn->GetExclusiveLockSet()->end());
+    lock_set.insert(lock_set.end(), txn->GetSharedLockSet()->begin(), txn->GetSharedLockSet()->end());
+    lock_set.insert(lock_set.end(), txn->GetIncrementLockSet()->begin(), txn->GetIncrementLockSet()->end());
     for (auto locked_rid : lock_set) {
       lock_manager_->Unlock(txn, locked_rid);
     }
+    txn->GetTableRowLockSet()->clear();
+    // Tables go last, their locks announce the locks on their tuples.
+    std::vector<table_oid_t> locked_tables;
+    for (const auto &item : *txn->GetTableLockSet()) {
+      locked_tables.push_back(item.first);
+    }
+    for (auto table_oid : locked_tables) {
+      lock_manager_->UnlockTable(txn, table_oid);
+    }
   }
 
+  /** Commits or aborts a read-only transaction, which has nothing to apply, roll back or log. */
+  void FinishReadOnly(Transaction *txn, TransactionState state);
+
+  /** Removes a committed or aborted transaction from the running transactions. */
+  void Unregister(Transaction *txn);
+
+  /**
+   * Gives the changes of a committing transaction a commit timestamp, and ends its snapshot.
+   * @return the commit timestamp, or 0 if the transaction changed no tuple
+   */
+  timestamp_t CommitVersions(Transaction *txn);
+
+  /** Records that the COMMIT record of the transaction with the commit timestamp is appended at commit_lsn. */
+  void CommitLogged(timestamp_t commit_ts, lsn_t commit_lsn);
+
+  /**
+   * Validates an OPTIMISTIC transaction, installs its buffered changes and moves it to COMMITTED, then commits its
+   * versions.
+   * @return the commit timestamp, see CommitVersions()
+   * @throw TransactionAbortException if the transaction must abort
+   */
+  timestamp_t ValidateAndInstall(Transaction *txn);
+
+  /** Ends the snapshot of txn, if it reads one. Call with timestamp_latch_ held. */
+  void EndSnapshot(Transaction *txn);
+
+  /** A running transaction, with the transaction manager that began it. */
+  /** The running transactions are split into 2^REGISTRY_SHARD_BITS shards by id, each with its own latch. */
+  static constexpr size_t REGISTRY_SHARD_BITS = 6;
+  static constexpr size_t NUM_REGISTRY_SHARDS = 1 << REGISTRY_SHARD_BITS;
+
+  struct alignas(64) RegistryShard {
+    std::mutex latch_;
+    std::unordered_map<txn_id_t, Transaction *> txns_;
+  };
+
+  /** Ids are handed out in order, so consecutive transactions go to different shards. */
+  RegistryShard *GetRegistryShard(txn_id_t txn_id) {
+    return &registry_[static_cast<size_t>(txn_id) & (NUM_REGISTRY_SHARDS - 1)];
+  }
+
+  /**
+   * The running transactions begun here, which checkpoints read while transactions come and go. Each transaction
+   * manager hands out its own ids, so each keeps its own registry.
+   */
+  RegistryShard registry_[NUM_REGISTRY_SHARDS];
+
+  /**
+   * Protects the commit timestamps and snapshots below, so that a snapshot sees all the changes of a commit or none.
+   */
+  std::mutex timestamp_latch_;
+  /** The commit timestamp of the last transaction that committed a change. */
+  timestamp_t last_commit_ts_{0};
+  /** The read timestamps of the running transactions that read snapshots. */
+  std::multiset<timestamp_t> snapshots_;
+  /** The commit timestamps of the transactions whose COMMIT records are not appended yet. */
+  std::set<timestamp_t> unlogged_commits_;
+  /** The newest COMMIT record of a transaction that committed a change. */
+  lsn_t last_commit_lsn_{INVALID_LSN};
+  /** Notified when a COMMIT record leaves unlogged_commits_. */
+  std::condition_variable commit_logged_cv_;
+  /** Lets one OPTIMISTIC transaction at a time validate and install its changes. */
+  std::mutex validation_latch_;
+
   std::atomic<txn_id_t> next_txn_id_{0};
   LockManager *lock_manager_ __attribute__((__unused__));
-  LogManager *log_manager_ __attribute__((__unused__));
+  LogManager *log_manager_;
+  /** How the transactions begun here keep out of the way of each other. */
+  const ConcurrencyMode concurrency_mode_;
 
   /** The global transaction latch is used for checkpointing. */
   ReaderWriterLatch global_txn_latch_;
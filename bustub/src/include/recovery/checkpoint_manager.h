@@ -12,6 +12,9 @@
 
 #pragma once
 
+#include <thread>  // NOLINT
+#include <vector>
+
 #include "buffer/buffer_pool_manager.h"
 #include "concurrency/transaction_manager.h"
 #include "recovery/log_manager.h"
@@ -19,7 +22,12 @@
 namespace bustub {
 
 /**
- * CheckpointManager creates consistent checkpoints by blocking all other transactions temporarily.
+ * CheckpointManager creates fuzzy checkpoints, transactions keep running while a checkpoint is taken.
+ *
+ * BeginCheckpoint() logs a CHECKPOINT_BEGIN record and starts writing the pages that are dirty at that point in the
+ * background. EndCheckpoint() waits for those writes and logs a CHECKPOINT_END record with the active transaction
+ * table and the dirty page table. Recovery does not need the log before the oldest recovery LSN of the dirty pages
+ * or the oldest first LSN of the active transactions, which is recorded in the master record.
  */
 class CheckpointManager {
  public:
@@ -29,15 +37,23 @@ class CheckpointManager {
         log_manager_(log_manager),
         buffer_pool_manager_(buffer_pool_manager) {}
 
-  ~CheckpointManager() = default;
+  ~CheckpointManager();
 
   void BeginCheckpoint();
   void EndCheckpoint();
 
  private:
-  TransactionManager *transaction_manager_ __attribute__((__unused__));
-  LogManager *log_manager_ __attribute__((__unused__));
-  BufferPoolManager *buffer_pool_manager_ __attribute__((__unused__));
+  /** Writes the dirty pages of the checkpoint, in page id order so that the disk sees mostly sequential writes. */
+  void WriteDirtyPages(std::vector<page_id_t> page_ids);
+
+  TransactionManager *transaction_manager_;
+  LogManager *log_manager_;
+  BufferPoolManager *buffer_pool_manager_;
+
+  /** LSN of the CHECKPOINT_BEGIN record of the checkpoint in progress, INVALID_LSN if there is none. */
+  lsn_t begin_lsn_{INVALID_LSN};
+  /** Writes the pages that were dirty at the beginning of the checkpoint. */
+  std::thread writer_thread_;
 };
 
 }  // namespace bustub
@@ -13,9 +13,14 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <chrono>              // NOLINT
 #include <condition_variable>  // NOLINT
 #include <future>              // NOLINT
+#include <map>
 #include <mutex>               // NOLINT
+#include <thread>              // NOLINT
 
 #include "recovery/log_record.h"
 #include "storage/disk/disk_manager.h"
@@ -25,11 +30,27 @@ namespace bustub {
 /**
  * LogManager maintains a separate thread that is awakened whenever the log buffer is full or whenever a timeout
  * happens. When the thread is awakened, the log buffer's content is written into the disk log file.
+ *
+ * Commits are made durable with group commit: a committing transaction registers its commit LSN and waits, and the
+ * flush thread writes the log buffer once for all the commits that accumulated in it. While a write is in progress new
+ * records go to the other buffer, so they join the next write. The flush thread can also be told to wait a little for
+ * more commits, up to a maximum delay or until enough commits are waiting.
+ *
+ * Appends do not take the latch. A single compare-and-swap on log_tail_ assigns the LSN and reserves space in the log
+ * buffer, then the record is serialized into its space in parallel with other appends. To flush, the log buffer is
+ * sealed so that no more space can be reserved in it, and the flush waits for the copies into the reserved space to
+ * finish. Only appends that find the log buffer full or sealed take the latch, to wait for the flush.
  */
 class LogManager {
  public:
   explicit LogManager(DiskManager *disk_manager)
-      : next_lsn_(0), persistent_lsn_(INVALID_LSN), disk_manager_(disk_manager) {
+      : log_tail_(static_cast<uint64_t>(disk_manager->GetNextLSN()) << 32),
+        persistent_lsn_(disk_manager->GetNextLSN() - 1),
+        log_start_offset_(disk_manager->GetLogSize()),
+        log_file_offset_(log_start_offset_),
+        log_buffer_first_lsn_(disk_manager->GetNextLSN()),
+        flush_thread_(nullptr),
+        disk_manager_(disk_manager) {
     log_buffer_ = new char[LOG_BUFFER_SIZE];
     flush_buffer_ = new char[LOG_BUFFER_SIZE];
   }
@@ -46,29 +67,147 @@ class LogManager {
 
   lsn_t AppendLogRecord(LogRecord *log_record);
 
-  inline lsn_t GetNextLSN() { return next_lsn_; }
+  /**
+   * Blocks until the log record with the given LSN, usually a COMMIT record, is on disk. Concurrent callers are made
+   * durable by the same log write.
+   * @param commit_lsn the LSN that must be persistent when this returns
+   */
+  void WaitForCommit(lsn_t commit_lsn);
+
+  /**
+   * Asks the flush thread to write the log up to the given LSN with the next group commit, without waiting for it.
+   * Used by asynchronous commits, which can wait for durability later with WaitForCommit().
+   * @param lsn the LSN that should become persistent soon
+   */
+  void ScheduleFlush(lsn_t lsn);
+
+  /**
+   * Writes the log buffer to disk right away, without waiting for a timeout or for other commits, and blocks until the
+   * log record with the given LSN is on disk. The buffer pool calls this before writing out a page whose LSN is not
+   * persistent yet.
+   * @param lsn the LSN that must be persistent when this returns
+   */
+  void Flush(lsn_t lsn);
+
+  /**
+   * Sets how long the flush thread waits for more commits once a transaction is waiting for its commit to be durable.
+   * The default of zero still batches every commit that arrives while the previous log write is in progress.
+   * @param delay the maximum delay added to a commit
+   */
+  void SetGroupCommitDelay(std::chrono::microseconds delay);
+
+  /**
+   * Sets the number of waiting commits at which the flush thread stops waiting for more and writes the log.
+   * @param batch_size the number of commits in a full group
+   */
+  void SetGroupCommitBatchSize(size_t batch_size);
+
+  /**
+   * Points recovery at a checkpoint by writing the master record, then drops the log segments before it. Both LSNs
+   * must be persistent.
+   * @param checkpoint_lsn the LSN of the CHECKPOINT_BEGIN record
+   * @param recovery_lsn the oldest LSN that recovery needs to read
+   */
+  void WriteMasterRecord(lsn_t checkpoint_lsn, lsn_t recovery_lsn);
+
+  /**
+   * Continues the log after a recovered log: the next record gets the given LSN, and the records before it are
+   * persistent. Must be called before any record is appended.
+   * @param next_lsn the LSN after the last LSN in the log
+   */
+  void SetNextLSN(lsn_t next_lsn);
+
+  inline lsn_t GetNextLSN() { return static_cast<lsn_t>(log_tail_.load() >> 32); }
   inline lsn_t GetPersistentLSN() { return persistent_lsn_; }
   inline void SetPersistentLSN(lsn_t lsn) { persistent_lsn_ = lsn; }
   inline char *GetLogBuffer() { return log_buffer_; }
 
  private:
-  // TODO(students): you may add your own member variables
+  /** Body of the flush thread. */
+  void FlushThreadMain();
 
-  /** The atomic counter which records the next log sequence number. */
-  std::atomic<lsn_t> next_lsn_;
+  /**
+   * Swaps the log buffer with the flush buffer and writes the records to disk. Waits for a write that is already in
+   * progress first, since it uses the flush buffer. The latch is released during the write.
+   * @param lock the lock holding latch_
+   */
+  void FlushLogBuffer(std::unique_lock<std::mutex> *lock);
+
+  /** Adds a commit to the next group commit and wakes up the flush thread, latch_ must be held. */
+  void RegisterCommit(lsn_t commit_lsn);
+
+  /** Blocks until the log buffer is neither full nor sealed, flushing it if there is no flush thread. */
+  void WaitForLogBufferSpace(int32_t size);
+
+  /** @return true if records were appended since the last flush, latch_ must be held */
+  inline bool HasBufferedRecords() const { return static_cast<uint32_t>(log_tail_.load()) != 0; }
+
+  /** @return true if a waiting commit or a forced flush needs the log buffer written out, latch_ must be held */
+  inline bool FlushRequested() const {
+    return force_flush_ || buffer_full_ || stop_flush_thread_ || commit_lsn_ > persistent_lsn_;
+  }
+
+  /** Serializes a log record, whose LSN has already been assigned, to dest. */
+  static void SerializeLogRecord(const LogRecord &log_record, char *dest);
+
+  /** Offset of log_tail_ while a flush is sealing the log buffer. */
+  static constexpr uint32_t SEALED_OFFSET = UINT32_MAX;
+
+  /**
+   * The next log sequence number (high 32 bits) and the number of bytes reserved in log_buffer_ (low 32 bits). Both
+   * change together, so records are laid out in the log buffer in LSN order.
+   */
+  std::atomic<uint64_t> log_tail_;
+  /** Number of bytes that appends have finished copying into log_buffer_. */
+  std::atomic<uint32_t> log_buffer_filled_{0};
   /** The log records before and including the persistent lsn have been written to disk. */
   std::atomic<lsn_t> persistent_lsn_;
 
+  /**
+   * Offset in the log file of the first record of each log write since the last master record, by the LSN of that
+   * record. A master record must point at a record boundary, and these are the only ones we know of after the write.
+   */
+  std::map<lsn_t, int> flush_offsets_;
+  /** Offset in the log file of the first record appended by this log manager. */
+  const int log_start_offset_;
+  /** Offset in the log file at which the next log write starts. */
+  int log_file_offset_;
+  /** LSN of the first record in log_buffer_. */
+  lsn_t log_buffer_first_lsn_{0};
+
+  /** Records are appended here. */
   char *log_buffer_;
+  /** Records that are being written to disk, swapped with log_buffer_ by each flush. */
   char *flush_buffer_;
-
+  /** Largest LSN a committing transaction is waiting for. */
+  lsn_t commit_lsn_{INVALID_LSN};
+  /** Number of commits waiting for the next flush. */
+  size_t group_commit_count_{0};
+  /** Maximum time the flush thread waits for more commits. */
+  std::chrono::microseconds group_commit_delay_{0};
+  /** Number of waiting commits that are flushed without further delay. */
+  size_t group_commit_batch_size_{16};
+
+  /** True while flush_buffer_ is being written to disk. */
+  bool flush_in_progress_{false};
+  /** True if some thread needs the log flushed now. */
+  bool force_flush_{false};
+  /** True if an append is waiting for space in log_buffer_. */
+  bool buffer_full_{false};
+  /** True when the flush thread should flush what is left and exit. */
+  bool stop_flush_thread_{false};
+
+  /** Serializes flushes and protects the flush state above. Appends only take it to wait for space. */
   std::mutex latch_;
 
-  std::thread *flush_thread_ __attribute__((__unused__));
+  std::thread *flush_thread_;
 
+  /** Wakes up the flush thread. */
   std::condition_variable cv_;
+  /** Signalled after each flush, wakes up committing transactions and appends waiting for space. */
+  std::condition_variable flushed_cv_;
 
-  DiskManager *disk_manager_ __attribute__((__unused__));
+  DiskManager *disk_manager_;
 };
 
 }  // namespace bustub
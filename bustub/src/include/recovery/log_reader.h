@@ -0,0 +1,78 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// log_reader.h
+//
+// Identification: src/include/recovery/log_reader.h
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <future>  // NOLINT
+
+#include "common/config.h"
+#include "storage/disk/disk_manager.h"
+
+namespace bustub {
+
+/**
+ * LogReader scans the log from an offset to its end, for the recovery passes that read the log sequentially.
+ *
+ * The log is read in large chunks with double buffering: while the records of one chunk are parsed, a background read
+ * fills the other buffer with the next chunk. Each buffer has room for one record in front of its chunk, so a record
+ * that straddles two chunks is completed by copying its first part in front of the next chunk, instead of reading it
+ * again from disk.
+ */
+class LogReader {
+ public:
+  /** Number of bytes of the log read from disk at once. */
+  static constexpr int DEFAULT_READ_AHEAD_SIZE = 1 << 20;
+
+  /**
+   * Starts reading the log in the background.
+   * @param offset offset in the log file of the first record
+   * @param read_ahead_size number of bytes read at once
+   */
+  LogReader(DiskManager *disk_manager, int offset, int read_ahead_size = DEFAULT_READ_AHEAD_SIZE);
+
+  ~LogReader();
+
+  /**
+   * Moves to the next record.
+   * @param[out] offset offset of the record in the log file
+   * @param[out] size size of the record
+   * @return the serialized record, valid until the next call, or nullptr at the end of the log
+   */
+  const char *Next(int *offset, int *size);
+
+ private:
+  /** Starts reading the next chunk of the log into the buffer that is not being parsed. */
+  void ReadAhead();
+
+  /** Moves on to the chunk that was read ahead, with the part of a record left at the end of the current chunk. */
+  void SwapBuffers();
+
+  DiskManager *disk_manager_;
+  /** Number of bytes in a chunk. */
+  const int read_ahead_size_;
+  /** Offset in the log file at which the log ends, nothing is appended to the log while it is read. */
+  const int log_end_;
+  /** Offset in the log file of the chunk that is read next. */
+  int read_ahead_offset_;
+  /** Number of bytes of the chunk that is being read, once the read is done. */
+  std::future<int> read_ahead_;
+
+  /** Each buffer holds a partial record of up to LOG_BUFFER_SIZE bytes, then a chunk. */
+  char *buffer_;
+  char *next_buffer_;
+  /** The unparsed bytes in buffer_, and the offset of the first one in the log file. */
+  const char *pos_;
+  const char *end_;
+  int offset_;
+};
+
+}  // namespace bustub
@@ -12,8 +12,13 @@
 
 #pragma once
 
+#include <algorithm>
 #include <cassert>
+#include <cstring>
 #include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "common/config.h"
 #include "storage/table/tuple.h"
@@ -32,6 +37,14 @@ enum class LogRecordType {
   ABORT,
   /** Creating a new page in the table heap. */
   NEWPAGE,
+  /** Start of a fuzzy checkpoint. */
+  CHECKPOINT_BEGIN,
+  /** End of a fuzzy checkpoint, with the active transaction table and the dirty page table. */
+  CHECKPOINT_END,
+  /** Writing a range of bytes of a page other than a table page, such as an index page. */
+  PAGEWRITE,
+  /** Adding to a numeric field of a tuple, undone by subtracting it again. */
+  INCREMENT,
 };
 
 /**
@@ -49,16 +62,30 @@ enum class LogRecordType {
  *----------------------------------------------------------------
  * | HEADER | tuple_rid | tuple_size | tuple_data(char[] array) |
  *---------------------------------------------------------------
- * For update type log record
- *-----------------------------------------------------------------------------------
- * | HEADER | tuple_rid | tuple_size | old_tuple_data | tuple_size | new_tuple_data |
- *-----------------------------------------------------------------------------------
+ * For update type log record, only the bytes between the longest common prefix and the longest common suffix of the
+ * old and the new tuple are logged
+ *------------------------------------------------------------------------------------------------------
+ * | HEADER | tuple_rid | prefix_size | suffix_size | old_size | old_middle_data | new_size | new_middle_data |
+ *------------------------------------------------------------------------------------------------------
  * For new page type log record
- *--------------------------
- * | HEADER | prev_page_id |
- *--------------------------
+ *-------------------------------------
+ * | HEADER | prev_page_id | page_id |
+ *-------------------------------------
+ * For page write type log record, the page keeps its LSN at Page::OFFSET_LSN like every page that is logged
+ *-----------------------------------------------------------------------
+ * | HEADER | page_id | offset | size | old_data | new_data |
+ *-----------------------------------------------------------------------
+ * For increment type log record, the delta is as wide as the field, whose type it has
+ *-------------------------------------------------------
+ * | HEADER | tuple_rid | field_offset | type_id | delta |
+ *-------------------------------------------------------
+ * For checkpoint end type log record, prevLSN is the LSN of the matching checkpoint begin record
+ *-------------------------------------------------------------------------------------
+ * | HEADER | num_txns | (txn_id, last_lsn)... | num_pages | (page_id, rec_lsn)... |
+ *-------------------------------------------------------------------------------------
  */
 class LogRecord {
+  friend class DiskManager;
   friend class LogManager;
   friend class LogRecovery;
 
@@ -70,32 +97,44 @@ class LogRecord {
       : size_(HEADER_SIZE), txn_id_(txn_id), prev_lsn_(prev_lsn), log_record_type_(log_record_type) {}
 
   // constructor for INSERT/DELETE type
+  // the tuple is not copied, it is serialized straight into the log buffer and must outlive the record
   LogRecord(txn_id_t txn_id, lsn_t prev_lsn, LogRecordType log_record_type, const RID &rid, const Tuple &tuple)
-      : txn_id_(txn_id), prev_lsn_(prev_lsn), log_record_type_(log_record_type) {
+      : txn_id_(txn_id), prev_lsn_(prev_lsn), log_record_type_(log_record_type), tuple_ref_(&tuple) {
     if (log_record_type == LogRecordType::INSERT) {
       insert_rid_ = rid;
-      insert_tuple_ = tuple;
     } else {
       assert(log_record_type == LogRecordType::APPLYDELETE || log_record_type == LogRecordType::MARKDELETE ||
              log_record_type == LogRecordType::ROLLBACKDELETE);
       delete_rid_ = rid;
-      delete_tuple_ = tuple;
     }
     // calculate log record size
     size_ = HEADER_SIZE + sizeof(RID) + sizeof(int32_t) + tuple.GetLength();
   }
 
   // constructor for UPDATE type
+  // the tuples are not copied, they are serialized straight into the log buffer and must outlive the record
   LogRecord(txn_id_t txn_id, lsn_t prev_lsn, LogRecordType log_record_type, const RID &update_rid,
             const Tuple &old_tuple, const Tuple &new_tuple)
       : txn_id_(txn_id),
         prev_lsn_(prev_lsn),
         log_record_type_(log_record_type),
         update_rid_(update_rid),
-        old_tuple_(old_tuple),
-        new_tuple_(new_tuple) {
+        tuple_ref_(&old_tuple),
+        new_tuple_ref_(&new_tuple) {
+    // Usually a few columns change, and the bytes around them are the same in both tuples.
+    uint32_t common_size = std::min(old_tuple.GetLength(), new_tuple.GetLength());
+    while (update_prefix_size_ < common_size &&
+           old_tuple.GetData()[update_prefix_size_] == new_tuple.GetData()[update_prefix_size_]) {
+      update_prefix_size_++;
+    }
+    while (update_prefix_size_ + update_suffix_size_ < common_size &&
+           old_tuple.GetData()[old_tuple.GetLength() - update_suffix_size_ - 1] ==
+               new_tuple.GetData()[new_tuple.GetLength() - update_suffix_size_ - 1]) {
+      update_suffix_size_++;
+    }
     // calculate log record size
-    size_ = HEADER_SIZE + sizeof(RID) + old_tuple.GetLength() + new_tuple.GetLength() + 2 * sizeof(int32_t);
+    size_ = HEADER_SIZE + sizeof(RID) + 4 * sizeof(int32_t) + old_tuple.GetLength() + new_tuple.GetLength() -
+            2 * (update_prefix_size_ + update_suffix_size_);
   }
 
   // constructor for NEWPAGE type
@@ -110,24 +149,111 @@ class LogRecord {
     size_ = HEADER_SIZE + sizeof(page_id_t) * 2;
   }
 
+  // constructor for PAGEWRITE type
+  // used by index pages, whose operations (inserting or removing an entry, splitting or merging a node) are logged as
+  // the bytes they change on each page, so that recovery does not need to know the layout of the page
+  LogRecord(txn_id_t txn_id, lsn_t prev_lsn, LogRecordType log_record_type, page_id_t page_id, uint32_t offset,
+            const char *old_data, const char *new_data, uint32_t size)
+      : txn_id_(txn_id),
+        prev_lsn_(prev_lsn),
+        log_record_type_(log_record_type),
+        page_id_(page_id),
+        page_write_offset_(offset),
+        page_write_old_(old_data, old_data + size),
+        page_write_new_(new_data, new_data + size) {
+    assert(log_record_type == LogRecordType::PAGEWRITE);
+    size_ = HEADER_SIZE + sizeof(page_id_t) + 2 * sizeof(uint32_t) + 2 * size;
+  }
+
+  // constructor for INCREMENT type
+  // the record is logical, so that increments of the same tuple by other transactions may come between the increment
+  // and its undo
+  LogRecord(txn_id_t txn_id, lsn_t prev_lsn, LogRecordType log_record_type, const RID &rid, uint32_t offset,
+            const Value &delta)
+      : txn_id_(txn_id),
+        prev_lsn_(prev_lsn),
+        log_record_type_(log_record_type),
+        increment_rid_(rid),
+        increment_offset_(offset),
+        increment_delta_(delta) {
+    assert(log_record_type == LogRecordType::INCREMENT);
+    size_ = HEADER_SIZE + sizeof(RID) + sizeof(uint32_t) + sizeof(TypeId) + Type::GetTypeSize(delta.GetTypeId());
+  }
+
+  // constructor for CHECKPOINT_END type
+  LogRecord(lsn_t begin_checkpoint_lsn, const std::unordered_map<txn_id_t, lsn_t> &active_txns,
+            const std::unordered_map<page_id_t, lsn_t> &dirty_pages)
+      : txn_id_(INVALID_TXN_ID),
+        prev_lsn_(begin_checkpoint_lsn),
+        log_record_type_(LogRecordType::CHECKPOINT_END),
+        active_txns_(active_txns.begin(), active_txns.end()),
+        dirty_pages_(dirty_pages.begin(), dirty_pages.end()) {
+    // calculate log record size, header size + both tables with their lengths
+    size_ = HEADER_SIZE + 2 * sizeof(int32_t) + active_txns_.size() * (sizeof(txn_id_t) + sizeof(lsn_t)) +
+            dirty_pages_.size() * (sizeof(page_id_t) + sizeof(lsn_t));
+  }
+
   ~LogRecord() = default;
 
-  inline Tuple &GetDeleteTuple() { return delete_tuple_; }
+  /**
+   * @return the size of the largest tuple whose log records fit in the log buffer, an update record carries two tuples
+   */
+  static constexpr uint32_t MaxTupleSize() {
+    return (LOG_BUFFER_SIZE - HEADER_SIZE - sizeof(RID) - 4 * sizeof(int32_t)) / 2;
+  }
+
+  inline const Tuple &GetDeleteTuple() const { return tuple_ref_ != nullptr ? *tuple_ref_ : delete_tuple_; }
 
   inline RID &GetDeleteRID() { return delete_rid_; }
 
-  inline Tuple &GetInsertTuple() { return insert_tuple_; }
+  inline const Tuple &GetInsertTuple() const { return tuple_ref_ != nullptr ? *tuple_ref_ : insert_tuple_; }
 
   inline RID &GetInsertRID() { return insert_rid_; }
 
-  inline Tuple &GetOriginalTuple() { return old_tuple_; }
+  /**
+   * Rebuilds the tuple before an update, for undo.
+   * @param new_tuple the tuple after the update
+   */
+  inline Tuple GetOriginalTuple(const Tuple &new_tuple) const {
+    return SpliceUpdate(new_tuple, new_middle_, old_middle_);
+  }
 
-  inline Tuple &GetUpdateTuple() { return new_tuple_; }
+  /**
+   * Rebuilds the tuple after an update, for redo.
+   * @param old_tuple the tuple before the update
+   */
+  inline Tuple GetUpdateTuple(const Tuple &old_tuple) const {
+    return SpliceUpdate(old_tuple, old_middle_, new_middle_);
+  }
 
   inline RID &GetUpdateRID() { return update_rid_; }
 
   inline page_id_t GetNewPageRecord() { return prev_page_id_; }
 
+  inline page_id_t GetNewPageId() { return page_id_; }
+
+  inline page_id_t GetPageWritePageId() { return page_id_; }
+
+  inline uint32_t GetPageWriteOffset() { return page_write_offset_; }
+
+  /** @return the bytes of the page before the write */
+  inline const std::vector<char> &GetPageWriteOldData() const { return page_write_old_; }
+
+  /** @return the bytes of the page after the write */
+  inline const std::vector<char> &GetPageWriteNewData() const { return page_write_new_; }
+
+  inline RID &GetIncrementRID() { return increment_rid_; }
+
+  /** @return the offset of the incremented field in the tuple */
+  inline uint32_t GetIncrementOffset() { return increment_offset_; }
+
+  /** @return the value added to the field */
+  inline const Value &GetIncrementDelta() const { return increment_delta_; }
+
+  inline const std::vector<std::pair<txn_id_t, lsn_t>> &GetActiveTxns() const { return active_txns_; }
+
+  inline const std::vector<std::pair<page_id_t, lsn_t>> &GetDirtyPages() const { return dirty_pages_; }
+
   inline int32_t GetSize() { return size_; }
 
   inline lsn_t GetLSN() { return lsn_; }
@@ -168,15 +294,71 @@ class LogRecord {
   RID insert_rid_;
   Tuple insert_tuple_;
 
-  // case3: for update operation
+  // case3: for update operation, the bytes that both tuples start and end with, and the bytes in between
   RID update_rid_;
-  Tuple old_tuple_;
-  Tuple new_tuple_;
+  uint32_t update_prefix_size_{0};
+  uint32_t update_suffix_size_{0};
+  std::vector<char> old_middle_;
+  std::vector<char> new_middle_;
+
+  // tuples of a record that is being appended, owned by the caller (the tuples above are only used by records that
+  // were read back from the log)
+  const Tuple *tuple_ref_{nullptr};
+  const Tuple *new_tuple_ref_{nullptr};
 
-  // case4: for new page operation
+  // case4: for new page operation, page_id_ is also the page of a page write
   page_id_t prev_page_id_{INVALID_PAGE_ID};
   page_id_t page_id_{INVALID_PAGE_ID};
+
+  // case5: for page write operation
+  uint32_t page_write_offset_{0};
+  std::vector<char> page_write_old_;
+  std::vector<char> page_write_new_;
+
+  // case6: for increment operation
+  RID increment_rid_;
+  uint32_t increment_offset_{0};
+  Value increment_delta_;
+
+  // case7: for checkpoint end, the last LSN of each active transaction and the recovery LSN of each dirty page
+  std::vector<std::pair<txn_id_t, lsn_t>> active_txns_;
+  std::vector<std::pair<page_id_t, lsn_t>> dirty_pages_;
+
+  /** @return tuple with its middle bytes, which must be from_middle, replaced by to_middle */
+  Tuple SpliceUpdate(const Tuple &tuple, const std::vector<char> &from_middle,
+                     const std::vector<char> &to_middle) const {
+    assert(tuple.GetLength() == update_prefix_size_ + from_middle.size() + update_suffix_size_);
+    uint32_t size = update_prefix_size_ + to_middle.size() + update_suffix_size_;
+    // Serialized form of the result, which is how a tuple can be built from bytes.
+    std::vector<char> storage(sizeof(uint32_t) + size);
+    memcpy(storage.data(), &size, sizeof(uint32_t));
+    char *data = storage.data() + sizeof(uint32_t);
+    memcpy(data, tuple.GetData(), update_prefix_size_);
+    memcpy(data + update_prefix_size_, to_middle.data(), to_middle.size());
+    memcpy(data + update_prefix_size_ + to_middle.size(), tuple.GetData() + tuple.GetLength() - update_suffix_size_,
+           update_suffix_size_);
+    Tuple result;
+    result.DeserializeFrom(storage.data());
+    return result;
+  }
+
   static const int HEADER_SIZE = 20;
 };  // namespace bustub
 
+/**
+ * The master record points recovery at the last complete checkpoint. It is rewritten in place after every checkpoint,
+ * so a crash during a checkpoint leaves the previous one in effect.
+ */
+struct MasterRecord {
+  /** LSN of the CHECKPOINT_BEGIN record of the checkpoint. */
+  lsn_t checkpoint_lsn_{INVALID_LSN};
+  /**
+   * LSN from which recovery must read the log: the oldest of the checkpoint begin, the recovery LSN of every dirty page
+   * and the first record of every active transaction at the checkpoint.
+   */
+  lsn_t recovery_lsn_{INVALID_LSN};
+  /** Offset in the log file of a record boundary at or before recovery_lsn_. */
+  int recovery_offset_{0};
+};
+
 }  // namespace bustub
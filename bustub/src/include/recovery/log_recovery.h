@@ -13,26 +13,56 @@
 #pragma once
 
 #include <algorithm>
+#include <chrono>  // NOLINT
 #include <mutex>  // NOLINT
+#include <thread>  // NOLINT
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 #include "buffer/buffer_pool_manager.h"
 #include "concurrency/lock_manager.h"
+#include "concurrency/transaction_manager.h"
+#include "recovery/log_reader.h"
 #include "recovery/log_record.h"
 
 namespace bustub {
 
+class TablePage;
+
 /**
  * Read log file from disk, redo and undo.
+ *
+ * If a checkpoint was taken, the master record tells where to start reading the log. Redo first runs an analysis pass
+ * that rebuilds the active transaction table and the dirty page table from the checkpoint and the records after it,
+ * then repeats history from the oldest recovery LSN of the dirty pages. Undo rolls back the transactions that were
+ * still active at the crash.
+ *
+ * Both passes apply changes on a pool of worker threads. Redo reads the log on the calling thread and hands each record
+ * to the worker that owns its page, so the changes to one page are applied in LSN order by a single thread. Undo reads
+ * the records of the losers on the calling thread and rolls back each loser on one worker, as losers never changed the
+ * same tuple. The passes that scan the log read it through a LogReader, which reads ahead while records are applied.
+ *
+ * Instead of Redo() and Undo(), StartInstantRestart() only runs the analysis pass before new transactions can begin.
+ * The rest of recovery runs in the background, and a page that is fetched before the background redo got to it is
+ * redone on its first fetch.
  */
 class LogRecovery {
  public:
-  LogRecovery(DiskManager *disk_manager, BufferPoolManager *buffer_pool_manager)
-      : disk_manager_(disk_manager), buffer_pool_manager_(buffer_pool_manager), offset_(0) {
+  /** Default number of worker threads of redo and undo. */
+  static constexpr size_t DEFAULT_NUM_RECOVERY_WORKERS = 4;
+
+  /**
+   * @param num_workers number of threads that apply changes to pages, 0 or 1 to apply them on the calling thread
+   */
+  LogRecovery(DiskManager *disk_manager, BufferPoolManager *buffer_pool_manager,
+              size_t num_workers = DEFAULT_NUM_RECOVERY_WORKERS)
+      : disk_manager_(disk_manager), buffer_pool_manager_(buffer_pool_manager), num_workers_(num_workers), offset_(0) {
     log_buffer_ = new char[LOG_BUFFER_SIZE];
   }
 
   ~LogRecovery() {
+    WaitForInstantRestart();
     delete[] log_buffer_;
     log_buffer_ = nullptr;
   }
@@ -41,16 +71,146 @@ class LogRecovery {
   void Undo();
   bool DeserializeLogRecord(const char *data, LogRecord *log_record);
 
+  /**
+   * Recovers the database while it accepts new transactions. Runs the analysis pass, locks the tuples the losers
+   * changed, then returns and leaves redo and undo to a background thread. Until a page is redone, the buffer pool
+   * redoes it when it is first fetched. Once the losers are rolled back, their pages are flushed and ABORT records are
+   * logged for them, then their locks are released. Until then, table locks that cover the tuples wait, see
+   * LockManager::BlockTableLocks().
+   *
+   * Call this after the log flush thread started, before any transaction begins or any page is fetched. Checkpoints
+   * must wait for WaitForInstantRestart(), the background recovery is not in their tables. So must SNAPSHOT_ISOLATION
+   * transactions, they read without locks and the losers keep no older versions of the tuples they changed.
+   * @param log_manager new log records get LSNs after the recovered log
+   * @param txn_manager new transactions get ids after the transactions in the log
+   * @param lock_manager the lock manager that new transactions lock tuples with
+   */
+  void StartInstantRestart(LogManager *log_manager, TransactionManager *txn_manager, LockManager *lock_manager);
+
+  /** Blocks until the background recovery of StartInstantRestart() is done. Returns right away if there is none. */
+  void WaitForInstantRestart();
+
+  /** @return how long the analysis pass took, which Redo() and StartInstantRestart() run first */
+  inline std::chrono::microseconds GetAnalysisTime() const { return analysis_time_; }
+  /** @return how long Redo() took after the analysis pass */
+  inline std::chrono::microseconds GetRedoTime() const { return redo_time_; }
+  /** @return how long Undo() took */
+  inline std::chrono::microseconds GetUndoTime() const { return undo_time_; }
+
  private:
-  DiskManager *disk_manager_ __attribute__((__unused__));
-  BufferPoolManager *buffer_pool_manager_ __attribute__((__unused__));
+  /**
+   * Reads the log record at the given offset of the log file, from the log buffer if it is there.
+   * @param offset offset of the record in the log file
+   * @param[out] log_record the record
+   * @param backward true to fill the log buffer mostly with the log before offset, for undo
+   * @return false at the end of the log
+   */
+  bool ReadLogRecord(int offset, LogRecord *log_record, bool backward = false);
+
+  /**
+   * Reads the next log record of a sequential scan of the log, and sets offset_ to its offset.
+   * @return false at the end of the log
+   */
+  bool ReadNextLogRecord(LogReader *reader, LogRecord *log_record);
+
+  /** Deserializes a log record that must end before end. */
+  static bool DeserializeLogRecord(const char *data, const char *end, LogRecord *log_record);
+
+  /** Analysis: rebuilds active_txn_, lsn_mapping_ and dirty_page_table_ from the log, starting at offset. */
+  void Analyze(int offset, lsn_t checkpoint_lsn);
+
+  /**
+   * Runs the analysis pass from the checkpoint in the master record, if any.
+   * @param[out] redo_offset offset in the log file at which redo starts
+   * @return the LSN redo starts at, INVALID_LSN if no page needs redo
+   */
+  lsn_t AnalyzeLog(int *redo_offset);
+
+  /** Reads the changes of the losers, each loser's latest first. */
+  std::unordered_map<txn_id_t, std::vector<LogRecord>> ReadLoserChanges();
+
+  /** Rolls back the changes of the losers, each loser on one worker. */
+  void UndoLosers(std::unordered_map<txn_id_t, std::vector<LogRecord>> *loser_changes);
+
+  /**
+   * Redoes the changes a page read from disk misses, during an instant restart. Installed in the buffer pool.
+   * @param page the page, pinned and write latched
+   * @return true if the page was changed
+   */
+  bool RecoverPage(Page *page);
+
+  /** Body of the background thread of an instant restart. */
+  void FinishInstantRestart(LogManager *log_manager, LockManager *lock_manager,
+                            std::unordered_map<txn_id_t, std::vector<LogRecord>> loser_changes);
+
+  /**
+   * Redoes the part of a change that falls on one page, if the page does not have it yet.
+   * Safe to call concurrently for different pages.
+   * @param log_record the change
+   * @param page_id one of the pages the record changes, see GetChangedPageIds()
+   */
+  void RedoLogRecord(LogRecord *log_record, page_id_t page_id);
+
+  /**
+   * Redoes the part of a change that falls on a page, if the page does not have it yet.
+   * @param log_record the change
+   * @param page the page, write latched
+   * @return true if the page was changed
+   */
+  bool RedoOnPage(LogRecord *log_record, TablePage *page);
+
+  /** @return true if the part of a change that falls on a page may be missing on disk, going by the dirty pages */
+  bool MayNeedRedo(LogRecord *log_record, page_id_t page_id);
+
+  /** Rolls back a change to a table page. Safe to call concurrently for changes to different tuples. */
+  void UndoLogRecord(LogRecord *log_record);
+
+  /** @return the page changed by a log record, INVALID_PAGE_ID if the record does not change a page */
+  static page_id_t GetChangedPageId(LogRecord *log_record);
+
+  /**
+   * @return every page a log record changes, which is the page of GetChangedPageId() and, for a new page, the page
+   * before it that is linked to the new page
+   */
+  static std::vector<page_id_t> GetChangedPageIds(LogRecord *log_record);
+
+  DiskManager *disk_manager_;
+  BufferPoolManager *buffer_pool_manager_;
+  /** Number of threads that apply changes to pages. */
+  size_t num_workers_;
 
   /** Maintain active transactions and its corresponding latest lsn. */
   std::unordered_map<txn_id_t, lsn_t> active_txn_;
   /** Mapping the log sequence number to log file offset for undos. */
   std::unordered_map<lsn_t, int> lsn_mapping_;
+  /** Pages that may be missing changes on disk, with the LSN of the oldest such change. */
+  std::unordered_map<page_id_t, lsn_t> dirty_page_table_;
+  /** Transactions that committed or aborted, a checkpoint taken before they ended must not revive them. */
+  std::unordered_set<txn_id_t> finished_txns_;
+  /** Largest LSN and transaction id that analysis came across. */
+  lsn_t max_lsn_{INVALID_LSN};
+  txn_id_t max_txn_id_{INVALID_TXN_ID};
+
+  /** During an instant restart, the offsets in the log file of the changes each page may miss, in LSN order. */
+  std::unordered_map<page_id_t, std::vector<int>> pending_pages_;
+  /** Protects pending_pages_. */
+  std::mutex pending_latch_;
+  /** Serializes the use of log_buffer_ while pages are redone on fetch. */
+  std::mutex log_buffer_latch_;
+  /** During an instant restart, the stand-ins of the losers that hold their locks until they are rolled back. */
+  std::unordered_map<txn_id_t, Transaction *> loser_txns_;
+  /** Finishes an instant restart in the background. */
+  std::thread restart_thread_;
+
+  /** How long each pass took. */
+  std::chrono::microseconds analysis_time_{0};
+  std::chrono::microseconds redo_time_{0};
+  std::chrono::microseconds undo_time_{0};
 
-  int offset_ __attribute__((__unused__));
+  /** Offset in the log file of the record that a sequential scan of the log read last. */
+  int offset_;
+  /** Offset in the log file of the data in log_buffer_, -1 if the buffer is empty. */
+  int buffer_offset_{-1};
   char *log_buffer_;
 };
 
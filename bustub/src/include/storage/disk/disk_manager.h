@@ -15,23 +15,36 @@
 #include <atomic>
 #include <fstream>
 #include <future>  // NOLINT
+#include <mutex>   // NOLINT
 #include <string>
 
 #include "common/config.h"
+#include "storage/page/page_size_class.h"
 
 namespace bustub {
 
 /**
  * DiskManager takes care of the allocation and deallocation of pages within a database. It performs the reading and
  * writing of pages to and from disk, providing a logical file layer within the context of a database management system.
+ *
+ * The log is addressed by offsets in one logical log, which is stored in fixed size segment files: test.log.000000,
+ * test.log.000001 and so on. test.log itself is the log control file, holding the segment size and the offset of the
+ * oldest log record that is still needed. Once a checkpoint no longer needs the oldest segments, they are zeroed and
+ * renamed to become the next segments, so that log writes reuse allocated files instead of extending new ones.
  */
 class DiskManager {
  public:
+  /** Default size of a log segment file. */
+  static constexpr int DEFAULT_LOG_SEGMENT_SIZE = 4 * 1024 * 1024;
+  /** Number of zeroed segment files kept ready beyond the one being written. */
+  static constexpr int NUM_SPARE_LOG_SEGMENTS = 2;
+
   /**
    * Creates a new disk manager that writes to the specified database file.
    * @param db_file the file name of the database file to write to
+   * @param log_segment_size the size of the log segment files, only used when a new log is created
    */
-  explicit DiskManager(const std::string &db_file);
+  explicit DiskManager(const std::string &db_file, int log_segment_size = DEFAULT_LOG_SEGMENT_SIZE);
 
   ~DiskManager() = default;
 
@@ -41,14 +54,14 @@ class DiskManager {
   void ShutDown();
 
   /**
-   * Write a page to the database file.
+   * Write a page to the database file. The page size and the file are taken from the size class in the page id.
    * @param page_id id of the page
    * @param page_data raw page data
    */
   void WritePage(page_id_t page_id, const char *page_data);
 
   /**
-   * Read a page from the database file.
+   * Read a page from the database file. The page size and the file are taken from the size class in the page id.
    * @param page_id id of the page
    * @param[out] page_data output buffer
    */
@@ -70,11 +83,49 @@ class DiskManager {
    */
   bool ReadLog(char *log_data, int size, int offset);
 
+  /** @return the size of the log in bytes, i.e. the offset of the next log write */
+  int GetLogSize();
+
+  /** @return the LSN after the last record in the log when it was opened, which new records continue from */
+  inline lsn_t GetNextLSN() const { return next_lsn_; }
+
+  /**
+   * Drop the log before the given offset. Segment files that only hold older records are recycled as spare segments
+   * or deleted, and spare segments are preallocated. Meant to be called after a checkpoint, not on the commit path.
+   * @param offset offset of the oldest log record that recovery still needs
+   */
+  void TruncateLog(int offset);
+
+  /** @return the offset of the oldest log record that can be read */
+  int GetLogStart();
+
+  /** @return the size of the log segment files */
+  int GetLogSegmentSize() const { return log_segment_size_; }
+
+  /** @return the file name of a log segment */
+  std::string GetLogSegmentName(int segment) const;
+
+  /**
+   * Overwrite the master record file, which tells recovery where to start reading the log.
+   * @param data raw master record
+   * @param size size of the master record
+   */
+  void WriteMasterRecord(const char *data, int size);
+
+  /**
+   * Read the master record file.
+   * @param[out] data output buffer
+   * @param size size of the master record
+   * @return false if there is no complete master record, e.g. because no checkpoint was taken yet
+   */
+  bool ReadMasterRecord(char *data, int size);
+
   /**
    * Allocate a page on disk.
-   * @return the id of the allocated page
+   * @param size_class the size class of the page
+   * @return the id of the allocated page, with the size class encoded in it
    */
-  page_id_t AllocatePage();
+  page_id_t AllocatePage(PageSizeClass size_class = PageSizeClass::SMALL);
 
   /**
    * Deallocate a page on disk.
@@ -82,6 +133,19 @@ class DiskManager {
    */
   void DeallocatePage(page_id_t page_id);
 
+  /**
+   * Makes AllocatePage() skip the given page and the pages before it in its size class. Recovery reserves the pages
+   * that exist on disk or in the log, so that they are not allocated again after a restart.
+   * @param page_id id of an existing page
+   */
+  void ReservePageId(page_id_t page_id);
+
+  /**
+   * @param size_class a page size class
+   * @return the number of pages of the size class that were written to disk
+   */
+  int GetNumPages(PageSizeClass size_class);
+
   /** @return the number of disk flushes */
   int GetNumFlushes() const;
 
@@ -91,6 +155,9 @@ class DiskManager {
   /** @return the number of disk writes */
   int GetNumWrites() const;
 
+  /** @return the number of page reads, i.e. buffer pool misses */
+  int GetNumReads() const;
+
   /**
    * Sets the future which is used to check for non-blocking flushes.
    * @param f the non-blocking flush check
@@ -102,15 +169,57 @@ class DiskManager {
 
  private:
   int GetFileSize(const std::string &file_name);
-  // stream to write log file
+  /** Opens the log segment file that log writes go to, creating it if there is no spare segment. */
+  void OpenLogSegment(int segment);
+  /** Reads the log, across segment files. Parts that are in no segment file read as zeroes. */
+  void ReadLogSegments(char *log_data, int size, int offset);
+  /**
+   * @param[out] next_lsn the LSN after the last record found, 0 if there is none
+   * @return the offset right after the last complete-looking record, walking the records from offset
+   */
+  int FindLogEnd(int offset, lsn_t *next_lsn);
+  /** Writes the log control file. */
+  void WriteLogControl();
+  /** Deletes the segment files of a log whose control file is gone. */
+  void RemoveLogSegments();
+  /** Zeroes a dead segment or a new file and renames it to follow the last segment. @return false if not needed */
+  bool AddSpareLogSegment(const std::string &file_name);
+  /** Fills a segment file with zeroes, so that nothing in it looks like a log record. */
+  void ZeroLogSegment(const std::string &segment_name);
+  /** @return the stream of the file holding pages of the given size class, opening the file on first use */
+  std::fstream &GetPageFile(PageSizeClass size_class);
+  // stream to write the current log segment
   std::fstream log_io_;
+  // segment of log_io_, -1 if it is not open
+  int log_io_segment_{-1};
+  // stream to read log segments and the segment it is open on
+  std::ifstream log_read_io_;
+  int log_read_segment_{-1};
+  // name of the log control file, the segment files are named after it
   std::string log_name_;
-  // stream to write db file
+  int log_segment_size_;
+  // offsets in the log of the oldest record that is still needed and of the next log write
+  int log_start_{0};
+  int log_end_{0};
+  // LSN after the last record in the log when it was opened
+  lsn_t next_lsn_{0};
+  // number of segment files after the current one, ready to be written
+  int num_spare_log_segments_{0};
+  // protects the log state, the log is written by the log flush thread while checkpoints truncate it
+  std::mutex log_latch_;
+  // the master record is written to its own small file, next to the log
+  std::string master_name_;
+  // stream to write db file, pages of size class SMALL
   std::fstream db_io_;
   std::string file_name_;
-  std::atomic<page_id_t> next_page_id_;
+  // streams to write the files of the larger size classes, index 0 is unused and db_io_ is used instead
+  std::fstream size_class_io_[NUM_PAGE_SIZE_CLASSES];
+  std::string size_class_file_name_[NUM_PAGE_SIZE_CLASSES];
+  // next local page id of each size class
+  std::atomic<page_id_t> next_page_id_[NUM_PAGE_SIZE_CLASSES]{};
   int num_flushes_;
   int num_writes_;
+  int num_reads_;
   bool flush_log_;
   std::future<void> *flush_log_f_;
 };
@@ -60,13 +60,16 @@ class BPlusTree {
   INDEXITERATOR_TYPE end();
 
   void Print(BufferPoolManager *bpm) {
-    ToString(reinterpret_cast<BPlusTreePage *>(bpm->FetchPage(root_page_id_)->GetData()), bpm);
+    auto root_guard = bpm->FetchPageBasic(root_page_id_);
+    ToString(root_guard.As<BPlusTreePage>(), bpm);
   }
 
   void Draw(BufferPoolManager *bpm, const std::string &outf) {
     std::ofstream out(outf);
     out << "digraph G {" << std::endl;
-    ToGraph(reinterpret_cast<BPlusTreePage *>(bpm->FetchPage(root_page_id_)->GetData()), bpm, out);
+    auto root_guard = bpm->FetchPageBasic(root_page_id_);
+    ToGraph(root_guard.As<BPlusTreePage>(), bpm, out);
+    root_guard.Drop();
     out << "}" << std::endl;
     out.close();
   }
@@ -104,7 +107,7 @@ class BPlusTree {
 
   void UpdateRootPageId(int insert_record = 0);
 
-  /* Debug Routines for FREE!! */
+  /* Debug Routines for FREE!! The caller keeps page pinned, children are pinned through page guards. */
   void ToGraph(BPlusTreePage *page, BufferPoolManager *bpm, std::ofstream &out) const;
 
   void ToString(BPlusTreePage *page, BufferPoolManager *bpm) const;
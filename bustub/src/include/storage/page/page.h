@@ -12,10 +12,12 @@
 
 #pragma once
 
+#include <atomic>
 #include <cstring>
 #include <iostream>
 
 #include "common/config.h"
+#include "common/macros.h"
 #include "common/rwlatch.h"
 
 namespace bustub {
@@ -30,15 +32,26 @@ class Page {
   friend class BufferPoolManager;
 
  public:
-  /** Constructor. Zeros out the page data. */
-  Page() { ResetMemory(); }
+  /** Constructor. Allocates PAGE_SIZE bytes of page data and zeros it out. */
+  Page() : Page(PAGE_SIZE) {}
 
-  /** Default destructor. */
-  ~Page() = default;
+  /**
+   * Constructor. Allocates the page data and zeros it out.
+   * @param page_size the number of bytes of page data, see PageSizeOf() for the sizes used by the buffer pool
+   */
+  explicit Page(uint32_t page_size) : data_(new char[page_size]), page_size_(page_size) { ResetMemory(); }
+
+  /** Destructor. Frees the page data. */
+  ~Page() { delete[] data_; }
+
+  DISALLOW_COPY_AND_MOVE(Page);
 
   /** @return the actual data contained within this page */
   inline char *GetData() { return data_; }
 
+  /** @return the number of bytes of data held by this page */
+  inline uint32_t GetPageSize() { return page_size_; }
+
   /** @return the page id of this page */
   inline page_id_t GetPageId() { return page_id_; }
 
@@ -63,8 +76,18 @@ class Page {
   /** @return the page LSN. */
   inline lsn_t GetLSN() { return *reinterpret_cast<lsn_t *>(GetData() + OFFSET_LSN); }
 
-  /** Sets the page LSN. */
-  inline void SetLSN(lsn_t lsn) { memcpy(GetData() + OFFSET_LSN, &lsn, sizeof(lsn_t)); }
+  /** Sets the page LSN. The first LSN set since the page was last written out becomes its recovery LSN. */
+  inline void SetLSN(lsn_t lsn) {
+    memcpy(GetData() + OFFSET_LSN, &lsn, sizeof(lsn_t));
+    lsn_t no_rec_lsn = INVALID_LSN;
+    rec_lsn_.compare_exchange_strong(no_rec_lsn, lsn);
+  }
+
+  /**
+   * @return the recovery LSN, i.e. the LSN of the first log record that changed the page since it was last written to
+   * disk, or INVALID_LSN if the page on disk reflects every logged change
+   */
+  inline lsn_t GetRecLSN() const { return rec_lsn_; }
 
  protected:
   static_assert(sizeof(page_id_t) == 4);
@@ -76,16 +99,20 @@ class Page {
 
  private:
   /** Zeroes out the data that is held within the page. */
-  inline void ResetMemory() { memset(data_, OFFSET_PAGE_START, PAGE_SIZE); }
+  inline void ResetMemory() { memset(data_, OFFSET_PAGE_START, page_size_); }
 
   /** The actual data that is stored within a page. */
-  char data_[PAGE_SIZE]{};
+  char *data_;
+  /** The number of bytes in data_. */
+  uint32_t page_size_;
   /** The ID of this page. */
   page_id_t page_id_ = INVALID_PAGE_ID;
   /** The pin count of this page. */
   int pin_count_ = 0;
   /** True if the page is dirty, i.e. it is different from its corresponding page on disk. */
   bool is_dirty_ = false;
+  /** The recovery LSN, for the dirty page table of checkpoints. Set by the thread holding the write latch. */
+  std::atomic<lsn_t> rec_lsn_{INVALID_LSN};
   /** Page latch. */
   ReaderWriterLatch rwlatch_;
 };
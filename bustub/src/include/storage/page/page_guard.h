@@ -0,0 +1,219 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// page_guard.h
+//
+// Identification: src/include/storage/page/page_guard.h
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <type_traits>
+#include <utility>
+
+#include "storage/page/page.h"
+
+namespace bustub {
+
+class BufferPoolManager;
+class ReadPageGuard;
+class WritePageGuard;
+
+/**
+ * BasicPageGuard owns one pin on a buffer pool page. The pin is released when the guard is destroyed, dropped or
+ * overwritten by a move assignment, so a page can never be left pinned on an early return.
+ *
+ * Guards are move-only: exactly one guard is responsible for a pin at any time.
+ */
+class BasicPageGuard {
+  friend class ReadPageGuard;
+  friend class WritePageGuard;
+
+ public:
+  BasicPageGuard() = default;
+
+  /**
+   * Wraps a page that has already been pinned by the buffer pool manager.
+   * @param bpm the buffer pool manager that pinned the page
+   * @param page the pinned page, may be nullptr if the fetch failed
+   */
+  BasicPageGuard(BufferPoolManager *bpm, Page *page) : bpm_(bpm), page_(page) {}
+
+  BasicPageGuard(const BasicPageGuard &) = delete;
+  BasicPageGuard &operator=(const BasicPageGuard &) = delete;
+
+  /** Takes over the pin held by that. That is left empty. */
+  BasicPageGuard(BasicPageGuard &&that) noexcept;
+
+  /** Releases the pin held by this guard, then takes over the pin held by that. */
+  BasicPageGuard &operator=(BasicPageGuard &&that) noexcept;
+
+  /** Unpins the page if this guard still owns it. */
+  ~BasicPageGuard();
+
+  /** Unpins the page now. The guard becomes empty and a later Drop() or destruction is a no-op. */
+  void Drop();
+
+  /**
+   * Acquires the read latch on the guarded page and hands the pin over to a ReadPageGuard.
+   * This guard is left empty.
+   */
+  ReadPageGuard UpgradeRead();
+
+  /**
+   * Acquires the write latch on the guarded page and hands the pin over to a WritePageGuard.
+   * This guard is left empty.
+   */
+  WritePageGuard UpgradeWrite();
+
+  /** @return true if the guard owns a pinned page, false if it is empty or the fetch failed */
+  inline bool IsValid() const { return page_ != nullptr; }
+
+  /** @return the id of the guarded page */
+  inline page_id_t PageId() const { return page_->GetPageId(); }
+
+  /** @return the data of the guarded page */
+  inline const char *GetData() const { return page_->GetData(); }
+
+  /** @return the data of the guarded page, the page is marked dirty */
+  inline char *GetDataMut() {
+    is_dirty_ = true;
+    return page_->GetData();
+  }
+
+  /** Marks the page dirty so that it is written back when the guard releases its pin. */
+  inline void MarkDirty() { is_dirty_ = true; }
+
+  /**
+   * Views the guarded page as T without marking it dirty. Page subclasses (TablePage, HeaderPage) are cast from the
+   * frame itself, everything else (B+ tree and hash table pages) is overlaid on the page data.
+   */
+  template <class T>
+  inline T *As() const {
+    if constexpr (std::is_base_of_v<Page, T>) {
+      return static_cast<T *>(page_);
+    } else {
+      return reinterpret_cast<T *>(page_->GetData());
+    }
+  }
+
+  /** Same as As(), but the page is marked dirty. */
+  template <class T>
+  inline T *AsMut() {
+    is_dirty_ = true;
+    return As<T>();
+  }
+
+ private:
+  BufferPoolManager *bpm_{nullptr};
+  Page *page_{nullptr};
+  bool is_dirty_{false};
+};
+
+/**
+ * ReadPageGuard owns one pin and the read latch of a page. The latch is released before the pin.
+ */
+class ReadPageGuard {
+  friend class BasicPageGuard;
+
+ public:
+  ReadPageGuard() = default;
+
+  /**
+   * Wraps a page that has already been pinned and read-latched.
+   * @param bpm the buffer pool manager that pinned the page
+   * @param page the pinned and read-latched page, may be nullptr if the fetch failed
+   */
+  ReadPageGuard(BufferPoolManager *bpm, Page *page) : guard_(bpm, page) {}
+
+  ReadPageGuard(const ReadPageGuard &) = delete;
+  ReadPageGuard &operator=(const ReadPageGuard &) = delete;
+
+  ReadPageGuard(ReadPageGuard &&that) noexcept = default;
+
+  /** Releases the latch and pin held by this guard, then takes over those held by that. */
+  ReadPageGuard &operator=(ReadPageGuard &&that) noexcept;
+
+  /** Unlatches and unpins the page if this guard still owns it. */
+  ~ReadPageGuard();
+
+  /** Unlatches and unpins the page now. */
+  void Drop();
+
+  inline bool IsValid() const { return guard_.IsValid(); }
+
+  inline page_id_t PageId() const { return guard_.PageId(); }
+
+  inline const char *GetData() const { return guard_.GetData(); }
+
+  /** Views the guarded page as T. Callers must only use the read-only members of T. */
+  template <class T>
+  inline T *As() const {
+    return guard_.As<T>();
+  }
+
+ private:
+  BasicPageGuard guard_;
+};
+
+/**
+ * WritePageGuard owns one pin and the write latch of a page. The latch is released before the pin.
+ */
+class WritePageGuard {
+  friend class BasicPageGuard;
+
+ public:
+  WritePageGuard() = default;
+
+  /**
+   * Wraps a page that has already been pinned and write-latched.
+   * @param bpm the buffer pool manager that pinned the page
+   * @param page the pinned and write-latched page, may be nullptr if the fetch failed
+   */
+  WritePageGuard(BufferPoolManager *bpm, Page *page) : guard_(bpm, page) {}
+
+  WritePageGuard(const WritePageGuard &) = delete;
+  WritePageGuard &operator=(const WritePageGuard &) = delete;
+
+  WritePageGuard(WritePageGuard &&that) noexcept = default;
+
+  /** Releases the latch and pin held by this guard, then takes over those held by that. */
+  WritePageGuard &operator=(WritePageGuard &&that) noexcept;
+
+  /** Unlatches and unpins the page if this guard still owns it. */
+  ~WritePageGuard();
+
+  /** Unlatches and unpins the page now. */
+  void Drop();
+
+  inline bool IsValid() const { return guard_.IsValid(); }
+
+  inline page_id_t PageId() const { return guard_.PageId(); }
+
+  inline const char *GetData() const { return guard_.GetData(); }
+
+  inline char *GetDataMut() { return guard_.GetDataMut(); }
+
+  inline void MarkDirty() { guard_.MarkDirty(); }
+
+  /** Views the guarded page as T without marking it dirty. */
+  template <class T>
+  inline T *As() const {
+    return guard_.As<T>();
+  }
+
+  /** Views the guarded page as T, the page is marked dirty. */
+  template <class T>
+  inline T *AsMut() {
+    return guard_.AsMut<T>();
+  }
+
+ private:
+  BasicPageGuard guard_;
+};
+
+}  // namespace bustub
@@ -0,0 +1,71 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// page_size_class.h
+//
+// Identification: src/include/storage/page/page_size_class.h
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "common/config.h"
+
+namespace bustub {
+
+/**
+ * Pages come in a few fixed sizes. Each size class has its own frames in the buffer pool and its own file on disk.
+ *
+ * The size class is encoded in the page id, so that any component holding a page id can find the page size:
+ *  -------------------------------------------------
+ *  | sign (1) | size class (3) | local page id (28) |
+ *  -------------------------------------------------
+ * SMALL pages have a size class of 0, so their page ids are the same as before size classes were introduced.
+ */
+enum class PageSizeClass : uint8_t { SMALL = 0, MEDIUM, LARGE };
+
+/** Number of page size classes. */
+static constexpr size_t NUM_PAGE_SIZE_CLASSES = 3;
+
+static constexpr uint32_t PAGE_SIZE_CLASS_SHIFT = 28;
+static constexpr page_id_t LOCAL_PAGE_ID_MASK = (1 << PAGE_SIZE_CLASS_SHIFT) - 1;
+
+/** @return the number of bytes in a page of the given size class: PAGE_SIZE, 4 * PAGE_SIZE or 16 * PAGE_SIZE */
+inline constexpr uint32_t PageSizeOf(PageSizeClass size_class) {
+  return static_cast<uint32_t>(PAGE_SIZE) << (2 * static_cast<uint32_t>(size_class));
+}
+
+/** @return the size in bytes of the largest page size class */
+inline constexpr uint32_t MaxPageSize() { return PageSizeOf(static_cast<PageSizeClass>(NUM_PAGE_SIZE_CLASSES - 1)); }
+
+/** @return the smallest size class whose pages hold at least bytes bytes, false if no size class is large enough */
+inline bool PageSizeClassFor(size_t bytes, PageSizeClass *size_class) {
+  for (size_t i = 0; i < NUM_PAGE_SIZE_CLASSES; i++) {
+    if (bytes <= PageSizeOf(static_cast<PageSizeClass>(i))) {
+      *size_class = static_cast<PageSizeClass>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+/** @return the size class encoded in a (valid) page id */
+inline constexpr PageSizeClass GetPageSizeClass(page_id_t page_id) {
+  return static_cast<PageSizeClass>(static_cast<uint32_t>(page_id) >> PAGE_SIZE_CLASS_SHIFT);
+}
+
+/** @return the page id within its size class, i.e. its slot in the size class file */
+inline constexpr page_id_t GetLocalPageId(page_id_t page_id) { return page_id & LOCAL_PAGE_ID_MASK; }
+
+/** @return the page id of the local_page_id-th page of the given size class */
+inline constexpr page_id_t MakePageId(PageSizeClass size_class, page_id_t local_page_id) {
+  return static_cast<page_id_t>(static_cast<uint32_t>(size_class) << PAGE_SIZE_CLASS_SHIFT) | local_page_id;
+}
+
+}  // namespace bustub
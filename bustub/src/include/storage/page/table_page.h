@@ -40,6 +40,7 @@ namespace bustub {
  *  | TupleCount (4) | Tuple_1 offset (4) | Tuple_1 size (4) | ... |
  *  ----------------------------------------------------------------
  *
+ * Changes made without a transaction, i.e. by recovery, are neither locked nor logged.
  */
 class TablePage : public Page {
  public:
@@ -77,17 +78,25 @@ class TablePage : public Page {
    * @param tuple tuple to insert
    * @param[out] rid rid of the inserted tuple
    * @param txn transaction performing the insert
-   * @param lock_manager the lock manager
+   * @param lock_manager the lock manager, nullptr if txn holds a table lock that covers the tuple
    * @param log_manager the log manager
    * @return true if the insert is successful (i.e. there is enough space)
    */
   bool InsertTuple(const Tuple &tuple, RID *rid, Transaction *txn, LockManager *lock_manager, LogManager *log_manager);
 
+  /**
+   * Insert a tuple into the slot it had, to redo its insert or undo its delete. Nothing is locked or logged.
+   * @param tuple tuple to insert
+   * @param rid rid of the tuple, a free slot or the one after the last slot
+   * @return true if the insert is successful (i.e. there is enough space)
+   */
+  bool InsertTupleAt(const Tuple &tuple, const RID &rid);
+
   /**
    * Mark a tuple as deleted. This does not actually delete the tuple.
    * @param rid rid of the tuple to mark as deleted
    * @param txn transaction performing the delete
-   * @param lock_manager the lock manager
+   * @param lock_manager the lock manager, nullptr if txn holds a table lock that covers the tuple
    * @param log_manager the log manager
    * @return true if marking the tuple as deleted is successful (i.e the tuple exists)
    */
@@ -99,7 +108,7 @@ class TablePage : public Page {
    * @param[out] old_tuple old value of the tuple
    * @param rid rid of the tuple
    * @param txn transaction performing the update
-   * @param lock_manager the lock manager
+   * @param lock_manager the lock manager, nullptr if txn holds a table lock that covers the tuple
    * @param log_manager the log manager
    * @return true if updating the tuple succeeded
    */
@@ -112,12 +121,26 @@ class TablePage : public Page {
   /** To be called on abort. Rollback a delete, i.e. this reverses a MarkDelete. */
   void RollbackDelete(const RID &rid, Transaction *txn, LogManager *log_manager);
 
+  /**
+   * Add to a fixed-size numeric field of a tuple in place. The caller holds a lock on the tuple that lets it increment.
+   * @param rid rid of the tuple
+   * @param offset offset of the field in the tuple
+   * @param delta value added to the field, of the type of the field
+   * @param txn transaction performing the increment
+   * @param log_manager the log manager
+   * @return false if the tuple does not exist, or the field would overflow
+   */
+  bool IncrementTuple(const RID &rid, uint32_t offset, const Value &delta, Transaction *txn, LogManager *log_manager);
+
+  /** @return the delta that undoes adding delta to a field */
+  static Value NegateDelta(const Value &delta);
+
   /**
    * Read a tuple from a table.
    * @param rid rid of the tuple to read
    * @param[out] tuple the tuple that was read
    * @param txn transaction performing the read
-   * @param lock_manager the lock manager
+   * @param lock_manager the lock manager, nullptr if txn holds a table lock that covers the tuple
    * @return true if the read is successful (i.e. the tuple exists)
    */
   bool GetTuple(const RID &rid, Tuple *tuple, Transaction *txn, LockManager *lock_manager);
@@ -126,16 +149,18 @@ class TablePage : public Page {
 
   /**
    * @param[out] first_rid the RID of the first tuple in this page
+   * @param with_empty_slots true to return the first slot even if its tuple is deleted or empty
    * @return true if the first tuple exists, false otherwise
    */
-  bool GetFirstTupleRid(RID *first_rid);
+  bool GetFirstTupleRid(RID *first_rid, bool with_empty_slots = false);
 
   /**
    * @param cur_rid the RID of the current tuple
    * @param[out] next_rid the RID of the tuple following the current tuple
+   * @param with_empty_slots true to return the next slot even if its tuple is deleted or empty
    * @return true if the next tuple exists, false otherwise
    */
-  bool GetNextTupleRid(const RID &cur_rid, RID *next_rid);
+  bool GetNextTupleRid(const RID &cur_rid, RID *next_rid, bool with_empty_slots = false);
 
  private:
   static_assert(sizeof(page_id_t) == 4);
@@ -190,6 +215,12 @@ class TablePage : public Page {
     memcpy(GetData() + OFFSET_TUPLE_SIZE + SIZE_TUPLE * slot_num, &size, sizeof(uint32_t));
   }
 
+  /** Locks a free slot for a new tuple of txn, unless another transaction still holds a lock on it. */
+  bool TryLockFreeSlot(uint32_t slot_num, Transaction *txn, LockManager *lock_manager);
+
+  /** Copies a tuple into the free space and points a free slot, or the one after the last slot, at it. */
+  void PutTuple(const Tuple &tuple, uint32_t slot_num);
+
   /** @return true if the tuple is deleted or empty */
   static bool IsDeleted(uint32_t tuple_size) { return static_cast<bool>(tuple_size & DELETE_MASK) || tuple_size == 0; }
 
@@ -12,17 +12,33 @@
 
 #pragma once
 
+#include <mutex>  // NOLINT
+#include <unordered_map>
+#include <vector>
+
 #include "buffer/buffer_pool_manager.h"
 #include "recovery/log_manager.h"
 #include "storage/page/table_page.h"
 #include "storage/table/table_iterator.h"
 #include "storage/table/tuple.h"
+#include "storage/table/version_store.h"
 
 namespace bustub {
 
 /**
  * TableHeap represents a physical table on disk.
  * This is just a doubly-linked list of pages.
+ *
+ * While transactions are locked, the heap keeps the versions that their changes replace in a VersionStore, so that
+ * SNAPSHOT_ISOLATION and OPTIMISTIC transactions read the table as it was when they began, without taking shared
+ * locks. OPTIMISTIC transactions keep their updates and deletes in their buffered write set, which TransactionManager
+ * installs when they commit; their inserts need a RID right away, so they go to the pages as for other transactions.
+ *
+ * Increments of numeric columns go to the pages for every transaction. They commute, so the transactions that increment
+ * a tuple take INCREMENT locks that go together, and each increment is rolled back or undone by recovery by subtracting
+ * it, which keeps the increments other transactions made since. While increments of a field are pending, the heap keeps
+ * the range the field may end up in whichever of them commit, and refuses an increment that would take the range out of
+ * its type, so that rolling back any of them cannot overflow.
  */
 class TableHeap {
   friend class TableIterator;
@@ -36,9 +52,10 @@ class TableHeap {
    * @param lock_manager the lock manager
    * @param log_manager the log manager
    * @param first_page_id the id of the first page
+   * @param table_oid the table stored in the heap, which transactions lock to announce their locks on its tuples
    */
   TableHeap(BufferPoolManager *buffer_pool_manager, LockManager *lock_manager, LogManager *log_manager,
-            page_id_t first_page_id);
+            page_id_t first_page_id, table_oid_t table_oid = 0);
 
   /**
    * Create a table heap with a transaction. (create table)
@@ -46,12 +63,15 @@ class TableHeap {
    * @param lock_manager the lock manager
    * @param log_manager the log manager
    * @param txn the creating transaction
+   * @param table_oid the table stored in the heap, which transactions lock to announce their locks on its tuples
    */
   TableHeap(BufferPoolManager *buffer_pool_manager, LockManager *lock_manager, LogManager *log_manager,
-            Transaction *txn);
+            Transaction *txn, table_oid_t table_oid = 0);
 
   /**
-   * Insert a tuple into the table. If the tuple is too large (>= page_size), return false.
+   * Insert a tuple into the table. Tuples that do not fit in a default sized page go to a page of a larger size class.
+   * If the tuple is too large for the largest page size class, or for its log records to fit in the log buffer while
+   * logging is enabled, abort the transaction and return false.
    * @param tuple tuple to insert
    * @param[out] rid the rid of the inserted tuple
    * @param txn the transaction performing the insert
@@ -60,7 +80,8 @@ class TableHeap {
   bool InsertTuple(const Tuple &tuple, RID *rid, Transaction *txn);
 
   /**
-   * Mark the tuple as deleted. The actual delete will occur when ApplyDelete is called.
+   * Mark the tuple as deleted. The actual delete will occur when ApplyDelete is called. An OPTIMISTIC transaction only
+   * buffers the delete.
    * @param rid resource id of the tuple of delete
    * @param txn transaction performing the delete
    * @return true iff the delete is successful (i.e the tuple exists)
@@ -68,7 +89,9 @@ class TableHeap {
   bool MarkDelete(const RID &rid, Transaction *txn);  // for delete
 
   /**
-   * if the new tuple is too large to fit in the old page, return false (will delete and insert)
+   * if the new tuple is too large to fit in the old page, return false (will delete and insert). A tuple too large for
+   * its log records to fit in the log buffer aborts the transaction. An OPTIMISTIC transaction only buffers the
+   * update, and finds out whether it fits when it commits.
    * @param tuple new tuple
    * @param rid rid of the old tuple
    * @param txn transaction performing the update
@@ -77,12 +100,32 @@ class TableHeap {
   bool UpdateTuple(const Tuple &tuple, const RID &rid, Transaction *txn);
 
   /**
-   * Called on Commit/Abort to actually delete a tuple or rollback an insert.
+   * Add to a column of a tuple in place, without reading the tuple.
+   * @param rid rid of the tuple
+   * @param schema the schema of the tuple
+   * @param column_idx the column to add to, of a numeric type
+   * @param delta the value to add, which is cast to the type of the column
+   * @param txn transaction performing the increment
+   * @return true if the increment is successful, false if the tuple does not exist or the column would overflow
+   */
+  bool IncrementTuple(const RID &rid, const Schema &schema, uint32_t column_idx, const Value &delta,
+                      Transaction *txn);
+
+  /**
+   * Called on Abort to rollback an insert. The tuple is unlocked while its page is still latched.
    * @param rid rid of the tuple to delete
    * @param txn transaction performing the delete.
    */
   void ApplyDelete(const RID &rid, Transaction *txn);
 
+  /**
+   * Called on Commit to actually delete the tuples txn marked deleted on one page. The tuples stay locked until txn
+   * releases its locks, after its COMMIT record is appended.
+   * @param rids rids of the tuples to delete, all on the same page
+   * @param txn transaction performing the delete.
+   */
+  void ApplyDeletes(const std::vector<RID> &rids, Transaction *txn);
+
   /**
    * Called on abort to rollback a delete.
    * @param rid rid of the deleted tuple.
@@ -90,6 +133,31 @@ class TableHeap {
    */
   void RollbackDelete(const RID &rid, Transaction *txn);
 
+  /**
+   * Called on abort to rollback an update.
+   * @param tuple the old value of the tuple
+   * @param rid rid of the updated tuple
+   * @param txn transaction performing the rollback
+   */
+  void RollbackUpdate(const Tuple &tuple, const RID &rid, Transaction *txn);
+
+  /**
+   * Called on commit for each increment of the transaction, to give up the range it kept for a rollback.
+   * @param rid rid of the incremented tuple
+   * @param offset offset of the incremented field in the tuple
+   * @param delta the value that was added to the field
+   */
+  void CommitIncrement(const RID &rid, uint32_t offset, const Value &delta);
+
+  /**
+   * Called on abort to rollback an increment, by subtracting it.
+   * @param rid rid of the incremented tuple
+   * @param offset offset of the incremented field in the tuple
+   * @param delta the value that was added to the field
+   * @param txn transaction performing the rollback
+   */
+  void RollbackIncrement(const RID &rid, uint32_t offset, const Value &delta, Transaction *txn);
+
   /**
    * Read a tuple from the table.
    * @param rid rid of the tuple to read
@@ -99,20 +167,152 @@ class TableHeap {
    */
   bool GetTuple(const RID &rid, Tuple *tuple, Transaction *txn);
 
+  /**
+   * Called on commit, before the locks of the transaction are released, for each tuple it changed.
+   * @param rid a tuple the transaction changed
+   * @param txn the committing transaction
+   * @param commit_ts the commit timestamp of the transaction
+   * @param watermark the read timestamp of the oldest running snapshot, older versions are dropped
+   */
+  void CommitVersion(const RID &rid, Transaction *txn, timestamp_t commit_ts, timestamp_t watermark);
+
+  /**
+   * Called on abort, once the changes of the transaction are rolled back, for each tuple it changed.
+   * @param rid a tuple the transaction changed
+   * @param txn the aborted transaction
+   */
+  void RollbackVersion(const RID &rid, Transaction *txn);
+
+  /**
+   * Called on commit of an OPTIMISTIC transaction, before it is validated, for each tuple it buffered a change of.
+   * @return false if the transaction was aborted while it waited for the lock
+   */
+  bool LockForInstall(const RID &rid, Transaction *txn);
+
+  /** @return true if a version of rid was committed after the snapshot of txn */
+  bool IsChangedSince(const RID &rid, Transaction *txn);
+
+  /**
+   * Called on commit of an OPTIMISTIC transaction, once it is validated, to apply a change it buffered.
+   * @return false if the change could not be applied
+   */
+  bool InstallWrite(const TableWriteRecord &write, Transaction *txn);
+
   /** @return the begin iterator of this table */
   TableIterator Begin(Transaction *txn);
 
   /** @return the end iterator of this table */
   TableIterator End();
 
+  /** @return the number of tuples that have older versions kept for snapshots */
+  inline size_t GetNumVersionChains() const { return versions_.GetNumChains(); }
+
   /** @return the id of the first page of this table */
   inline page_id_t GetFirstPageId() const { return first_page_id_; }
 
+  /** @return the table stored in the heap */
+  inline table_oid_t GetTableOid() const { return table_oid_; }
+
  private:
+  /** @return true if txn has yet to lock rid to read it, or to change it if exclusive is true */
+  bool NeedsLock(const RID &rid, Transaction *txn, bool exclusive);
+
+  /** @return true if txn has yet to lock rid to increment it */
+  bool NeedsIncrementLock(const RID &rid, Transaction *txn);
+
+  /**
+   * Widens the range of a field by an increment about to be made, while the page of the tuple is write latched.
+   * @param page the page of the tuple
+   * @return false if the range would overflow the type of the field
+   */
+  bool ReserveIncrement(TablePage *page, const RID &rid, const Schema &schema, uint32_t column_idx,
+                        const Value &delta);
+
+  /** Narrows the range of a field once an increment committed, or was rolled back if committed is false. */
+  void ReleaseIncrement(const RID &rid, uint32_t offset, const Value &delta, bool committed);
+
+  /** @return true if txn holds a lock on the table that lets it read any tuple, or change any if exclusive is true */
+  bool IsCoveredByTableLock(Transaction *txn, bool exclusive);
+
+  /** @return the lock manager that table pages lock tuples of txn with, nullptr if the table lock covers the tuples */
+  LockManager *GetRowLockManager(Transaction *txn, bool exclusive);
+
+  /**
+   * Takes the lock txn needs on rid, if any, after an intention lock on the table. Locks are taken before the page of
+   * the tuple is latched, as a transaction that waits for a lock while it holds a latch may keep the holder of the lock
+   * from finishing.
+   * @return false if the transaction is aborted
+   */
+  bool LockTuple(const RID &rid, Transaction *txn, bool exclusive);
+
+  /** Marks a tuple deleted under an exclusive lock of txn, see MarkDelete(). */
+  bool LockedMarkDelete(const RID &rid, Transaction *txn);
+
+  /** Updates a tuple under an exclusive lock of txn, see UpdateTuple(). */
+  bool LockedUpdateTuple(const Tuple &tuple, const RID &rid, Transaction *txn);
+
+  /**
+   * Buffers the change of an OPTIMISTIC transaction to a tuple, in place of an earlier one.
+   * @return false if the tuple does not exist for txn
+   */
+  bool BufferWrite(const RID &rid, WType wtype, const Tuple &tuple, Transaction *txn);
+
+  /** Gives back a lock that txn took for a tuple that turned out not to exist. */
+  void ReleaseMissingTuple(const RID &rid, Transaction *txn);
+
+  /** @return true if the changes of txn replace versions that are kept for snapshots */
+  static bool IsVersioned(Transaction *txn) { return enable_logging && txn != nullptr; }
+
+  /** @return true if txn reads the versions of its snapshot instead of locking the tuples */
+  static bool IsSnapshotRead(Transaction *txn) { return IsVersioned(txn) && txn->ReadsSnapshot(); }
+
+  /** @return true if txn buffers its updates and deletes until it commits */
+  static bool IsOptimistic(Transaction *txn) {
+    return IsVersioned(txn) && txn->GetConcurrencyMode() == ConcurrencyMode::OPTIMISTIC;
+  }
+
+  /** @return true if the log records of a change to the tuple fit in the log buffer, or nothing is logged */
+  static bool FitsInLog(const Tuple &tuple) {
+    return !enable_logging || tuple.GetLength() <= LogRecord::MaxTupleSize();
+  }
+
+  /**
+   * Aborts a read-only transaction that is about to change the table.
+   * @return false if the transaction was aborted
+   */
+  static bool CheckWritable(Transaction *txn);
+
+  /**
+   * Aborts a transaction reading a snapshot that is about to overwrite a version committed after its snapshot.
+   * @return false if the transaction was aborted
+   */
+  bool CheckWriteConflict(const RID &rid, Transaction *txn);
+
+  /**
+   * Reads the version of a tuple that the snapshot of txn sees.
+   * @param page the page of the tuple, latched
+   * @return true if the tuple exists in the snapshot
+   */
+  bool GetVisibleTuple(TablePage *page, const RID &rid, Tuple *tuple, Transaction *txn);
+
   BufferPoolManager *buffer_pool_manager_;
   LockManager *lock_manager_;
   LogManager *log_manager_;
   page_id_t first_page_id_{};
+  table_oid_t table_oid_;
+  /** The versions replaced by changes that some snapshot may still read. */
+  VersionStore versions_;
+
+  /** The values a field may end up with, whichever of the pending increments of it commit. */
+  struct IncrementRange {
+    Value min_;
+    Value max_;
+    /** Number of increments that did not commit or roll back yet. */
+    size_t pending_{0};
+  };
+  std::mutex increment_latch_;
+  /** The ranges of the fields with pending increments, by tuple and offset of the field. */
+  std::unordered_map<RID, std::unordered_map<uint32_t, IncrementRange>> increment_ranges_;
 };
 
 }  // namespace bustub
@@ -0,0 +1,176 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// version_store.h
+//
+// Identification: src/include/storage/table/version_store.h
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <atomic>
+#include <mutex>  // NOLINT
+#include <unordered_map>
+#include <vector>
+
+#include "common/rid.h"
+#include "concurrency/transaction.h"
+#include "storage/table/tuple.h"
+
+namespace bustub {
+
+/**
+ * VersionStore keeps the older versions of the tuples of a table, for the transactions that read snapshots.
+ *
+ * A table page only holds the newest version of each tuple, which may not be committed yet. Before a transaction
+ * first changes a tuple, the version it replaces goes into the version chain of the tuple, together with the commit
+ * timestamp the version was created at. When the transaction commits, the version on the page gets the commit
+ * timestamp of the transaction. A snapshot reads the newest version committed at or before its read timestamp.
+ *
+ * Increments do not replace the version on the page, they add to it while other transactions increment the same tuple
+ * too. The chain keeps each increment with the timestamp its transaction committed at, and a snapshot subtracts the
+ * increments it does not see from the version it reads. A transaction that overwrites the tuple later turns the
+ * increments into versions.
+ *
+ * Tuples that have no chain were committed before every snapshot that is still running. A chain is dropped once every
+ * snapshot sees the version on the page, and versions that no snapshot sees anymore are dropped from the chains.
+ *
+ * The chains of a tuple are changed while its page is write latched, and read while it is latched, so that the page
+ * and the chain are always seen together.
+ */
+class VersionStore {
+  /** A version a transaction replaced. */
+  struct UndoVersion {
+    /** The commit timestamp the version was created at. */
+    timestamp_t ts_;
+    /** False if the tuple did not exist. */
+    bool exists_;
+    Tuple tuple_;
+  };
+
+  /** An increment of a field of the version on the page. */
+  struct IncrementVersion {
+    txn_id_t txn_id_;
+    /** The commit timestamp of the transaction, 0 until it commits. */
+    timestamp_t ts_;
+    /** The offset of the field in the tuple. */
+    uint32_t offset_;
+    Value delta_;
+  };
+
+  struct VersionChain {
+    /** The transaction that changed the version on the page and did not commit yet, INVALID_TXN_ID if none. */
+    txn_id_t writer_{INVALID_TXN_ID};
+    /** The commit timestamp of the version on the page, if it is committed. */
+    timestamp_t ts_{0};
+    /** The versions that were replaced, oldest first. */
+    std::vector<UndoVersion> undo_;
+    /** The increments of the version on the page that some snapshot may not see, only while there is no writer. */
+    std::vector<IncrementVersion> increments_;
+  };
+
+  /** The chains are split into 2^SHARD_BITS shards by the hash of the RID, each with its own latch. */
+  static constexpr size_t SHARD_BITS = 4;
+  static constexpr size_t NUM_SHARDS = 1 << SHARD_BITS;
+  /** Number of chains below which the chains are not swept for garbage. */
+  static constexpr size_t MIN_CHAINS_TO_COLLECT = 1024;
+
+  struct alignas(64) Shard {
+    std::mutex latch_;
+    std::unordered_map<RID, VersionChain> chains_;
+  };
+
+ public:
+  /**
+   * Saves the version of a tuple that a transaction is about to replace, unless the transaction replaced it already.
+   * @param rid the tuple, whose page is write latched
+   * @param txn the transaction changing the tuple, which holds an exclusive lock on it
+   * @param tuple the version that is replaced, nullptr if the tuple does not exist yet
+   */
+  void SaveVersion(const RID &rid, Transaction *txn, const Tuple *tuple);
+
+  /**
+   * Records an increment of a field of a tuple, unless the version on the page is the transaction's own.
+   * @param rid the tuple, whose page is write latched
+   * @param txn the transaction incrementing the tuple, which holds an increment or exclusive lock on it
+   * @param offset the offset of the field in the tuple
+   * @param delta the value added to the field
+   */
+  void SaveIncrement(const RID &rid, Transaction *txn, uint32_t offset, const Value &delta);
+
+  /** Drops the newest increment a transaction recorded for a field of a tuple, once the page no longer has it. */
+  void RollbackIncrement(const RID &rid, Transaction *txn, uint32_t offset);
+
+  /** @return true if the tuple has a version committed after the snapshot of txn, which txn may not overwrite */
+  bool IsChangedSince(const RID &rid, Transaction *txn);
+
+  /**
+   * Reads the version of a tuple that the snapshot of a transaction sees, if it is not the version on the page.
+   * @param rid the tuple, whose page is latched
+   * @param txn a transaction reading a snapshot
+   * @param[out] tuple the version, if it exists
+   * @param[out] exists false if the tuple does not exist in the snapshot
+   * @return false if the snapshot sees the version on the page
+   */
+  bool GetVersion(const RID &rid, Transaction *txn, Tuple *tuple, bool *exists);
+
+  /**
+   * Subtracts the increments that the snapshot of a transaction does not see from the version on the page.
+   * @param rid the tuple, whose page is latched
+   * @param txn a transaction reading a snapshot, for which GetVersion() returned false
+   * @param[in,out] tuple the version on the page
+   */
+  void UndoIncrements(const RID &rid, Transaction *txn, Tuple *tuple);
+
+  /**
+   * Gives the version of a tuple on the page the commit timestamp of the transaction that changed it.
+   * @param watermark no snapshot older than this is running, versions that only older snapshots see are dropped
+   */
+  void Commit(const RID &rid, Transaction *txn, timestamp_t commit_ts, timestamp_t watermark);
+
+  /** Drops the version a transaction saved for a tuple, once the page holds that version again. */
+  void Rollback(const RID &rid, Transaction *txn);
+
+  /** Drops the versions that no snapshot at or after watermark sees, and the chains that no snapshot needs. */
+  void CollectGarbage(timestamp_t watermark);
+
+  /** @return the number of tuples that have a version chain */
+  size_t GetNumChains() const { return num_chains_; }
+
+ private:
+  Shard *GetShard(const RID &rid) {
+    return &shards_[(std::hash<RID>()(rid) * 0x9E3779B97F4A7C15ULL) >> (64 - SHARD_BITS)];
+  }
+
+  /**
+   * Drops the versions of a chain that no snapshot at or after watermark sees.
+   * @return true if the chain is not needed anymore
+   */
+  static bool Prune(VersionChain *chain, timestamp_t watermark);
+
+  /**
+   * Saves the version on the page that a transaction is about to replace, as one version for each commit timestamp of
+   * the increments of the page, without the increments of the transaction itself.
+   */
+  static void FoldIncrements(VersionChain *chain, Transaction *txn, const Tuple &tuple);
+
+  /** @return true if the snapshot of txn sees an increment */
+  static bool IsVisible(const IncrementVersion &increment, Transaction *txn) {
+    return increment.txn_id_ == txn->GetTransactionId() || (increment.ts_ != 0 && increment.ts_ <= txn->GetReadTs());
+  }
+
+  /** Adds to a field of a tuple, or subtracts from it if subtract is true. */
+  static void AddToField(Tuple *tuple, uint32_t offset, const Value &delta, bool subtract);
+
+  Shard shards_[NUM_SHARDS];
+  /** Lets readers of a table nobody changed skip the shard latches. */
+  std::atomic<size_t> num_chains_{0};
+  /** Number of chains after the last sweep, the next sweep starts when the chains doubled. */
+  std::atomic<size_t> collect_at_{MIN_CHAINS_TO_COLLECT};
+};
+
+}  // namespace bustub
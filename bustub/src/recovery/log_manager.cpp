@@ -12,43 +12,338 @@
 
 #include "recovery/log_manager.h"
 
+#include <cstring>
+
+#include "common/macros.h"
+
 namespace bustub {
 /*
  * set enable_logging = true
  * Start a separate thread to execute flush to disk operation periodically
  * The flush can be triggered when timeout or the log buffer is full or buffer
  * pool manager wants to force flush (it only happens when the flushed page has
- * a larger LSN than persistent LSN)
+ * a larger LSN than persistent LSN) or a transaction waits for its commit
  *
  * This thread runs forever until system shutdown/StopFlushThread
  */
-void LogManager::RunFlushThread() {}
+void LogManager::RunFlushThread() {
+  std::lock_guard<std::mutex> guard(latch_);
+  if (flush_thread_ != nullptr) {
+    return;
+  }
+  enable_logging = true;
+  stop_flush_thread_ = false;
+  flush_thread_ = new std::thread(&LogManager::FlushThreadMain, this);
+}
 
 /*
  * Stop and join the flush thread, set enable_logging = false
+ * Whatever is left in the log buffer is flushed before the thread exits
  */
-void LogManager::StopFlushThread() {}
+void LogManager::StopFlushThread() {
+  {
+    std::lock_guard<std::mutex> guard(latch_);
+    if (flush_thread_ == nullptr) {
+      return;
+    }
+    stop_flush_thread_ = true;
+  }
+  cv_.notify_one();
+  flush_thread_->join();
+  delete flush_thread_;
+  std::lock_guard<std::mutex> guard(latch_);
+  flush_thread_ = nullptr;
+  enable_logging = false;
+}
+
+void LogManager::FlushThreadMain() {
+  std::unique_lock<std::mutex> lock(latch_);
+  while (!stop_flush_thread_) {
+    cv_.wait_for(lock, log_timeout, [&] { return FlushRequested(); });
+    // Only a waiting commit woke us up: give other transactions a chance to join this flush.
+    if (!force_flush_ && !buffer_full_ && !stop_flush_thread_ && group_commit_count_ > 0 &&
+        group_commit_count_ < group_commit_batch_size_ && group_commit_delay_.count() > 0) {
+      cv_.wait_for(lock, group_commit_delay_, [&] {
+        return force_flush_ || buffer_full_ || stop_flush_thread_ || group_commit_count_ >= group_commit_batch_size_;
+      });
+    }
+    FlushLogBuffer(&lock);
+  }
+  FlushLogBuffer(&lock);
+}
+
+void LogManager::FlushLogBuffer(std::unique_lock<std::mutex> *lock) {
+  // The flush buffer is still being written by another flush.
+  flushed_cv_.wait(*lock, [&] { return !flush_in_progress_; });
+  force_flush_ = false;
+  buffer_full_ = false;
+
+  // Seal the log buffer, appends that have not reserved their space yet wait for the swap below.
+  uint64_t tail = log_tail_.load();
+  do {
+    if (static_cast<uint32_t>(tail) == 0) {
+      return;
+    }
+  } while (!log_tail_.compare_exchange_weak(tail, (tail & ~uint64_t{UINT32_MAX}) | SEALED_OFFSET));
+  auto flush_size = static_cast<uint32_t>(tail);
+  auto next_lsn = static_cast<lsn_t>(tail >> 32);
+
+  // Wait for the appends that reserved space before the seal to finish copying their records.
+  while (log_buffer_filled_.load(std::memory_order_acquire) != flush_size) {
+    std::this_thread::yield();
+  }
+
+  flush_offsets_.emplace(log_buffer_first_lsn_, log_file_offset_);
+  log_file_offset_ += static_cast<int>(flush_size);
+  log_buffer_first_lsn_ = next_lsn;
+  std::swap(log_buffer_, flush_buffer_);
+  log_buffer_filled_.store(0, std::memory_order_relaxed);
+  group_commit_count_ = 0;
+  flush_in_progress_ = true;
+  // Unseal: appends can go ahead in the empty buffer while we write.
+  log_tail_.store(static_cast<uint64_t>(next_lsn) << 32, std::memory_order_release);
+  flushed_cv_.notify_all();
+
+  lock->unlock();
+  disk_manager_->WriteLog(flush_buffer_, static_cast<int>(flush_size));
+  lock->lock();
+
+  flush_in_progress_ = false;
+  persistent_lsn_ = next_lsn - 1;
+  flushed_cv_.notify_all();
+}
+
+void LogManager::WaitForCommit(lsn_t commit_lsn) {
+  std::unique_lock<std::mutex> lock(latch_);
+  if (flush_thread_ == nullptr) {
+    // Nobody to batch with, write the log ourselves.
+    while (persistent_lsn_ < commit_lsn && (HasBufferedRecords() || flush_in_progress_)) {
+      FlushLogBuffer(&lock);
+    }
+    return;
+  }
+  if (persistent_lsn_ >= commit_lsn) {
+    return;
+  }
+  RegisterCommit(commit_lsn);
+  flushed_cv_.wait(lock, [&] { return persistent_lsn_ >= commit_lsn; });
+}
+
+void LogManager::ScheduleFlush(lsn_t lsn) {
+  std::lock_guard<std::mutex> guard(latch_);
+  if (flush_thread_ != nullptr && persistent_lsn_ < lsn) {
+    RegisterCommit(lsn);
+  }
+}
+
+void LogManager::RegisterCommit(lsn_t commit_lsn) {
+  commit_lsn_ = std::max(commit_lsn_, commit_lsn);
+  group_commit_count_++;
+  cv_.notify_one();
+}
+
+void LogManager::Flush(lsn_t lsn) {
+  std::unique_lock<std::mutex> lock(latch_);
+  // Stop once the LSN is persistent, or once everything that was appended is, in case lsn was never appended.
+  auto flushed = [&] { return persistent_lsn_ >= lsn || (!HasBufferedRecords() && !flush_in_progress_); };
+  if (flush_thread_ == nullptr) {
+    while (!flushed()) {
+      FlushLogBuffer(&lock);
+    }
+    return;
+  }
+  while (!flushed()) {
+    force_flush_ = true;
+    cv_.notify_one();
+    flushed_cv_.wait(lock);
+  }
+}
+
+void LogManager::SetGroupCommitDelay(std::chrono::microseconds delay) {
+  std::lock_guard<std::mutex> guard(latch_);
+  group_commit_delay_ = delay;
+}
+
+void LogManager::SetGroupCommitBatchSize(size_t batch_size) {
+  std::lock_guard<std::mutex> guard(latch_);
+  group_commit_batch_size_ = std::max<size_t>(batch_size, 1);
+}
+
+void LogManager::SetNextLSN(lsn_t next_lsn) {
+  std::lock_guard<std::mutex> guard(latch_);
+  BUSTUB_ASSERT(static_cast<uint32_t>(log_tail_.load()) == 0 && log_file_offset_ == log_start_offset_,
+                "The log continues a recovered log before any record is appended.");
+  log_tail_.store(static_cast<uint64_t>(next_lsn) << 32);
+  log_buffer_first_lsn_ = next_lsn;
+  persistent_lsn_ = next_lsn - 1;
+}
+
+void LogManager::WriteMasterRecord(lsn_t checkpoint_lsn, lsn_t recovery_lsn) {
+  MasterRecord master_record;
+  master_record.checkpoint_lsn_ = checkpoint_lsn;
+  master_record.recovery_lsn_ = recovery_lsn;
+  {
+    std::lock_guard<std::mutex> guard(latch_);
+    BUSTUB_ASSERT(recovery_lsn <= persistent_lsn_ && checkpoint_lsn <= persistent_lsn_,
+                  "Master record points at a log record that is not persistent.");
+    // The log write that holds recovery_lsn starts at the last first LSN that is not larger.
+    auto write = flush_offsets_.upper_bound(recovery_lsn);
+    if (write == flush_offsets_.begin()) {
+      // Older than any write we still know of, recovery has to read the log from where this log manager started it.
+      master_record.recovery_offset_ = log_start_offset_;
+    } else {
+      --write;
+      master_record.recovery_offset_ = write->second;
+      // Later checkpoints hardly ever point further back.
+      flush_offsets_.erase(flush_offsets_.begin(), write);
+    }
+  }
+  disk_manager_->WriteMasterRecord(reinterpret_cast<const char *>(&master_record), sizeof(MasterRecord));
+  // Recovery never reads the log before the master record again.
+  disk_manager_->TruncateLog(master_record.recovery_offset_);
+}
 
 /*
  * append a log record into log buffer
  * you MUST set the log record's lsn within this method
  * @return: lsn that is assigned to this log record
  *
- *
- * example below
- * // First, serialize the must have fields(20 bytes in total)
- * log_record.lsn_ = next_lsn_++;
- * memcpy(log_buffer_ + offset_, &log_record, 20);
- * int pos = offset_ + 20;
- *
- * if (log_record.log_record_type_ == LogRecordType::INSERT) {
- *    memcpy(log_buffer_ + pos, &log_record.insert_rid_, sizeof(RID));
- *    pos += sizeof(RID);
- *    // we have provided serialize function for tuple class
- *    log_record.insert_tuple_.SerializeTo(log_buffer_ + pos);
- *  }
- *
+ * The LSN and the space in the log buffer are reserved together without
+ * taking the latch, the record is then serialized in parallel with other
+ * appends. If the record does not fit in the log buffer, wait for the flush
+ * thread to swap the buffers first.
  */
-lsn_t LogManager::AppendLogRecord(LogRecord *log_record) { return INVALID_LSN; }
+lsn_t LogManager::AppendLogRecord(LogRecord *log_record) {
+  BUSTUB_ASSERT(log_record->size_ <= LOG_BUFFER_SIZE, "Log record is larger than the log buffer.");
+  auto size = static_cast<uint32_t>(log_record->size_);
+  uint64_t tail = log_tail_.load(std::memory_order_acquire);
+  while (true) {
+    auto offset = static_cast<uint32_t>(tail);
+    if (offset == SEALED_OFFSET || offset + size > static_cast<uint32_t>(LOG_BUFFER_SIZE)) {
+      WaitForLogBufferSpace(log_record->size_);
+      tail = log_tail_.load(std::memory_order_acquire);
+      continue;
+    }
+    // Take the next LSN and the next size bytes of the log buffer.
+    if (log_tail_.compare_exchange_weak(tail, tail + (uint64_t{1} << 32) + size, std::memory_order_acq_rel)) {
+      break;
+    }
+  }
+
+  log_record->lsn_ = static_cast<lsn_t>(tail >> 32);
+  SerializeLogRecord(*log_record, log_buffer_ + static_cast<uint32_t>(tail));
+  // The flush of this buffer waits until every reserved byte is filled.
+  log_buffer_filled_.fetch_add(size, std::memory_order_release);
+  return log_record->lsn_;
+}
+
+void LogManager::WaitForLogBufferSpace(int32_t size) {
+  std::unique_lock<std::mutex> lock(latch_);
+  auto has_space = [&] {
+    auto offset = static_cast<uint32_t>(log_tail_.load());
+    return offset != SEALED_OFFSET && offset + size <= static_cast<uint32_t>(LOG_BUFFER_SIZE);
+  };
+  while (!has_space()) {
+    if (flush_thread_ == nullptr) {
+      FlushLogBuffer(&lock);
+    } else {
+      buffer_full_ = true;
+      cv_.notify_one();
+      flushed_cv_.wait(lock);
+    }
+  }
+}
+
+void LogManager::SerializeLogRecord(const LogRecord &log_record, char *dest) {
+  // First, serialize the must have fields (20 bytes in total).
+  memcpy(dest, &log_record, LogRecord::HEADER_SIZE);
+  int pos = LogRecord::HEADER_SIZE;
+
+  switch (log_record.log_record_type_) {
+    case LogRecordType::INSERT:
+      memcpy(dest + pos, &log_record.insert_rid_, sizeof(RID));
+      pos += sizeof(RID);
+      // we have provided serialize function for tuple class
+      log_record.GetInsertTuple().SerializeTo(dest + pos);
+      break;
+    case LogRecordType::MARKDELETE:
+    case LogRecordType::APPLYDELETE:
+    case LogRecordType::ROLLBACKDELETE:
+      memcpy(dest + pos, &log_record.delete_rid_, sizeof(RID));
+      pos += sizeof(RID);
+      log_record.GetDeleteTuple().SerializeTo(dest + pos);
+      break;
+    case LogRecordType::UPDATE: {
+      memcpy(dest + pos, &log_record.update_rid_, sizeof(RID));
+      pos += sizeof(RID);
+      memcpy(dest + pos, &log_record.update_prefix_size_, sizeof(uint32_t));
+      pos += sizeof(uint32_t);
+      memcpy(dest + pos, &log_record.update_suffix_size_, sizeof(uint32_t));
+      pos += sizeof(uint32_t);
+      // Only the middle of each tuple, between the bytes they have in common.
+      for (const Tuple *tuple : {log_record.tuple_ref_, log_record.new_tuple_ref_}) {
+        uint32_t middle_size = tuple->GetLength() - log_record.update_prefix_size_ - log_record.update_suffix_size_;
+        memcpy(dest + pos, &middle_size, sizeof(uint32_t));
+        pos += sizeof(uint32_t);
+        memcpy(dest + pos, tuple->GetData() + log_record.update_prefix_size_, middle_size);
+        pos += middle_size;
+      }
+      break;
+    }
+    case LogRecordType::NEWPAGE:
+      memcpy(dest + pos, &log_record.prev_page_id_, sizeof(page_id_t));
+      pos += sizeof(page_id_t);
+      memcpy(dest + pos, &log_record.page_id_, sizeof(page_id_t));
+      break;
+    case LogRecordType::PAGEWRITE: {
+      auto size = static_cast<uint32_t>(log_record.page_write_new_.size());
+      memcpy(dest + pos, &log_record.page_id_, sizeof(page_id_t));
+      pos += sizeof(page_id_t);
+      memcpy(dest + pos, &log_record.page_write_offset_, sizeof(uint32_t));
+      pos += sizeof(uint32_t);
+      memcpy(dest + pos, &size, sizeof(uint32_t));
+      pos += sizeof(uint32_t);
+      memcpy(dest + pos, log_record.page_write_old_.data(), size);
+      pos += size;
+      memcpy(dest + pos, log_record.page_write_new_.data(), size);
+      break;
+    }
+    case LogRecordType::INCREMENT: {
+      TypeId type_id = log_record.increment_delta_.GetTypeId();
+      memcpy(dest + pos, &log_record.increment_rid_, sizeof(RID));
+      pos += sizeof(RID);
+      memcpy(dest + pos, &log_record.increment_offset_, sizeof(uint32_t));
+      pos += sizeof(uint32_t);
+      memcpy(dest + pos, &type_id, sizeof(TypeId));
+      pos += sizeof(TypeId);
+      log_record.increment_delta_.SerializeTo(dest + pos);
+      break;
+    }
+    case LogRecordType::CHECKPOINT_END: {
+      auto num_txns = static_cast<int32_t>(log_record.active_txns_.size());
+      memcpy(dest + pos, &num_txns, sizeof(int32_t));
+      pos += sizeof(int32_t);
+      for (const auto &txn : log_record.active_txns_) {
+        memcpy(dest + pos, &txn.first, sizeof(txn_id_t));
+        pos += sizeof(txn_id_t);
+        memcpy(dest + pos, &txn.second, sizeof(lsn_t));
+        pos += sizeof(lsn_t);
+      }
+      auto num_pages = static_cast<int32_t>(log_record.dirty_pages_.size());
+      memcpy(dest + pos, &num_pages, sizeof(int32_t));
+      pos += sizeof(int32_t);
+      for (const auto &page : log_record.dirty_pages_) {
+        memcpy(dest + pos, &page.first, sizeof(page_id_t));
+        pos += sizeof(page_id_t);
+        memcpy(dest + pos, &page.second, sizeof(lsn_t));
+        pos += sizeof(lsn_t);
+      }
+      break;
+    }
+    default:
+      // BEGIN/COMMIT/ABORT/CHECKPOINT_BEGIN only have the header.
+      break;
+  }
+}
 
 }  // namespace bustub
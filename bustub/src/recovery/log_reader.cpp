@@ -0,0 +1,93 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// log_reader.cpp
+//
+// Identification: src/recovery/log_reader.cpp
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#include "recovery/log_reader.h"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+namespace bustub {
+
+LogReader::LogReader(DiskManager *disk_manager, int offset, int read_ahead_size)
+    : disk_manager_(disk_manager),
+      read_ahead_size_(read_ahead_size),
+      log_end_(disk_manager->GetLogSize()),
+      read_ahead_offset_(offset),
+      offset_(offset) {
+  buffer_ = new char[LOG_BUFFER_SIZE + read_ahead_size_];
+  next_buffer_ = new char[LOG_BUFFER_SIZE + read_ahead_size_];
+  pos_ = buffer_ + LOG_BUFFER_SIZE;
+  end_ = pos_;
+  ReadAhead();
+}
+
+LogReader::~LogReader() {
+  if (read_ahead_.valid()) {
+    read_ahead_.wait();
+  }
+  delete[] buffer_;
+  delete[] next_buffer_;
+}
+
+const char *LogReader::Next(int *offset, int *size) {
+  while (true) {
+    if (end_ - pos_ >= static_cast<int>(sizeof(int32_t))) {
+      int32_t record_size;
+      memcpy(&record_size, pos_, sizeof(int32_t));
+      // no record is larger than the log buffer, and the zeroes after the last record are no record
+      if (record_size <= 0 || record_size > LOG_BUFFER_SIZE) {
+        return nullptr;
+      }
+      if (record_size <= end_ - pos_) {
+        const char *record = pos_;
+        *offset = offset_;
+        *size = record_size;
+        pos_ += record_size;
+        offset_ += record_size;
+        return record;
+      }
+    }
+    // the record continues in the next chunk, unless the log ends here
+    if (!read_ahead_.valid()) {
+      return nullptr;
+    }
+    SwapBuffers();
+  }
+}
+
+void LogReader::ReadAhead() {
+  if (read_ahead_offset_ >= log_end_) {
+    return;
+  }
+  char *dest = next_buffer_ + LOG_BUFFER_SIZE;
+  int offset = read_ahead_offset_;
+  int size = std::min(read_ahead_size_, log_end_ - offset);
+  read_ahead_ = std::async(std::launch::async, [this, dest, offset, size] {
+    return disk_manager_->ReadLog(dest, size, offset) ? size : 0;
+  });
+  read_ahead_offset_ += size;
+}
+
+void LogReader::SwapBuffers() {
+  int read_size = read_ahead_.get();
+  // Less than a record is left, which fits in front of the next chunk.
+  int left = end_ - pos_;
+  char *start = next_buffer_ + LOG_BUFFER_SIZE - left;
+  memcpy(start, pos_, left);
+  std::swap(buffer_, next_buffer_);
+  pos_ = start;
+  end_ = buffer_ + LOG_BUFFER_SIZE + read_size;
+  ReadAhead();
+}
+
+}  // namespace bustub
@@ -12,15 +12,395 @@
 
 #include "recovery/log_recovery.h"
 
+#include <atomic>
+#include <chrono>              // NOLINT
+#include <condition_variable>  // NOLINT
+#include <cstring>
+#include <deque>
+#include <queue>
+#include <thread>  // NOLINT
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
 #include "storage/page/table_page.h"
 
 namespace bustub {
+
+namespace {
+
+/** Changes to redo, each with the page it is redone on. */
+using RedoBatch = std::vector<std::pair<page_id_t, LogRecord>>;
+
+/** Batches of changes handed from the log reader to one redo worker, in LSN order. */
+struct RedoQueue {
+  std::mutex latch_;
+  std::condition_variable cv_;
+  std::deque<RedoBatch> batches_;
+  /** Set once the log reader handed over every batch. */
+  bool done_{false};
+};
+
+/**
+ * @param log_record a log record
+ * @param[out] rid the tuple the record changes
+ * @return false if the record does not change a tuple
+ */
+bool GetChangedRID(LogRecord *log_record, RID *rid) {
+  switch (log_record->GetLogRecordType()) {
+    case LogRecordType::INSERT:
+      *rid = log_record->GetInsertRID();
+      return true;
+    case LogRecordType::MARKDELETE:
+    case LogRecordType::APPLYDELETE:
+    case LogRecordType::ROLLBACKDELETE:
+      *rid = log_record->GetDeleteRID();
+      return true;
+    case LogRecordType::UPDATE:
+      *rid = log_record->GetUpdateRID();
+      return true;
+    case LogRecordType::INCREMENT:
+      *rid = log_record->GetIncrementRID();
+      return true;
+    default:
+      return false;
+  }
+}
+
+/** Number of changes handed to a redo worker at once. */
+constexpr size_t REDO_BATCH_SIZE = 256;
+/** Number of batches a redo worker may fall behind the log reader, which bounds the memory redo uses. */
+constexpr size_t MAX_QUEUED_REDO_BATCHES = 8;
+
+}  // namespace
+
 /*
  * deserialize a log record from log buffer
  * @return: true means deserialize succeed, otherwise can't deserialize cause
  * incomplete log record
  */
-bool LogRecovery::DeserializeLogRecord(const char *data, LogRecord *log_record) { return false; }
+bool LogRecovery::DeserializeLogRecord(const char *data, LogRecord *log_record) {
+  if (data < log_buffer_) {
+    return false;
+  }
+  return DeserializeLogRecord(data, log_buffer_ + LOG_BUFFER_SIZE, log_record);
+}
+
+bool LogRecovery::DeserializeLogRecord(const char *data, const char *end, LogRecord *log_record) {
+  if (end - data < LogRecord::HEADER_SIZE) {
+    return false;
+  }
+  // The log ends with zeroes when it is read past its end, which never make a valid header.
+  memcpy(&log_record->size_, data, sizeof(int32_t));
+  if (log_record->size_ < LogRecord::HEADER_SIZE || log_record->size_ > end - data) {
+    return false;
+  }
+  memcpy(&log_record->lsn_, data + 4, sizeof(lsn_t));
+  memcpy(&log_record->txn_id_, data + 8, sizeof(txn_id_t));
+  memcpy(&log_record->prev_lsn_, data + 12, sizeof(lsn_t));
+  memcpy(&log_record->log_record_type_, data + 16, sizeof(LogRecordType));
+  if (log_record->log_record_type_ <= LogRecordType::INVALID ||
+      log_record->log_record_type_ > LogRecordType::INCREMENT) {
+    return false;
+  }
+
+  const char *pos = data + LogRecord::HEADER_SIZE;
+  switch (log_record->log_record_type_) {
+    case LogRecordType::INSERT:
+      memcpy(&log_record->insert_rid_, pos, sizeof(RID));
+      log_record->insert_tuple_.DeserializeFrom(pos + sizeof(RID));
+      break;
+    case LogRecordType::MARKDELETE:
+    case LogRecordType::APPLYDELETE:
+    case LogRecordType::ROLLBACKDELETE:
+      memcpy(&log_record->delete_rid_, pos, sizeof(RID));
+      log_record->delete_tuple_.DeserializeFrom(pos + sizeof(RID));
+      break;
+    case LogRecordType::UPDATE:
+      memcpy(&log_record->update_rid_, pos, sizeof(RID));
+      pos += sizeof(RID);
+      memcpy(&log_record->update_prefix_size_, pos, sizeof(uint32_t));
+      pos += sizeof(uint32_t);
+      memcpy(&log_record->update_suffix_size_, pos, sizeof(uint32_t));
+      pos += sizeof(uint32_t);
+      for (auto *middle : {&log_record->old_middle_, &log_record->new_middle_}) {
+        uint32_t middle_size;
+        memcpy(&middle_size, pos, sizeof(uint32_t));
+        pos += sizeof(uint32_t);
+        middle->assign(pos, pos + middle_size);
+        pos += middle_size;
+      }
+      break;
+    case LogRecordType::NEWPAGE:
+      memcpy(&log_record->prev_page_id_, pos, sizeof(page_id_t));
+      memcpy(&log_record->page_id_, pos + sizeof(page_id_t), sizeof(page_id_t));
+      break;
+    case LogRecordType::PAGEWRITE: {
+      uint32_t size;
+      memcpy(&log_record->page_id_, pos, sizeof(page_id_t));
+      pos += sizeof(page_id_t);
+      memcpy(&log_record->page_write_offset_, pos, sizeof(uint32_t));
+      pos += sizeof(uint32_t);
+      memcpy(&size, pos, sizeof(uint32_t));
+      pos += sizeof(uint32_t);
+      log_record->page_write_old_.assign(pos, pos + size);
+      pos += size;
+      log_record->page_write_new_.assign(pos, pos + size);
+      break;
+    }
+    case LogRecordType::INCREMENT: {
+      TypeId type_id;
+      memcpy(&log_record->increment_rid_, pos, sizeof(RID));
+      pos += sizeof(RID);
+      memcpy(&log_record->increment_offset_, pos, sizeof(uint32_t));
+      pos += sizeof(uint32_t);
+      memcpy(&type_id, pos, sizeof(TypeId));
+      pos += sizeof(TypeId);
+      log_record->increment_delta_ = Value::DeserializeFrom(pos, type_id);
+      break;
+    }
+    case LogRecordType::CHECKPOINT_END: {
+      int32_t num_txns;
+      memcpy(&num_txns, pos, sizeof(int32_t));
+      pos += sizeof(int32_t);
+      log_record->active_txns_.resize(num_txns);
+      for (auto &txn : log_record->active_txns_) {
+        memcpy(&txn.first, pos, sizeof(txn_id_t));
+        memcpy(&txn.second, pos + sizeof(txn_id_t), sizeof(lsn_t));
+        pos += sizeof(txn_id_t) + sizeof(lsn_t);
+      }
+      int32_t num_pages;
+      memcpy(&num_pages, pos, sizeof(int32_t));
+      pos += sizeof(int32_t);
+      log_record->dirty_pages_.resize(num_pages);
+      for (auto &page : log_record->dirty_pages_) {
+        memcpy(&page.first, pos, sizeof(page_id_t));
+        memcpy(&page.second, pos + sizeof(page_id_t), sizeof(lsn_t));
+        pos += sizeof(page_id_t) + sizeof(lsn_t);
+      }
+      break;
+    }
+    default:
+      // BEGIN/COMMIT/ABORT/CHECKPOINT_BEGIN only have the header.
+      break;
+  }
+  return true;
+}
+
+bool LogRecovery::ReadLogRecord(int offset, LogRecord *log_record, bool backward) {
+  bool buffered = buffer_offset_ >= 0 && offset >= buffer_offset_ && offset - buffer_offset_ < LOG_BUFFER_SIZE;
+  if (buffered && DeserializeLogRecord(log_buffer_ + (offset - buffer_offset_), log_record)) {
+    return true;
+  }
+  // Read a whole log buffer at once, most of the records that are read next are in it.
+  int read_offset = backward ? std::max(disk_manager_->GetLogStart(), offset - LOG_BUFFER_SIZE / 2) : offset;
+  if (!disk_manager_->ReadLog(log_buffer_, LOG_BUFFER_SIZE, read_offset)) {
+    buffer_offset_ = -1;
+    return false;
+  }
+  buffer_offset_ = read_offset;
+  if (DeserializeLogRecord(log_buffer_ + (offset - buffer_offset_), log_record)) {
+    return true;
+  }
+  if (read_offset == offset) {
+    return false;
+  }
+  // The record did not fit behind the data before it.
+  return ReadLogRecord(offset, log_record, false);
+}
+
+bool LogRecovery::ReadNextLogRecord(LogReader *reader, LogRecord *log_record) {
+  int size;
+  const char *data = reader->Next(&offset_, &size);
+  return data != nullptr && DeserializeLogRecord(data, data + size, log_record);
+}
+
+page_id_t LogRecovery::GetChangedPageId(LogRecord *log_record) {
+  switch (log_record->GetLogRecordType()) {
+    case LogRecordType::INSERT:
+      return log_record->GetInsertRID().GetPageId();
+    case LogRecordType::MARKDELETE:
+    case LogRecordType::APPLYDELETE:
+    case LogRecordType::ROLLBACKDELETE:
+      return log_record->GetDeleteRID().GetPageId();
+    case LogRecordType::UPDATE:
+      return log_record->GetUpdateRID().GetPageId();
+    case LogRecordType::INCREMENT:
+      return log_record->GetIncrementRID().GetPageId();
+    case LogRecordType::NEWPAGE:
+      return log_record->GetNewPageId();
+    case LogRecordType::PAGEWRITE:
+      return log_record->GetPageWritePageId();
+    default:
+      return INVALID_PAGE_ID;
+  }
+}
+
+std::vector<page_id_t> LogRecovery::GetChangedPageIds(LogRecord *log_record) {
+  std::vector<page_id_t> page_ids;
+  page_id_t page_id = GetChangedPageId(log_record);
+  if (page_id != INVALID_PAGE_ID) {
+    page_ids.push_back(page_id);
+  }
+  if (log_record->GetLogRecordType() == LogRecordType::NEWPAGE && log_record->GetNewPageRecord() != INVALID_PAGE_ID) {
+    page_ids.push_back(log_record->GetNewPageRecord());
+  }
+  return page_ids;
+}
+
+void LogRecovery::Analyze(int offset, lsn_t checkpoint_lsn) {
+  LogReader reader(disk_manager_, offset);
+  LogRecord log_record;
+  while (ReadNextLogRecord(&reader, &log_record)) {
+    lsn_t lsn = log_record.GetLSN();
+    txn_id_t txn_id = log_record.GetTxnId();
+    lsn_mapping_[lsn] = offset_;
+    max_lsn_ = std::max(max_lsn_, lsn);
+    max_txn_id_ = std::max(max_txn_id_, txn_id);
+
+    switch (log_record.GetLogRecordType()) {
+      case LogRecordType::CHECKPOINT_BEGIN:
+        break;
+      case LogRecordType::CHECKPOINT_END:
+        // The tables of the checkpoint cover the changes before it that the records we read do not.
+        for (const auto &txn : log_record.GetActiveTxns()) {
+          max_txn_id_ = std::max(max_txn_id_, txn.first);
+          if (finished_txns_.count(txn.first) == 0) {
+            lsn_t &last_lsn = active_txn_.emplace(txn.first, txn.second).first->second;
+            last_lsn = std::max(last_lsn, txn.second);
+          }
+        }
+        for (const auto &page : log_record.GetDirtyPages()) {
+          lsn_t &rec_lsn = dirty_page_table_.emplace(page.first, page.second).first->second;
+          rec_lsn = std::min(rec_lsn, page.second);
+        }
+        break;
+      case LogRecordType::COMMIT:
+      case LogRecordType::ABORT:
+        active_txn_.erase(txn_id);
+        finished_txns_.insert(txn_id);
+        break;
+      default: {
+        active_txn_[txn_id] = lsn;
+        // Changes before the checkpoint are on disk unless the checkpoint lists their page as dirty.
+        page_id_t page_id = GetChangedPageId(&log_record);
+        if (page_id != INVALID_PAGE_ID && (checkpoint_lsn == INVALID_LSN || lsn >= checkpoint_lsn)) {
+          dirty_page_table_.emplace(page_id, lsn);
+        }
+        // The page may never have been written, make sure it is not allocated again.
+        if (log_record.GetLogRecordType() == LogRecordType::NEWPAGE) {
+          disk_manager_->ReservePageId(page_id);
+        }
+        break;
+      }
+    }
+  }
+}
+
+bool LogRecovery::MayNeedRedo(LogRecord *log_record, page_id_t page_id) {
+  if (log_record->GetLogRecordType() == LogRecordType::NEWPAGE && page_id != log_record->GetNewPageId()) {
+    // The link to a new page is not logged, so the page LSN does not tell whether the previous page has it.
+    return true;
+  }
+  auto dirty_page = dirty_page_table_.find(page_id);
+  // Otherwise the page was written to disk after this change.
+  return dirty_page != dirty_page_table_.end() && dirty_page->second <= log_record->GetLSN();
+}
+
+void LogRecovery::RedoLogRecord(LogRecord *log_record, page_id_t page_id) {
+  if (!MayNeedRedo(log_record, page_id)) {
+    return;
+  }
+  auto *page = reinterpret_cast<TablePage *>(buffer_pool_manager_->FetchPage(page_id));
+  BUSTUB_ASSERT(page != nullptr, "Recovery needs a free frame.");
+  page->WLatch();
+  bool redo = RedoOnPage(log_record, page);
+  page->WUnlatch();
+  buffer_pool_manager_->UnpinPage(page_id, redo);
+}
+
+bool LogRecovery::RedoOnPage(LogRecord *log_record, TablePage *page) {
+  page_id_t page_id = page->GetPageId();
+  if (log_record->GetLogRecordType() == LogRecordType::NEWPAGE && page_id != log_record->GetNewPageId()) {
+    // Linking the previous page to the new page is not logged, it is part of creating the new page.
+    if (page->GetNextPageId() != INVALID_PAGE_ID) {
+      return false;
+    }
+    page->SetNextPageId(log_record->GetNewPageId());
+    return true;
+  }
+  if (page->GetLSN() >= log_record->GetLSN()) {
+    return false;
+  }
+  Tuple old_tuple;
+  switch (log_record->GetLogRecordType()) {
+    case LogRecordType::INSERT:
+      page->InsertTupleAt(log_record->GetInsertTuple(), log_record->GetInsertRID());
+      break;
+    case LogRecordType::MARKDELETE:
+      page->MarkDelete(log_record->GetDeleteRID(), nullptr, nullptr, nullptr);
+      break;
+    case LogRecordType::APPLYDELETE:
+      page->ApplyDelete(log_record->GetDeleteRID(), nullptr, nullptr);
+      break;
+    case LogRecordType::ROLLBACKDELETE:
+      page->RollbackDelete(log_record->GetDeleteRID(), nullptr, nullptr);
+      break;
+    case LogRecordType::UPDATE:
+      // The page has the tuple as it was right before the update.
+      if (page->GetTuple(log_record->GetUpdateRID(), &old_tuple, nullptr, nullptr)) {
+        page->UpdateTuple(log_record->GetUpdateTuple(old_tuple), &old_tuple, log_record->GetUpdateRID(), nullptr,
+                          nullptr, nullptr);
+      }
+      break;
+    case LogRecordType::INCREMENT:
+      page->IncrementTuple(log_record->GetIncrementRID(), log_record->GetIncrementOffset(),
+                           log_record->GetIncrementDelta(), nullptr, nullptr);
+      break;
+    case LogRecordType::NEWPAGE:
+      page->Init(page_id, PageSizeOf(GetPageSizeClass(page_id)), log_record->GetNewPageRecord(), nullptr, nullptr);
+      break;
+    case LogRecordType::PAGEWRITE: {
+      const auto &new_data = log_record->GetPageWriteNewData();
+      memcpy(page->GetData() + log_record->GetPageWriteOffset(), new_data.data(), new_data.size());
+      break;
+    }
+    default:
+      break;
+  }
+  page->SetLSN(log_record->GetLSN());
+  return true;
+}
+
+lsn_t LogRecovery::AnalyzeLog(int *redo_offset) {
+  auto start = std::chrono::steady_clock::now();
+  MasterRecord master_record;
+  if (!disk_manager_->ReadMasterRecord(reinterpret_cast<char *>(&master_record), sizeof(MasterRecord))) {
+    master_record = MasterRecord();
+  }
+  // Pages on disk exist even if the log we read does not mention them.
+  for (size_t i = 0; i < NUM_PAGE_SIZE_CLASSES; i++) {
+    auto size_class = static_cast<PageSizeClass>(i);
+    int num_pages = disk_manager_->GetNumPages(size_class);
+    if (num_pages > 0) {
+      disk_manager_->ReservePageId(MakePageId(size_class, num_pages - 1));
+    }
+  }
+  Analyze(master_record.recovery_offset_, master_record.checkpoint_lsn_);
+  analysis_time_ = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+  if (dirty_page_table_.empty()) {
+    return INVALID_LSN;
+  }
+
+  // Repeat history from the oldest change that may be missing on disk.
+  lsn_t redo_lsn = dirty_page_table_.begin()->second;
+  for (const auto &page : dirty_page_table_) {
+    redo_lsn = std::min(redo_lsn, page.second);
+  }
+  auto offset = lsn_mapping_.find(redo_lsn);
+  *redo_offset = offset == lsn_mapping_.end() ? master_record.recovery_offset_ : offset->second;
+  return redo_lsn;
+}
 
 /*
  *redo phase on TABLE PAGE level(table/table_page.h)
@@ -28,13 +408,347 @@ bool LogRecovery::DeserializeLogRecord(const char *data, LogRecord *log_record)
  *log buffer to reduce unnecessary I/O operations), remember to compare page's
  *LSN with log_record's sequence number, and also build active_txn_ table &
  *lsn_mapping_ table
+ *
+ *reading starts at the offset in the master record if a checkpoint was taken,
+ *the log is read ahead by a LogReader, the records are applied by the worker
+ *that owns their page
  */
-void LogRecovery::Redo() {}
+void LogRecovery::Redo() {
+  lsn_t redo_lsn = AnalyzeLog(&offset_);
+  if (redo_lsn == INVALID_LSN) {
+    return;
+  }
+  auto start = std::chrono::steady_clock::now();
+
+  // Worker i owns the pages whose id is i modulo the number of workers. Without workers, changes are redone here.
+  std::vector<RedoQueue> queues(num_workers_ > 1 ? num_workers_ : 0);
+  std::vector<std::thread> workers;
+  for (auto &queue : queues) {
+    workers.emplace_back([this, &queue] {
+      std::unique_lock<std::mutex> lock(queue.latch_);
+      while (true) {
+        queue.cv_.wait(lock, [&queue] { return queue.done_ || !queue.batches_.empty(); });
+        if (queue.batches_.empty()) {
+          return;
+        }
+        RedoBatch batch = std::move(queue.batches_.front());
+        queue.batches_.pop_front();
+        lock.unlock();
+        queue.cv_.notify_all();
+        for (auto &change : batch) {
+          RedoLogRecord(&change.second, change.first);
+        }
+        lock.lock();
+      }
+    });
+  }
+  std::vector<RedoBatch> batches(queues.size());
+  auto submit = [&queues, &batches](size_t worker) {
+    RedoQueue &queue = queues[worker];
+    {
+      std::unique_lock<std::mutex> lock(queue.latch_);
+      queue.cv_.wait(lock, [&queue] { return queue.batches_.size() < MAX_QUEUED_REDO_BATCHES; });
+      queue.batches_.push_back(std::move(batches[worker]));
+    }
+    queue.cv_.notify_all();
+    batches[worker].clear();
+  };
+
+  LogReader reader(disk_manager_, offset_);
+  LogRecord log_record;
+  while (ReadNextLogRecord(&reader, &log_record)) {
+    if (log_record.GetLSN() < redo_lsn) {
+      continue;
+    }
+    for (page_id_t page_id : GetChangedPageIds(&log_record)) {
+      if (queues.empty()) {
+        RedoLogRecord(&log_record, page_id);
+        continue;
+      }
+      size_t worker = static_cast<size_t>(page_id) % queues.size();
+      batches[worker].emplace_back(page_id, log_record);
+      if (batches[worker].size() == REDO_BATCH_SIZE) {
+        submit(worker);
+      }
+    }
+  }
+
+  for (size_t worker = 0; worker < queues.size(); worker++) {
+    if (!batches[worker].empty()) {
+      submit(worker);
+    }
+    {
+      std::lock_guard<std::mutex> lock(queues[worker].latch_);
+      queues[worker].done_ = true;
+    }
+    queues[worker].cv_.notify_all();
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  redo_time_ = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+}
+
+void LogRecovery::UndoLogRecord(LogRecord *log_record) {
+  page_id_t page_id = GetChangedPageId(log_record);
+  if (page_id == INVALID_PAGE_ID || log_record->GetLogRecordType() == LogRecordType::NEWPAGE) {
+    // An empty page in the table heap is harmless.
+    return;
+  }
+  auto *page = reinterpret_cast<TablePage *>(buffer_pool_manager_->FetchPage(page_id));
+  BUSTUB_ASSERT(page != nullptr, "Recovery needs a free frame.");
+  page->WLatch();
+  Tuple old_tuple;
+  switch (log_record->GetLogRecordType()) {
+    case LogRecordType::INSERT:
+      // The stand-in of the loser keeps the free slot locked until the loser is aborted, so new inserts skip it.
+      page->ApplyDelete(log_record->GetInsertRID(), nullptr, nullptr);
+      break;
+    case LogRecordType::MARKDELETE:
+      page->RollbackDelete(log_record->GetDeleteRID(), nullptr, nullptr);
+      break;
+    case LogRecordType::APPLYDELETE:
+      page->InsertTupleAt(log_record->GetDeleteTuple(), log_record->GetDeleteRID());
+      break;
+    case LogRecordType::ROLLBACKDELETE:
+      page->MarkDelete(log_record->GetDeleteRID(), nullptr, nullptr, nullptr);
+      break;
+    case LogRecordType::UPDATE:
+      // Later changes to the tuple are undone already, the page has the tuple as it was right after the update.
+      if (page->GetTuple(log_record->GetUpdateRID(), &old_tuple, nullptr, nullptr)) {
+        page->UpdateTuple(log_record->GetOriginalTuple(old_tuple), &old_tuple, log_record->GetUpdateRID(), nullptr,
+                          nullptr, nullptr);
+      }
+      break;
+    case LogRecordType::INCREMENT:
+      // Other transactions may have incremented the field since, which subtracting the delta keeps.
+      page->IncrementTuple(log_record->GetIncrementRID(), log_record->GetIncrementOffset(),
+                           TablePage::NegateDelta(log_record->GetIncrementDelta()), nullptr, nullptr);
+      break;
+    case LogRecordType::PAGEWRITE: {
+      // The writer kept the bytes to itself until it ended, the page has them as they were right after the write.
+      const auto &old_data = log_record->GetPageWriteOldData();
+      memcpy(page->GetData() + log_record->GetPageWriteOffset(), old_data.data(), old_data.size());
+      break;
+    }
+    default:
+      break;
+  }
+  page->WUnlatch();
+  buffer_pool_manager_->UnpinPage(page_id, true);
+}
 
 /*
  *undo phase on TABLE PAGE level(table/table_page.h)
  *iterate through active txn map and undo each operation
+ *
+ *the changes of all the losers are read together, latest first, following
+ *the prevLSN chain of each transaction, then each loser is undone on one
+ *worker
  */
-void LogRecovery::Undo() {}
+void LogRecovery::Undo() {
+  auto start = std::chrono::steady_clock::now();
+  auto loser_changes = ReadLoserChanges();
+  UndoLosers(&loser_changes);
+  active_txn_.clear();
+  lsn_mapping_.clear();
+  undo_time_ = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+}
+
+std::unordered_map<txn_id_t, std::vector<LogRecord>> LogRecovery::ReadLoserChanges() {
+  std::priority_queue<lsn_t> to_read;
+  for (const auto &txn : active_txn_) {
+    to_read.push(txn.second);
+  }
+  std::unordered_map<txn_id_t, std::vector<LogRecord>> loser_changes;
+  LogRecord log_record;
+  while (!to_read.empty()) {
+    lsn_t lsn = to_read.top();
+    to_read.pop();
+    auto offset = lsn_mapping_.find(lsn);
+    if (offset == lsn_mapping_.end() || !ReadLogRecord(offset->second, &log_record, true)) {
+      continue;
+    }
+    if (GetChangedPageId(&log_record) != INVALID_PAGE_ID) {
+      loser_changes[log_record.GetTxnId()].push_back(log_record);
+    }
+    if (log_record.GetPrevLSN() != INVALID_LSN) {
+      to_read.push(log_record.GetPrevLSN());
+    }
+  }
+  return loser_changes;
+}
+
+void LogRecovery::UndoLosers(std::unordered_map<txn_id_t, std::vector<LogRecord>> *loser_changes) {
+  // Losers held their locks until the crash, so they never changed the same tuple and can be undone in any order.
+  std::vector<std::vector<LogRecord> *> losers;
+  for (auto &loser : *loser_changes) {
+    losers.push_back(&loser.second);
+  }
+  std::atomic<size_t> next_loser{0};
+  auto undo_losers = [this, &losers, &next_loser] {
+    for (size_t i = next_loser++; i < losers.size(); i = next_loser++) {
+      for (auto &change : *losers[i]) {
+        UndoLogRecord(&change);
+      }
+    }
+  };
+  std::vector<std::thread> workers;
+  for (size_t i = 1; i < std::min(num_workers_, losers.size()); i++) {
+    workers.emplace_back(undo_losers);
+  }
+  undo_losers();
+  for (auto &worker : workers) {
+    worker.join();
+  }
+}
+
+void LogRecovery::StartInstantRestart(LogManager *log_manager, TransactionManager *txn_manager,
+                                      LockManager *lock_manager) {
+  int redo_offset;
+  lsn_t redo_lsn = AnalyzeLog(&redo_offset);
+
+  // Note where to find the changes each page may miss, the changes themselves are read again when the page is redone.
+  if (redo_lsn != INVALID_LSN) {
+    LogReader reader(disk_manager_, redo_offset);
+    LogRecord log_record;
+    while (ReadNextLogRecord(&reader, &log_record)) {
+      if (log_record.GetLSN() >= redo_lsn) {
+        for (page_id_t page_id : GetChangedPageIds(&log_record)) {
+          if (MayNeedRedo(&log_record, page_id)) {
+            pending_pages_[page_id].push_back(offset_);
+          }
+        }
+      }
+    }
+  }
+
+  // The losers keep the tuples they changed locked until they are rolled back. The locks are held by stand-ins of the
+  // losers, as the loser transactions are gone. A tuple the loser only incremented is locked in increment mode, as
+  // other losers may have incremented it as well.
+  auto loser_changes = ReadLoserChanges();
+  if (lock_manager != nullptr) {
+    // The stand-ins hold no intention locks on the tables, so no transaction may lock a whole table until they end.
+    lock_manager->BlockTableLocks();
+    for (auto &loser : loser_changes) {
+      auto *txn = new Transaction(loser.first);
+      std::unordered_set<RID> changed_rids;
+      std::unordered_set<RID> incremented_rids;
+      for (auto &change : loser.second) {
+        RID rid;
+        if (GetChangedRID(&change, &rid)) {
+          (change.GetLogRecordType() == LogRecordType::INCREMENT ? incremented_rids : changed_rids).insert(rid);
+        }
+      }
+      for (const auto &rid : changed_rids) {
+        lock_manager->LockExclusive(txn, rid);
+      }
+      for (const auto &rid : incremented_rids) {
+        if (changed_rids.count(rid) == 0) {
+          lock_manager->LockIncrement(txn, rid);
+        }
+      }
+      loser_txns_.emplace(loser.first, txn);
+    }
+  }
+
+  // New transactions and their log records must not be mistaken for the ones in the log.
+  log_manager->SetNextLSN(max_lsn_ + 1);
+  txn_manager->SetNextTxnId(max_txn_id_ + 1);
+
+  buffer_pool_manager_->SetPageRecoveryHandler([this](Page *page) { return RecoverPage(page); });
+  restart_thread_ =
+      std::thread(&LogRecovery::FinishInstantRestart, this, log_manager, lock_manager, std::move(loser_changes));
+}
+
+bool LogRecovery::RecoverPage(Page *page) {
+  std::vector<int> offsets;
+  {
+    std::lock_guard<std::mutex> guard(pending_latch_);
+    auto pending = pending_pages_.find(page->GetPageId());
+    if (pending == pending_pages_.end()) {
+      return false;
+    }
+    offsets = std::move(pending->second);
+    pending_pages_.erase(pending);
+  }
+  bool changed = false;
+  LogRecord log_record;
+  for (int offset : offsets) {
+    {
+      std::lock_guard<std::mutex> guard(log_buffer_latch_);
+      [[maybe_unused]] bool found = ReadLogRecord(offset, &log_record);
+      BUSTUB_ASSERT(found, "A change to redo is missing from the log.");
+    }
+    changed |= RedoOnPage(&log_record, reinterpret_cast<TablePage *>(page));
+  }
+  return changed;
+}
+
+void LogRecovery::FinishInstantRestart(LogManager *log_manager, LockManager *lock_manager,
+                                       std::unordered_map<txn_id_t, std::vector<LogRecord>> loser_changes) {
+  // Redo the pages nobody fetched yet. Fetching a page redoes it.
+  std::vector<page_id_t> page_ids;
+  {
+    std::lock_guard<std::mutex> guard(pending_latch_);
+    for (const auto &page : pending_pages_) {
+      page_ids.push_back(page.first);
+    }
+  }
+  std::atomic<size_t> next_page{0};
+  auto redo_pages = [this, &page_ids, &next_page] {
+    for (size_t i = next_page++; i < page_ids.size(); i = next_page++) {
+      Page *page;
+      // New transactions may have every frame pinned for a moment.
+      while ((page = buffer_pool_manager_->FetchPage(page_ids[i])) == nullptr) {
+        std::this_thread::yield();
+      }
+      buffer_pool_manager_->UnpinPage(page_ids[i], false);
+    }
+  };
+  std::vector<std::thread> workers;
+  for (size_t i = 1; i < std::min(num_workers_, page_ids.size()); i++) {
+    workers.emplace_back(redo_pages);
+  }
+  redo_pages();
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  buffer_pool_manager_->SetPageRecoveryHandler(nullptr);
+
+  UndoLosers(&loser_changes);
+  // Undo is not logged, so the rolled back pages must be on disk before the losers count as aborted.
+  buffer_pool_manager_->FlushAllPages();
+  if (enable_logging) {
+    lsn_t last_lsn = INVALID_LSN;
+    for (const auto &txn : active_txn_) {
+      LogRecord log_record(txn.first, txn.second, LogRecordType::ABORT);
+      last_lsn = log_manager->AppendLogRecord(&log_record);
+    }
+    if (last_lsn != INVALID_LSN) {
+      log_manager->Flush(last_lsn);
+    }
+  }
+  for (auto &loser : loser_txns_) {
+    std::vector<RID> rids(loser.second->GetExclusiveLockSet()->begin(), loser.second->GetExclusiveLockSet()->end());
+    rids.insert(rids.end(), loser.second->GetIncrementLockSet()->begin(), loser.second->GetIncrementLockSet()->end());
+    for (const auto &rid : rids) {
+      lock_manager->Unlock(loser.second, rid);
+    }
+    delete loser.second;
+  }
+  loser_txns_.clear();
+  if (lock_manager != nullptr) {
+    lock_manager->ResumeTableLocks();
+  }
+  active_txn_.clear();
+  lsn_mapping_.clear();
+}
+
+void LogRecovery::WaitForInstantRestart() {
+  if (restart_thread_.joinable()) {
+    restart_thread_.join();
+  }
+}
 
 }  // namespace bustub
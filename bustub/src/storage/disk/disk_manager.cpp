@@ -10,46 +10,85 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include <dirent.h>
 #include <sys/stat.h>
+#include <algorithm>
 #include <cassert>
+#include <cstdio>
 #include <cstring>
 #include <iostream>
 #include <string>
 #include <thread>  // NOLINT
+#include <vector>
 
 #include "common/exception.h"
 #include "common/logger.h"
+#include "recovery/log_record.h"
 #include "storage/disk/disk_manager.h"
 
 namespace bustub {
 
 static char *buffer_used;
 
+/** Marks a log control file, as opposed to a log file from before logs were split into segments. */
+static constexpr uint32_t LOG_CONTROL_MAGIC = 0x4c4f4753;
+
+/** Contents of the log control file. */
+struct LogControl {
+  uint32_t magic_;
+  int32_t segment_size_;
+  int32_t log_start_;
+};
+
 /**
  * Constructor: open/create a single database file & log file
  * @input db_file: database file name
+ * @input log_segment_size: size of the log segment files of a new log
  */
-DiskManager::DiskManager(const std::string &db_file)
-    : file_name_(db_file), next_page_id_(0), num_flushes_(0), num_writes_(0), flush_log_(false), flush_log_f_(nullptr) {
+DiskManager::DiskManager(const std::string &db_file, int log_segment_size)
+    : log_segment_size_(log_segment_size),
+      file_name_(db_file),
+      num_flushes_(0),
+      num_writes_(0),
+      num_reads_(0),
+      flush_log_(false),
+      flush_log_f_(nullptr) {
+  assert(log_segment_size_ > 0);
   std::string::size_type n = file_name_.rfind('.');
   if (n == std::string::npos) {
     LOG_DEBUG("wrong file format");
     return;
   }
   log_name_ = file_name_.substr(0, n) + ".log";
+  master_name_ = file_name_.substr(0, n) + ".master";
+  // Larger size classes live in their own files, e.g. test.16k.db, which are only created once they are used.
+  size_class_file_name_[0] = file_name_;
+  for (size_t i = 1; i < NUM_PAGE_SIZE_CLASSES; i++) {
+    size_class_file_name_[i] = file_name_.substr(0, n) + "." +
+                               std::to_string(PageSizeOf(static_cast<PageSizeClass>(i)) / 1024) + "k" +
+                               file_name_.substr(n);
+  }
 
-  log_io_.open(log_name_, std::ios::binary | std::ios::in | std::ios::app | std::ios::out);
-  // directory or file does not exist
-  if (!log_io_.is_open()) {
-    log_io_.clear();
-    // create a new file
-    log_io_.open(log_name_, std::ios::binary | std::ios::trunc | std::ios::app | std::ios::out);
-    log_io_.close();
-    // reopen with original mode
-    log_io_.open(log_name_, std::ios::binary | std::ios::in | std::ios::app | std::ios::out);
-    if (!log_io_.is_open()) {
-      throw Exception("can't open dblog file");
-    }
+  LogControl log_control{};
+  std::ifstream control_io(log_name_, std::ios::binary | std::ios::in);
+  control_io.read(reinterpret_cast<char *>(&log_control), sizeof(LogControl));
+  if (control_io.gcount() == sizeof(LogControl) && log_control.magic_ == LOG_CONTROL_MAGIC &&
+      log_control.segment_size_ > 0) {
+    log_segment_size_ = log_control.segment_size_;
+    log_start_ = log_control.log_start_;
+    log_end_ = FindLogEnd(log_start_, &next_lsn_);
+  } else if (GetFileSize(log_name_) > 0) {
+    // A log from before logs were split into segments, or no log at all. Starting a new log would overwrite it.
+    throw Exception("log file " + log_name_ + " has no log control header");
+  } else {
+    // A new log. Segments and a master record left behind by an older log point into a log that is gone.
+    RemoveLogSegments();
+    remove(master_name_.c_str());
+    WriteLogControl();
+  }
+  control_io.close();
+  while (GetFileSize(GetLogSegmentName(log_end_ / log_segment_size_ + num_spare_log_segments_ + 1)) >= 0) {
+    num_spare_log_segments_++;
   }
 
   db_io_.open(db_file, std::ios::binary | std::ios::in | std::ios::out);
@@ -73,51 +112,93 @@ DiskManager::DiskManager(const std::string &db_file)
  */
 void DiskManager::ShutDown() {
   db_io_.close();
+  log_read_io_.close();
+  for (auto &io : size_class_io_) {
+    if (io.is_open()) {
+      io.close();
+    }
+  }
   log_io_.close();
 }
 
+/**
+ * Private helper function to get the file of a page size class
+ */
+std::fstream &DiskManager::GetPageFile(PageSizeClass size_class) {
+  auto i = static_cast<size_t>(size_class);
+  if (i == 0) {
+    return db_io_;
+  }
+  std::fstream &io = size_class_io_[i];
+  if (!io.is_open()) {
+    io.open(size_class_file_name_[i], std::ios::binary | std::ios::in | std::ios::out);
+    // file does not exist
+    if (!io.is_open()) {
+      io.clear();
+      // create a new file
+      io.open(size_class_file_name_[i], std::ios::binary | std::ios::trunc | std::ios::out);
+      io.close();
+      // reopen with original mode
+      io.open(size_class_file_name_[i], std::ios::binary | std::ios::in | std::ios::out);
+      if (!io.is_open()) {
+        throw Exception("can't open db file");
+      }
+    }
+  }
+  return io;
+}
+
 /**
  * Write the contents of the specified page into disk file
  */
 void DiskManager::WritePage(page_id_t page_id, const char *page_data) {
-  size_t offset = static_cast<size_t>(page_id) * PAGE_SIZE;
+  PageSizeClass size_class = GetPageSizeClass(page_id);
+  uint32_t page_size = PageSizeOf(size_class);
+  std::fstream &io = GetPageFile(size_class);
+  size_t offset = static_cast<size_t>(GetLocalPageId(page_id)) * page_size;
   // set write cursor to offset
   num_writes_ += 1;
-  db_io_.seekp(offset);
-  db_io_.write(page_data, PAGE_SIZE);
+  io.seekp(offset);
+  io.write(page_data, page_size);
   // check for I/O error
-  if (db_io_.bad()) {
+  if (io.bad()) {
     LOG_DEBUG("I/O error while writing");
     return;
   }
   // needs to flush to keep disk file in sync
-  db_io_.flush();
+  io.flush();
 }
 
 /**
  * Read the contents of the specified page into the given memory area
  */
 void DiskManager::ReadPage(page_id_t page_id, char *page_data) {
-  int offset = page_id * PAGE_SIZE;
+  PageSizeClass size_class = GetPageSizeClass(page_id);
+  int page_size = static_cast<int>(PageSizeOf(size_class));
+  std::fstream &io = GetPageFile(size_class);
+  int offset = GetLocalPageId(page_id) * page_size;
+  num_reads_ += 1;
   // check if read beyond file length
-  if (offset > GetFileSize(file_name_)) {
+  if (offset > GetFileSize(size_class_file_name_[static_cast<size_t>(size_class)])) {
     LOG_DEBUG("I/O error reading past end of file");
     // std::cerr << "I/O error while reading" << std::endl;
+    // The page was allocated but never written, e.g. before a crash. Do not hand out the old content of the frame.
+    memset(page_data, 0, page_size);
   } else {
     // set read cursor to offset
-    db_io_.seekp(offset);
-    db_io_.read(page_data, PAGE_SIZE);
-    if (db_io_.bad()) {
+    io.seekp(offset);
+    io.read(page_data, page_size);
+    if (io.bad()) {
       LOG_DEBUG("I/O error while reading");
       return;
     }
-    // if file ends before reading PAGE_SIZE
-    int read_count = db_io_.gcount();
-    if (read_count < PAGE_SIZE) {
+    // if file ends before reading a whole page
+    int read_count = io.gcount();
+    if (read_count < page_size) {
       LOG_DEBUG("Read less than a page");
-      db_io_.clear();
+      io.clear();
       // std::cerr << "Read less than a page" << std::endl;
-      memset(page_data + read_count, 0, PAGE_SIZE - read_count);
+      memset(page_data + read_count, 0, page_size - read_count);
     }
   }
 }
@@ -142,53 +223,340 @@ void DiskManager::WriteLog(char *log_data, int size) {
     assert(flush_log_f_->wait_for(std::chrono::seconds(10)) == std::future_status::ready);
   }
 
+  std::lock_guard<std::mutex> guard(log_latch_);
   num_flushes_ += 1;
-  // sequence write
-  log_io_.write(log_data, size);
+  // sequence write, continued in the next segment when the current one is full
+  while (size > 0) {
+    int segment = log_end_ / log_segment_size_;
+    int segment_offset = log_end_ % log_segment_size_;
+    int write_size = std::min(size, log_segment_size_ - segment_offset);
+    if (segment != log_io_segment_) {
+      OpenLogSegment(segment);
+    }
+    log_io_.seekp(segment_offset);
+    log_io_.write(log_data, write_size);
 
-  // check for I/O error
-  if (log_io_.bad()) {
-    LOG_DEBUG("I/O error while writing log");
-    return;
+    // check for I/O error
+    if (log_io_.bad()) {
+      LOG_DEBUG("I/O error while writing log");
+      return;
+    }
+    log_data += write_size;
+    size -= write_size;
+    log_end_ += write_size;
   }
   // needs to flush to keep disk file in sync
   log_io_.flush();
   flush_log_ = false;
 }
 
+/**
+ * Private helper function to switch log writes to another segment
+ * A spare segment is taken if there is one, otherwise the segment file is created
+ */
+void DiskManager::OpenLogSegment(int segment) {
+  if (log_io_.is_open()) {
+    log_io_.close();
+  }
+  std::string segment_name = GetLogSegmentName(segment);
+  log_io_.clear();
+  log_io_.open(segment_name, std::ios::binary | std::ios::in | std::ios::out);
+  if (log_io_.is_open()) {
+    if (log_io_segment_ != -1 && segment > log_io_segment_ && num_spare_log_segments_ > 0) {
+      num_spare_log_segments_--;
+    }
+  } else {
+    // no spare segment, the file grows with the writes
+    log_io_.clear();
+    log_io_.open(segment_name, std::ios::binary | std::ios::trunc | std::ios::out);
+    log_io_.close();
+    log_io_.open(segment_name, std::ios::binary | std::ios::in | std::ios::out);
+    if (!log_io_.is_open()) {
+      throw Exception("can't open dblog file");
+    }
+  }
+  log_io_segment_ = segment;
+}
+
 /**
  * Read the contents of the log into the given memory area
  * Always read from the beginning and perform sequence read
  * @return: false means already reach the end
  */
 bool DiskManager::ReadLog(char *log_data, int size, int offset) {
-  if (offset >= GetFileSize(log_name_)) {
+  std::lock_guard<std::mutex> guard(log_latch_);
+  if (offset < log_start_ || offset >= log_end_) {
     // LOG_DEBUG("end of log file");
-    // LOG_DEBUG("file size is %d", GetFileSize(log_name_));
     return false;
   }
-  log_io_.seekp(offset);
-  log_io_.read(log_data, size);
+  // if log ends before reading "size"
+  int read_count = std::min(size, log_end_ - offset);
+  ReadLogSegments(log_data, read_count, offset);
+  memset(log_data + read_count, 0, size - read_count);
+  return true;
+}
 
-  if (log_io_.bad()) {
-    LOG_DEBUG("I/O error while reading log");
-    return false;
+/**
+ * Private helper function to read the log across segment files
+ */
+void DiskManager::ReadLogSegments(char *log_data, int size, int offset) {
+  while (size > 0) {
+    int segment = offset / log_segment_size_;
+    int segment_offset = offset % log_segment_size_;
+    int read_size = std::min(size, log_segment_size_ - segment_offset);
+    if (segment != log_read_segment_) {
+      log_read_io_.close();
+      log_read_io_.clear();
+      log_read_io_.open(GetLogSegmentName(segment), std::ios::binary | std::ios::in);
+      log_read_segment_ = log_read_io_.is_open() ? segment : -1;
+    }
+    int read_count = 0;
+    if (log_read_io_.is_open()) {
+      log_read_io_.clear();
+      log_read_io_.seekg(segment_offset);
+      log_read_io_.read(log_data, read_size);
+      if (log_read_io_.bad()) {
+        LOG_DEBUG("I/O error while reading log");
+      }
+      read_count = log_read_io_.gcount();
+    }
+    // the segment file ends before reading "read_size"
+    memset(log_data + read_count, 0, read_size - read_count);
+    log_data += read_size;
+    size -= read_size;
+    offset += read_size;
   }
-  // if log file ends before reading "size"
-  int read_count = log_io_.gcount();
-  if (read_count < size) {
-    log_io_.clear();
-    memset(log_data + read_count, 0, size - read_count);
+}
+
+/**
+ * Private helper function to find the end of the log when it is opened
+ * Segment files are zeroed before they are written, so the log ends at the first record without a valid header. A
+ * header is valid if recovery would read it, and if its LSN follows the LSN of the record before it, which rules out
+ * torn writes that happen to leave a plausible size behind.
+ */
+int DiskManager::FindLogEnd(int offset, lsn_t *next_lsn) {
+  std::vector<char> chunk(LOG_BUFFER_SIZE);
+  int chunk_offset = offset;
+  ReadLogSegments(chunk.data(), LOG_BUFFER_SIZE, chunk_offset);
+  lsn_t last_lsn = INVALID_LSN;
+  while (true) {
+    if (offset + LogRecord::HEADER_SIZE > chunk_offset + LOG_BUFFER_SIZE) {
+      chunk_offset = offset;
+      ReadLogSegments(chunk.data(), LOG_BUFFER_SIZE, chunk_offset);
+    }
+    const char *header = chunk.data() + (offset - chunk_offset);
+    int32_t record_size;
+    lsn_t lsn;
+    LogRecordType type;
+    memcpy(&record_size, header, sizeof(int32_t));
+    memcpy(&lsn, header + 4, sizeof(lsn_t));
+    memcpy(&type, header + 16, sizeof(LogRecordType));
+    // no record is larger than the log buffer
+    if (record_size < LogRecord::HEADER_SIZE || record_size > LOG_BUFFER_SIZE || type <= LogRecordType::INVALID ||
+        type > LogRecordType::INCREMENT || lsn < 0 || (last_lsn != INVALID_LSN && lsn != last_lsn + 1)) {
+      *next_lsn = last_lsn + 1;
+      return offset;
+    }
+    last_lsn = lsn;
+    offset += record_size;
   }
+}
 
-  return true;
+/**
+ * Returns the size of the log, i.e. the offset of the next log write
+ */
+int DiskManager::GetLogSize() {
+  std::lock_guard<std::mutex> guard(log_latch_);
+  return log_end_;
+}
+
+/**
+ * Returns the offset of the oldest log record that is kept
+ */
+int DiskManager::GetLogStart() {
+  std::lock_guard<std::mutex> guard(log_latch_);
+  return log_start_;
+}
+
+/**
+ * Drop the segments before the given log offset
+ * Dead segments are zeroed outside the latch, nothing reads or writes them anymore, and then renamed to follow the
+ * last segment. New spare segments are prepared under a temporary name the same way.
+ */
+void DiskManager::TruncateLog(int offset) {
+  std::vector<int> dead_segments;
+  {
+    std::lock_guard<std::mutex> guard(log_latch_);
+    if (offset > log_start_) {
+      for (int segment = log_start_ / log_segment_size_; segment < offset / log_segment_size_; segment++) {
+        dead_segments.push_back(segment);
+      }
+      log_start_ = offset;
+      // a crash from here on leaves dead segments behind, but never a control file pointing at a missing segment
+      WriteLogControl();
+      if (log_read_segment_ != -1 && log_read_segment_ < offset / log_segment_size_) {
+        log_read_io_.close();
+        log_read_segment_ = -1;
+      }
+    }
+  }
+
+  for (int segment : dead_segments) {
+    std::string segment_name = GetLogSegmentName(segment);
+    if (GetFileSize(segment_name) >= 0) {
+      AddSpareLogSegment(segment_name);
+    }
+  }
+  // preallocate spares until there are enough
+  while (AddSpareLogSegment(log_name_ + ".spare")) {
+  }
+}
+
+/**
+ * Private helper function to turn a file into the next spare log segment
+ * @return: false means there are enough spares already, and the file was deleted
+ */
+bool DiskManager::AddSpareLogSegment(const std::string &file_name) {
+  {
+    std::lock_guard<std::mutex> guard(log_latch_);
+    if (num_spare_log_segments_ >= NUM_SPARE_LOG_SEGMENTS) {
+      remove(file_name.c_str());
+      return false;
+    }
+  }
+  ZeroLogSegment(file_name);
+  std::lock_guard<std::mutex> guard(log_latch_);
+  // spares follow the segment being written, which the log end may have just left
+  int current_segment = log_io_segment_ != -1 ? log_io_segment_ : log_end_ / log_segment_size_;
+  int spare_segment = current_segment + num_spare_log_segments_ + 1;
+  if (num_spare_log_segments_ < NUM_SPARE_LOG_SEGMENTS &&
+      rename(file_name.c_str(), GetLogSegmentName(spare_segment).c_str()) == 0) {
+    num_spare_log_segments_++;
+    return true;
+  }
+  remove(file_name.c_str());
+  return false;
+}
+
+/**
+ * Private helper function to overwrite a whole log segment file with zeroes, creating it if needed
+ */
+void DiskManager::ZeroLogSegment(const std::string &segment_name) {
+  std::fstream segment_io(segment_name, std::ios::binary | std::ios::in | std::ios::out);
+  if (!segment_io.is_open()) {
+    segment_io.clear();
+    segment_io.open(segment_name, std::ios::binary | std::ios::trunc | std::ios::out);
+  }
+  std::vector<char> zeroes(std::min(log_segment_size_, 64 * 1024), 0);
+  for (int written = 0; written < log_segment_size_; written += static_cast<int>(zeroes.size())) {
+    segment_io.write(zeroes.data(), std::min(static_cast<int>(zeroes.size()), log_segment_size_ - written));
+  }
+  segment_io.flush();
+  if (segment_io.bad()) {
+    LOG_DEBUG("I/O error while preallocating a log segment");
+  }
+}
+
+/**
+ * Private helper function to write the log control file
+ * It is written to a temporary file first and renamed, so a crash leaves either the old or the new control file
+ */
+void DiskManager::WriteLogControl() {
+  LogControl log_control{LOG_CONTROL_MAGIC, log_segment_size_, log_start_};
+  std::string tmp_name = log_name_ + ".tmp";
+  std::ofstream control_io(tmp_name, std::ios::binary | std::ios::trunc | std::ios::out);
+  if (!control_io.is_open()) {
+    throw Exception("can't open dblog file");
+  }
+  control_io.write(reinterpret_cast<const char *>(&log_control), sizeof(LogControl));
+  control_io.close();
+  if (control_io.bad() || rename(tmp_name.c_str(), log_name_.c_str()) != 0) {
+    LOG_DEBUG("I/O error while writing log control file");
+  }
+}
+
+/**
+ * Private helper function to delete the segment files of an old log, named after the log control file
+ */
+void DiskManager::RemoveLogSegments() {
+  std::string::size_type slash = log_name_.rfind('/');
+  std::string dir_name = slash == std::string::npos ? "." : log_name_.substr(0, slash + 1);
+  std::string prefix = (slash == std::string::npos ? log_name_ : log_name_.substr(slash + 1)) + ".";
+  DIR *dir = opendir(dir_name.c_str());
+  if (dir == nullptr) {
+    return;
+  }
+  std::vector<std::string> segment_names;
+  for (dirent *entry = readdir(dir); entry != nullptr; entry = readdir(dir)) {
+    std::string name(entry->d_name);
+    if (name.size() > prefix.size() && name.compare(0, prefix.size(), prefix) == 0 &&
+        name.find_first_not_of("0123456789", prefix.size()) == std::string::npos) {
+      segment_names.push_back(slash == std::string::npos ? name : dir_name + name);
+    }
+  }
+  closedir(dir);
+  for (const auto &segment_name : segment_names) {
+    remove(segment_name.c_str());
+  }
+}
+
+/**
+ * Returns the file name of a log segment, e.g. test.log.000002
+ */
+std::string DiskManager::GetLogSegmentName(int segment) const {
+  char suffix[16];
+  snprintf(suffix, sizeof(suffix), ".%06d", segment);
+  return log_name_ + suffix;
+}
+
+/**
+ * Write the master record into its own file
+ * The file is truncated first, a torn write is detected by ReadMasterRecord as a short file
+ */
+void DiskManager::WriteMasterRecord(const char *data, int size) {
+  std::ofstream master_io(master_name_, std::ios::binary | std::ios::trunc | std::ios::out);
+  master_io.write(data, size);
+  master_io.flush();
+  if (master_io.bad()) {
+    LOG_DEBUG("I/O error while writing master record");
+  }
+}
+
+/**
+ * Read the master record from its file
+ * @return: false means there is no complete master record
+ */
+bool DiskManager::ReadMasterRecord(char *data, int size) {
+  std::ifstream master_io(master_name_, std::ios::binary | std::ios::in);
+  if (!master_io.is_open()) {
+    return false;
+  }
+  master_io.read(data, size);
+  return master_io.gcount() == size;
 }
 
 /**
  * Allocate new page (operations like create index/table)
  * For now just keep an increasing counter
  */
-page_id_t DiskManager::AllocatePage() { return next_page_id_++; }
+page_id_t DiskManager::AllocatePage(PageSizeClass size_class) {
+  return MakePageId(size_class, next_page_id_[static_cast<size_t>(size_class)]++);
+}
+
+void DiskManager::ReservePageId(page_id_t page_id) {
+  std::atomic<page_id_t> &next_page_id = next_page_id_[static_cast<size_t>(GetPageSizeClass(page_id))];
+  page_id_t next = next_page_id.load();
+  do {
+    if (next > GetLocalPageId(page_id)) {
+      return;
+    }
+  } while (!next_page_id.compare_exchange_weak(next, GetLocalPageId(page_id) + 1));
+}
+
+int DiskManager::GetNumPages(PageSizeClass size_class) {
+  int file_size = GetFileSize(size_class_file_name_[static_cast<size_t>(size_class)]);
+  return file_size < 0 ? 0 : file_size / static_cast<int>(PageSizeOf(size_class));
+}
 
 /**
  * Deallocate page (operations like drop index/table)
@@ -207,6 +575,11 @@ int DiskManager::GetNumFlushes() const { return num_flushes_; }
  */
 int DiskManager::GetNumWrites() const { return num_writes_; }
 
+/**
+ * Returns number of page reads made so far
+ */
+int DiskManager::GetNumReads() const { return num_reads_; }
+
 /**
  * Returns true if the log is currently being flushed
  */
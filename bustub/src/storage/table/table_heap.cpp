@@ -11,118 +11,251 @@
 //===----------------------------------------------------------------------===//
 
 #include <cassert>
+#include <utility>
 
+#include "common/exception.h"
 #include "common/logger.h"
 #include "storage/table/table_heap.h"
+#include "type/value_factory.h"
 
 namespace bustub {
 
 TableHeap::TableHeap(BufferPoolManager *buffer_pool_manager, LockManager *lock_manager, LogManager *log_manager,
-                     page_id_t first_page_id)
+                     page_id_t first_page_id, table_oid_t table_oid)
     : buffer_pool_manager_(buffer_pool_manager),
       lock_manager_(lock_manager),
       log_manager_(log_manager),
-      first_page_id_(first_page_id) {}
+      first_page_id_(first_page_id),
+      table_oid_(table_oid) {}
 
 TableHeap::TableHeap(BufferPoolManager *buffer_pool_manager, LockManager *lock_manager, LogManager *log_manager,
-                     Transaction *txn)
-    : buffer_pool_manager_(buffer_pool_manager), lock_manager_(lock_manager), log_manager_(log_manager) {
+                     Transaction *txn, table_oid_t table_oid)
+    : buffer_pool_manager_(buffer_pool_manager),
+      lock_manager_(lock_manager),
+      log_manager_(log_manager),
+      table_oid_(table_oid) {
   // Initialize the first table page.
-  auto first_page = reinterpret_cast<TablePage *>(buffer_pool_manager_->NewPage(&first_page_id_));
-  BUSTUB_ASSERT(first_page != nullptr, "Couldn't create a page for the table heap.");
-  first_page->WLatch();
-  first_page->Init(first_page_id_, PAGE_SIZE, INVALID_LSN, log_manager_, txn);
-  first_page->WUnlatch();
-  buffer_pool_manager_->UnpinPage(first_page_id_, true);
+  auto first_page_guard = buffer_pool_manager_->NewPageGuarded(&first_page_id_);
+  BUSTUB_ASSERT(first_page_guard.IsValid(), "Couldn't create a page for the table heap.");
+  auto first_page_write_guard = first_page_guard.UpgradeWrite();
+  first_page_write_guard.AsMut<TablePage>()->Init(first_page_id_, PAGE_SIZE, INVALID_LSN, log_manager_, txn);
 }
 
 bool TableHeap::InsertTuple(const Tuple &tuple, RID *rid, Transaction *txn) {
-  if (tuple.size_ + 32 > PAGE_SIZE) {  // larger than one page size
+  if (!CheckWritable(txn)) {
+    return false;
+  }
+  if (tuple.size_ + 32 > MaxPageSize() || !FitsInLog(tuple)) {  // larger than the largest page size or log record
     txn->SetState(TransactionState::ABORTED);
     return false;
   }
+  // The new tuple is locked while its page is latched, free slots that others still hold locks on are skipped.
+  if (enable_logging && !IsCoveredByTableLock(txn, true) &&
+      !lock_manager_->LockTable(txn, table_oid_, LockMode::INTENTION_EXCLUSIVE)) {
+    return false;
+  }
+  LockManager *row_lock_manager = GetRowLockManager(txn, true);
 
-  auto cur_page = static_cast<TablePage *>(buffer_pool_manager_->FetchPage(first_page_id_));
-  if (cur_page == nullptr) {
+  auto cur_guard = buffer_pool_manager_->FetchPageWrite(first_page_id_);
+  if (!cur_guard.IsValid()) {
     txn->SetState(TransactionState::ABORTED);
     return false;
   }
 
-  cur_page->WLatch();
   // Insert into the first page with enough space. If no such page exists, create a new page and insert into that.
-  // INVARIANT: cur_page is WLatched if you leave the loop normally.
-  while (!cur_page->InsertTuple(tuple, rid, txn, lock_manager_, log_manager_)) {
-    auto next_page_id = cur_page->GetNextPageId();
+  // INVARIANT: cur_guard holds the write latch of the page we are trying to insert into.
+  while (!cur_guard.As<TablePage>()->InsertTuple(tuple, rid, txn, row_lock_manager, log_manager_)) {
+    auto next_page_id = cur_guard.As<TablePage>()->GetNextPageId();
     // If the next page is a valid page,
     if (next_page_id != INVALID_PAGE_ID) {
-      // Unlatch and unpin the current page.
-      cur_page->WUnlatch();
-      buffer_pool_manager_->UnpinPage(cur_page->GetTablePageId(), false);
-      // And repeat the process with the next page.
-      cur_page = static_cast<TablePage *>(buffer_pool_manager_->FetchPage(next_page_id));
-      cur_page->WLatch();
+      // Move on to the next page, the move assignment unlatches and unpins the current page.
+      cur_guard = buffer_pool_manager_->FetchPageWrite(next_page_id);
+      if (!cur_guard.IsValid()) {
+        txn->SetState(TransactionState::ABORTED);
+        return false;
+      }
     } else {
-      // Otherwise we have run out of valid pages. We need to create a new page.
-      auto new_page = static_cast<TablePage *>(buffer_pool_manager_->NewPage(&next_page_id));
+      // Otherwise we have run out of valid pages. We need to create a new page, large enough to hold the tuple.
+      PageSizeClass size_class = PageSizeClass::SMALL;
+      PageSizeClassFor(tuple.size_ + 32, &size_class);
+      auto new_page_guard = buffer_pool_manager_->NewPageGuarded(&next_page_id, size_class);
       // If we could not create a new page,
-      if (new_page == nullptr) {
+      if (!new_page_guard.IsValid()) {
         // Then life sucks and we abort the transaction.
-        cur_page->WUnlatch();
-        buffer_pool_manager_->UnpinPage(cur_page->GetTablePageId(), false);
         txn->SetState(TransactionState::ABORTED);
         return false;
       }
       // Otherwise we were able to create a new page. We initialize it now.
-      new_page->WLatch();
-      cur_page->SetNextPageId(next_page_id);
-      new_page->Init(next_page_id, PAGE_SIZE, cur_page->GetTablePageId(), log_manager_, txn);
-      cur_page->WUnlatch();
-      buffer_pool_manager_->UnpinPage(cur_page->GetTablePageId(), true);
-      cur_page = new_page;
+      auto new_guard = new_page_guard.UpgradeWrite();
+      cur_guard.AsMut<TablePage>()->SetNextPageId(next_page_id);
+      new_guard.AsMut<TablePage>()->Init(next_page_id, PageSizeOf(size_class), cur_guard.PageId(), log_manager_, txn);
+      cur_guard = std::move(new_guard);
     }
   }
-  // This line has caused most of us to double-take and "whoa double unlatch".
-  // We are not, in fact, double unlatching. See the invariant above.
-  cur_page->WUnlatch();
-  buffer_pool_manager_->UnpinPage(cur_page->GetTablePageId(), true);
+  if (IsVersioned(txn)) {
+    // Snapshots taken before the insert do not see the new tuple.
+    versions_.SaveVersion(*rid, txn, nullptr);
+  }
+  // The page we inserted into is dirty, the guard writes that back on release.
+  cur_guard.MarkDirty();
+  cur_guard.Drop();
+  // The new tuple is locked already, this counts its lock towards escalating the locks on the table.
+  if (enable_logging && row_lock_manager != nullptr) {
+    lock_manager_->LockExclusive(txn, table_oid_, *rid);
+  }
   // Update the transaction's write set.
   txn->GetWriteSet()->emplace_back(*rid, WType::INSERT, Tuple{}, this);
   return true;
 }
 
 bool TableHeap::MarkDelete(const RID &rid, Transaction *txn) {
+  if (!CheckWritable(txn)) {
+    return false;
+  }
+  if (IsOptimistic(txn)) {
+    return BufferWrite(rid, WType::DELETE, Tuple{}, txn);
+  }
+  return LockedMarkDelete(rid, txn);
+}
+
+bool TableHeap::UpdateTuple(const Tuple &tuple, const RID &rid, Transaction *txn) {
+  if (!CheckWritable(txn)) {
+    return false;
+  }
+  if (!FitsInLog(tuple)) {
+    txn->SetState(TransactionState::ABORTED);
+    return false;
+  }
+  if (IsOptimistic(txn)) {
+    return BufferWrite(rid, WType::UPDATE, tuple, txn);
+  }
+  return LockedUpdateTuple(tuple, rid, txn);
+}
+
+bool TableHeap::IncrementTuple(const RID &rid, const Schema &schema, uint32_t column_idx, const Value &delta,
+                               Transaction *txn) {
+  if (!CheckWritable(txn)) {
+    return false;
+  }
+  const Column &column = schema.GetColumn(column_idx);
+  BUSTUB_ASSERT(column.GetType() >= TypeId::TINYINT && column.GetType() <= TypeId::DECIMAL,
+                "Only numeric columns can be incremented.");
+  Value field_delta = delta.CastAs(column.GetType());
+  bool needs_lock = NeedsIncrementLock(rid, txn);
+  if (needs_lock && !lock_manager_->LockIncrement(txn, table_oid_, rid)) {
+    return false;
+  }
+  // Find the page which contains the tuple.
+  auto guard = buffer_pool_manager_->FetchPageWrite(rid.GetPageId());
+  // If the page could not be found, then abort the transaction.
+  if (!guard.IsValid()) {
+    txn->SetState(TransactionState::ABORTED);
+    return false;
+  }
+  auto *page = guard.AsMut<TablePage>();
+  bool is_incremented = false;
+  if (ReserveIncrement(page, rid, schema, column_idx, field_delta)) {
+    is_incremented = page->IncrementTuple(rid, column.GetOffset(), field_delta, txn, log_manager_);
+    if (!is_incremented) {
+      ReleaseIncrement(rid, column.GetOffset(), field_delta, false);
+    }
+  }
+  if (is_incremented) {
+    guard.MarkDirty();
+    // Snapshots taken before the increment subtract it from the version on the page.
+    if (IsVersioned(txn)) {
+      versions_.SaveIncrement(rid, txn, column.GetOffset(), field_delta);
+    }
+  }
+  guard.Drop();
+  // An overflow leaves the tuple as it was, but keeps the lock.
+  if (!is_incremented && needs_lock && txn->GetState() == TransactionState::ABORTED) {
+    ReleaseMissingTuple(rid, txn);
+  }
+  // Update the transaction's write set.
+  if (is_incremented && txn->GetState() != TransactionState::ABORTED) {
+    txn->GetWriteSet()->emplace_back(rid, column.GetOffset(), field_delta, this);
+  }
+  return is_incremented;
+}
+
+bool TableHeap::InstallWrite(const TableWriteRecord &write, Transaction *txn) {
+  if (write.wtype_ == WType::DELETE) {
+    return LockedMarkDelete(write.rid_, txn);
+  }
+  return LockedUpdateTuple(write.tuple_, write.rid_, txn);
+}
+
+bool TableHeap::LockForInstall(const RID &rid, Transaction *txn) { return LockTuple(rid, txn, true); }
+
+bool TableHeap::IsChangedSince(const RID &rid, Transaction *txn) { return versions_.IsChangedSince(rid, txn); }
+
+bool TableHeap::LockedMarkDelete(const RID &rid, Transaction *txn) {
   // TODO(Amadou): remove empty page
+  bool was_locked = !NeedsLock(rid, txn, true);
+  if (!LockTuple(rid, txn, true)) {
+    return false;
+  }
   // Find the page which contains the tuple.
-  auto page = reinterpret_cast<TablePage *>(buffer_pool_manager_->FetchPage(rid.GetPageId()));
+  auto guard = buffer_pool_manager_->FetchPageWrite(rid.GetPageId());
   // If the page could not be found, then abort the transaction.
-  if (page == nullptr) {
+  if (!guard.IsValid()) {
     txn->SetState(TransactionState::ABORTED);
     return false;
   }
+  if (!CheckWriteConflict(rid, txn)) {
+    return false;
+  }
+  // Snapshots taken before the delete still see the tuple.
+  Tuple old_tuple;
+  bool has_old_tuple = IsVersioned(txn) && guard.As<TablePage>()->GetTuple(rid, &old_tuple, nullptr, nullptr);
   // Otherwise, mark the tuple as deleted.
-  page->WLatch();
-  page->MarkDelete(rid, txn, lock_manager_, log_manager_);
-  page->WUnlatch();
-  buffer_pool_manager_->UnpinPage(page->GetTablePageId(), true);
+  bool is_deleted = guard.AsMut<TablePage>()->MarkDelete(rid, txn, GetRowLockManager(txn, true), log_manager_);
+  if (is_deleted && has_old_tuple) {
+    versions_.SaveVersion(rid, txn, &old_tuple);
+  }
+  guard.Drop();
+  if (!is_deleted) {
+    if (!was_locked) {
+      ReleaseMissingTuple(rid, txn);
+    }
+    return false;
+  }
   // Update the transaction's write set.
   txn->GetWriteSet()->emplace_back(rid, WType::DELETE, Tuple{}, this);
   return true;
 }
 
-bool TableHeap::UpdateTuple(const Tuple &tuple, const RID &rid, Transaction *txn) {
+bool TableHeap::LockedUpdateTuple(const Tuple &tuple, const RID &rid, Transaction *txn) {
+  bool was_locked = !NeedsLock(rid, txn, true);
+  if (!LockTuple(rid, txn, true)) {
+    return false;
+  }
   // Find the page which contains the tuple.
-  auto page = reinterpret_cast<TablePage *>(buffer_pool_manager_->FetchPage(rid.GetPageId()));
+  auto guard = buffer_pool_manager_->FetchPageWrite(rid.GetPageId());
   // If the page could not be found, then abort the transaction.
-  if (page == nullptr) {
+  if (!guard.IsValid()) {
     txn->SetState(TransactionState::ABORTED);
     return false;
   }
+  if (!CheckWriteConflict(rid, txn)) {
+    return false;
+  }
   // Update the tuple; but first save the old value for rollbacks.
   Tuple old_tuple;
-  page->WLatch();
-  bool is_updated = page->UpdateTuple(tuple, &old_tuple, rid, txn, lock_manager_, log_manager_);
-  page->WUnlatch();
-  buffer_pool_manager_->UnpinPage(page->GetTablePageId(), is_updated);
+  bool is_updated =
+      guard.As<TablePage>()->UpdateTuple(tuple, &old_tuple, rid, txn, GetRowLockManager(txn, true), log_manager_);
+  if (is_updated) {
+    guard.MarkDirty();
+    // Snapshots taken before the update still see the old value.
+    if (IsVersioned(txn)) {
+      versions_.SaveVersion(rid, txn, &old_tuple);
+    }
+  }
+  guard.Drop();
+  if (!is_updated && !was_locked) {
+    ReleaseMissingTuple(rid, txn);
+  }
   // Update the transaction's write set.
   if (is_updated && txn->GetState() != TransactionState::ABORTED) {
     txn->GetWriteSet()->emplace_back(rid, WType::UPDATE, old_tuple, this);
@@ -132,41 +265,254 @@ bool TableHeap::UpdateTuple(const Tuple &tuple, const RID &rid, Transaction *txn
 
 void TableHeap::ApplyDelete(const RID &rid, Transaction *txn) {
   // Find the page which contains the tuple.
-  auto page = reinterpret_cast<TablePage *>(buffer_pool_manager_->FetchPage(rid.GetPageId()));
-  BUSTUB_ASSERT(page != nullptr, "Couldn't find a page containing that RID.");
+  auto guard = buffer_pool_manager_->FetchPageWrite(rid.GetPageId());
+  BUSTUB_ASSERT(guard.IsValid(), "Couldn't find a page containing that RID.");
   // Delete the tuple from the page.
-  page->WLatch();
-  page->ApplyDelete(rid, txn, log_manager_);
-  lock_manager_->Unlock(txn, rid);
-  page->WUnlatch();
-  buffer_pool_manager_->UnpinPage(page->GetTablePageId(), true);
+  guard.AsMut<TablePage>()->ApplyDelete(rid, txn, log_manager_);
+  // Rolling back an insert brings back the version before it, which must happen before the slot can be reused.
+  if (IsVersioned(txn) && txn->GetState() == TransactionState::ABORTED) {
+    versions_.Rollback(rid, txn);
+  }
+  // The lock is released while we still hold the page latch.
+  lock_manager_->Unlock(txn, table_oid_, rid);
+}
+
+void TableHeap::ApplyDeletes(const std::vector<RID> &rids, Transaction *txn) {
+  // Find the page which contains the tuples.
+  auto guard = buffer_pool_manager_->FetchPageWrite(rids.front().GetPageId());
+  BUSTUB_ASSERT(guard.IsValid(), "Couldn't find a page containing that RID.");
+  // Delete the tuples from the page. Inserts skip the freed slots until their locks are released.
+  for (const RID &rid : rids) {
+    guard.AsMut<TablePage>()->ApplyDelete(rid, txn, log_manager_);
+  }
 }
 
 void TableHeap::RollbackDelete(const RID &rid, Transaction *txn) {
   // Find the page which contains the tuple.
-  auto page = reinterpret_cast<TablePage *>(buffer_pool_manager_->FetchPage(rid.GetPageId()));
-  BUSTUB_ASSERT(page != nullptr, "Couldn't find a page containing that RID.");
+  auto guard = buffer_pool_manager_->FetchPageWrite(rid.GetPageId());
+  BUSTUB_ASSERT(guard.IsValid(), "Couldn't find a page containing that RID.");
   // Rollback the delete.
-  page->WLatch();
-  page->RollbackDelete(rid, txn, log_manager_);
-  page->WUnlatch();
-  buffer_pool_manager_->UnpinPage(page->GetTablePageId(), true);
+  guard.AsMut<TablePage>()->RollbackDelete(rid, txn, log_manager_);
+}
+
+void TableHeap::RollbackUpdate(const Tuple &tuple, const RID &rid, Transaction *txn) {
+  LockedUpdateTuple(tuple, rid, txn);
+}
+
+void TableHeap::RollbackIncrement(const RID &rid, uint32_t offset, const Value &delta, Transaction *txn) {
+  // Find the page which contains the tuple.
+  auto guard = buffer_pool_manager_->FetchPageWrite(rid.GetPageId());
+  BUSTUB_ASSERT(guard.IsValid(), "Couldn't find a page containing that RID.");
+  // Other transactions may have incremented the tuple since, subtracting the increment keeps theirs. The range kept
+  // for the increment makes sure the field does not overflow.
+  [[maybe_unused]] bool is_rolled_back =
+      guard.AsMut<TablePage>()->IncrementTuple(rid, offset, TablePage::NegateDelta(delta), txn, log_manager_);
+  BUSTUB_ASSERT(is_rolled_back, "Couldn't rollback an increment.");
+  ReleaseIncrement(rid, offset, delta, false);
+  guard.MarkDirty();
+  // Snapshots must not subtract the increment from a page that no longer has it.
+  if (IsVersioned(txn)) {
+    versions_.RollbackIncrement(rid, txn, offset);
+  }
+}
+
+void TableHeap::CommitIncrement(const RID &rid, uint32_t offset, const Value &delta) {
+  ReleaseIncrement(rid, offset, delta, true);
+}
+
+bool TableHeap::ReserveIncrement(TablePage *page, const RID &rid, const Schema &schema, uint32_t column_idx,
+                                 const Value &delta) {
+  uint32_t offset = schema.GetColumn(column_idx).GetOffset();
+  std::lock_guard<std::mutex> guard(increment_latch_);
+  auto &fields = increment_ranges_[rid];
+  auto &range = fields[offset];
+  if (range.pending_ == 0) {
+    // Nothing is pending, so the field is committed. A missing tuple fails the increment on the page.
+    Tuple tuple;
+    range.min_ = page->GetTuple(rid, &tuple, nullptr, nullptr) ? tuple.GetValue(&schema, column_idx)
+                                                                 : ValueFactory::GetZeroValueByType(delta.GetTypeId());
+    range.max_ = range.min_;
+  }
+  // A positive increment raises the value the field has if it commits, a negative one lowers it.
+  bool raises = delta.CompareGreaterThan(ValueFactory::GetZeroValueByType(delta.GetTypeId())) == CmpBool::CmpTrue;
+  Value &bound = raises ? range.max_ : range.min_;
+  try {
+    bound = bound.Add(delta);
+  } catch (Exception &e) {
+    if (range.pending_ == 0) {
+      fields.erase(offset);
+      if (fields.empty()) {
+        increment_ranges_.erase(rid);
+      }
+    }
+    return false;
+  }
+  range.pending_++;
+  return true;
+}
+
+void TableHeap::ReleaseIncrement(const RID &rid, uint32_t offset, const Value &delta, bool committed) {
+  std::lock_guard<std::mutex> guard(increment_latch_);
+  auto fields = increment_ranges_.find(rid);
+  BUSTUB_ASSERT(fields != increment_ranges_.end(), "An increment that is not pending.");
+  auto range = fields->second.find(offset);
+  BUSTUB_ASSERT(range != fields->second.end(), "An increment that is not pending.");
+  if (--range->second.pending_ == 0) {
+    fields->second.erase(range);
+    if (fields->second.empty()) {
+      increment_ranges_.erase(fields);
+    }
+    return;
+  }
+  // The field can no longer end up without a committed increment, nor with a rolled back one. Either bound moves
+  // towards the other, which does not overflow.
+  bool raises = delta.CompareGreaterThan(ValueFactory::GetZeroValueByType(delta.GetTypeId())) == CmpBool::CmpTrue;
+  if (committed) {
+    Value &bound = raises ? range->second.min_ : range->second.max_;
+    bound = bound.Add(delta);
+  } else {
+    Value &bound = raises ? range->second.max_ : range->second.min_;
+    bound = bound.Subtract(delta);
+  }
 }
 
 bool TableHeap::GetTuple(const RID &rid, Tuple *tuple, Transaction *txn) {
+  if (IsSnapshotRead(txn)) {
+    auto guard = buffer_pool_manager_->FetchPageRead(rid.GetPageId());
+    if (!guard.IsValid()) {
+      txn->SetState(TransactionState::ABORTED);
+      return false;
+    }
+    return GetVisibleTuple(guard.As<TablePage>(), rid, tuple, txn);
+  }
+  bool was_locked = !NeedsLock(rid, txn, false);
+  if (!LockTuple(rid, txn, false)) {
+    return false;
+  }
   // Find the page which contains the tuple.
-  auto page = static_cast<TablePage *>(buffer_pool_manager_->FetchPage(rid.GetPageId()));
+  auto guard = buffer_pool_manager_->FetchPageRead(rid.GetPageId());
   // If the page could not be found, then abort the transaction.
-  if (page == nullptr) {
+  if (!guard.IsValid()) {
     txn->SetState(TransactionState::ABORTED);
     return false;
   }
   // Read the tuple from the page.
-  page->RLatch();
-  bool res = page->GetTuple(rid, tuple, txn, lock_manager_);
-  page->RUnlatch();
-  buffer_pool_manager_->UnpinPage(rid.GetPageId(), false);
-  return res;
+  bool found = guard.As<TablePage>()->GetTuple(rid, tuple, txn, GetRowLockManager(txn, false));
+  guard.Drop();
+  if (!was_locked) {
+    if (!found) {
+      ReleaseMissingTuple(rid, txn);
+    } else if (txn->GetIsolationLevel() == IsolationLevel::READ_COMMITTED) {
+      // Under READ_COMMITTED the shared lock is only held for the read.
+      lock_manager_->Unlock(txn, table_oid_, rid);
+    }
+  }
+  return found;
+}
+
+void TableHeap::CommitVersion(const RID &rid, Transaction *txn, timestamp_t commit_ts, timestamp_t watermark) {
+  versions_.Commit(rid, txn, commit_ts, watermark);
+}
+
+void TableHeap::RollbackVersion(const RID &rid, Transaction *txn) { versions_.Rollback(rid, txn); }
+
+bool TableHeap::NeedsLock(const RID &rid, Transaction *txn, bool exclusive) {
+  if (!enable_logging || txn == nullptr || txn->IsExclusiveLocked(rid) || IsCoveredByTableLock(txn, exclusive) ||
+      (!exclusive && IsSnapshotRead(txn))) {
+    return false;
+  }
+  return exclusive || (!txn->IsSharedLocked(rid) && txn->GetIsolationLevel() != IsolationLevel::READ_UNCOMMITTED);
+}
+
+bool TableHeap::NeedsIncrementLock(const RID &rid, Transaction *txn) {
+  return enable_logging && txn != nullptr && !txn->IsExclusiveLocked(rid) && !txn->IsIncrementLocked(rid) &&
+         !IsCoveredByTableLock(txn, true);
+}
+
+bool TableHeap::IsCoveredByTableLock(Transaction *txn, bool exclusive) {
+  LockMode held;
+  return txn->IsTableLocked(table_oid_, &held) &&
+         LockManager::Covers(held, exclusive ? LockMode::EXCLUSIVE : LockMode::SHARED);
+}
+
+LockManager *TableHeap::GetRowLockManager(Transaction *txn, bool exclusive) {
+  return txn != nullptr && IsCoveredByTableLock(txn, exclusive) ? nullptr : lock_manager_;
+}
+
+bool TableHeap::LockTuple(const RID &rid, Transaction *txn, bool exclusive) {
+  if (!NeedsLock(rid, txn, exclusive)) {
+    return true;
+  }
+  if (exclusive) {
+    return lock_manager_->LockExclusive(txn, table_oid_, rid);
+  }
+  return lock_manager_->LockShared(txn, table_oid_, rid);
+}
+
+void TableHeap::ReleaseMissingTuple(const RID &rid, Transaction *txn) {
+  // The slot may be free, and an insert that takes it locks it while it holds the page latch.
+  if (txn->IsSharedLocked(rid) || txn->IsExclusiveLocked(rid) || txn->IsIncrementLocked(rid)) {
+    lock_manager_->Unlock(txn, table_oid_, rid);
+  }
+}
+
+bool TableHeap::CheckWritable(Transaction *txn) {
+  if (txn != nullptr && txn->IsReadOnly()) {
+    txn->SetState(TransactionState::ABORTED);
+    return false;
+  }
+  return true;
+}
+
+bool TableHeap::CheckWriteConflict(const RID &rid, Transaction *txn) {
+  // First committer wins, a snapshot may not overwrite a change it does not see.
+  if (IsSnapshotRead(txn) && versions_.IsChangedSince(rid, txn)) {
+    txn->SetState(TransactionState::ABORTED);
+    return false;
+  }
+  return true;
+}
+
+bool TableHeap::BufferWrite(const RID &rid, WType wtype, const Tuple &tuple, Transaction *txn) {
+  // The tuple must exist for txn, and reading it makes validation check that nobody changed it.
+  Tuple current;
+  if (!GetTuple(rid, &current, txn)) {
+    return false;
+  }
+  // Only the last change of a tuple is installed.
+  auto writes = txn->GetBufferedWriteSet();
+  writes->erase(rid);
+  auto write = writes->emplace(rid, TableWriteRecord(rid, wtype, tuple, this)).first;
+  // The tuple is copied over the ones iterators read into, which must keep their RID.
+  write->second.tuple_.rid_ = rid;
+  return true;
+}
+
+bool TableHeap::GetVisibleTuple(TablePage *page, const RID &rid, Tuple *tuple, Transaction *txn) {
+  if (txn->GetConcurrencyMode() == ConcurrencyMode::OPTIMISTIC) {
+    txn->GetTableReadSet()->emplace(rid, this);
+    // A transaction sees its own buffered changes.
+    auto write = txn->GetBufferedWriteSet()->find(rid);
+    if (write != txn->GetBufferedWriteSet()->end()) {
+      if (write->second.wtype_ == WType::DELETE) {
+        return false;
+      }
+      *tuple = write->second.tuple_;
+      return true;
+    }
+  }
+  bool exists;
+  if (!versions_.GetVersion(rid, txn, tuple, &exists)) {
+    // The version on the page is the one the snapshot sees, but for the increments committed after the snapshot and
+    // those of running transactions. It is read without locking it or aborting if it is missing.
+    if (!page->GetTuple(rid, tuple, nullptr, nullptr)) {
+      return false;
+    }
+    versions_.UndoIncrements(rid, txn, tuple);
+    return true;
+  }
+  tuple->rid_ = rid;
+  return exists;
 }
 
 TableIterator TableHeap::Begin(Transaction *txn) {
@@ -175,15 +521,14 @@ TableIterator TableHeap::Begin(Transaction *txn) {
   RID rid;
   auto page_id = first_page_id_;
   while (page_id != INVALID_PAGE_ID) {
-    auto page = static_cast<TablePage *>(buffer_pool_manager_->FetchPage(page_id));
-    page->RLatch();
+    auto guard = buffer_pool_manager_->FetchPageRead(page_id);
+    auto page = guard.As<TablePage>();
     // If this fails because there is no tuple, then RID will be the default-constructed value, which means EOF.
-    auto found_tuple = page->GetFirstTupleRid(&rid);
-    page->RUnlatch();
-    buffer_pool_manager_->UnpinPage(page_id, false);
-    if (found_tuple) {
+    // A snapshot may see tuples that were deleted since it began, so it starts at the first slot.
+    if (page->GetFirstTupleRid(&rid, IsSnapshotRead(txn))) {
       break;
     }
+    // Read the next page id while the page is still pinned and latched.
     page_id = page->GetNextPageId();
   }
   return TableIterator(this, rid, txn);
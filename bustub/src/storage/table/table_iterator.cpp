@@ -11,6 +11,7 @@
 //===----------------------------------------------------------------------===//
 
 #include <cassert>
+#include <utility>
 
 #include "storage/table/table_heap.h"
 
@@ -18,8 +19,10 @@ namespace bustub {
 
 TableIterator::TableIterator(TableHeap *table_heap, RID rid, Transaction *txn)
     : table_heap_(table_heap), tuple_(new Tuple(rid)), txn_(txn) {
-  if (rid.GetPageId() != INVALID_PAGE_ID) {
-    table_heap_->GetTuple(tuple_->rid_, tuple_, txn_);
+  // A snapshot starts at the first slot, which may hold no tuple it sees.
+  if (rid.GetPageId() != INVALID_PAGE_ID && !table_heap_->GetTuple(tuple_->rid_, tuple_, txn_) &&
+      TableHeap::IsSnapshotRead(txn_)) {
+    ++(*this);
   }
 }
 
@@ -35,32 +38,39 @@ Tuple *TableIterator::operator->() {
 
 TableIterator &TableIterator::operator++() {
   BufferPoolManager *buffer_pool_manager = table_heap_->buffer_pool_manager_;
-  auto cur_page = static_cast<TablePage *>(buffer_pool_manager->FetchPage(tuple_->rid_.GetPageId()));
-  cur_page->RLatch();
-  assert(cur_page != nullptr);  // all pages are pinned
+  auto cur_guard = buffer_pool_manager->FetchPageRead(tuple_->rid_.GetPageId());
+  assert(cur_guard.IsValid());  // all pages are pinned
 
+  // A snapshot visits the empty slots too, as it sees the tuples that were deleted since it began, and skips the slots
+  // that hold no tuple it sees.
+  bool snapshot = TableHeap::IsSnapshotRead(txn_);
   RID next_tuple_rid;
-  if (!cur_page->GetNextTupleRid(tuple_->rid_,
-                                 &next_tuple_rid)) {  // end of this page
-    while (cur_page->GetNextPageId() != INVALID_PAGE_ID) {
-      auto next_page = static_cast<TablePage *>(buffer_pool_manager->FetchPage(cur_page->GetNextPageId()));
-      cur_page->RUnlatch();
-      buffer_pool_manager->UnpinPage(cur_page->GetTablePageId(), false);
-      cur_page = next_page;
-      cur_page->RLatch();
-      if (cur_page->GetFirstTupleRid(&next_tuple_rid)) {
-        break;
+  do {
+    if (!cur_guard.As<TablePage>()->GetNextTupleRid(tuple_->rid_, &next_tuple_rid,
+                                                    snapshot)) {  // end of this page
+      while (cur_guard.As<TablePage>()->GetNextPageId() != INVALID_PAGE_ID) {
+        auto next_guard = buffer_pool_manager->FetchPageRead(cur_guard.As<TablePage>()->GetNextPageId());
+        cur_guard = std::move(next_guard);
+        if (cur_guard.As<TablePage>()->GetFirstTupleRid(&next_tuple_rid, snapshot)) {
+          break;
+        }
       }
     }
-  }
-  tuple_->rid_ = next_tuple_rid;
+    tuple_->rid_ = next_tuple_rid;
+  } while (snapshot && *this != table_heap_->End() &&
+           !table_heap_->GetVisibleTuple(cur_guard.As<TablePage>(), tuple_->rid_, tuple_, txn_));
 
-  if (*this != table_heap_->End()) {
-    table_heap_->GetTuple(tuple_->rid_, tuple_, txn_);
+  if (*this != table_heap_->End() && !snapshot) {
+    if (table_heap_->NeedsLock(tuple_->rid_, txn_, false)) {
+      // The tuple must be locked before its page is latched.
+      cur_guard.Drop();
+      table_heap_->GetTuple(tuple_->rid_, tuple_, txn_);
+    } else {
+      // Read the tuple through the page we already hold instead of fetching it again.
+      cur_guard.As<TablePage>()->GetTuple(tuple_->rid_, tuple_, txn_, table_heap_->GetRowLockManager(txn_, false));
+    }
   }
   // release until copy the tuple
-  cur_page->RUnlatch();
-  buffer_pool_manager->UnpinPage(cur_page->GetTablePageId(), false);
   return *this;
 }
 
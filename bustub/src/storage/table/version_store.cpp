@@ -0,0 +1,277 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// version_store.cpp
+//
+// Identification: src/storage/table/version_store.cpp
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#include "storage/table/version_store.h"
+
+#include <algorithm>
+
+#include "common/macros.h"
+
+namespace bustub {
+
+void VersionStore::SaveVersion(const RID &rid, Transaction *txn, const Tuple *tuple) {
+  Shard *shard = GetShard(rid);
+  std::lock_guard<std::mutex> guard(shard->latch_);
+  auto [chain, inserted] = shard->chains_.try_emplace(rid);
+  if (inserted) {
+    // A tuple without a chain is seen by every snapshot, as if it was committed at timestamp 0.
+    num_chains_++;
+  } else if (chain->second.writer_ == txn->GetTransactionId()) {
+    return;
+  }
+  BUSTUB_ASSERT(chain->second.writer_ == INVALID_TXN_ID, "Another transaction changed the tuple and did not commit.");
+  if (chain->second.increments_.empty()) {
+    chain->second.undo_.push_back(
+        UndoVersion{chain->second.ts_, tuple != nullptr, tuple != nullptr ? *tuple : Tuple{}});
+  } else {
+    BUSTUB_ASSERT(tuple != nullptr, "An incremented tuple exists.");
+    FoldIncrements(&chain->second, txn, *tuple);
+  }
+  chain->second.writer_ = txn->GetTransactionId();
+}
+
+void VersionStore::SaveIncrement(const RID &rid, Transaction *txn, uint32_t offset, const Value &delta) {
+  Shard *shard = GetShard(rid);
+  std::lock_guard<std::mutex> guard(shard->latch_);
+  auto [chain, inserted] = shard->chains_.try_emplace(rid);
+  if (inserted) {
+    num_chains_++;
+  } else if (chain->second.writer_ == txn->GetTransactionId()) {
+    return;
+  }
+  BUSTUB_ASSERT(chain->second.writer_ == INVALID_TXN_ID, "Another transaction changed the tuple and did not commit.");
+  chain->second.increments_.push_back(IncrementVersion{txn->GetTransactionId(), 0, offset, delta});
+}
+
+void VersionStore::RollbackIncrement(const RID &rid, Transaction *txn, uint32_t offset) {
+  if (num_chains_ == 0) {
+    return;
+  }
+  Shard *shard = GetShard(rid);
+  std::lock_guard<std::mutex> guard(shard->latch_);
+  auto chain = shard->chains_.find(rid);
+  if (chain == shard->chains_.end()) {
+    return;
+  }
+  // Increments are rolled back newest first. Those of a transaction that overwrote the tuple afterwards are gone.
+  auto &increments = chain->second.increments_;
+  auto increment =
+      std::find_if(increments.rbegin(), increments.rend(), [txn, offset](const IncrementVersion &increment) {
+        return increment.txn_id_ == txn->GetTransactionId() && increment.offset_ == offset;
+      });
+  if (increment != increments.rend()) {
+    increments.erase(std::prev(increment.base()));
+  }
+}
+
+bool VersionStore::IsChangedSince(const RID &rid, Transaction *txn) {
+  if (num_chains_ == 0) {
+    return false;
+  }
+  Shard *shard = GetShard(rid);
+  std::lock_guard<std::mutex> guard(shard->latch_);
+  auto chain = shard->chains_.find(rid);
+  if (chain == shard->chains_.end() || chain->second.writer_ != INVALID_TXN_ID) {
+    return false;
+  }
+  const auto &increments = chain->second.increments_;
+  return chain->second.ts_ > txn->GetReadTs() ||
+         std::any_of(increments.begin(), increments.end(), [txn](const IncrementVersion &increment) {
+           return increment.ts_ > txn->GetReadTs();
+         });
+}
+
+bool VersionStore::GetVersion(const RID &rid, Transaction *txn, Tuple *tuple, bool *exists) {
+  if (num_chains_ == 0) {
+    return false;
+  }
+  Shard *shard = GetShard(rid);
+  std::lock_guard<std::mutex> guard(shard->latch_);
+  auto chain = shard->chains_.find(rid);
+  if (chain == shard->chains_.end() || chain->second.writer_ == txn->GetTransactionId() ||
+      (chain->second.writer_ == INVALID_TXN_ID && chain->second.ts_ <= txn->GetReadTs())) {
+    return false;
+  }
+  const auto &undo = chain->second.undo_;
+  auto version = std::find_if(undo.rbegin(), undo.rend(),
+                              [txn](const UndoVersion &version) { return version.ts_ <= txn->GetReadTs(); });
+  // Garbage collection keeps the newest version that the oldest snapshot sees, so only a snapshot that began before
+  // the tuple existed finds none.
+  *exists = version != undo.rend() && version->exists_;
+  if (*exists) {
+    *tuple = version->tuple_;
+    // The transaction sees its own increments, which apply to any version.
+    for (const auto &increment : chain->second.increments_) {
+      if (increment.txn_id_ == txn->GetTransactionId()) {
+        AddToField(tuple, increment.offset_, increment.delta_, false);
+      }
+    }
+  }
+  return true;
+}
+
+void VersionStore::UndoIncrements(const RID &rid, Transaction *txn, Tuple *tuple) {
+  if (num_chains_ == 0) {
+    return;
+  }
+  Shard *shard = GetShard(rid);
+  std::lock_guard<std::mutex> guard(shard->latch_);
+  auto chain = shard->chains_.find(rid);
+  if (chain == shard->chains_.end()) {
+    return;
+  }
+  for (const auto &increment : chain->second.increments_) {
+    if (!IsVisible(increment, txn)) {
+      AddToField(tuple, increment.offset_, increment.delta_, true);
+    }
+  }
+}
+
+void VersionStore::Commit(const RID &rid, Transaction *txn, timestamp_t commit_ts, timestamp_t watermark) {
+  if (num_chains_ == 0) {
+    return;
+  }
+  {
+    Shard *shard = GetShard(rid);
+    std::lock_guard<std::mutex> guard(shard->latch_);
+    auto chain = shard->chains_.find(rid);
+    if (chain == shard->chains_.end()) {
+      return;
+    }
+    // A transaction commits each tuple once, however many times it changed it.
+    bool committed = false;
+    for (auto &increment : chain->second.increments_) {
+      if (increment.txn_id_ == txn->GetTransactionId() && increment.ts_ == 0) {
+        increment.ts_ = commit_ts;
+        committed = true;
+      }
+    }
+    if (chain->second.writer_ == txn->GetTransactionId()) {
+      chain->second.writer_ = INVALID_TXN_ID;
+      chain->second.ts_ = commit_ts;
+      committed = true;
+    }
+    if (committed && Prune(&chain->second, watermark)) {
+      shard->chains_.erase(chain);
+      num_chains_--;
+    }
+  }
+  if (num_chains_ >= collect_at_) {
+    CollectGarbage(watermark);
+  }
+}
+
+void VersionStore::Rollback(const RID &rid, Transaction *txn) {
+  if (num_chains_ == 0) {
+    return;
+  }
+  Shard *shard = GetShard(rid);
+  std::lock_guard<std::mutex> guard(shard->latch_);
+  auto chain = shard->chains_.find(rid);
+  if (chain == shard->chains_.end()) {
+    return;
+  }
+  auto &increments = chain->second.increments_;
+  increments.erase(std::remove_if(increments.begin(), increments.end(),
+                                  [txn](const IncrementVersion &increment) {
+                                    return increment.txn_id_ == txn->GetTransactionId();
+                                  }),
+                   increments.end());
+  if (chain->second.writer_ == txn->GetTransactionId()) {
+    chain->second.ts_ = chain->second.undo_.back().ts_;
+    chain->second.undo_.pop_back();
+    chain->second.writer_ = INVALID_TXN_ID;
+  }
+  // Without older versions, the chain was new or every snapshot saw its version already.
+  if (chain->second.writer_ == INVALID_TXN_ID && chain->second.undo_.empty() && increments.empty()) {
+    shard->chains_.erase(chain);
+    num_chains_--;
+  }
+}
+
+void VersionStore::CollectGarbage(timestamp_t watermark) {
+  for (auto &shard : shards_) {
+    std::lock_guard<std::mutex> guard(shard.latch_);
+    for (auto chain = shard.chains_.begin(); chain != shard.chains_.end();) {
+      if (Prune(&chain->second, watermark)) {
+        chain = shard.chains_.erase(chain);
+        num_chains_--;
+      } else {
+        ++chain;
+      }
+    }
+  }
+  collect_at_ = std::max(MIN_CHAINS_TO_COLLECT, 2 * num_chains_.load());
+}
+
+bool VersionStore::Prune(VersionChain *chain, timestamp_t watermark) {
+  // The increments every snapshot sees are part of the version on the page.
+  auto &increments = chain->increments_;
+  auto seen =
+      std::stable_partition(increments.begin(), increments.end(), [watermark](const IncrementVersion &increment) {
+        return increment.ts_ == 0 || increment.ts_ > watermark;
+      });
+  for (auto increment = seen; increment != increments.end(); ++increment) {
+    chain->ts_ = std::max(chain->ts_, increment->ts_);
+  }
+  increments.erase(seen, increments.end());
+  if (chain->writer_ == INVALID_TXN_ID && increments.empty() && chain->ts_ <= watermark) {
+    return true;
+  }
+  // Snapshots at or after the watermark see no version older than the newest one committed at or before it.
+  auto &undo = chain->undo_;
+  auto visible = std::find_if(undo.rbegin(), undo.rend(),
+                              [watermark](const UndoVersion &version) { return version.ts_ <= watermark; });
+  if (visible != undo.rend()) {
+    undo.erase(undo.begin(), std::prev(visible.base()));
+  }
+  return false;
+}
+
+void VersionStore::FoldIncrements(VersionChain *chain, Transaction *txn, const Tuple &tuple) {
+  // The increments of the transaction are not committed, the increments of others are, as they held locks that go
+  // with the exclusive lock of the transaction.
+  Tuple version = tuple;
+  std::vector<IncrementVersion> committed;
+  for (const auto &increment : chain->increments_) {
+    if (increment.txn_id_ == txn->GetTransactionId()) {
+      AddToField(&version, increment.offset_, increment.delta_, true);
+    } else {
+      BUSTUB_ASSERT(increment.ts_ != 0, "Another transaction incremented the tuple and did not commit.");
+      committed.push_back(increment);
+    }
+  }
+  // Increments commute, so the version at a timestamp has the increments committed at or before it, in any order.
+  std::sort(committed.begin(), committed.end(),
+            [](const IncrementVersion &a, const IncrementVersion &b) { return a.ts_ > b.ts_; });
+  std::vector<UndoVersion> folded;
+  for (const auto &increment : committed) {
+    if (folded.empty() || folded.back().ts_ != increment.ts_) {
+      folded.push_back(UndoVersion{increment.ts_, true, version});
+    }
+    AddToField(&version, increment.offset_, increment.delta_, true);
+  }
+  chain->undo_.push_back(UndoVersion{chain->ts_, true, version});
+  chain->undo_.insert(chain->undo_.end(), folded.rbegin(), folded.rend());
+  if (!committed.empty()) {
+    chain->ts_ = committed.front().ts_;
+  }
+  chain->increments_.clear();
+}
+
+void VersionStore::AddToField(Tuple *tuple, uint32_t offset, const Value &delta, bool subtract) {
+  char *field = tuple->GetData() + offset;
+  Value value = Value::DeserializeFrom(field, delta.GetTypeId());
+  (subtract ? value.Subtract(delta) : value.Add(delta)).SerializeTo(field);
+}
+
+}  // namespace bustub
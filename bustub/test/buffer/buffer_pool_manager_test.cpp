@@ -11,6 +11,7 @@
 //===----------------------------------------------------------------------===//
 
 #include "buffer/buffer_pool_manager.h"
+#include <array>
 #include <cstdio>
 #include <random>
 #include <string>
@@ -141,4 +142,56 @@ TEST(BufferPoolManagerTest, DISABLED_SampleTest) {
   delete disk_manager;
 }
 
+// NOLINTNEXTLINE
+// Check that each page size class has its own frames and that larger pages round trip through their own file
+TEST(BufferPoolManagerTest, DISABLED_PageSizeClassTest) {
+  const std::string db_name = "test.db";
+  const std::array<size_t, NUM_PAGE_SIZE_CLASSES> pool_sizes{2, 1, 1};
+
+  auto *disk_manager = new DiskManager(db_name);
+  auto *bpm = new BufferPoolManager(pool_sizes, disk_manager);
+
+  page_id_t small_page_id;
+  page_id_t large_page_id;
+  auto *small_page = bpm->NewPage(&small_page_id);
+  auto *large_page = bpm->NewPage(&large_page_id, PageSizeClass::LARGE);
+
+  // Scenario: Page ids encode the size class, small page ids are unchanged.
+  ASSERT_NE(nullptr, small_page);
+  ASSERT_NE(nullptr, large_page);
+  EXPECT_EQ(0, small_page_id);
+  EXPECT_EQ(PageSizeClass::LARGE, GetPageSizeClass(large_page_id));
+  EXPECT_EQ(0, GetLocalPageId(large_page_id));
+  EXPECT_EQ(PAGE_SIZE, small_page->GetPageSize());
+  EXPECT_EQ(PageSizeOf(PageSizeClass::LARGE), large_page->GetPageSize());
+  EXPECT_EQ(2, bpm->GetPoolSize());
+  EXPECT_EQ(1, bpm->GetPoolSize(PageSizeClass::LARGE));
+
+  // Scenario: The large pool is full, but the other pools still have free frames.
+  page_id_t page_id_temp;
+  EXPECT_EQ(nullptr, bpm->NewPage(&page_id_temp, PageSizeClass::LARGE));
+  EXPECT_NE(nullptr, bpm->NewPage(&page_id_temp, PageSizeClass::MEDIUM));
+  EXPECT_NE(nullptr, bpm->NewPage(&page_id_temp));
+
+  // Scenario: Data at the end of a large page survives its eviction.
+  const uint32_t last = PageSizeOf(PageSizeClass::LARGE) - 6;
+  snprintf(large_page->GetData() + last, 6, "Hello");
+  EXPECT_EQ(true, bpm->UnpinPage(large_page_id, true));
+  EXPECT_NE(nullptr, bpm->NewPage(&page_id_temp, PageSizeClass::LARGE));
+  EXPECT_EQ(nullptr, bpm->FetchPage(large_page_id));
+  EXPECT_EQ(true, bpm->UnpinPage(page_id_temp, false));
+  large_page = bpm->FetchPage(large_page_id);
+  ASSERT_NE(nullptr, large_page);
+  EXPECT_EQ(0, strcmp(large_page->GetData() + last, "Hello"));
+
+  // Shutdown the disk manager and remove the temporary files we created.
+  disk_manager->ShutDown();
+  remove("test.db");
+  remove("test.16k.db");
+  remove("test.64k.db");
+
+  delete bpm;
+  delete disk_manager;
+}
+
 }  // namespace bustub
@@ -2,6 +2,8 @@
  * lock_manager_test.cpp
  */
 
+#include <atomic>
+#include <chrono>  // NOLINT
 #include <random>
 #include <thread>  // NOLINT
 
@@ -152,6 +154,290 @@ void UpgradeTest() {
 }
 TEST(LockManagerTest, DISABLED_UpgradeLockTest) { UpgradeTest(); }
 
+// Transactions lock records all over the sharded lock table, and take turns on the records they share
+TEST(LockManagerTest, DISABLED_ShardedLockTest) {
+  LockManager lock_mgr{};
+  TransactionManager txn_mgr{&lock_mgr};
+  const int num_threads = 8;
+  const int num_txns = 50;
+  const int num_rids = 100;
+  std::atomic<int> holders{0};
+
+  auto task = [&](int thread_id) {
+    for (int i = 0; i < num_txns; i++) {
+      auto *txn = txn_mgr.Begin();
+      // Records of this thread only, spread over the shards.
+      for (int j = 0; j < num_rids; j++) {
+        EXPECT_TRUE(lock_mgr.LockExclusive(txn, RID{thread_id, static_cast<uint32_t>(j)}));
+      }
+      // A record every thread writes, one at a time.
+      EXPECT_TRUE(lock_mgr.LockExclusive(txn, RID{num_threads, 0}));
+      EXPECT_EQ(1, ++holders);
+      --holders;
+      CheckTxnLockSize(txn, 0, num_rids + 1);
+      txn_mgr.Commit(txn);
+      CheckTxnLockSize(txn, 0, 0);
+      delete txn;
+    }
+  };
+  std::vector<std::thread> threads;
+  for (int i = 0; i < num_threads; i++) {
+    threads.emplace_back(task, i);
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  // Every lock was given back, so a new transaction gets any lock at once.
+  auto *txn = txn_mgr.Begin();
+  EXPECT_TRUE(lock_mgr.LockExclusive(txn, RID{num_threads, 0}));
+  EXPECT_TRUE(lock_mgr.LockShared(txn, RID{0, 0}));
+  txn_mgr.Commit(txn);
+  delete txn;
+}
+
+// Transactions begin and finish concurrently, while other threads look them up in the registry
+TEST(LockManagerTest, DISABLED_TransactionRegistryTest) {
+  LockManager lock_mgr{};
+  TransactionManager txn_mgr{&lock_mgr};
+  const int num_threads = 8;
+  const int num_txns = 1000;
+  std::atomic<bool> done{false};
+
+  auto task = [&](int thread_id) {
+    for (int i = 0; i < num_txns; i++) {
+      auto *txn = txn_mgr.Begin();
+      EXPECT_EQ(txn, txn_mgr.GetTransaction(txn->GetTransactionId()));
+      // A transaction that took no locks has none to give back.
+      EXPECT_FALSE(txn->HoldsLocks());
+      if (i % 2 == 0) {
+        EXPECT_TRUE(lock_mgr.LockShared(txn, RID{thread_id, static_cast<uint32_t>(i)}));
+        EXPECT_TRUE(txn->HoldsLocks());
+      }
+      txn_id_t txn_id = txn->GetTransactionId();
+      txn_mgr.Commit(txn);
+      EXPECT_FALSE(txn->HoldsLocks());
+      delete txn;
+      EXPECT_FALSE(txn_mgr.VisitTransaction(txn_id, [](Transaction *) {}));
+    }
+  };
+  // Visiting a transaction keeps it from finishing, so it is never seen once it was freed.
+  auto visitor = [&] {
+    while (!done) {
+      for (txn_id_t txn_id = 0; txn_id < num_threads * num_txns; txn_id++) {
+        txn_mgr.VisitTransaction(txn_id,
+                                 [txn_id](Transaction *found) { EXPECT_EQ(txn_id, found->GetTransactionId()); });
+      }
+    }
+  };
+  std::thread visitor_thread(visitor);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < num_threads; i++) {
+    threads.emplace_back(task, i);
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  done = true;
+  visitor_thread.join();
+}
+
+// Transaction managers hand out the same ids, each finds its own transactions
+TEST(LockManagerTest, DISABLED_TransactionRegistryIdTest) {
+  LockManager lock_mgr{};
+  TransactionManager txn_mgr{&lock_mgr};
+  TransactionManager other_txn_mgr{&lock_mgr};
+  auto *txn = txn_mgr.Begin();
+  auto *other_txn = other_txn_mgr.Begin();
+  EXPECT_EQ(txn->GetTransactionId(), other_txn->GetTransactionId());
+  EXPECT_EQ(txn, txn_mgr.GetTransaction(txn->GetTransactionId()));
+  EXPECT_EQ(other_txn, other_txn_mgr.GetTransaction(other_txn->GetTransactionId()));
+
+  txn_mgr.Commit(txn);
+  EXPECT_FALSE(txn_mgr.VisitTransaction(txn->GetTransactionId(), [](Transaction *) {}));
+  EXPECT_EQ(other_txn, other_txn_mgr.GetTransaction(other_txn->GetTransactionId()));
+  other_txn_mgr.Commit(other_txn);
+
+  delete txn;
+  delete other_txn;
+}
+
+// Intention locks on a table go together, while a lock on the whole table waits for the writers of its tuples
+TEST(LockManagerTest, DISABLED_TableLockTest) {
+  LockManager lock_mgr{};
+  TransactionManager txn_mgr{&lock_mgr};
+  const table_oid_t oid = 0;
+  auto *writer = txn_mgr.Begin();
+  auto *reader = txn_mgr.Begin();
+  auto *scanner = txn_mgr.Begin();
+
+  EXPECT_TRUE(lock_mgr.LockTable(writer, oid, LockMode::INTENTION_EXCLUSIVE));
+  EXPECT_TRUE(lock_mgr.LockTable(reader, oid, LockMode::INTENTION_SHARED));
+  // A weaker mode is covered by the lock held already.
+  EXPECT_TRUE(lock_mgr.LockTable(writer, oid, LockMode::INTENTION_SHARED));
+  EXPECT_EQ(LockMode::INTENTION_EXCLUSIVE, writer->GetTableLockSet()->at(oid));
+
+  std::atomic<bool> scanning{false};
+  std::thread scan([&] {
+    EXPECT_TRUE(lock_mgr.LockTable(scanner, oid, LockMode::SHARED));
+    scanning = true;
+    // Reading the whole table and writing some of its tuples takes both modes at once.
+    EXPECT_TRUE(lock_mgr.LockTable(scanner, oid, LockMode::INTENTION_EXCLUSIVE));
+    EXPECT_EQ(LockMode::SHARED_INTENTION_EXCLUSIVE, scanner->GetTableLockSet()->at(oid));
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_FALSE(scanning);
+  txn_mgr.Commit(writer);
+  CheckTxnLockSize(writer, 0, 0);
+  EXPECT_TRUE(writer->GetTableLockSet()->empty());
+  scan.join();
+  EXPECT_TRUE(scanning);
+
+  txn_mgr.Commit(scanner);
+  txn_mgr.Commit(reader);
+  delete writer;
+  delete reader;
+  delete scanner;
+
+  EXPECT_TRUE(LockManager::AreCompatible(LockMode::INTENTION_SHARED, LockMode::SHARED_INTENTION_EXCLUSIVE));
+  EXPECT_TRUE(LockManager::AreCompatible(LockMode::SHARED, LockMode::SHARED));
+  EXPECT_FALSE(LockManager::AreCompatible(LockMode::SHARED, LockMode::INTENTION_EXCLUSIVE));
+  EXPECT_FALSE(LockManager::AreCompatible(LockMode::SHARED_INTENTION_EXCLUSIVE, LockMode::SHARED_INTENTION_EXCLUSIVE));
+  EXPECT_FALSE(LockManager::AreCompatible(LockMode::INTENTION_SHARED, LockMode::EXCLUSIVE));
+}
+
+// Increment locks on a record go together, while a reader of the record waits for every incrementer
+TEST(LockManagerTest, DISABLED_IncrementLockTest) {
+  LockManager lock_mgr{};
+  TransactionManager txn_mgr{&lock_mgr};
+  const table_oid_t oid = 0;
+  const RID rid{0, 0};
+  auto *first = txn_mgr.Begin();
+  auto *second = txn_mgr.Begin();
+  auto *reader = txn_mgr.Begin();
+
+  EXPECT_TRUE(lock_mgr.LockIncrement(first, oid, rid));
+  EXPECT_TRUE(lock_mgr.LockIncrement(second, oid, rid));
+  EXPECT_TRUE(first->IsIncrementLocked(rid));
+  EXPECT_TRUE(second->IsIncrementLocked(rid));
+  EXPECT_EQ(LockMode::INTENTION_EXCLUSIVE, first->GetTableLockSet()->at(oid));
+
+  std::atomic<bool> reading{false};
+  std::thread read([&] {
+    EXPECT_TRUE(lock_mgr.LockShared(reader, oid, rid));
+    reading = true;
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_FALSE(reading);
+  txn_mgr.Commit(first);
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_FALSE(reading);
+  txn_mgr.Commit(second);
+  read.join();
+  EXPECT_TRUE(reading);
+  txn_mgr.Commit(reader);
+
+  // Reading a record the transaction increments upgrades its lock.
+  auto *incrementer = txn_mgr.Begin();
+  EXPECT_TRUE(lock_mgr.LockIncrement(incrementer, oid, rid));
+  EXPECT_TRUE(lock_mgr.LockShared(incrementer, oid, rid));
+  EXPECT_TRUE(incrementer->IsExclusiveLocked(rid));
+  EXPECT_FALSE(incrementer->IsIncrementLocked(rid));
+  txn_mgr.Commit(incrementer);
+  EXPECT_FALSE(incrementer->HoldsLocks());
+  delete first;
+  delete second;
+  delete reader;
+  delete incrementer;
+
+  EXPECT_TRUE(LockManager::AreCompatible(LockMode::INCREMENT, LockMode::INCREMENT));
+  EXPECT_FALSE(LockManager::AreCompatible(LockMode::INCREMENT, LockMode::SHARED));
+  EXPECT_TRUE(LockManager::Covers(LockMode::EXCLUSIVE, LockMode::INCREMENT));
+  EXPECT_FALSE(LockManager::Covers(LockMode::SHARED_INTENTION_EXCLUSIVE, LockMode::INCREMENT));
+}
+
+// Many tuple locks on one table are traded for a lock on the table, unless that lock would have to wait
+TEST(LockManagerTest, DISABLED_EscalationTest) {
+  const size_t threshold = 10;
+  LockManager lock_mgr{LockManager::DeadlockMode::DETECTION, threshold};
+  TransactionManager txn_mgr{&lock_mgr};
+  const table_oid_t oid = 1;
+  auto *reader = txn_mgr.Begin();
+  auto *writer = txn_mgr.Begin();
+
+  for (uint32_t i = 0; i < threshold - 1; i++) {
+    EXPECT_TRUE(lock_mgr.LockShared(reader, oid, RID{0, i}));
+  }
+  CheckTxnLockSize(reader, threshold - 1, 0);
+  EXPECT_EQ(LockMode::INTENTION_SHARED, reader->GetTableLockSet()->at(oid));
+  EXPECT_TRUE(lock_mgr.LockShared(reader, oid, RID{0, threshold}));
+  CheckTxnLockSize(reader, 0, 0);
+  EXPECT_EQ(LockMode::SHARED, reader->GetTableLockSet()->at(oid));
+  // The table lock covers the reads that follow.
+  EXPECT_TRUE(lock_mgr.LockShared(reader, oid, RID{1, 0}));
+  CheckTxnLockSize(reader, 0, 0);
+  txn_mgr.Commit(reader);
+  delete reader;
+
+  // An exclusive lock on the table would wait for the reader, so the writer keeps its tuple locks.
+  reader = txn_mgr.Begin();
+  EXPECT_TRUE(lock_mgr.LockShared(reader, oid, RID{2, 0}));
+  for (uint32_t i = 0; i < threshold; i++) {
+    EXPECT_TRUE(lock_mgr.LockExclusive(writer, oid, RID{0, i}));
+  }
+  CheckTxnLockSize(writer, 0, threshold);
+  EXPECT_EQ(LockMode::INTENTION_EXCLUSIVE, writer->GetTableLockSet()->at(oid));
+  txn_mgr.Commit(reader);
+
+  // Once the reader is gone, the next round of tuple locks escalates.
+  for (uint32_t i = 0; i < threshold; i++) {
+    EXPECT_TRUE(lock_mgr.LockExclusive(writer, oid, RID{1, i}));
+  }
+  CheckTxnLockSize(writer, 0, 0);
+  EXPECT_EQ(LockMode::EXCLUSIVE, writer->GetTableLockSet()->at(oid));
+  EXPECT_EQ(TransactionState::GROWING, writer->GetState());
+  txn_mgr.Commit(writer);
+  EXPECT_TRUE(writer->GetTableLockSet()->empty());
+
+  delete reader;
+  delete writer;
+}
+
+TEST(LockManagerTest, DISABLED_BlockedTableLockTest) {
+  const size_t threshold = 10;
+  LockManager lock_mgr{LockManager::DeadlockMode::DETECTION, threshold};
+  TransactionManager txn_mgr{&lock_mgr};
+  const table_oid_t oid = 1;
+  auto *reader = txn_mgr.Begin();
+  auto *scanner = txn_mgr.Begin();
+
+  // Intention locks and tuple locks go ahead, escalation does not.
+  lock_mgr.BlockTableLocks();
+  for (uint32_t i = 0; i < threshold; i++) {
+    EXPECT_TRUE(lock_mgr.LockShared(reader, oid, RID{0, i}));
+  }
+  CheckTxnLockSize(reader, threshold, 0);
+  EXPECT_EQ(LockMode::INTENTION_SHARED, reader->GetTableLockSet()->at(oid));
+
+  // A lock on the whole table waits until table locks resume.
+  std::atomic<bool> locked{false};
+  std::thread scan([&] {
+    EXPECT_TRUE(lock_mgr.LockTable(scanner, oid, LockMode::SHARED));
+    locked = true;
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_FALSE(locked);
+  lock_mgr.ResumeTableLocks();
+  scan.join();
+  EXPECT_TRUE(locked);
+  EXPECT_EQ(LockMode::SHARED, scanner->GetTableLockSet()->at(oid));
+
+  txn_mgr.Commit(reader);
+  txn_mgr.Commit(scanner);
+  delete reader;
+  delete scanner;
+}
+
 TEST(LockManagerTest, DISABLED_GraphEdgeTest) {
   LockManager lock_mgr{};
   TransactionManager txn_mgr{&lock_mgr};
@@ -267,4 +553,209 @@ TEST(LockManagerTest, DISABLED_BasicDeadlockDetectionTest) {
   delete txn0;
   delete txn1;
 }
+
+// A request that waits past cycle_detection_interval breaks a cycle it is in, and leaves waiters outside cycles alone
+TEST(LockManagerTest, DISABLED_WaitingDeadlockDetectionTest) {
+  LockManager lock_mgr{};
+  auto interval = cycle_detection_interval;
+  cycle_detection_interval = std::chrono::milliseconds(20);
+  TransactionManager txn_mgr{&lock_mgr};
+  const int num_txns = 4;
+  std::vector<Transaction *> txns;
+  for (int i = 0; i < num_txns; i++) {
+    txns.push_back(txn_mgr.Begin());
+  }
+  for (uint32_t i = 0; i < 3; i++) {
+    EXPECT_TRUE(lock_mgr.LockExclusive(txns[i], RID{0, i}));
+  }
+
+  std::atomic<int> aborted[num_txns] = {};
+  auto wait_for = [&](int i, uint32_t slot) {
+    try {
+      lock_mgr.LockExclusive(txns[i], RID{0, slot});
+      txn_mgr.Commit(txns[i]);
+    } catch (TransactionAbortException &e) {
+      EXPECT_EQ(AbortReason::DEADLOCK, e.GetAbortReason());
+      aborted[i] = 1;
+      txn_mgr.Abort(txns[i]);
+    }
+  };
+  // The edges of a waiting request are in the waits-for graph while it waits.
+  std::vector<std::thread> threads;
+  threads.emplace_back(wait_for, 1, 0);
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  EXPECT_EQ((std::vector<std::pair<txn_id_t, txn_id_t>>{{1, 0}}), lock_mgr.GetEdgeList());
+  threads.emplace_back(wait_for, 3, 0);
+  threads.emplace_back(wait_for, 2, 1);
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  // Closes the cycle 0 -> 2 -> 1 -> 0, of which 2 is the newest.
+  threads.emplace_back(wait_for, 0, 2);
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  EXPECT_TRUE(lock_mgr.GetEdgeList().empty());
+  for (int i = 0; i < num_txns; i++) {
+    EXPECT_EQ(i == 2 ? 1 : 0, aborted[i]) << "txn " << i;
+    delete txns[i];
+  }
+  cycle_detection_interval = interval;
+}
+
+// Waiters that are woken up over and over, without being granted, still search for a cycle once the interval passed
+TEST(LockManagerTest, DISABLED_WokenDeadlockDetectionTest) {
+  LockManager lock_mgr{};
+  auto interval = cycle_detection_interval;
+  cycle_detection_interval = std::chrono::milliseconds(20);
+  TransactionManager txn_mgr{&lock_mgr};
+  RID rid0{0, 0};
+  RID rid1{1, 1};
+  auto *txn0 = txn_mgr.Begin();
+  auto *txn1 = txn_mgr.Begin();
+  EXPECT_TRUE(lock_mgr.LockExclusive(txn0, rid0));
+  EXPECT_TRUE(lock_mgr.LockExclusive(txn1, rid1));
+
+  // Requests that are given up at once wake up the waiters of both tuples more often than the interval.
+  std::atomic<bool> done{false};
+  std::thread noise([&] {
+    while (!done) {
+      auto *txn = txn_mgr.Begin();
+      EXPECT_FALSE(lock_mgr.TryLockExclusive(txn, rid0));
+      EXPECT_FALSE(lock_mgr.TryLockExclusive(txn, rid1));
+      txn_mgr.Commit(txn);
+      delete txn;
+      std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+  });
+
+  std::atomic<int> aborted[2] = {};
+  auto wait_for = [&](int i, Transaction *txn, const RID &rid) {
+    try {
+      lock_mgr.LockExclusive(txn, rid);
+      txn_mgr.Commit(txn);
+    } catch (TransactionAbortException &e) {
+      aborted[i] = 1;
+      txn_mgr.Abort(txn);
+    }
+  };
+  std::thread t0(wait_for, 0, txn0, rid1);
+  std::thread t1(wait_for, 1, txn1, rid0);
+  t0.join();
+  t1.join();
+  done = true;
+  noise.join();
+  EXPECT_EQ(0, aborted[0]);
+  EXPECT_EQ(1, aborted[1]);
+
+  delete txn0;
+  delete txn1;
+  cycle_detection_interval = interval;
+}
+
+// Under WOUND_WAIT, an older transaction aborts a younger one that holds a lock it wants, even while the younger waits
+TEST(LockManagerTest, DISABLED_WoundWaitTest) {
+  LockManager lock_mgr{LockManager::DeadlockMode::WOUND_WAIT};
+  TransactionManager txn_mgr{&lock_mgr};
+  RID rid0{0, 0};
+  RID rid1{1, 1};
+  auto *txn0 = txn_mgr.Begin();
+  auto *txn1 = txn_mgr.Begin();
+  EXPECT_TRUE(lock_mgr.LockExclusive(txn0, rid0));
+  EXPECT_TRUE(lock_mgr.LockExclusive(txn1, rid1));
+
+  // The younger transaction waits for the older one.
+  std::atomic<bool> wounded = false;
+  std::thread t1([&] {
+    try {
+      lock_mgr.LockExclusive(txn1, rid0);
+    } catch (TransactionAbortException &e) {
+      EXPECT_EQ(AbortReason::DEADLOCK, e.GetAbortReason());
+      wounded = true;
+    }
+    CheckAborted(txn1);
+    txn_mgr.Abort(txn1);
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+  // The older transaction wounds it rather than wait for it, and gets the lock once it is rolled back.
+  EXPECT_TRUE(lock_mgr.LockExclusive(txn0, rid1));
+  CheckGrowing(txn0);
+  t1.join();
+  EXPECT_TRUE(wounded);
+  CheckTxnLockSize(txn1, 0, 0);
+  txn_mgr.Commit(txn0);
+
+  delete txn0;
+  delete txn1;
+}
+
+// Under WOUND_WAIT, a younger transaction wounded while it asks for no lock is aborted when it tries to commit
+TEST(LockManagerTest, DISABLED_WoundedCommitTest) {
+  LockManager lock_mgr{LockManager::DeadlockMode::WOUND_WAIT};
+  TransactionManager txn_mgr{&lock_mgr};
+  RID rid{0, 0};
+  auto *txn0 = txn_mgr.Begin();
+  auto *txn1 = txn_mgr.Begin();
+  EXPECT_TRUE(lock_mgr.LockExclusive(txn1, rid));
+
+  // The older transaction wounds the holder and waits for it to be rolled back.
+  std::thread t0([&] {
+    EXPECT_TRUE(lock_mgr.LockExclusive(txn0, rid));
+    CheckGrowing(txn0);
+    txn_mgr.Commit(txn0);
+  });
+  while (txn1->GetState() != TransactionState::ABORTED) {
+    std::this_thread::yield();
+  }
+
+  // The wounded holder must not commit, it is rolled back instead and its lock goes to the older transaction.
+  try {
+    txn_mgr.Commit(txn1);
+    FAIL();
+  } catch (TransactionAbortException &e) {
+    EXPECT_EQ(AbortReason::DEADLOCK, e.GetAbortReason());
+  }
+  CheckAborted(txn1);
+  CheckTxnLockSize(txn1, 0, 0);
+  t0.join();
+  CheckCommitted(txn0);
+
+  delete txn0;
+  delete txn1;
+}
+
+// Under WAIT_DIE, a younger transaction that asks for a lock an older one holds is aborted at once
+TEST(LockManagerTest, DISABLED_WaitDieTest) {
+  LockManager lock_mgr{LockManager::DeadlockMode::WAIT_DIE};
+  TransactionManager txn_mgr{&lock_mgr};
+  RID rid0{0, 0};
+  RID rid1{1, 1};
+  auto *txn0 = txn_mgr.Begin();
+  auto *txn1 = txn_mgr.Begin();
+  EXPECT_TRUE(lock_mgr.LockShared(txn0, rid0));
+  EXPECT_TRUE(lock_mgr.LockShared(txn1, rid0));
+  EXPECT_TRUE(lock_mgr.LockExclusive(txn1, rid1));
+
+  // The older transaction waits for the younger one.
+  std::thread t0([&] {
+    EXPECT_TRUE(lock_mgr.LockExclusive(txn0, rid1));
+    CheckGrowing(txn0);
+    txn_mgr.Commit(txn0);
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+  // The younger transaction dies rather than wait for the older one.
+  try {
+    lock_mgr.LockUpgrade(txn1, rid0);
+    FAIL();
+  } catch (TransactionAbortException &e) {
+    EXPECT_EQ(AbortReason::DEADLOCK, e.GetAbortReason());
+  }
+  CheckAborted(txn1);
+  txn_mgr.Abort(txn1);
+  t0.join();
+  CheckCommitted(txn0);
+
+  delete txn0;
+  delete txn1;
+}
 }  // namespace bustub
@@ -0,0 +1,308 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// log_manager_test.cpp
+//
+// Identification: test/recovery/log_manager_test.cpp
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#include <chrono>  // NOLINT
+#include <cstdio>
+#include <cstring>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "concurrency/lock_manager.h"
+#include "concurrency/transaction_manager.h"
+#include "gtest/gtest.h"
+#include "recovery/log_manager.h"
+#include "recovery/log_reader.h"
+
+namespace bustub {
+
+// NOLINTNEXTLINE
+TEST(LogManagerTest, DISABLED_GroupCommitTest) {
+  remove("test.db");
+  remove("test.log");
+  const int num_threads = 8;
+  const int num_txns = 50;
+
+  DiskManager disk_manager("test.db");
+  LogManager log_manager(&disk_manager);
+  log_manager.SetGroupCommitDelay(std::chrono::milliseconds(2));
+  log_manager.SetGroupCommitBatchSize(num_threads);
+  log_manager.RunFlushThread();
+  EXPECT_TRUE(enable_logging);
+
+  std::vector<std::thread> threads;
+  for (int tid = 0; tid < num_threads; tid++) {
+    threads.emplace_back([&log_manager, tid] {
+      for (int i = 0; i < num_txns; i++) {
+        txn_id_t txn_id = tid * num_txns + i;
+        LogRecord begin_record(txn_id, INVALID_LSN, LogRecordType::BEGIN);
+        lsn_t prev_lsn = log_manager.AppendLogRecord(&begin_record);
+        LogRecord commit_record(txn_id, prev_lsn, LogRecordType::COMMIT);
+        lsn_t commit_lsn = log_manager.AppendLogRecord(&commit_record);
+        log_manager.WaitForCommit(commit_lsn);
+        // Scenario: a commit only returns once its COMMIT record is on disk.
+        EXPECT_GE(log_manager.GetPersistentLSN(), commit_lsn);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  // Scenario: concurrent commits share log writes.
+  EXPECT_LT(disk_manager.GetNumFlushes(), num_threads * num_txns);
+  log_manager.StopFlushThread();
+  EXPECT_FALSE(enable_logging);
+  EXPECT_EQ(log_manager.GetNextLSN() - 1, log_manager.GetPersistentLSN());
+
+  // Scenario: every record is in the log file, in LSN order.
+  const int record_size = 20;
+  const int num_records = 2 * num_threads * num_txns;
+  std::vector<char> log_data(num_records * record_size);
+  ASSERT_TRUE(disk_manager.ReadLog(log_data.data(), log_data.size(), 0));
+  for (int i = 0; i < num_records; i++) {
+    int32_t size;
+    lsn_t lsn;
+    memcpy(&size, log_data.data() + i * record_size, sizeof(int32_t));
+    memcpy(&lsn, log_data.data() + i * record_size + sizeof(int32_t), sizeof(lsn_t));
+    EXPECT_EQ(record_size, size);
+    EXPECT_EQ(i, lsn);
+  }
+
+  disk_manager.ShutDown();
+  remove("test.db");
+  remove("test.log");
+}
+
+// NOLINTNEXTLINE
+TEST(LogManagerTest, DISABLED_ConcurrentAppendTest) {
+  remove("test.db");
+  remove("test.log");
+  const int num_threads = 4;
+  const int num_records = 2000;
+  const int32_t tuple_size = 100;
+
+  DiskManager disk_manager("test.db");
+  LogManager log_manager(&disk_manager);
+  log_manager.RunFlushThread();
+
+  // Each thread appends INSERT records whose RID and tuple bytes identify the thread, many times the log buffer size.
+  std::vector<std::thread> threads;
+  for (int tid = 0; tid < num_threads; tid++) {
+    threads.emplace_back([&log_manager, tid] {
+      char storage[sizeof(int32_t) + tuple_size];
+      *reinterpret_cast<int32_t *>(storage) = tuple_size;
+      memset(storage + sizeof(int32_t), 'a' + tid, tuple_size);
+      Tuple tuple;
+      tuple.DeserializeFrom(storage);
+      for (int i = 0; i < num_records; i++) {
+        LogRecord log_record(tid, INVALID_LSN, LogRecordType::INSERT, RID(tid, i), tuple);
+        log_manager.AppendLogRecord(&log_record);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  log_manager.StopFlushThread();
+  EXPECT_GT(disk_manager.GetNumFlushes(), 1);
+  EXPECT_EQ(num_threads * num_records - 1, log_manager.GetPersistentLSN());
+
+  // Scenario: the log holds every record exactly once, in LSN order, and no record was torn by a concurrent append.
+  const int record_size = 20 + sizeof(RID) + sizeof(int32_t) + tuple_size;
+  std::vector<char> log_data(num_threads * num_records * record_size);
+  ASSERT_TRUE(disk_manager.ReadLog(log_data.data(), log_data.size(), 0));
+  std::vector<int> next_slot(num_threads, 0);
+  for (int i = 0; i < num_threads * num_records; i++) {
+    const char *record = log_data.data() + i * record_size;
+    int32_t size;
+    lsn_t lsn;
+    txn_id_t txn_id;
+    RID rid;
+    memcpy(&size, record, sizeof(int32_t));
+    memcpy(&lsn, record + 4, sizeof(lsn_t));
+    memcpy(&txn_id, record + 8, sizeof(txn_id_t));
+    memcpy(&rid, record + 20, sizeof(RID));
+    ASSERT_EQ(record_size, size);
+    ASSERT_EQ(i, lsn);
+    ASSERT_EQ(txn_id, rid.GetPageId());
+    // Records of one thread are appended in order.
+    ASSERT_EQ(next_slot[txn_id]++, static_cast<int>(rid.GetSlotNum()));
+    for (int j = 0; j < tuple_size; j++) {
+      ASSERT_EQ('a' + txn_id, record[20 + sizeof(RID) + sizeof(int32_t) + j]);
+    }
+  }
+
+  disk_manager.ShutDown();
+  remove("test.db");
+  remove("test.log");
+}
+
+// NOLINTNEXTLINE
+TEST(LogManagerTest, DISABLED_AsyncCommitTest) {
+  remove("test.db");
+  remove("test.log");
+
+  DiskManager disk_manager("test.db");
+  LogManager log_manager(&disk_manager);
+  LockManager lock_manager;
+  TransactionManager txn_manager(&lock_manager, &log_manager);
+  // Hold group commits back so that we can observe a commit that is not durable yet.
+  log_manager.SetGroupCommitDelay(std::chrono::milliseconds(200));
+  log_manager.RunFlushThread();
+
+  // Scenario: an asynchronous commit returns before its COMMIT record is on disk.
+  Transaction *txn = txn_manager.Begin();
+  txn->SetAsyncCommit(true);
+  txn_manager.Commit(txn);
+  lsn_t commit_lsn = txn->GetPrevLSN();
+  EXPECT_EQ(TransactionState::COMMITTED, txn->GetState());
+  EXPECT_LT(log_manager.GetPersistentLSN(), commit_lsn);
+  delete txn;
+
+  // Scenario: the commit becomes durable with the next group commit, well before the log timeout.
+  auto start = std::chrono::steady_clock::now();
+  txn_manager.WaitForDurableCommit(commit_lsn);
+  EXPECT_GE(log_manager.GetPersistentLSN(), commit_lsn);
+  EXPECT_LT(std::chrono::steady_clock::now() - start, log_timeout);
+
+  // Scenario: a synchronous commit is durable when it returns.
+  txn = txn_manager.Begin();
+  txn_manager.Commit(txn);
+  EXPECT_GE(log_manager.GetPersistentLSN(), txn->GetPrevLSN());
+  delete txn;
+
+  log_manager.StopFlushThread();
+  disk_manager.ShutDown();
+  remove("test.db");
+  remove("test.log");
+}
+
+// NOLINTNEXTLINE
+TEST(LogManagerTest, DISABLED_EarlyLockReleaseTest) {
+  remove("test.db");
+  remove("test.log");
+
+  DiskManager disk_manager("test.db");
+  LogManager log_manager(&disk_manager);
+  LockManager lock_manager;
+  TransactionManager txn_manager(&lock_manager, &log_manager);
+  // Hold group commits back so that we can observe a commit that is not durable yet.
+  log_manager.SetGroupCommitDelay(std::chrono::milliseconds(200));
+  log_manager.RunFlushThread();
+
+  RID rid{0, 0};
+  Transaction *holder = txn_manager.Begin();
+  ASSERT_TRUE(lock_manager.LockExclusive(holder, rid));
+  std::thread committer([&] { txn_manager.Commit(holder); });
+
+  // Scenario: the lock is released once the COMMIT record is in the log buffer, before it is on disk.
+  Transaction *reader = txn_manager.BeginReadOnly(nullptr, IsolationLevel::REPEATABLE_READ);
+  ASSERT_TRUE(lock_manager.LockShared(reader, rid));
+  EXPECT_NE(INVALID_LSN, reader->GetDependencyLSN());
+  EXPECT_LT(log_manager.GetPersistentLSN(), reader->GetDependencyLSN());
+
+  // Scenario: the reader writes no COMMIT record, so its commit waits for the one it depends on.
+  txn_manager.Commit(reader);
+  EXPECT_GE(log_manager.GetPersistentLSN(), reader->GetDependencyLSN());
+  committer.join();
+  EXPECT_EQ(holder->GetPrevLSN(), reader->GetDependencyLSN());
+  delete holder;
+  delete reader;
+
+  log_manager.StopFlushThread();
+  disk_manager.ShutDown();
+  remove("test.db");
+  remove("test.log");
+}
+
+// NOLINTNEXTLINE
+TEST(LogManagerTest, DISABLED_FlushWithoutFlushThreadTest) {
+  remove("test.db");
+  remove("test.log");
+
+  DiskManager disk_manager("test.db");
+  LogManager log_manager(&disk_manager);
+
+  // Scenario: without the flush thread, a forced flush writes the log buffer in the calling thread.
+  LogRecord begin_record(0, INVALID_LSN, LogRecordType::BEGIN);
+  lsn_t lsn = log_manager.AppendLogRecord(&begin_record);
+  EXPECT_EQ(INVALID_LSN, log_manager.GetPersistentLSN());
+  log_manager.Flush(lsn);
+  EXPECT_EQ(lsn, log_manager.GetPersistentLSN());
+  EXPECT_EQ(1, disk_manager.GetNumFlushes());
+
+  // Scenario: flushing an LSN that is already persistent does not write anything.
+  log_manager.Flush(lsn);
+  EXPECT_EQ(1, disk_manager.GetNumFlushes());
+
+  // Scenario: so does a commit.
+  LogRecord commit_record(0, lsn, LogRecordType::COMMIT);
+  lsn = log_manager.AppendLogRecord(&commit_record);
+  log_manager.WaitForCommit(lsn);
+  EXPECT_EQ(lsn, log_manager.GetPersistentLSN());
+  EXPECT_EQ(2, disk_manager.GetNumFlushes());
+
+  disk_manager.ShutDown();
+  remove("test.db");
+  remove("test.log");
+}
+
+// NOLINTNEXTLINE
+TEST(LogManagerTest, DISABLED_LogReaderTest) {
+  remove("test.db");
+  remove("test.log");
+  const int num_records = 1000;
+
+  DiskManager disk_manager("test.db");
+  LogManager log_manager(&disk_manager);
+
+  // Records of many sizes, so that they straddle the chunks the reader reads ahead.
+  std::vector<int32_t> record_sizes;
+  for (int i = 0; i < num_records; i++) {
+    int32_t tuple_size = (i * 37) % 3000 + 1;
+    std::vector<char> storage(sizeof(int32_t) + tuple_size, 'a' + i % 26);
+    memcpy(storage.data(), &tuple_size, sizeof(int32_t));
+    Tuple tuple;
+    tuple.DeserializeFrom(storage.data());
+    LogRecord log_record(0, INVALID_LSN, LogRecordType::INSERT, RID(0, i), tuple);
+    log_manager.AppendLogRecord(&log_record);
+    record_sizes.push_back(log_record.GetSize());
+  }
+  log_manager.Flush(num_records - 1);
+
+  // Scenario: whatever the read-ahead size, the reader returns every record whole, in order, and then stops.
+  for (int read_ahead_size : {4096, 10000, LogReader::DEFAULT_READ_AHEAD_SIZE}) {
+    LogReader reader(&disk_manager, 0, read_ahead_size);
+    int expected_offset = 0;
+    int offset;
+    int size;
+    for (int i = 0; i < num_records; i++) {
+      const char *data = reader.Next(&offset, &size);
+      ASSERT_NE(nullptr, data);
+      EXPECT_EQ(expected_offset, offset);
+      ASSERT_EQ(record_sizes[i], size);
+      lsn_t lsn;
+      memcpy(&lsn, data + 4, sizeof(lsn_t));
+      EXPECT_EQ(i, lsn);
+      // the last byte of the tuple
+      EXPECT_EQ('a' + i % 26, data[size - 1]);
+      expected_offset += size;
+    }
+    EXPECT_EQ(nullptr, reader.Next(&offset, &size));
+  }
+
+  disk_manager.ShutDown();
+  remove("test.db");
+  remove("test.log");
+}
+
+}  // namespace bustub
@@ -10,6 +10,8 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include <algorithm>
+#include <cstring>
 #include <string>
 #include <vector>
 
@@ -23,6 +25,7 @@
 #include "storage/table/table_heap.h"
 #include "storage/table/table_iterator.h"
 #include "storage/table/tuple.h"
+#include "type/value_factory.h"
 
 namespace bustub {
 
@@ -314,4 +317,558 @@ TEST(RecoveryTest, DISABLED_CheckpointTest) {
   remove("test.db");
   remove("test.log");
 }
+
+// NOLINTNEXTLINE
+TEST(RecoveryTest, DISABLED_FuzzyCheckpointTest) {
+  remove("test.db");
+  remove("test.log");
+  remove("test.master");
+  BustubInstance *bustub_instance = new BustubInstance("test.db");
+  bustub_instance->log_manager_->RunFlushThread();
+  auto *txn_manager = bustub_instance->transaction_manager_;
+
+  Column col1{"a", TypeId::VARCHAR, 20};
+  Column col2{"b", TypeId::SMALLINT};
+  std::vector<Column> cols{col1, col2};
+  Schema schema{cols};
+  const Tuple tuple = ConstructTuple(&schema);
+
+  Transaction *txn = txn_manager->Begin();
+  auto *test_table = new TableHeap(bustub_instance->buffer_pool_manager_, bustub_instance->lock_manager_,
+                                   bustub_instance->log_manager_, txn);
+  page_id_t first_page_id = test_table->GetFirstPageId();
+  RID committed_rid;
+  ASSERT_TRUE(test_table->InsertTuple(tuple, &committed_rid, txn));
+  txn_manager->Commit(txn);
+  delete txn;
+
+  // A transaction that is still running at the crash, and was running during the checkpoint.
+  Transaction *loser_txn = txn_manager->Begin();
+  RID loser_rid;
+  ASSERT_TRUE(test_table->InsertTuple(tuple, &loser_rid, loser_txn));
+  lsn_t loser_first_lsn = loser_txn->GetFirstLSN();
+
+  // Scenario: transactions begin and commit while the checkpoint writes the dirty pages.
+  bustub_instance->checkpoint_manager_->BeginCheckpoint();
+  txn = txn_manager->Begin();
+  RID during_rid;
+  ASSERT_TRUE(test_table->InsertTuple(tuple, &during_rid, txn));
+  txn_manager->Commit(txn);
+  delete txn;
+  bustub_instance->checkpoint_manager_->EndCheckpoint();
+
+  // Scenario: the master record points recovery back to the first record of the running transaction.
+  MasterRecord master_record;
+  ASSERT_TRUE(bustub_instance->disk_manager_->ReadMasterRecord(reinterpret_cast<char *>(&master_record),
+                                                                sizeof(MasterRecord)));
+  EXPECT_GT(master_record.checkpoint_lsn_, loser_first_lsn);
+  EXPECT_EQ(loser_first_lsn, master_record.recovery_lsn_);
+
+  txn = txn_manager->Begin();
+  RID after_rid;
+  ASSERT_TRUE(test_table->InsertTuple(tuple, &after_rid, txn));
+  txn_manager->Commit(txn);
+  delete txn;
+
+  LOG_INFO("System crash");
+  delete test_table;
+  delete bustub_instance;
+  delete loser_txn;
+
+  bustub_instance = new BustubInstance("test.db");
+  auto *log_recovery = new LogRecovery(bustub_instance->disk_manager_, bustub_instance->buffer_pool_manager_);
+  log_recovery->Redo();
+  log_recovery->Undo();
+  delete log_recovery;
+
+  // Scenario: every committed insert survives, the insert of the running transaction is rolled back.
+  txn = bustub_instance->transaction_manager_->Begin();
+  test_table = new TableHeap(bustub_instance->buffer_pool_manager_, bustub_instance->lock_manager_,
+                             bustub_instance->log_manager_, first_page_id);
+  Tuple result;
+  EXPECT_TRUE(test_table->GetTuple(committed_rid, &result, txn));
+  EXPECT_TRUE(test_table->GetTuple(during_rid, &result, txn));
+  EXPECT_TRUE(test_table->GetTuple(after_rid, &result, txn));
+  EXPECT_FALSE(test_table->GetTuple(loser_rid, &result, txn));
+  bustub_instance->transaction_manager_->Commit(txn);
+  delete txn;
+  delete test_table;
+
+  delete bustub_instance;
+  remove("test.db");
+  remove("test.log");
+  remove("test.master");
+}
+
+// NOLINTNEXTLINE
+TEST(RecoveryTest, DISABLED_ParallelRecoveryTest) {
+  remove("test.db");
+  remove("test.log");
+  remove("test.master");
+  BustubInstance *bustub_instance = new BustubInstance("test.db");
+  bustub_instance->log_manager_->RunFlushThread();
+  auto *txn_manager = bustub_instance->transaction_manager_;
+
+  Column col1{"a", TypeId::VARCHAR, 20};
+  Column col2{"b", TypeId::SMALLINT};
+  std::vector<Column> cols{col1, col2};
+  Schema schema{cols};
+  const Tuple tuple = ConstructTuple(&schema);
+
+  Transaction *txn = txn_manager->Begin();
+  auto *test_table = new TableHeap(bustub_instance->buffer_pool_manager_, bustub_instance->lock_manager_,
+                                   bustub_instance->log_manager_, txn);
+  page_id_t first_page_id = test_table->GetFirstPageId();
+  txn_manager->Commit(txn);
+  delete txn;
+
+  // Committed and running transactions interleave their inserts, which span many more pages than the buffer pool.
+  const int num_txns = 6;
+  const int num_inserts = 300;
+  std::vector<Transaction *> txns;
+  std::vector<std::vector<RID>> rids(num_txns);
+  for (int i = 0; i < num_txns; i++) {
+    txns.push_back(txn_manager->Begin());
+  }
+  for (int j = 0; j < num_inserts; j++) {
+    for (int i = 0; i < num_txns; i++) {
+      RID rid;
+      ASSERT_TRUE(test_table->InsertTuple(tuple, &rid, txns[i]));
+      rids[i].push_back(rid);
+    }
+  }
+  // Even transactions commit, odd ones are still running at the crash.
+  for (int i = 0; i < num_txns; i += 2) {
+    txn_manager->Commit(txns[i]);
+  }
+
+  LOG_INFO("System crash");
+  delete test_table;
+  delete bustub_instance;
+  for (auto *loser_txn : txns) {
+    delete loser_txn;
+  }
+
+  bustub_instance = new BustubInstance("test.db");
+  auto *log_recovery = new LogRecovery(bustub_instance->disk_manager_, bustub_instance->buffer_pool_manager_, 4);
+  log_recovery->Redo();
+  log_recovery->Undo();
+  delete log_recovery;
+
+  // Scenario: workers redo every committed insert and undo every insert of the running transactions.
+  txn = bustub_instance->transaction_manager_->Begin();
+  test_table = new TableHeap(bustub_instance->buffer_pool_manager_, bustub_instance->lock_manager_,
+                             bustub_instance->log_manager_, first_page_id);
+  Tuple result;
+  for (int i = 0; i < num_txns; i++) {
+    for (const auto &rid : rids[i]) {
+      ASSERT_EQ(i % 2 == 0, test_table->GetTuple(rid, &result, txn));
+    }
+  }
+  // Scenario: the page chain of the table was relinked, a scan sees exactly the committed tuples.
+  int num_tuples = 0;
+  for (auto it = test_table->Begin(txn); it != test_table->End(); ++it) {
+    num_tuples++;
+  }
+  EXPECT_EQ(num_txns / 2 * num_inserts, num_tuples);
+  bustub_instance->transaction_manager_->Commit(txn);
+  delete txn;
+  delete test_table;
+
+  delete bustub_instance;
+  remove("test.db");
+  remove("test.log");
+  remove("test.master");
+}
+
+// NOLINTNEXTLINE
+TEST(RecoveryTest, DISABLED_InstantRestartTest) {
+  remove("test.db");
+  remove("test.log");
+  remove("test.master");
+  BustubInstance *bustub_instance = new BustubInstance("test.db");
+  bustub_instance->log_manager_->RunFlushThread();
+  auto *txn_manager = bustub_instance->transaction_manager_;
+
+  Column col1{"a", TypeId::VARCHAR, 20};
+  Column col2{"b", TypeId::SMALLINT};
+  std::vector<Column> cols{col1, col2};
+  Schema schema{cols};
+  const Tuple tuple = ConstructTuple(&schema);
+
+  // The inserts span many more pages than the buffer pool, so some of them are on disk at the crash and some are not.
+  Transaction *txn = txn_manager->Begin();
+  auto *test_table = new TableHeap(bustub_instance->buffer_pool_manager_, bustub_instance->lock_manager_,
+                                   bustub_instance->log_manager_, txn);
+  page_id_t first_page_id = test_table->GetFirstPageId();
+  const int num_inserts = 500;
+  std::vector<RID> committed_rids(num_inserts);
+  for (auto &rid : committed_rids) {
+    ASSERT_TRUE(test_table->InsertTuple(tuple, &rid, txn));
+  }
+  txn_manager->Commit(txn);
+  delete txn;
+  Transaction *loser_txn = txn_manager->Begin();
+  std::vector<RID> loser_rids(num_inserts);
+  for (auto &rid : loser_rids) {
+    ASSERT_TRUE(test_table->InsertTuple(tuple, &rid, loser_txn));
+  }
+  txn_id_t loser_txn_id = loser_txn->GetTransactionId();
+  lsn_t last_lsn = bustub_instance->log_manager_->GetNextLSN() - 1;
+
+  LOG_INFO("System crash");
+  delete test_table;
+  delete bustub_instance;
+  delete loser_txn;
+
+  bustub_instance = new BustubInstance("test.db");
+  bustub_instance->log_manager_->RunFlushThread();
+  auto *log_recovery = new LogRecovery(bustub_instance->disk_manager_, bustub_instance->buffer_pool_manager_);
+  log_recovery->StartInstantRestart(bustub_instance->log_manager_, bustub_instance->transaction_manager_,
+                                    bustub_instance->lock_manager_);
+
+  // Scenario: new transactions run right away. Pages are redone when they are fetched, so committed tuples are there.
+  txn = bustub_instance->transaction_manager_->Begin();
+  EXPECT_GT(txn->GetTransactionId(), loser_txn_id);
+  EXPECT_GT(txn->GetPrevLSN(), last_lsn);
+  test_table = new TableHeap(bustub_instance->buffer_pool_manager_, bustub_instance->lock_manager_,
+                             bustub_instance->log_manager_, first_page_id);
+  Tuple result;
+  for (const auto &rid : committed_rids) {
+    ASSERT_TRUE(test_table->GetTuple(rid, &result, txn));
+  }
+  // Scenario: the slots of the rolled back inserts stay locked until the loser is aborted, so a new insert skips them.
+  RID new_rid;
+  ASSERT_TRUE(test_table->InsertTuple(tuple, &new_rid, txn));
+  EXPECT_EQ(loser_rids.end(), std::find(loser_rids.begin(), loser_rids.end(), new_rid));
+  bustub_instance->transaction_manager_->Commit(txn);
+  delete txn;
+
+  // Scenario: once the background recovery is done, the loser is rolled back.
+  log_recovery->WaitForInstantRestart();
+  delete log_recovery;
+  for (const auto &rid : loser_rids) {
+    // Reading a missing tuple aborts the reader.
+    txn = bustub_instance->transaction_manager_->Begin();
+    ASSERT_FALSE(test_table->GetTuple(rid, &result, txn));
+    bustub_instance->transaction_manager_->Abort(txn);
+    delete txn;
+  }
+  txn = bustub_instance->transaction_manager_->Begin();
+  int num_tuples = 0;
+  for (auto it = test_table->Begin(txn); it != test_table->End(); ++it) {
+    num_tuples++;
+  }
+  EXPECT_EQ(num_inserts + 1, num_tuples);
+  bustub_instance->transaction_manager_->Commit(txn);
+  delete txn;
+  delete test_table;
+
+  LOG_INFO("System crash again");
+  delete bustub_instance;
+
+  // Scenario: the loser was logged as aborted, another recovery keeps the new insert and does not undo the loser again.
+  bustub_instance = new BustubInstance("test.db");
+  log_recovery = new LogRecovery(bustub_instance->disk_manager_, bustub_instance->buffer_pool_manager_);
+  log_recovery->Redo();
+  log_recovery->Undo();
+  delete log_recovery;
+  txn = bustub_instance->transaction_manager_->Begin();
+  test_table = new TableHeap(bustub_instance->buffer_pool_manager_, bustub_instance->lock_manager_,
+                             bustub_instance->log_manager_, first_page_id);
+  EXPECT_TRUE(test_table->GetTuple(new_rid, &result, txn));
+  num_tuples = 0;
+  for (auto it = test_table->Begin(txn); it != test_table->End(); ++it) {
+    num_tuples++;
+  }
+  EXPECT_EQ(num_inserts + 1, num_tuples);
+  bustub_instance->transaction_manager_->Commit(txn);
+  delete txn;
+  delete test_table;
+
+  delete bustub_instance;
+  remove("test.db");
+  remove("test.log");
+  remove("test.master");
+}
+
+// NOLINTNEXTLINE
+TEST(RecoveryTest, DISABLED_DeltaUpdateTest) {
+  remove("test.db");
+  remove("test.log");
+  remove("test.master");
+  BustubInstance *bustub_instance = new BustubInstance("test.db");
+  bustub_instance->log_manager_->RunFlushThread();
+  auto *txn_manager = bustub_instance->transaction_manager_;
+
+  std::vector<Column> cols{Column{"a", TypeId::VARCHAR, 20}};
+  for (int i = 0; i < 8; i++) {
+    cols.emplace_back("c" + std::to_string(i), TypeId::INTEGER);
+  }
+  Schema schema{cols};
+  auto make_tuple = [&schema](int32_t middle) {
+    std::vector<Value> values{ValueFactory::GetVarcharValue("delta")};
+    for (int i = 0; i < 8; i++) {
+      values.push_back(ValueFactory::GetIntegerValue(i == 4 ? middle : i));
+    }
+    return Tuple(values, &schema);
+  };
+  const Tuple tuple = make_tuple(0);
+
+  // Scenario: a record of an update that changes one column is smaller than a record with one copy of the tuple.
+  LogRecord update_record(0, INVALID_LSN, LogRecordType::UPDATE, RID(0, 0), tuple, make_tuple(1));
+  LogRecord insert_record(0, INVALID_LSN, LogRecordType::INSERT, RID(0, 0), tuple);
+  EXPECT_LT(update_record.GetSize(), insert_record.GetSize());
+
+  // Many rows, so some pages are on disk at the crash and some are not.
+  Transaction *txn = txn_manager->Begin();
+  auto *test_table = new TableHeap(bustub_instance->buffer_pool_manager_, bustub_instance->lock_manager_,
+                                   bustub_instance->log_manager_, txn);
+  page_id_t first_page_id = test_table->GetFirstPageId();
+  const int num_rows = 600;
+  std::vector<RID> rids(num_rows);
+  for (auto &rid : rids) {
+    ASSERT_TRUE(test_table->InsertTuple(tuple, &rid, txn));
+  }
+  txn_manager->Commit(txn);
+  delete txn;
+
+  // Even rows are updated twice by a transaction that commits, odd rows once by one that is running at the crash.
+  Transaction *winner_txn = txn_manager->Begin();
+  Transaction *loser_txn = txn_manager->Begin();
+  for (int i = 0; i < num_rows; i++) {
+    if (i % 2 == 0) {
+      ASSERT_TRUE(test_table->UpdateTuple(make_tuple(i), rids[i], winner_txn));
+      ASSERT_TRUE(test_table->UpdateTuple(make_tuple(-i), rids[i], winner_txn));
+    } else {
+      ASSERT_TRUE(test_table->UpdateTuple(make_tuple(i), rids[i], loser_txn));
+    }
+  }
+  txn_manager->Commit(winner_txn);
+
+  LOG_INFO("System crash");
+  delete test_table;
+  delete bustub_instance;
+  delete winner_txn;
+  delete loser_txn;
+
+  bustub_instance = new BustubInstance("test.db");
+  auto *log_recovery = new LogRecovery(bustub_instance->disk_manager_, bustub_instance->buffer_pool_manager_);
+  log_recovery->Redo();
+  log_recovery->Undo();
+  delete log_recovery;
+
+  // Scenario: redo rebuilds the committed updates and undo the original tuples from the tuples on the pages.
+  txn = bustub_instance->transaction_manager_->Begin();
+  test_table = new TableHeap(bustub_instance->buffer_pool_manager_, bustub_instance->lock_manager_,
+                             bustub_instance->log_manager_, first_page_id);
+  Tuple result;
+  for (int i = 0; i < num_rows; i++) {
+    ASSERT_TRUE(test_table->GetTuple(rids[i], &result, txn));
+    int32_t expected = i % 2 == 0 ? -i : 0;
+    ASSERT_EQ(CmpBool::CmpTrue, result.GetValue(&schema, 5).CompareEquals(ValueFactory::GetIntegerValue(expected)));
+    ASSERT_EQ(CmpBool::CmpTrue, result.GetValue(&schema, 8).CompareEquals(ValueFactory::GetIntegerValue(7)));
+  }
+  bustub_instance->transaction_manager_->Commit(txn);
+  delete txn;
+  delete test_table;
+
+  delete bustub_instance;
+  remove("test.db");
+  remove("test.log");
+  remove("test.master");
+}
+
+// NOLINTNEXTLINE
+TEST(RecoveryTest, DISABLED_PageWriteTest) {
+  remove("test.db");
+  remove("test.log");
+  remove("test.master");
+  BustubInstance *bustub_instance = new BustubInstance("test.db");
+  bustub_instance->log_manager_->RunFlushThread();
+  auto *txn_manager = bustub_instance->transaction_manager_;
+  auto *buffer_pool_manager = bustub_instance->buffer_pool_manager_;
+
+  // Writes a range of bytes of a page the way an index page is changed, logging the old and the new bytes.
+  auto write_page = [bustub_instance](Transaction *txn, Page *page, uint32_t offset, const std::string &data) {
+    LogRecord log_record(txn->GetTransactionId(), txn->GetPrevLSN(), LogRecordType::PAGEWRITE, page->GetPageId(),
+                         offset, page->GetData() + offset, data.data(), data.size());
+    lsn_t lsn = bustub_instance->log_manager_->AppendLogRecord(&log_record);
+    memcpy(page->GetData() + offset, data.data(), data.size());
+    page->SetLSN(lsn);
+    txn->SetPrevLSN(lsn);
+  };
+
+  page_id_t page_id;
+  Page *page = buffer_pool_manager->NewPage(&page_id);
+  ASSERT_NE(nullptr, page);
+  Transaction *winner_txn = txn_manager->Begin();
+  Transaction *loser_txn = txn_manager->Begin();
+  write_page(winner_txn, page, 100, "committed");
+  write_page(loser_txn, page, 200, "running");
+  write_page(winner_txn, page, 104, "overwritten");
+  txn_manager->Commit(winner_txn);
+  // Scenario: the page is on disk with the change of the loser, which undo must take back.
+  buffer_pool_manager->UnpinPage(page_id, true);
+  ASSERT_TRUE(buffer_pool_manager->FlushPage(page_id));
+  page = buffer_pool_manager->FetchPage(page_id);
+  write_page(loser_txn, page, 300, "lost");
+  buffer_pool_manager->UnpinPage(page_id, true);
+
+  LOG_INFO("System crash");
+  delete bustub_instance;
+  delete winner_txn;
+  delete loser_txn;
+
+  bustub_instance = new BustubInstance("test.db");
+  auto *log_recovery = new LogRecovery(bustub_instance->disk_manager_, bustub_instance->buffer_pool_manager_);
+  log_recovery->Redo();
+  log_recovery->Undo();
+  delete log_recovery;
+
+  // Scenario: the committed writes are redone and the writes of the loser are undone, whatever reached the disk.
+  page = bustub_instance->buffer_pool_manager_->FetchPage(page_id);
+  ASSERT_NE(nullptr, page);
+  EXPECT_EQ("commoverwritten", std::string(page->GetData() + 100, 15));
+  EXPECT_EQ(std::string(7, '\0'), std::string(page->GetData() + 200, 7));
+  EXPECT_EQ(std::string(4, '\0'), std::string(page->GetData() + 300, 4));
+  bustub_instance->buffer_pool_manager_->UnpinPage(page_id, false);
+
+  delete bustub_instance;
+  remove("test.db");
+  remove("test.log");
+  remove("test.master");
+}
+
+// NOLINTNEXTLINE
+TEST(RecoveryTest, DISABLED_IncrementTest) {
+  remove("test.db");
+  remove("test.log");
+  remove("test.master");
+  BustubInstance *bustub_instance = new BustubInstance("test.db");
+  bustub_instance->log_manager_->RunFlushThread();
+  auto *txn_manager = bustub_instance->transaction_manager_;
+
+  Schema schema{std::vector<Column>{Column{"a", TypeId::VARCHAR, 20}, Column{"count", TypeId::BIGINT}}};
+  const Tuple tuple({ValueFactory::GetVarcharValue("counter"), ValueFactory::GetBigIntValue(0)}, &schema);
+
+  // Many rows, so some pages are on disk at the crash and some are not.
+  Transaction *txn = txn_manager->Begin();
+  auto *test_table = new TableHeap(bustub_instance->buffer_pool_manager_, bustub_instance->lock_manager_,
+                                   bustub_instance->log_manager_, txn);
+  page_id_t first_page_id = test_table->GetFirstPageId();
+  const int num_rows = 600;
+  std::vector<RID> rids(num_rows);
+  for (auto &rid : rids) {
+    ASSERT_TRUE(test_table->InsertTuple(tuple, &rid, txn));
+  }
+  txn_manager->Commit(txn);
+  delete txn;
+
+  // Every row is incremented by a transaction that is running at the crash, before and after a transaction that
+  // commits increments it too.
+  Transaction *winner_txn = txn_manager->Begin();
+  Transaction *loser_txn = txn_manager->Begin();
+  for (const auto &rid : rids) {
+    ASSERT_TRUE(test_table->IncrementTuple(rid, schema, 1, ValueFactory::GetIntegerValue(100), loser_txn));
+    ASSERT_TRUE(test_table->IncrementTuple(rid, schema, 1, ValueFactory::GetIntegerValue(1), winner_txn));
+    ASSERT_TRUE(test_table->IncrementTuple(rid, schema, 1, ValueFactory::GetIntegerValue(1000), loser_txn));
+  }
+  txn_manager->Commit(winner_txn);
+
+  LOG_INFO("System crash");
+  delete test_table;
+  delete bustub_instance;
+  delete winner_txn;
+  delete loser_txn;
+
+  bustub_instance = new BustubInstance("test.db");
+  auto *log_recovery = new LogRecovery(bustub_instance->disk_manager_, bustub_instance->buffer_pool_manager_);
+  log_recovery->Redo();
+  log_recovery->Undo();
+  delete log_recovery;
+
+  // Scenario: undo subtracts the increments of the loser, which keeps the increment of the winner in between.
+  txn = bustub_instance->transaction_manager_->Begin();
+  test_table = new TableHeap(bustub_instance->buffer_pool_manager_, bustub_instance->lock_manager_,
+                             bustub_instance->log_manager_, first_page_id);
+  Tuple result;
+  for (const auto &rid : rids) {
+    ASSERT_TRUE(test_table->GetTuple(rid, &result, txn));
+    ASSERT_EQ(CmpBool::CmpTrue, result.GetValue(&schema, 1).CompareEquals(ValueFactory::GetBigIntValue(1)));
+  }
+  bustub_instance->transaction_manager_->Commit(txn);
+  delete txn;
+  delete test_table;
+
+  delete bustub_instance;
+  remove("test.db");
+  remove("test.log");
+  remove("test.master");
+}
+
+// NOLINTNEXTLINE
+TEST(RecoveryTest, DISABLED_InstantRestartIncrementTest) {
+  remove("test.db");
+  remove("test.log");
+  remove("test.master");
+  BustubInstance *bustub_instance = new BustubInstance("test.db");
+  bustub_instance->log_manager_->RunFlushThread();
+  auto *txn_manager = bustub_instance->transaction_manager_;
+
+  Schema schema{std::vector<Column>{Column{"a", TypeId::VARCHAR, 20}, Column{"count", TypeId::BIGINT}}};
+  const Tuple tuple({ValueFactory::GetVarcharValue("counter"), ValueFactory::GetBigIntValue(0)}, &schema);
+
+  Transaction *txn = txn_manager->Begin();
+  auto *test_table = new TableHeap(bustub_instance->buffer_pool_manager_, bustub_instance->lock_manager_,
+                                   bustub_instance->log_manager_, txn);
+  page_id_t first_page_id = test_table->GetFirstPageId();
+  RID rid;
+  ASSERT_TRUE(test_table->InsertTuple(tuple, &rid, txn));
+  txn_manager->Commit(txn);
+  delete txn;
+
+  // Two transactions that are running at the crash incremented the same counter.
+  Transaction *loser_txn1 = txn_manager->Begin();
+  Transaction *loser_txn2 = txn_manager->Begin();
+  ASSERT_TRUE(test_table->IncrementTuple(rid, schema, 1, ValueFactory::GetIntegerValue(10), loser_txn1));
+  ASSERT_TRUE(test_table->IncrementTuple(rid, schema, 1, ValueFactory::GetIntegerValue(20), loser_txn2));
+
+  LOG_INFO("System crash");
+  delete test_table;
+  delete bustub_instance;
+  delete loser_txn1;
+  delete loser_txn2;
+
+  // Scenario: the stand-ins of both losers lock the counter in increment mode, so the restart does not wait on itself
+  // and new transactions may increment the counter right away.
+  bustub_instance = new BustubInstance("test.db");
+  bustub_instance->log_manager_->RunFlushThread();
+  auto *log_recovery = new LogRecovery(bustub_instance->disk_manager_, bustub_instance->buffer_pool_manager_);
+  log_recovery->StartInstantRestart(bustub_instance->log_manager_, bustub_instance->transaction_manager_,
+                                    bustub_instance->lock_manager_);
+  txn = bustub_instance->transaction_manager_->Begin();
+  test_table = new TableHeap(bustub_instance->buffer_pool_manager_, bustub_instance->lock_manager_,
+                             bustub_instance->log_manager_, first_page_id);
+  ASSERT_TRUE(test_table->IncrementTuple(rid, schema, 1, ValueFactory::GetIntegerValue(1), txn));
+  bustub_instance->transaction_manager_->Commit(txn);
+  delete txn;
+
+  // Scenario: once the background recovery is done, only the committed increment is left.
+  log_recovery->WaitForInstantRestart();
+  delete log_recovery;
+  txn = bustub_instance->transaction_manager_->Begin();
+  Tuple result;
+  ASSERT_TRUE(test_table->GetTuple(rid, &result, txn));
+  EXPECT_EQ(CmpBool::CmpTrue, result.GetValue(&schema, 1).CompareEquals(ValueFactory::GetBigIntValue(1)));
+  bustub_instance->transaction_manager_->Commit(txn);
+  delete txn;
+  delete test_table;
+
+  delete bustub_instance;
+  remove("test.db");
+  remove("test.log");
+  remove("test.master");
+}
+
 }  // namespace bustub
@@ -10,10 +10,14 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include <cstdio>
 #include <cstring>
+#include <string>
+#include <vector>
 
 #include "common/exception.h"
 #include "gtest/gtest.h"
+#include "recovery/log_record.h"
 #include "storage/disk/disk_manager.h"
 
 namespace bustub {
@@ -58,6 +62,109 @@ TEST(DiskManagerTest, ReadWriteLogTest) {
   remove(db_file.c_str());
 }
 
+TEST(DiskManagerTest, LogSegmentTest) {
+  const int segment_size = 1024;
+  const int record_size = 300;
+  std::string db_file("test.db");
+  remove("test.log");
+  auto *dm = new DiskManager(db_file, segment_size);
+
+  // Records that only carry a header, with consecutive LSNs like real log records, so that the end of the log can be
+  // found again.
+  lsn_t next_lsn = 0;
+  auto make_records = [&](int num_records, char fill) {
+    std::vector<char> records(num_records * record_size, fill);
+    for (int i = 0; i < num_records; i++) {
+      char *header = records.data() + i * record_size;
+      lsn_t lsn = next_lsn++;
+      LogRecordType type = LogRecordType::BEGIN;
+      memcpy(header, &record_size, sizeof(int32_t));
+      memcpy(header + 4, &lsn, sizeof(lsn_t));
+      memcpy(header + 16, &type, sizeof(LogRecordType));
+    }
+    return records;
+  };
+  auto segment_exists = [&](int segment) {
+    FILE *file = fopen(dm->GetLogSegmentName(segment).c_str(), "rb");
+    if (file != nullptr) {
+      fclose(file);
+    }
+    return file != nullptr;
+  };
+
+  // Scenario: the log continues in the next segment file, reads see one log.
+  std::vector<char> first = make_records(10, 'a');
+  dm->WriteLog(first.data(), first.size());
+  EXPECT_EQ(3000, dm->GetLogSize());
+  EXPECT_TRUE(segment_exists(2));
+  std::vector<char> buf(first.size());
+  ASSERT_TRUE(dm->ReadLog(buf.data(), buf.size(), 0));
+  EXPECT_EQ(0, std::memcmp(buf.data(), first.data(), buf.size()));
+
+  // Scenario: truncating recycles the segments before the offset as zeroed spares after the last one.
+  dm->TruncateLog(7 * record_size);
+  EXPECT_EQ(7 * record_size, dm->GetLogStart());
+  EXPECT_FALSE(segment_exists(0));
+  EXPECT_FALSE(segment_exists(1));
+  EXPECT_TRUE(segment_exists(3));
+  EXPECT_TRUE(segment_exists(4));
+  EXPECT_FALSE(segment_exists(5));
+  EXPECT_FALSE(dm->ReadLog(buf.data(), record_size, 0));
+
+  // Scenario: later writes go to the spares.
+  std::vector<char> second = make_records(5, 'b');
+  dm->WriteLog(second.data(), second.size());
+  EXPECT_EQ(4500, dm->GetLogSize());
+  EXPECT_FALSE(segment_exists(5));
+  dm->ShutDown();
+  delete dm;
+
+  // Scenario: a reopened log keeps its segment size, start and end.
+  dm = new DiskManager(db_file);
+  EXPECT_EQ(segment_size, dm->GetLogSegmentSize());
+  EXPECT_EQ(7 * record_size, dm->GetLogStart());
+  EXPECT_EQ(4500, dm->GetLogSize());
+  EXPECT_EQ(15, dm->GetNextLSN());
+  ASSERT_TRUE(dm->ReadLog(buf.data(), second.size(), 3000));
+  EXPECT_EQ(0, std::memcmp(buf.data(), second.data(), second.size()));
+
+  // Scenario: a record whose LSN does not follow the last one, as a torn write may leave behind, ends the log.
+  next_lsn += 2;
+  std::vector<char> stray = make_records(1, 'c');
+  dm->WriteLog(stray.data(), stray.size());
+  dm->ShutDown();
+  delete dm;
+  dm = new DiskManager(db_file);
+  EXPECT_EQ(4500, dm->GetLogSize());
+  EXPECT_EQ(15, dm->GetNextLSN());
+
+  dm->ShutDown();
+  for (int segment = 2; segment <= 4; segment++) {
+    remove(dm->GetLogSegmentName(segment).c_str());
+  }
+  delete dm;
+  remove(db_file.c_str());
+  remove("test.log");
+}
+
+TEST(DiskManagerTest, LegacyLogTest) {
+  // Scenario: a log file without a log control header, e.g. from before logs were split into segments, is kept.
+  remove("test.log");
+  std::vector<char> records(300, 'a');
+  FILE *file = fopen("test.log", "wb");
+  ASSERT_NE(nullptr, file);
+  fwrite(records.data(), 1, records.size(), file);
+  fclose(file);
+  EXPECT_THROW(DiskManager("test.db"), Exception);
+  file = fopen("test.log", "rb");
+  ASSERT_NE(nullptr, file);
+  fseek(file, 0, SEEK_END);
+  EXPECT_EQ(300, ftell(file));
+  fclose(file);
+  remove("test.db");
+  remove("test.log");
+}
+
 TEST(DiskManagerTest, ThrowBadFileTest) { EXPECT_THROW(DiskManager("dev/null\\/foo/bar/baz/test.db"), Exception); }
 
 }  // namespace bustub
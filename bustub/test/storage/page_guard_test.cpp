@@ -0,0 +1,99 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// page_guard_test.cpp
+//
+// Identification: test/storage/page_guard_test.cpp
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <utility>
+
+#include "buffer/buffer_pool_manager.h"
+#include "gtest/gtest.h"
+#include "storage/page/page_guard.h"
+
+namespace bustub {
+
+// NOLINTNEXTLINE
+TEST(PageGuardTest, DISABLED_SampleTest) {
+  const std::string db_name = "test.db";
+  const size_t buffer_pool_size = 5;
+
+  auto *disk_manager = new DiskManager(db_name);
+  auto *bpm = new BufferPoolManager(buffer_pool_size, disk_manager);
+
+  page_id_t page_id_temp;
+  auto *page0 = bpm->NewPage(&page_id_temp);
+
+  // Scenario: A guard takes over the pin of the page and releases it on Drop().
+  auto guarded_page = BasicPageGuard(bpm, page0);
+  EXPECT_EQ(page0->GetData(), guarded_page.GetData());
+  EXPECT_EQ(page0->GetPageId(), guarded_page.PageId());
+  EXPECT_EQ(1, page0->GetPinCount());
+  guarded_page.Drop();
+  EXPECT_EQ(0, page0->GetPinCount());
+
+  // Scenario: Dropping twice, or destroying a dropped guard, does not unpin again.
+  guarded_page.Drop();
+  EXPECT_EQ(0, page0->GetPinCount());
+
+  {
+    // Scenario: Moving a guard transfers the pin, only the destination releases it.
+    auto basic_guard = bpm->FetchPageBasic(page_id_temp);
+    EXPECT_EQ(1, page0->GetPinCount());
+    BasicPageGuard moved_guard(std::move(basic_guard));
+    EXPECT_FALSE(basic_guard.IsValid());  // NOLINT
+    EXPECT_EQ(1, page0->GetPinCount());
+
+    // Scenario: Move-assigning over a guard releases the pin it held before.
+    moved_guard = bpm->FetchPageBasic(page_id_temp);
+    EXPECT_EQ(1, page0->GetPinCount());
+  }
+  EXPECT_EQ(0, page0->GetPinCount());
+
+  {
+    // Scenario: Read guards on the same page can coexist and each hold a pin.
+    auto read_guard1 = bpm->FetchPageRead(page_id_temp);
+    auto read_guard2 = bpm->FetchPageRead(page_id_temp);
+    EXPECT_EQ(2, page0->GetPinCount());
+  }
+  EXPECT_EQ(0, page0->GetPinCount());
+
+  {
+    // Scenario: Upgrading a basic guard latches the page and keeps the single pin.
+    auto basic_guard = bpm->FetchPageBasic(page_id_temp);
+    auto write_guard = basic_guard.UpgradeWrite();
+    EXPECT_FALSE(basic_guard.IsValid());  // NOLINT
+    EXPECT_EQ(1, page0->GetPinCount());
+    std::strncpy(write_guard.GetDataMut(), "Hello", 6);
+  }
+  EXPECT_EQ(0, page0->GetPinCount());
+
+  {
+    // Scenario: The write latch was released, so we can latch the page again and see the data.
+    auto read_guard = bpm->FetchPageRead(page_id_temp);
+    EXPECT_EQ(0, std::strcmp(read_guard.GetData(), "Hello"));
+  }
+
+  // Scenario: Unpinned pages can be evicted, so the pool is not shrunk by leaked pins.
+  for (size_t i = 0; i < buffer_pool_size * 2; ++i) {
+    auto new_guard = bpm->NewPageGuarded(&page_id_temp);
+    EXPECT_TRUE(new_guard.IsValid());
+  }
+
+  // Shutdown the disk manager and remove the temporary file we created.
+  disk_manager->ShutDown();
+  remove("test.db");
+
+  delete bpm;
+  delete disk_manager;
+}
+
+}  // namespace bustub
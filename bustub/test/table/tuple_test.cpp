@@ -11,16 +11,22 @@
 //===----------------------------------------------------------------------===//
 
 #include <algorithm>
+#include <array>
+#include <chrono>  // NOLINT
 #include <cstdio>
 #include <iostream>
+#include <numeric>
 #include <string>
+#include <thread>  // NOLINT
 #include <vector>
 
 #include "buffer/buffer_pool_manager.h"
+#include "concurrency/transaction_manager.h"
 #include "gtest/gtest.h"
 #include "logging/common.h"
 #include "storage/table/table_heap.h"
 #include "storage/table/tuple.h"
+#include "type/limits.h"
 
 namespace bustub {
 // NOLINTNEXTLINE
@@ -71,4 +77,686 @@ TEST(TupleTest, DISABLED_TableHeapTest) {
   delete disk_manager;
 }
 
+// NOLINTNEXTLINE
+TEST(TupleTest, DISABLED_TableLockScanTest) {
+  Column col1{"a", TypeId::VARCHAR, 20};
+  Column col2{"b", TypeId::SMALLINT};
+  std::vector<Column> cols{col1, col2};
+  Schema schema{cols};
+  Tuple tuple = ConstructTuple(&schema);
+
+  enable_logging = true;
+  auto *disk_manager = new DiskManager("test.db");
+  auto *buffer_pool_manager = new BufferPoolManager(50, disk_manager);
+  auto *lock_manager = new LockManager();
+  auto *log_manager = new LogManager(disk_manager);
+  log_manager->RunFlushThread();
+  auto *txn_manager = new TransactionManager(lock_manager, log_manager);
+
+  // The writer announces its locks on the tuples with an intention lock on the table.
+  Transaction *writer = txn_manager->Begin();
+  const table_oid_t oid = 3;
+  auto *table = new TableHeap(buffer_pool_manager, lock_manager, log_manager, writer, oid);
+  const int num_tuples = 100;
+  std::vector<RID> rid_v(num_tuples);
+  for (auto &rid : rid_v) {
+    ASSERT_TRUE(table->InsertTuple(tuple, &rid, writer));
+  }
+  EXPECT_EQ(LockMode::INTENTION_EXCLUSIVE, writer->GetTableLockSet()->at(oid));
+  EXPECT_EQ(num_tuples, writer->GetExclusiveLockSet()->size());
+  txn_manager->Commit(writer);
+
+  // A scan under a lock on the whole table locks none of the tuples it reads.
+  Transaction *scanner = txn_manager->Begin();
+  ASSERT_TRUE(lock_manager->LockTable(scanner, oid, LockMode::SHARED));
+  int count = 0;
+  for (auto itr = table->Begin(scanner); itr != table->End(); ++itr) {
+    count++;
+  }
+  EXPECT_EQ(num_tuples, count);
+  EXPECT_TRUE(scanner->GetSharedLockSet()->empty());
+
+  // A reader of one tuple locks the tuple, next to the scan.
+  Transaction *reader = txn_manager->Begin();
+  Tuple result;
+  EXPECT_TRUE(table->GetTuple(rid_v[0], &result, reader));
+  EXPECT_EQ(LockMode::INTENTION_SHARED, reader->GetTableLockSet()->at(oid));
+  EXPECT_EQ(1, reader->GetSharedLockSet()->size());
+  txn_manager->Commit(reader);
+  txn_manager->Commit(scanner);
+  EXPECT_TRUE(scanner->GetTableLockSet()->empty());
+
+  log_manager->StopFlushThread();
+  enable_logging = false;
+  delete writer;
+  delete scanner;
+  delete reader;
+  delete table;
+  delete txn_manager;
+  delete log_manager;
+  delete lock_manager;
+  delete buffer_pool_manager;
+  disk_manager->ShutDown();
+  delete disk_manager;
+  remove("test.db");
+  remove("test.log");
+}
+
+// NOLINTNEXTLINE
+TEST(TupleTest, DISABLED_WideTupleTest) {
+  Schema schema{std::vector<Column>{Column{"a", TypeId::VARCHAR, 65536}}};
+  auto make_tuple = [&schema](size_t length, char c) {
+    return Tuple{std::vector<Value>{Value(TypeId::VARCHAR, std::string(length, c))}, &schema};
+  };
+
+  enable_logging = true;
+  auto *disk_manager = new DiskManager("test.db");
+  auto *buffer_pool_manager = new BufferPoolManager(std::array<size_t, NUM_PAGE_SIZE_CLASSES>{50, 1, 1}, disk_manager);
+  auto *lock_manager = new LockManager();
+  auto *log_manager = new LogManager(disk_manager);
+  log_manager->RunFlushThread();
+  auto *txn_manager = new TransactionManager(lock_manager, log_manager);
+
+  // A tuple whose log records fit in the log buffer goes to a large page, and can be updated and deleted.
+  Transaction *txn = txn_manager->Begin();
+  auto *table = new TableHeap(buffer_pool_manager, lock_manager, log_manager, txn, 1);
+  const size_t length = LogRecord::MaxTupleSize() - 64;
+  RID rid;
+  ASSERT_TRUE(table->InsertTuple(make_tuple(length, 'a'), &rid, txn));
+  ASSERT_TRUE(table->UpdateTuple(make_tuple(length, 'b'), rid, txn));
+  Tuple result;
+  ASSERT_TRUE(table->GetTuple(rid, &result, txn));
+  EXPECT_EQ(make_tuple(length, 'b').GetLength(), result.GetLength());
+  ASSERT_TRUE(table->MarkDelete(rid, txn));
+  txn_manager->Commit(txn);
+  delete txn;
+
+  // A tuple that fits in a page, but whose records would not fit in the log buffer, is rejected.
+  const Tuple wide = make_tuple(LogRecord::MaxTupleSize() + 64, 'c');
+  ASSERT_LT(wide.GetLength() + 32, MaxPageSize());
+  txn = txn_manager->Begin();
+  EXPECT_FALSE(table->InsertTuple(wide, &rid, txn));
+  EXPECT_EQ(TransactionState::ABORTED, txn->GetState());
+  txn_manager->Abort(txn);
+  delete txn;
+
+  log_manager->StopFlushThread();
+  enable_logging = false;
+  delete table;
+  delete txn_manager;
+  delete log_manager;
+  delete lock_manager;
+  delete buffer_pool_manager;
+  disk_manager->ShutDown();
+  delete disk_manager;
+  remove("test.db");
+  remove("test.16k.db");
+  remove("test.64k.db");
+  remove("test.log");
+}
+
+// NOLINTNEXTLINE
+TEST(TupleTest, DISABLED_LockedFreeSlotTest) {
+  Schema schema{std::vector<Column>{Column{"a", TypeId::INTEGER}}};
+  auto make_tuple = [&schema](int32_t a) { return Tuple{std::vector<Value>{Value(TypeId::INTEGER, a)}, &schema}; };
+
+  enable_logging = true;
+  auto *disk_manager = new DiskManager("test.db");
+  auto *buffer_pool_manager = new BufferPoolManager(50, disk_manager);
+  auto *lock_manager = new LockManager();
+  auto *log_manager = new LogManager(disk_manager);
+  log_manager->RunFlushThread();
+  auto *txn_manager = new TransactionManager(lock_manager, log_manager);
+
+  // A rolled back insert leaves a free slot behind.
+  Transaction *loader = txn_manager->Begin();
+  auto *table = new TableHeap(buffer_pool_manager, lock_manager, log_manager, loader, 1);
+  RID kept_rid;
+  RID free_rid;
+  ASSERT_TRUE(table->InsertTuple(make_tuple(0), &kept_rid, loader));
+  txn_manager->Commit(loader);
+  Transaction *aborted = txn_manager->Begin();
+  ASSERT_TRUE(table->InsertTuple(make_tuple(1), &free_rid, aborted));
+  txn_manager->Abort(aborted);
+
+  // Scenario: while another transaction still holds a lock on the free slot, an insert takes a new slot.
+  Transaction *holder = txn_manager->Begin();
+  ASSERT_TRUE(lock_manager->LockExclusive(holder, free_rid));
+  Transaction *inserter = txn_manager->Begin();
+  RID rid;
+  ASSERT_TRUE(table->InsertTuple(make_tuple(2), &rid, inserter));
+  EXPECT_FALSE(free_rid == rid);
+  EXPECT_EQ(TransactionState::GROWING, inserter->GetState());
+  txn_manager->Commit(inserter);
+  txn_manager->Commit(holder);
+
+  // Scenario: once the lock is released, the free slot is reused.
+  Transaction *reuser = txn_manager->Begin();
+  ASSERT_TRUE(table->InsertTuple(make_tuple(3), &rid, reuser));
+  EXPECT_EQ(free_rid, rid);
+  EXPECT_TRUE(reuser->IsExclusiveLocked(rid));
+  txn_manager->Commit(reuser);
+
+  log_manager->StopFlushThread();
+  enable_logging = false;
+  delete loader;
+  delete aborted;
+  delete holder;
+  delete inserter;
+  delete reuser;
+  delete table;
+  delete txn_manager;
+  delete log_manager;
+  delete lock_manager;
+  delete buffer_pool_manager;
+  disk_manager->ShutDown();
+  delete disk_manager;
+  remove("test.db");
+  remove("test.log");
+}
+
+// NOLINTNEXTLINE
+TEST(TupleTest, DISABLED_SnapshotIsolationTest) {
+  Schema schema{std::vector<Column>{Column{"a", TypeId::INTEGER}}};
+  auto make_tuple = [&schema](int32_t a) { return Tuple{std::vector<Value>{Value(TypeId::INTEGER, a)}, &schema}; };
+  auto value_of = [&schema](const Tuple &tuple) { return tuple.GetValue(&schema, 0).GetAs<int32_t>(); };
+
+  enable_logging = true;
+  auto *disk_manager = new DiskManager("test.db");
+  auto *buffer_pool_manager = new BufferPoolManager(50, disk_manager);
+  auto *lock_manager = new LockManager();
+  auto *log_manager = new LogManager(disk_manager);
+  log_manager->RunFlushThread();
+  auto *txn_manager = new TransactionManager(lock_manager, log_manager);
+
+  Transaction *loader = txn_manager->Begin();
+  auto *table = new TableHeap(buffer_pool_manager, lock_manager, log_manager, loader, 1);
+  const int num_tuples = 10;
+  std::vector<RID> rid_v(num_tuples);
+  for (int i = 0; i < num_tuples; i++) {
+    ASSERT_TRUE(table->InsertTuple(make_tuple(i), &rid_v[i], loader));
+  }
+  txn_manager->Commit(loader);
+  // Without a snapshot running, no older versions are kept.
+  EXPECT_EQ(0, table->GetNumVersionChains());
+
+  auto scan = [&](Transaction *txn) {
+    std::vector<int32_t> values;
+    for (auto itr = table->Begin(txn); itr != table->End(); ++itr) {
+      values.push_back(value_of(*itr));
+    }
+    std::sort(values.begin(), values.end());
+    return values;
+  };
+  std::vector<int32_t> old_values(num_tuples);
+  std::iota(old_values.begin(), old_values.end(), 0);
+
+  // A snapshot reads the tuples a writer changes without waiting for its locks, and without locking them.
+  Transaction *snapshot = txn_manager->Begin(nullptr, IsolationLevel::SNAPSHOT_ISOLATION);
+  Transaction *writer = txn_manager->Begin();
+  RID new_rid;
+  ASSERT_TRUE(table->UpdateTuple(make_tuple(100), rid_v[0], writer));
+  ASSERT_TRUE(table->MarkDelete(rid_v[1], writer));
+  ASSERT_TRUE(table->InsertTuple(make_tuple(101), &new_rid, writer));
+  Tuple result;
+  ASSERT_TRUE(table->GetTuple(rid_v[0], &result, snapshot));
+  EXPECT_EQ(0, value_of(result));
+  EXPECT_EQ(old_values, scan(snapshot));
+  txn_manager->Commit(writer);
+  EXPECT_EQ(3, table->GetNumVersionChains());
+
+  // The snapshot does not see the commit, the deleted tuple included.
+  ASSERT_TRUE(table->GetTuple(rid_v[1], &result, snapshot));
+  EXPECT_EQ(1, value_of(result));
+  EXPECT_FALSE(table->GetTuple(new_rid, &result, snapshot));
+  EXPECT_EQ(old_values, scan(snapshot));
+  EXPECT_TRUE(snapshot->GetSharedLockSet()->empty());
+  EXPECT_EQ(TransactionState::GROWING, snapshot->GetState());
+
+  // A snapshot that begins after the commit sees it.
+  Transaction *new_snapshot = txn_manager->Begin(nullptr, IsolationLevel::SNAPSHOT_ISOLATION);
+  std::vector<int32_t> new_values(old_values.begin() + 2, old_values.end());
+  new_values.push_back(100);
+  new_values.push_back(101);
+  EXPECT_EQ(new_values, scan(new_snapshot));
+
+  // A snapshot may write a tuple nobody changed since it began, but not one that changed.
+  EXPECT_TRUE(table->UpdateTuple(make_tuple(102), rid_v[2], new_snapshot));
+  txn_manager->Commit(new_snapshot);
+  EXPECT_FALSE(table->UpdateTuple(make_tuple(103), rid_v[0], snapshot));
+  EXPECT_EQ(TransactionState::ABORTED, snapshot->GetState());
+  txn_manager->Abort(snapshot);
+
+  // An aborted change leaves no version behind.
+  size_t num_chains = table->GetNumVersionChains();
+  Transaction *aborted = txn_manager->Begin();
+  ASSERT_TRUE(table->UpdateTuple(make_tuple(104), rid_v[3], aborted));
+  EXPECT_EQ(num_chains + 1, table->GetNumVersionChains());
+  txn_manager->Abort(aborted);
+  EXPECT_EQ(num_chains, table->GetNumVersionChains());
+
+  log_manager->StopFlushThread();
+  enable_logging = false;
+  delete loader;
+  delete snapshot;
+  delete writer;
+  delete new_snapshot;
+  delete aborted;
+  delete table;
+  delete txn_manager;
+  delete log_manager;
+  delete lock_manager;
+  delete buffer_pool_manager;
+  disk_manager->ShutDown();
+  delete disk_manager;
+  remove("test.db");
+  remove("test.log");
+}
+
+// NOLINTNEXTLINE
+TEST(TupleTest, DISABLED_OptimisticTest) {
+  Schema schema{std::vector<Column>{Column{"a", TypeId::INTEGER}}};
+  auto make_tuple = [&schema](int32_t a) { return Tuple{std::vector<Value>{Value(TypeId::INTEGER, a)}, &schema}; };
+  auto value_of = [&schema](const Tuple &tuple) { return tuple.GetValue(&schema, 0).GetAs<int32_t>(); };
+
+  enable_logging = true;
+  auto *disk_manager = new DiskManager("test.db");
+  auto *buffer_pool_manager = new BufferPoolManager(50, disk_manager);
+  auto *lock_manager = new LockManager();
+  auto *log_manager = new LogManager(disk_manager);
+  log_manager->RunFlushThread();
+  auto *txn_manager = new TransactionManager(lock_manager, log_manager, ConcurrencyMode::OPTIMISTIC);
+
+  Transaction *loader = txn_manager->Begin();
+  auto *table = new TableHeap(buffer_pool_manager, lock_manager, log_manager, loader, 1);
+  const int num_tuples = 10;
+  std::vector<RID> rid_v(num_tuples);
+  for (int i = 0; i < num_tuples; i++) {
+    ASSERT_TRUE(table->InsertTuple(make_tuple(i), &rid_v[i], loader));
+  }
+  txn_manager->Commit(loader);
+
+  auto scan = [&](Transaction *txn) {
+    std::vector<int32_t> values;
+    for (auto itr = table->Begin(txn); itr != table->End(); ++itr) {
+      values.push_back(value_of(*itr));
+    }
+    std::sort(values.begin(), values.end());
+    return values;
+  };
+  std::vector<int32_t> old_values(num_tuples);
+  std::iota(old_values.begin(), old_values.end(), 0);
+
+  // Updates and deletes are buffered without locks, only the transaction itself sees them before it commits.
+  Transaction *txn = txn_manager->Begin();
+  Transaction *other = txn_manager->Begin();
+  Tuple result;
+  ASSERT_TRUE(table->GetTuple(rid_v[0], &result, txn));
+  ASSERT_TRUE(table->UpdateTuple(make_tuple(100), rid_v[1], txn));
+  ASSERT_TRUE(table->MarkDelete(rid_v[2], txn));
+  EXPECT_FALSE(table->UpdateTuple(make_tuple(101), rid_v[2], txn));
+  EXPECT_TRUE(txn->GetExclusiveLockSet()->empty());
+  EXPECT_TRUE(txn->GetSharedLockSet()->empty());
+  ASSERT_TRUE(table->GetTuple(rid_v[1], &result, txn));
+  EXPECT_EQ(100, value_of(result));
+  EXPECT_FALSE(table->GetTuple(rid_v[2], &result, txn));
+  std::vector<int32_t> new_values(old_values.begin() + 3, old_values.end());
+  new_values.insert(new_values.begin(), 0);
+  new_values.push_back(100);
+  EXPECT_EQ(new_values, scan(txn));
+  EXPECT_EQ(old_values, scan(other));
+
+  // Another transaction changes a tuple txn read and commits first, so txn fails validation and nothing it buffered
+  // is installed.
+  ASSERT_TRUE(table->UpdateTuple(make_tuple(200), rid_v[0], other));
+  txn_manager->Commit(other);
+  try {
+    txn_manager->Commit(txn);
+    FAIL() << "Committed a transaction that read a changed tuple.";
+  } catch (TransactionAbortException &e) {
+    EXPECT_EQ(AbortReason::VALIDATION_FAILED, e.GetAbortReason());
+  }
+  EXPECT_EQ(TransactionState::ABORTED, txn->GetState());
+  EXPECT_TRUE(txn->GetBufferedWriteSet()->empty());
+
+  // A transaction whose reads are unchanged installs its changes when it commits.
+  Transaction *retry = txn_manager->Begin();
+  ASSERT_TRUE(table->GetTuple(rid_v[0], &result, retry));
+  EXPECT_EQ(200, value_of(result));
+  ASSERT_TRUE(table->UpdateTuple(make_tuple(100), rid_v[1], retry));
+  ASSERT_TRUE(table->MarkDelete(rid_v[2], retry));
+  txn_manager->Commit(retry);
+  EXPECT_EQ(TransactionState::COMMITTED, retry->GetState());
+  Transaction *check = txn_manager->Begin();
+  new_values.erase(new_values.begin());
+  new_values.push_back(200);
+  EXPECT_EQ(new_values, scan(check));
+  txn_manager->Commit(check);
+
+  log_manager->StopFlushThread();
+  enable_logging = false;
+  delete loader;
+  delete txn;
+  delete other;
+  delete retry;
+  delete check;
+  delete table;
+  delete txn_manager;
+  delete log_manager;
+  delete lock_manager;
+  delete buffer_pool_manager;
+  disk_manager->ShutDown();
+  delete disk_manager;
+  remove("test.db");
+  remove("test.log");
+}
+
+// NOLINTNEXTLINE
+TEST(TupleTest, DISABLED_ReadOnlyTest) {
+  Schema schema{std::vector<Column>{Column{"a", TypeId::INTEGER}}};
+  auto make_tuple = [&schema](int32_t a) { return Tuple{std::vector<Value>{Value(TypeId::INTEGER, a)}, &schema}; };
+  auto value_of = [&schema](const Tuple &tuple) { return tuple.GetValue(&schema, 0).GetAs<int32_t>(); };
+
+  enable_logging = true;
+  auto *disk_manager = new DiskManager("test.db");
+  auto *buffer_pool_manager = new BufferPoolManager(50, disk_manager);
+  auto *lock_manager = new LockManager();
+  auto *log_manager = new LogManager(disk_manager);
+  log_manager->RunFlushThread();
+  auto *txn_manager = new TransactionManager(lock_manager, log_manager);
+
+  Transaction *loader = txn_manager->Begin();
+  auto *table = new TableHeap(buffer_pool_manager, lock_manager, log_manager, loader, 1);
+  const int num_tuples = 10;
+  std::vector<RID> rid_v(num_tuples);
+  for (int i = 0; i < num_tuples; i++) {
+    ASSERT_TRUE(table->InsertTuple(make_tuple(i), &rid_v[i], loader));
+  }
+  txn_manager->Commit(loader);
+
+  // Read-only transactions read the committed tuples past the locks of a writer, without logging anything.
+  Transaction *writer = txn_manager->Begin();
+  ASSERT_TRUE(table->UpdateTuple(make_tuple(100), rid_v[0], writer));
+  lsn_t next_lsn = log_manager->GetNextLSN();
+  Transaction *snapshot = txn_manager->BeginReadOnly();
+  Transaction *read_committed = txn_manager->BeginReadOnly(nullptr, IsolationLevel::READ_COMMITTED);
+  EXPECT_FALSE(txn_manager->VisitTransaction(snapshot->GetTransactionId(), [](Transaction *) {}));
+  Tuple result;
+  for (Transaction *txn : {snapshot, read_committed}) {
+    ASSERT_TRUE(table->GetTuple(rid_v[0], &result, txn));
+    EXPECT_EQ(0, value_of(result));
+    int count = 0;
+    for (auto itr = table->Begin(txn); itr != table->End(); ++itr) {
+      count++;
+    }
+    EXPECT_EQ(num_tuples, count);
+    EXPECT_FALSE(txn->HoldsLocks());
+  }
+  txn_manager->Commit(snapshot);
+  EXPECT_EQ(TransactionState::COMMITTED, snapshot->GetState());
+  EXPECT_EQ(next_lsn, log_manager->GetNextLSN());
+  EXPECT_EQ(INVALID_LSN, snapshot->GetPrevLSN());
+
+  // A read-only transaction may not change anything.
+  RID new_rid;
+  EXPECT_FALSE(table->InsertTuple(make_tuple(101), &new_rid, read_committed));
+  EXPECT_EQ(TransactionState::ABORTED, read_committed->GetState());
+  txn_manager->Abort(read_committed);
+  EXPECT_EQ(next_lsn, log_manager->GetNextLSN());
+  txn_manager->Commit(writer);
+
+  log_manager->StopFlushThread();
+  enable_logging = false;
+  delete loader;
+  delete writer;
+  delete snapshot;
+  delete read_committed;
+  delete table;
+  delete txn_manager;
+  delete log_manager;
+  delete lock_manager;
+  delete buffer_pool_manager;
+  disk_manager->ShutDown();
+  delete disk_manager;
+  remove("test.db");
+  remove("test.log");
+}
+
+// NOLINTNEXTLINE
+TEST(TupleTest, DISABLED_ReadOnlyDependencyTest) {
+  Schema schema{std::vector<Column>{Column{"a", TypeId::INTEGER}}};
+  auto make_tuple = [&schema](int32_t a) { return Tuple{std::vector<Value>{Value(TypeId::INTEGER, a)}, &schema}; };
+  auto value_of = [&schema](const Tuple &tuple) { return tuple.GetValue(&schema, 0).GetAs<int32_t>(); };
+
+  enable_logging = true;
+  auto *disk_manager = new DiskManager("test.db");
+  auto *buffer_pool_manager = new BufferPoolManager(50, disk_manager);
+  auto *lock_manager = new LockManager();
+  auto *log_manager = new LogManager(disk_manager);
+  // Hold group commits back so that we can observe a commit that is not durable yet.
+  log_manager->SetGroupCommitDelay(std::chrono::milliseconds(200));
+  log_manager->RunFlushThread();
+  auto *txn_manager = new TransactionManager(lock_manager, log_manager);
+
+  Transaction *loader = txn_manager->Begin();
+  auto *table = new TableHeap(buffer_pool_manager, lock_manager, log_manager, loader, 1);
+  RID rid0;
+  RID rid1;
+  ASSERT_TRUE(table->InsertTuple(make_tuple(0), &rid0, loader));
+  ASSERT_TRUE(table->InsertTuple(make_tuple(1), &rid1, loader));
+  txn_manager->Commit(loader);
+
+  // A read-only transaction that waits for the lock of a delete depends on the COMMIT record of the delete.
+  Transaction *deleter = txn_manager->Begin();
+  ASSERT_TRUE(table->MarkDelete(rid0, deleter));
+  Transaction *reader = txn_manager->BeginReadOnly(nullptr, IsolationLevel::REPEATABLE_READ);
+  std::thread reader_thread([&] {
+    EXPECT_TRUE(lock_manager->LockShared(reader, rid0));
+    EXPECT_EQ(deleter->GetPrevLSN(), reader->GetDependencyLSN());
+    EXPECT_LT(log_manager->GetPersistentLSN(), reader->GetDependencyLSN());
+    txn_manager->Commit(reader);
+    EXPECT_GE(log_manager->GetPersistentLSN(), reader->GetDependencyLSN());
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  txn_manager->Commit(deleter);
+  reader_thread.join();
+
+  // A snapshot takes no locks, but waits for the COMMIT records of the changes it sees to be durable.
+  Transaction *writer = txn_manager->Begin();
+  writer->SetAsyncCommit(true);
+  ASSERT_TRUE(table->UpdateTuple(make_tuple(100), rid1, writer));
+  txn_manager->Commit(writer);
+  EXPECT_LT(log_manager->GetPersistentLSN(), writer->GetPrevLSN());
+  Transaction *snapshot = txn_manager->BeginReadOnly();
+  Tuple result;
+  ASSERT_TRUE(table->GetTuple(rid1, &result, snapshot));
+  EXPECT_EQ(100, value_of(result));
+  txn_manager->Commit(snapshot);
+  EXPECT_EQ(writer->GetPrevLSN(), snapshot->GetDependencyLSN());
+  EXPECT_GE(log_manager->GetPersistentLSN(), writer->GetPrevLSN());
+
+  log_manager->StopFlushThread();
+  enable_logging = false;
+  delete loader;
+  delete deleter;
+  delete reader;
+  delete writer;
+  delete snapshot;
+  delete table;
+  delete txn_manager;
+  delete log_manager;
+  delete lock_manager;
+  delete buffer_pool_manager;
+  disk_manager->ShutDown();
+  delete disk_manager;
+  remove("test.db");
+  remove("test.log");
+}
+
+// NOLINTNEXTLINE
+TEST(TupleTest, DISABLED_IncrementTest) {
+  Schema schema{std::vector<Column>{Column{"a", TypeId::INTEGER}, Column{"count", TypeId::BIGINT}}};
+  auto make_tuple = [&schema](int32_t a) {
+    return Tuple{std::vector<Value>{Value(TypeId::INTEGER, a), Value(TypeId::BIGINT, static_cast<int64_t>(0))},
+                 &schema};
+  };
+  auto value_of = [&schema](const Tuple &tuple) { return tuple.GetValue(&schema, 0).GetAs<int32_t>(); };
+  auto count_of = [&schema](const Tuple &tuple) { return tuple.GetValue(&schema, 1).GetAs<int64_t>(); };
+
+  enable_logging = true;
+  auto *disk_manager = new DiskManager("test.db");
+  auto *buffer_pool_manager = new BufferPoolManager(50, disk_manager);
+  auto *lock_manager = new LockManager();
+  auto *log_manager = new LogManager(disk_manager);
+  log_manager->RunFlushThread();
+  auto *txn_manager = new TransactionManager(lock_manager, log_manager);
+
+  Transaction *loader = txn_manager->Begin();
+  auto *table = new TableHeap(buffer_pool_manager, lock_manager, log_manager, loader, 1);
+  RID rid;
+  ASSERT_TRUE(table->InsertTuple(make_tuple(7), &rid, loader));
+  txn_manager->Commit(loader);
+
+  // Transactions that increment the same tuple do not wait for each other.
+  Transaction *snapshot = txn_manager->Begin(nullptr, IsolationLevel::SNAPSHOT_ISOLATION);
+  Transaction *first = txn_manager->Begin();
+  Transaction *second = txn_manager->Begin(nullptr, IsolationLevel::SNAPSHOT_ISOLATION);
+  Transaction *aborted = txn_manager->Begin();
+  ASSERT_TRUE(table->IncrementTuple(rid, schema, 1, Value(TypeId::INTEGER, 1), first));
+  ASSERT_TRUE(table->IncrementTuple(rid, schema, 1, Value(TypeId::INTEGER, 2), second));
+  ASSERT_TRUE(table->IncrementTuple(rid, schema, 1, Value(TypeId::INTEGER, 4), aborted));
+  EXPECT_TRUE(first->IsIncrementLocked(rid));
+  EXPECT_TRUE(second->IsIncrementLocked(rid));
+
+  // Snapshots do not see the increments of others that are not committed, but see their own.
+  Tuple result;
+  ASSERT_TRUE(table->GetTuple(rid, &result, snapshot));
+  EXPECT_EQ(0, count_of(result));
+  ASSERT_TRUE(table->GetTuple(rid, &result, second));
+  EXPECT_EQ(2, count_of(result));
+  txn_manager->Commit(first);
+
+  // Rolling back an increment subtracts it, and keeps the increments of the others.
+  txn_manager->Abort(aborted);
+  Transaction *after_first = txn_manager->Begin(nullptr, IsolationLevel::SNAPSHOT_ISOLATION);
+  ASSERT_TRUE(table->GetTuple(rid, &result, after_first));
+  EXPECT_EQ(1, count_of(result));
+  txn_manager->Commit(second);
+  ASSERT_TRUE(table->GetTuple(rid, &result, after_first));
+  EXPECT_EQ(1, count_of(result));
+
+  const int num_threads = 4;
+  const int num_txns = 50;
+  std::vector<std::thread> threads;
+  for (int i = 0; i < num_threads; i++) {
+    threads.emplace_back([&] {
+      for (int j = 0; j < num_txns; j++) {
+        Transaction *txn = txn_manager->Begin();
+        EXPECT_TRUE(table->IncrementTuple(rid, schema, 1, Value(TypeId::INTEGER, 1), txn));
+        if (j % 5 == 0) {
+          txn_manager->Abort(txn);
+        } else {
+          txn_manager->Commit(txn);
+        }
+        delete txn;
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  // An update waits for the increments, and turns them into versions for the snapshots.
+  Transaction *writer = txn_manager->Begin();
+  ASSERT_TRUE(table->GetTuple(rid, &result, writer));
+  EXPECT_EQ(3 + num_threads * (num_txns - num_txns / 5), count_of(result));
+  ASSERT_TRUE(table->UpdateTuple(make_tuple(8), rid, writer));
+  txn_manager->Commit(writer);
+  ASSERT_TRUE(table->GetTuple(rid, &result, snapshot));
+  EXPECT_EQ(7, value_of(result));
+  EXPECT_EQ(0, count_of(result));
+  ASSERT_TRUE(table->GetTuple(rid, &result, after_first));
+  EXPECT_EQ(7, value_of(result));
+  EXPECT_EQ(1, count_of(result));
+  txn_manager->Commit(snapshot);
+  txn_manager->Commit(after_first);
+
+  log_manager->StopFlushThread();
+  enable_logging = false;
+  delete loader;
+  delete snapshot;
+  delete first;
+  delete second;
+  delete aborted;
+  delete after_first;
+  delete writer;
+  delete table;
+  delete txn_manager;
+  delete log_manager;
+  delete lock_manager;
+  delete buffer_pool_manager;
+  disk_manager->ShutDown();
+  delete disk_manager;
+  remove("test.db");
+  remove("test.log");
+}
+
+// NOLINTNEXTLINE
+TEST(TupleTest, DISABLED_IncrementRangeTest) {
+  Schema schema{std::vector<Column>{Column{"count", TypeId::BIGINT}}};
+  const Tuple tuple{std::vector<Value>{Value(TypeId::BIGINT, static_cast<int64_t>(0))}, &schema};
+  auto count_of = [&schema](const Tuple &tuple) { return tuple.GetValue(&schema, 0).GetAs<int64_t>(); };
+
+  enable_logging = true;
+  auto *disk_manager = new DiskManager("test.db");
+  auto *buffer_pool_manager = new BufferPoolManager(50, disk_manager);
+  auto *lock_manager = new LockManager();
+  auto *log_manager = new LogManager(disk_manager);
+  log_manager->RunFlushThread();
+  auto *txn_manager = new TransactionManager(lock_manager, log_manager);
+
+  Transaction *loader = txn_manager->Begin();
+  auto *table = new TableHeap(buffer_pool_manager, lock_manager, log_manager, loader, 1);
+  RID rid;
+  ASSERT_TRUE(table->InsertTuple(tuple, &rid, loader));
+  txn_manager->Commit(loader);
+
+  // Scenario: the counter fits every increment, but would overflow if the first one were rolled back after the third.
+  Transaction *first = txn_manager->Begin();
+  Transaction *second = txn_manager->Begin();
+  Transaction *third = txn_manager->Begin();
+  ASSERT_TRUE(table->IncrementTuple(rid, schema, 0, Value(TypeId::BIGINT, static_cast<int64_t>(-5)), first));
+  ASSERT_TRUE(table->IncrementTuple(rid, schema, 0, Value(TypeId::BIGINT, BUSTUB_INT64_MAX), second));
+  EXPECT_FALSE(table->IncrementTuple(rid, schema, 0, Value(TypeId::BIGINT, static_cast<int64_t>(5)), third));
+  EXPECT_EQ(TransactionState::GROWING, third->GetState());
+  txn_manager->Abort(first);
+  txn_manager->Commit(second);
+
+  // Scenario: a negative increment is allowed once the range is back to the committed value.
+  ASSERT_TRUE(table->IncrementTuple(rid, schema, 0, Value(TypeId::BIGINT, static_cast<int64_t>(-5)), third));
+  txn_manager->Commit(third);
+  Transaction *reader = txn_manager->Begin();
+  Tuple result;
+  ASSERT_TRUE(table->GetTuple(rid, &result, reader));
+  EXPECT_EQ(BUSTUB_INT64_MAX - 5, count_of(result));
+  txn_manager->Commit(reader);
+
+  log_manager->StopFlushThread();
+  enable_logging = false;
+  delete loader;
+  delete first;
+  delete second;
+  delete third;
+  delete reader;
+  delete table;
+  delete txn_manager;
+  delete log_manager;
+  delete lock_manager;
+  delete buffer_pool_manager;
+  disk_manager->ShutDown();
+  delete disk_manager;
+  remove("test.db");
+  remove("test.log");
+}
+
 }  // namespace bustub
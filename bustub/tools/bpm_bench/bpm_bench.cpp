@@ -0,0 +1,301 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// bpm_bench.cpp
+//
+// Identification: tools/bpm_bench/bpm_bench.cpp
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "buffer/buffer_pool_manager.h"
+#include "storage/disk/disk_manager.h"
+
+/**
+ * Buffer pool microbenchmark.
+ *
+ * A fixed working set of pages is created up front. Worker threads then fetch pages from it until the duration is up,
+ * latching each page in read or write mode and unpinning it right away. The access pattern decides which pages are
+ * fetched:
+ *  - uniform: every page of the working set is equally likely
+ *  - zipf:    page i is fetched with probability proportional to 1 / (i + 1)^theta
+ *  - scan:    each thread reads the working set sequentially from a random start, wrapping around
+ *
+ * Example: bpm_bench --threads=4 --pool-size=64 --pages=1024 --pattern=zipf --write-ratio=0.2 --replacer=clock
+ */
+
+namespace bustub {
+namespace {
+
+struct BenchOptions {
+  size_t threads_{1};
+  size_t pool_size_{BUFFER_POOL_SIZE};
+  size_t pages_{1000};
+  uint64_t duration_ms_{2000};
+  double write_ratio_{0.0};
+  std::string pattern_{"uniform"};
+  std::string replacer_{"lru"};
+  double zipf_theta_{0.99};
+  std::string db_file_{"bpm_bench.db"};
+};
+
+void PrintUsage(const char *program) {
+  fprintf(stderr,
+          "Usage: %s [options]\n"
+          "  --threads=N         number of worker threads (default 1)\n"
+          "  --pool-size=N       number of frames in the buffer pool (default %d)\n"
+          "  --pages=N           number of pages in the working set (default 1000)\n"
+          "  --duration-ms=N     how long the workers run (default 2000)\n"
+          "  --write-ratio=R     fraction of fetches that write latch and dirty the page (default 0)\n"
+          "  --pattern=P         uniform, zipf or scan (default uniform)\n"
+          "  --zipf-theta=T      skew of the zipf pattern, 0 < T < 1 (default 0.99)\n"
+          "  --replacer=R        lru or clock (default lru)\n"
+          "  --db-file=F         database file, removed after the run (default bpm_bench.db)\n",
+          program, BUFFER_POOL_SIZE);
+}
+
+/** Parses --key=value arguments into options. @return false if an argument is not recognized */
+bool ParseOptions(int argc, char **argv, BenchOptions *options) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg(argv[i]);
+    auto eq = arg.find('=');
+    if (arg.compare(0, 2, "--") != 0 || eq == std::string::npos) {
+      return false;
+    }
+    std::string key = arg.substr(2, eq - 2);
+    std::string value = arg.substr(eq + 1);
+    if (key == "threads") {
+      options->threads_ = std::stoul(value);
+    } else if (key == "pool-size") {
+      options->pool_size_ = std::stoul(value);
+    } else if (key == "pages") {
+      options->pages_ = std::stoul(value);
+    } else if (key == "duration-ms") {
+      options->duration_ms_ = std::stoull(value);
+    } else if (key == "write-ratio") {
+      options->write_ratio_ = std::stod(value);
+    } else if (key == "pattern") {
+      options->pattern_ = value;
+    } else if (key == "zipf-theta") {
+      options->zipf_theta_ = std::stod(value);
+    } else if (key == "replacer") {
+      options->replacer_ = value;
+    } else if (key == "db-file") {
+      options->db_file_ = value;
+    } else {
+      return false;
+    }
+  }
+  return options->threads_ > 0 && options->pool_size_ > 0 && options->pages_ > 0 &&
+         (options->pattern_ == "uniform" || options->pattern_ == "zipf" || options->pattern_ == "scan") &&
+         options->zipf_theta_ > 0 && options->zipf_theta_ < 1 &&
+         (options->replacer_ == "lru" || options->replacer_ == "clock");
+}
+
+/**
+ * Zipf distributed integers in [0, n), following Gray et al., "Quickly Generating Billion-Record Synthetic Databases".
+ * The zeta constants are computed once in O(n) and shared by all threads, each sample is then O(1).
+ */
+class ZipfGenerator {
+ public:
+  ZipfGenerator(uint64_t n, double theta) : n_(n), theta_(theta) {
+    double zeta2 = Zeta(2, theta);
+    zetan_ = Zeta(n, theta);
+    alpha_ = 1.0 / (1.0 - theta);
+    eta_ = (1.0 - std::pow(2.0 / static_cast<double>(n), 1.0 - theta)) / (1.0 - zeta2 / zetan_);
+  }
+
+  template <class Rng>
+  uint64_t Next(Rng *rng) const {
+    double u = std::uniform_real_distribution<double>(0.0, 1.0)(*rng);
+    double uz = u * zetan_;
+    if (uz < 1.0) {
+      return 0;
+    }
+    if (uz < 1.0 + std::pow(0.5, theta_)) {
+      return 1;
+    }
+    auto next = static_cast<uint64_t>(static_cast<double>(n_) * std::pow(eta_ * u - eta_ + 1.0, alpha_));
+    return std::min(next, n_ - 1);
+  }
+
+ private:
+  static double Zeta(uint64_t n, double theta) {
+    double sum = 0;
+    for (uint64_t i = 1; i <= n; i++) {
+      sum += 1.0 / std::pow(static_cast<double>(i), theta);
+    }
+    return sum;
+  }
+
+  uint64_t n_;
+  double theta_;
+  double zetan_;
+  double alpha_;
+  double eta_;
+};
+
+/** What one worker thread measured. */
+struct WorkerResult {
+  uint64_t ops_{0};
+  uint64_t failed_fetches_{0};
+  std::vector<uint64_t> fetch_latencies_ns_;
+};
+
+void RunWorker(size_t thread_id, const BenchOptions &options, const std::vector<page_id_t> &page_ids,
+               const ZipfGenerator &zipf, BufferPoolManager *bpm, const std::atomic<bool> &stop,
+               WorkerResult *result) {
+  std::mt19937_64 rng(thread_id * 7919 + 17);
+  std::uniform_int_distribution<uint64_t> uniform(0, page_ids.size() - 1);
+  std::uniform_real_distribution<double> coin(0.0, 1.0);
+  uint64_t scan_pos = uniform(rng);
+  result->fetch_latencies_ns_.reserve(1 << 20);
+
+  while (!stop.load(std::memory_order_relaxed)) {
+    uint64_t index;
+    if (options.pattern_ == "zipf") {
+      index = zipf.Next(&rng);
+    } else if (options.pattern_ == "scan") {
+      index = scan_pos++ % page_ids.size();
+    } else {
+      index = uniform(rng);
+    }
+    bool is_write = options.write_ratio_ > 0 && coin(rng) < options.write_ratio_;
+
+    auto start = std::chrono::steady_clock::now();
+    Page *page = bpm->FetchPage(page_ids[index]);
+    auto end = std::chrono::steady_clock::now();
+    result->ops_++;
+    if (page == nullptr) {
+      // Every frame is pinned by the other workers, which can only happen with more threads than frames.
+      result->failed_fetches_++;
+      continue;
+    }
+    result->fetch_latencies_ns_.push_back(
+        static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count()));
+
+    if (is_write) {
+      page->WLatch();
+      ++*reinterpret_cast<uint64_t *>(page->GetData());
+      page->WUnlatch();
+    } else {
+      page->RLatch();
+      volatile uint64_t value = *reinterpret_cast<uint64_t *>(page->GetData());
+      (void)value;
+      page->RUnlatch();
+    }
+    bpm->UnpinPage(page->GetPageId(), is_write);
+  }
+}
+
+/** @return the q-th quantile of the samples, which are reordered */
+uint64_t Quantile(std::vector<uint64_t> *samples, double q) {
+  if (samples->empty()) {
+    return 0;
+  }
+  auto nth = samples->begin() + static_cast<int64_t>(q * static_cast<double>(samples->size() - 1));
+  std::nth_element(samples->begin(), nth, samples->end());
+  return *nth;
+}
+
+/** Shuts down the buffer pool and removes the files it created. */
+void CleanUp(const BenchOptions &options, BufferPoolManager *bpm, DiskManager *disk_manager) {
+  disk_manager->ShutDown();
+  delete bpm;
+  delete disk_manager;
+  remove(options.db_file_.c_str());
+  remove((options.db_file_.substr(0, options.db_file_.rfind('.')) + ".log").c_str());
+}
+
+int RunBench(const BenchOptions &options) {
+  auto *disk_manager = new DiskManager(options.db_file_);
+  auto replacer_type = options.replacer_ == "clock" ? BufferPoolManager::ReplacerType::CLOCK
+                                                    : BufferPoolManager::ReplacerType::LRU;
+  auto *bpm = new BufferPoolManager(options.pool_size_, disk_manager, nullptr, replacer_type);
+
+  // Create the working set. Pages beyond the pool size are evicted and written out as we go.
+  std::vector<page_id_t> page_ids(options.pages_);
+  for (auto &page_id : page_ids) {
+    Page *page = bpm->NewPage(&page_id);
+    if (page == nullptr) {
+      fprintf(stderr, "could not create the working set\n");
+      CleanUp(options, bpm, disk_manager);
+      return 1;
+    }
+    bpm->UnpinPage(page_id, true);
+  }
+  ZipfGenerator zipf(options.pages_, options.zipf_theta_);
+  int reads_before = disk_manager->GetNumReads();
+  int writes_before = disk_manager->GetNumWrites();
+
+  std::atomic<bool> stop{false};
+  std::vector<WorkerResult> results(options.threads_);
+  std::vector<std::thread> workers;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < options.threads_; i++) {
+    workers.emplace_back(RunWorker, i, std::cref(options), std::cref(page_ids), std::cref(zipf), bpm, std::cref(stop),
+                         &results[i]);
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(options.duration_ms_));
+  stop = true;
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  uint64_t ops = 0;
+  uint64_t failed_fetches = 0;
+  std::vector<uint64_t> latencies;
+  for (auto &result : results) {
+    ops += result.ops_;
+    failed_fetches += result.failed_fetches_;
+    latencies.insert(latencies.end(), result.fetch_latencies_ns_.begin(), result.fetch_latencies_ns_.end());
+  }
+  auto misses = static_cast<uint64_t>(disk_manager->GetNumReads() - reads_before);
+  uint64_t fetches = ops - failed_fetches;
+  double hit_ratio = fetches == 0 ? 0.0 : 1.0 - static_cast<double>(misses) / static_cast<double>(fetches);
+
+  printf("pattern=%s replacer=%s threads=%zu pool_size=%zu pages=%zu write_ratio=%.2f", options.pattern_.c_str(),
+         options.replacer_.c_str(), options.threads_, options.pool_size_, options.pages_, options.write_ratio_);
+  if (options.pattern_ == "zipf") {
+    printf(" zipf_theta=%.2f", options.zipf_theta_);
+  }
+  printf("\n");
+  printf("ops:            %lu\n", static_cast<unsigned long>(ops));  // NOLINT
+  printf("ops/sec:        %.0f\n", static_cast<double>(ops) / seconds);
+  printf("hit ratio:      %.4f\n", hit_ratio);
+  printf("disk reads:     %lu\n", static_cast<unsigned long>(misses));  // NOLINT
+  printf("disk writes:    %d\n", disk_manager->GetNumWrites() - writes_before);
+  printf("failed fetches: %lu\n", static_cast<unsigned long>(failed_fetches));  // NOLINT
+  printf("fetch p50 (us): %.3f\n", static_cast<double>(Quantile(&latencies, 0.50)) / 1000.0);
+  printf("fetch p99 (us): %.3f\n", static_cast<double>(Quantile(&latencies, 0.99)) / 1000.0);
+
+  CleanUp(options, bpm, disk_manager);
+  return 0;
+}
+
+}  // namespace
+}  // namespace bustub
+
+int main(int argc, char **argv) {
+  bustub::BenchOptions options;
+  if (!bustub::ParseOptions(argc, argv, &options)) {
+    bustub::PrintUsage(argv[0]);
+    return 1;
+  }
+  return bustub::RunBench(options);
+}
@@ -0,0 +1,278 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// wal_bench.cpp
+//
+// Identification: tools/wal_bench/wal_bench.cpp
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "common/bustub_instance.h"
+#include "recovery/log_recovery.h"
+#include "storage/table/table_heap.h"
+
+/**
+ * Write-ahead log and recovery benchmark.
+ *
+ * Worker threads run transactions that each insert a few tuples into one table and commit, until every worker ran its
+ * share of the transactions. Commits wait for their COMMIT record to be on disk, so the commit latency includes the
+ * group commit. Checkpoints can be taken in the background while the workers run.
+ *
+ * Then a number of transactions insert tuples and are left running, and the system crashes: the log is on disk, the
+ * dirty pages in the buffer pool are lost. The benchmark restarts the system and times the analysis, redo and undo
+ * passes of recovery separately.
+ *
+ * Example: wal_bench --threads=8 --txns=2000 --record-size=200 --group-commit-delay-us=100 --checkpoint-ms=500
+ */
+
+namespace bustub {
+namespace {
+
+struct BenchOptions {
+  size_t threads_{4};
+  size_t txns_{1000};
+  size_t records_per_txn_{1};
+  size_t record_size_{100};
+  uint64_t group_commit_delay_us_{0};
+  size_t group_commit_batch_size_{16};
+  uint64_t checkpoint_ms_{0};
+  size_t losers_{4};
+  size_t records_per_loser_{100};
+  size_t recovery_workers_{LogRecovery::DEFAULT_NUM_RECOVERY_WORKERS};
+  std::string db_file_{"wal_bench.db"};
+};
+
+void PrintUsage(const char *program) {
+  fprintf(stderr,
+          "Usage: %s [options]\n"
+          "  --threads=N               number of committing threads (default 4)\n"
+          "  --txns=N                  number of transactions per thread (default 1000)\n"
+          "  --records-per-txn=N       number of tuples each transaction inserts (default 1)\n"
+          "  --record-size=N           size of a tuple in bytes, at most 2048 (default 100)\n"
+          "  --group-commit-delay-us=N how long a commit may wait for more commits (default 0)\n"
+          "  --group-commit-batch=N    number of commits flushed without further delay (default 16)\n"
+          "  --checkpoint-ms=N         interval between fuzzy checkpoints, 0 for none (default 0)\n"
+          "  --losers=N                number of transactions running at the crash (default 4)\n"
+          "  --records-per-loser=N     number of tuples each of them inserts (default 100)\n"
+          "  --recovery-workers=N      number of threads of redo and undo (default %zu)\n"
+          "  --db-file=F               database file, removed with its log after the run (default wal_bench.db)\n",
+          program, LogRecovery::DEFAULT_NUM_RECOVERY_WORKERS);
+}
+
+/** Parses --key=value arguments into options. @return false if an argument is not recognized */
+bool ParseOptions(int argc, char **argv, BenchOptions *options) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg(argv[i]);
+    auto eq = arg.find('=');
+    if (arg.compare(0, 2, "--") != 0 || eq == std::string::npos) {
+      return false;
+    }
+    std::string key = arg.substr(2, eq - 2);
+    std::string value = arg.substr(eq + 1);
+    if (key == "threads") {
+      options->threads_ = std::stoul(value);
+    } else if (key == "txns") {
+      options->txns_ = std::stoul(value);
+    } else if (key == "records-per-txn") {
+      options->records_per_txn_ = std::stoul(value);
+    } else if (key == "record-size") {
+      options->record_size_ = std::stoul(value);
+    } else if (key == "group-commit-delay-us") {
+      options->group_commit_delay_us_ = std::stoull(value);
+    } else if (key == "group-commit-batch") {
+      options->group_commit_batch_size_ = std::stoul(value);
+    } else if (key == "checkpoint-ms") {
+      options->checkpoint_ms_ = std::stoull(value);
+    } else if (key == "losers") {
+      options->losers_ = std::stoul(value);
+    } else if (key == "records-per-loser") {
+      options->records_per_loser_ = std::stoul(value);
+    } else if (key == "recovery-workers") {
+      options->recovery_workers_ = std::stoul(value);
+    } else if (key == "db-file") {
+      options->db_file_ = value;
+    } else {
+      return false;
+    }
+  }
+  return options->threads_ > 0 && options->txns_ > 0 && options->record_size_ > 0 &&
+         options->record_size_ <= 2048 && options->group_commit_batch_size_ > 0;
+}
+
+/** Removes the database file, its log segments and its master record, also the ones an earlier run left behind. */
+void RemoveDatabase(const std::string &db_file) {
+  std::string stem = db_file.substr(0, db_file.rfind('.'));
+  // Without its control file the log is new, and opening it removes the segments of the old log.
+  remove((stem + ".log").c_str());
+  DiskManager disk_manager(db_file);
+  disk_manager.ShutDown();
+  remove(db_file.c_str());
+  remove((stem + ".log").c_str());
+  remove((stem + ".master").c_str());
+}
+
+/** @return the q-th quantile of the samples, which are reordered */
+uint64_t Quantile(std::vector<uint64_t> *samples, double q) {
+  if (samples->empty()) {
+    return 0;
+  }
+  auto nth = samples->begin() + static_cast<int64_t>(q * static_cast<double>(samples->size() - 1));
+  std::nth_element(samples->begin(), nth, samples->end());
+  return *nth;
+}
+
+double Millis(std::chrono::microseconds duration) { return static_cast<double>(duration.count()) / 1000.0; }
+
+int RunBench(const BenchOptions &options) {
+  RemoveDatabase(options.db_file_);
+  auto *bustub_instance = new BustubInstance(options.db_file_);
+  auto *txn_manager = bustub_instance->transaction_manager_;
+  auto *log_manager = bustub_instance->log_manager_;
+  log_manager->SetGroupCommitDelay(std::chrono::microseconds(options.group_commit_delay_us_));
+  log_manager->SetGroupCommitBatchSize(options.group_commit_batch_size_);
+  log_manager->RunFlushThread();
+
+  // A tuple of the requested size, its bytes do not matter.
+  std::vector<char> storage(sizeof(uint32_t) + options.record_size_, 'x');
+  auto record_size = static_cast<uint32_t>(options.record_size_);
+  memcpy(storage.data(), &record_size, sizeof(uint32_t));
+  Tuple tuple;
+  tuple.DeserializeFrom(storage.data());
+
+  Transaction *txn = txn_manager->Begin();
+  auto *table = new TableHeap(bustub_instance->buffer_pool_manager_, bustub_instance->lock_manager_, log_manager, txn);
+  txn_manager->Commit(txn);
+  delete txn;
+
+  std::atomic<bool> stop_checkpoints{false};
+  size_t num_checkpoints = 0;
+  std::thread checkpoint_thread;
+  if (options.checkpoint_ms_ > 0) {
+    checkpoint_thread = std::thread([&] {
+      while (!stop_checkpoints) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(options.checkpoint_ms_));
+        bustub_instance->checkpoint_manager_->BeginCheckpoint();
+        bustub_instance->checkpoint_manager_->EndCheckpoint();
+        num_checkpoints++;
+      }
+    });
+  }
+
+  int flushes_before = bustub_instance->disk_manager_->GetNumFlushes();
+  int log_size_before = bustub_instance->disk_manager_->GetLogSize();
+  std::vector<std::vector<uint64_t>> commit_latencies_ns(options.threads_);
+  std::vector<std::thread> workers;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < options.threads_; i++) {
+    workers.emplace_back([&, i] {
+      commit_latencies_ns[i].reserve(options.txns_);
+      for (size_t j = 0; j < options.txns_; j++) {
+        Transaction *worker_txn = txn_manager->Begin();
+        for (size_t k = 0; k < options.records_per_txn_; k++) {
+          RID rid;
+          table->InsertTuple(tuple, &rid, worker_txn);
+        }
+        auto commit_start = std::chrono::steady_clock::now();
+        txn_manager->Commit(worker_txn);
+        auto commit_end = std::chrono::steady_clock::now();
+        commit_latencies_ns[i].push_back(static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(commit_end - commit_start).count()));
+        delete worker_txn;
+      }
+    });
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  stop_checkpoints = true;
+  if (checkpoint_thread.joinable()) {
+    checkpoint_thread.join();
+  }
+  int log_flushes = bustub_instance->disk_manager_->GetNumFlushes() - flushes_before;
+  int log_bytes = bustub_instance->disk_manager_->GetLogSize() - log_size_before;
+
+  std::vector<uint64_t> latencies;
+  for (auto &thread_latencies : commit_latencies_ns) {
+    latencies.insert(latencies.end(), thread_latencies.begin(), thread_latencies.end());
+  }
+  size_t commits = latencies.size();
+
+  // Leave some transactions running, make their records durable, and crash without writing the dirty pages.
+  std::vector<Transaction *> losers;
+  for (size_t i = 0; i < options.losers_; i++) {
+    losers.push_back(txn_manager->Begin());
+    for (size_t k = 0; k < options.records_per_loser_; k++) {
+      RID rid;
+      table->InsertTuple(tuple, &rid, losers.back());
+    }
+  }
+  log_manager->Flush(log_manager->GetNextLSN() - 1);
+  delete table;
+  delete bustub_instance;
+  for (auto *loser : losers) {
+    delete loser;
+  }
+
+  bustub_instance = new BustubInstance(options.db_file_);
+  int log_size = bustub_instance->disk_manager_->GetLogSize() - bustub_instance->disk_manager_->GetLogStart();
+  auto restart_start = std::chrono::steady_clock::now();
+  auto *log_recovery =
+      new LogRecovery(bustub_instance->disk_manager_, bustub_instance->buffer_pool_manager_, options.recovery_workers_);
+  log_recovery->Redo();
+  log_recovery->Undo();
+  bustub_instance->buffer_pool_manager_->FlushAllPages();
+  auto restart_time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() -
+                                                                            restart_start);
+
+  printf("threads=%zu txns=%zu records_per_txn=%zu record_size=%zu group_commit_delay_us=%lu group_commit_batch=%zu",
+         options.threads_, options.txns_, options.records_per_txn_, options.record_size_,
+         static_cast<unsigned long>(options.group_commit_delay_us_), options.group_commit_batch_size_);  // NOLINT
+  printf(" checkpoint_ms=%lu\n", static_cast<unsigned long>(options.checkpoint_ms_));  // NOLINT
+  printf("commits:              %zu\n", commits);
+  printf("commits/sec:          %.0f\n", static_cast<double>(commits) / seconds);
+  printf("records/sec:          %.0f\n", static_cast<double>(commits * options.records_per_txn_) / seconds);
+  printf("log MB/sec:           %.2f\n", static_cast<double>(log_bytes) / seconds / (1 << 20));
+  printf("log writes:           %d\n", log_flushes);
+  printf("commits per write:    %.2f\n", log_flushes == 0 ? 0.0 : static_cast<double>(commits) / log_flushes);
+  printf("checkpoints:          %zu\n", num_checkpoints);
+  printf("commit p50 (us):      %.1f\n", static_cast<double>(Quantile(&latencies, 0.50)) / 1000.0);
+  printf("commit p99 (us):      %.1f\n", static_cast<double>(Quantile(&latencies, 0.99)) / 1000.0);
+  printf("commit p99.9 (us):    %.1f\n", static_cast<double>(Quantile(&latencies, 0.999)) / 1000.0);
+  printf("commit max (us):      %.1f\n", static_cast<double>(Quantile(&latencies, 1.0)) / 1000.0);
+  printf("log to recover (KB):  %d\n", log_size / 1024);
+  printf("analysis (ms):        %.3f\n", Millis(log_recovery->GetAnalysisTime()));
+  printf("redo (ms):            %.3f\n", Millis(log_recovery->GetRedoTime()));
+  printf("undo (ms):            %.3f\n", Millis(log_recovery->GetUndoTime()));
+  printf("restart (ms):         %.3f\n", Millis(restart_time));
+
+  delete log_recovery;
+  delete bustub_instance;
+  RemoveDatabase(options.db_file_);
+  return 0;
+}
+
+}  // namespace
+}  // namespace bustub
+
+int main(int argc, char **argv) {
+  bustub::BenchOptions options;
+  if (!bustub::ParseOptions(argc, argv, &options)) {
+    bustub::PrintUsage(argv[0]);
+    return 1;
+  }
+  return bustub::RunBench(options);
+}